@@ -0,0 +1,60 @@
+/**
+ * \file bench.cpp implementation of the measurement harness, the
+ * allocations are counted by the allocation probe of the tests
+ *
+ * See LICENSE for copyright information.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "alloc_probe.hpp"
+#include "bench.hpp"
+
+uint64_t xmlpp::bench::allocations()
+{
+  return xmlpp::probe::total_allocations();
+}
+
+xmlpp::bench::options& xmlpp::bench::settings()
+{
+  static options o;
+  return o;
+}
+
+void xmlpp::bench::parse_arguments(int argc, char** argv)
+{
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i],"--min-time=",11)==0) {
+      settings().min_time = atof(argv[i] + 11);
+    } else if (strcmp(argv[i],"--help")==0) {
+      printf("usage: %s [--min-time=<seconds>] [filter]\n", argv[0]);
+      exit(0);
+    } else {
+      settings().filter = argv[i];
+    }
+  }
+}
+
+bool xmlpp::bench::selected(const std::string& name)
+{
+  return settings().filter.empty() || name.find(settings().filter)!=std::string::npos;
+}
+
+void xmlpp::bench::print_header()
+{
+  printf("%-56s %10s %10s %12s %12s %10s\n",
+         "case", "iterations", "MB/s", "Mevents/s", "us/doc", "allocs/doc");
+}
+
+void xmlpp::bench::print(const measurement& m)
+{
+  const double per_doc = m.iterations ? m.seconds / static_cast<double>(m.iterations) : 0;
+  const double mb_s = per_doc > 0 ? static_cast<double>(m.bytes) / per_doc / 1e6 : 0;
+  const double events_s = per_doc > 0 ? static_cast<double>(m.events) / per_doc / 1e6 : 0;
+  const double allocs = m.iterations ? static_cast<double>(m.allocations) / static_cast<double>(m.iterations) : 0;
+  printf("%-56s %10llu %10.1f %12.2f %12.1f %10.1f\n",
+         m.name.c_str(), static_cast<unsigned long long>(m.iterations),
+         mb_s, events_s, per_doc*1e6, allocs);
+  fflush(stdout);
+}
@@ -0,0 +1,83 @@
+/**
+ * \file bench.hpp contains the measurement harness of the benchmarks
+ *
+ * a case is run repeatedly until the minimum time is reached, reported are
+ * the throughput in MB/s, the parse events per second and the allocations
+ * (calls of operator new) per document.
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_bench_hpp
+#define xmlpp_bench_hpp
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace xmlpp {
+namespace bench {
+
+/** number of calls of the global operator new since program start */
+uint64_t allocations();
+
+struct measurement {
+  std::string name;
+  size_t bytes{0};        //< bytes per iteration
+  size_t events{0};       //< parse events per iteration
+  uint64_t iterations{0};
+  double seconds{0};
+  uint64_t allocations{0};
+};
+
+struct options {
+  double min_time{0.5};   //< seconds per case
+  std::string filter;     //< run only cases containing this string
+};
+
+options& settings();
+
+/** parses --min-time=<s> and a filter argument */
+void parse_arguments(int argc, char** argv);
+
+/** @return true if the case is selected by the filter */
+bool selected(const std::string& name);
+
+void print_header();
+void print(const measurement& m);
+
+/** runs f until settings().min_time is exceeded and prints the result
+ * @param bytes document size processed per call
+ * @param events parse events per call
+ * @param f case to run, returns a value which is kept to prevent the
+ * optimizer from dropping the work
+ */
+template<typename F>
+measurement run(const std::string& name, size_t bytes, size_t events, F f)
+{
+  typedef std::chrono::steady_clock clock;
+  measurement m;
+  m.name = name;
+  m.bytes = bytes;
+  m.events = events;
+  if (!selected(name)) return m;
+
+  volatile size_t sink = 0;
+  sink = sink + static_cast<size_t>(f()); // warm up
+  const uint64_t allocations_before = allocations();
+  const clock::time_point start = clock::now();
+  double elapsed = 0;
+  do {
+    sink = sink + static_cast<size_t>(f());
+    ++m.iterations;
+    elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  } while (elapsed < settings().min_time);
+  m.seconds = elapsed;
+  m.allocations = allocations() - allocations_before;
+  print(m);
+  return m;
+}
+
+}
+}
+#endif // #ifndef xmlpp_bench_hpp
@@ -0,0 +1,235 @@
+/**
+ * \file bench_decompress.cpp compares parsing of compressed files on the
+ * fly with decompressing them to a temporary file first
+ *
+ * the corpus is one flat document of about --size megabytes (default
+ * 1024), written gzip and xz compressed if the library was built with
+ * zlib and liblzma. The throughput is given in uncompressed bytes.
+ *
+ * usage: bench_decompress [--size=<MB>] [--min-time=<seconds>] [filter]
+ *
+ * See LICENSE for copyright information.
+ */
+#include "expatpp_config.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(HAVE_LZMA)
+#include <lzma.h>
+#endif
+
+#include "bench.hpp"
+#include "corpus.hpp"
+#include "counting_delegate.hpp"
+#include "decompressor.hpp"
+#include "pipeline.hpp"
+#include "xmlparser.hpp"
+
+using std::string;
+using xmlpp::parser;
+using namespace xmlpp::bench;
+
+namespace {
+
+const size_t BLOCK_SIZE = 16*1024*1024;
+const char* PLAIN_FILE = "bench_decompress.xml";
+const char* CASES[] = {"/decompress then parseFile", "/parseFile", "/parse_file_read_ahead"};
+
+/** streaming compressor writing into a file */
+class compressor {
+public:
+  virtual ~compressor() = default;
+  virtual bool write(const char* data, size_t len, bool final) = 0;
+};
+
+#if defined(HAVE_ZLIB)
+class gzip_writer : public compressor {
+public:
+  explicit gzip_writer(FILE* f) : f_(f)
+  {
+    memset(&z_, 0, sizeof(z_));
+    // level 6 as gzip, 16 selects the gzip wrapper
+    ok_ = deflateInit2(&z_, 6, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY)==Z_OK;
+  }
+  ~gzip_writer() override { if (ok_) deflateEnd(&z_); }
+  bool write(const char* data, size_t len, bool final) override
+  {
+    if (!ok_) return false;
+    z_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    z_.avail_in = static_cast<uInt>(len);
+    int r;
+    do {
+      z_.next_out = out_;
+      z_.avail_out = sizeof(out_);
+      r = deflate(&z_, final ? Z_FINISH : Z_NO_FLUSH);
+      const size_t n = sizeof(out_) - z_.avail_out;
+      if (n && fwrite(out_, 1, n, f_)!=n) return false;
+    } while (z_.avail_out==0 || (final && r!=Z_STREAM_END));
+    return true;
+  }
+private:
+  FILE* f_;
+  z_stream z_;
+  bool ok_;
+  Bytef out_[256*1024];
+};
+#endif
+
+#if defined(HAVE_LZMA)
+class xz_writer : public compressor {
+public:
+  explicit xz_writer(FILE* f) : f_(f)
+  {
+    // preset 6 as xz
+    ok_ = lzma_easy_encoder(&s_, 6, LZMA_CHECK_CRC64)==LZMA_OK;
+  }
+  ~xz_writer() override { lzma_end(&s_); }
+  bool write(const char* data, size_t len, bool final) override
+  {
+    if (!ok_) return false;
+    s_.next_in = reinterpret_cast<const uint8_t*>(data);
+    s_.avail_in = len;
+    lzma_ret r;
+    do {
+      s_.next_out = out_;
+      s_.avail_out = sizeof(out_);
+      r = lzma_code(&s_, final ? LZMA_FINISH : LZMA_RUN);
+      const size_t n = sizeof(out_) - s_.avail_out;
+      if (n && fwrite(out_, 1, n, f_)!=n) return false;
+    } while (s_.avail_out==0 || (final && r!=LZMA_STREAM_END));
+    return true;
+  }
+private:
+  FILE* f_;
+  lzma_stream s_ = LZMA_STREAM_INIT;
+  bool ok_;
+  uint8_t out_[256*1024];
+};
+#endif
+
+/** writes the corpus of about size bytes, one flat document whose records
+ * repeat a generated block
+ * @return the uncompressed size, 0 on errors */
+size_t write_corpus(const string& filename, compressor& out, size_t size)
+{
+  const string doc = generate(shape::FLAT, BLOCK_SIZE);
+  const size_t begin = doc.find('>', doc.find("<records")) + 1;
+  const size_t end = doc.rfind("</records>");
+  const string head = doc.substr(0, begin);
+  const string tail = doc.substr(end);
+  const string body = doc.substr(begin, end - begin);
+  size_t written = 0;
+  bool ok = out.write(head.data(), head.size(), false);
+  written += head.size();
+  while (ok && written + body.size() < size) {
+    ok = out.write(body.data(), body.size(), false);
+    written += body.size();
+  }
+  ok = ok && out.write(tail.data(), tail.size(), true);
+  written += tail.size();
+  if (!ok) fprintf(stderr, "can not write %s\n", filename.c_str());
+  return ok ? written : 0;
+}
+
+/** the former way: decompress into a file, then parse it */
+size_t decompress_then_parse(const string& filename)
+{
+  FILE* in = fopen(filename.c_str(), "rb");
+  FILE* out = fopen(PLAIN_FILE, "wb");
+  if (!in || !out) {
+    if (in) fclose(in);
+    if (out) fclose(out);
+    return 0;
+  }
+  xmlpp::decompressor input(in);
+  std::vector<char> buffer(1024*1024);
+  long n;
+  while ((n = input.read(buffer.data(), buffer.size())) > 0) {
+    fwrite(buffer.data(), 1, static_cast<size_t>(n), out);
+  }
+  fclose(in);
+  fclose(out);
+  counting_delegate d;
+  parser::parseFile(PLAIN_FILE, d);
+  remove(PLAIN_FILE);
+  return d.events;
+}
+
+void bench_format(const string& format, const string& filename, size_t bytes)
+{
+  counting_delegate counter;
+  if (parser::parseFile(filename, counter)!=parser::OK) {
+    fprintf(stderr, "can not parse %s\n", filename.c_str());
+    return;
+  }
+  const size_t events = counter.events;
+  run(format + CASES[0], bytes, events, [&filename]()
+    {
+      return decompress_then_parse(filename);
+    });
+  run(format + CASES[1], bytes, events, [&filename]()
+    {
+      counting_delegate d;
+      parser::parseFile(filename, d);
+      return d.events;
+    });
+  run(format + CASES[2], bytes, events, [&filename]()
+    {
+      counting_delegate d;
+      xmlpp::parse_file_read_ahead(filename, d);
+      return d.events;
+    });
+}
+
+template<typename Writer>
+void bench_writer(const string& format, size_t size)
+{
+  // compressing the corpus takes long, only for selected cases
+  bool any = false;
+  for (const char* c : CASES) any = any || selected(format + c);
+  if (!any) return;
+  const string filename = "bench_decompress." + format;
+  FILE* f = fopen(filename.c_str(), "wb");
+  if (!f) return;
+  size_t bytes = 0;
+  {
+    Writer w(f);
+    bytes = write_corpus(filename, w, size);
+  }
+  fclose(f);
+  if (bytes) bench_format(format, filename, bytes);
+  remove(filename.c_str());
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  size_t size = 1024;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    if (strncmp(argv[i], "--size=", 7)==0) {
+      size = static_cast<size_t>(atol(argv[i] + 7));
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  parse_arguments(static_cast<int>(args.size()), args.data());
+  size *= 1024*1024;
+
+  print_header();
+#if defined(HAVE_ZLIB)
+  bench_writer<gzip_writer>("gzip", size);
+#endif
+#if defined(HAVE_LZMA)
+  bench_writer<xz_writer>("xz", size);
+#endif
+  return 0;
+}
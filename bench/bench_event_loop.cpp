@@ -0,0 +1,115 @@
+/**
+ * \file bench_event_loop.cpp measures the event loop with many connections
+ * trickling small messages, as a server receiving XML streams would see it
+ *
+ * each connection is a socket pair carrying one endless document, an
+ * iteration writes one message to every connection and runs the loop until
+ * all messages are parsed. The writes are part of the measured time.
+ *
+ * usage: bench_event_loop [--min-time=<seconds>] [filter]
+ *
+ * See LICENSE for copyright information.
+ */
+#include <cstdio>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.hpp"
+#include "event_loop.hpp"
+
+using std::string;
+using xmlpp::event_loop;
+using namespace xmlpp::bench;
+
+namespace {
+
+const size_t CONNECTIONS = 10000;
+
+/** counts the messages of all connections */
+struct message_delegate : public xmlpp::abstract_delegate {
+  size_t* messages;
+
+  explicit message_delegate(size_t* m) : messages(m) {}
+  void onEndElement(const XML_Char *) override { ++*messages; }
+};
+
+/** @return number of connections the descriptor limit allows */
+size_t max_connections()
+{
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit)!=0) return 0;
+  if (limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+  }
+  // two descriptors per connection and some reserve for the loop
+  const rlim_t available = limit.rlim_cur > 64 ? (limit.rlim_cur - 64) / 2 : 0;
+  return available < CONNECTIONS ? static_cast<size_t>(available) : CONNECTIONS;
+}
+
+void bench_trickle(event_loop::backend b, size_t count)
+{
+  event_loop loop(b);
+  const string name = string("event loop/")
+    + (loop.active_backend()==event_loop::backend::IO_URING ? "io_uring" : "epoll")
+    + "/" + std::to_string(count) + " connections";
+  if (b!=loop.active_backend() || !selected(name)) return;
+
+  size_t messages = 0;
+  message_delegate d(&messages);
+  std::vector<int> writers;
+  std::vector<int> readers;
+  for (size_t i = 0; i < count; ++i) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)!=0) break;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    if (loop.add(fds[0], d)==nullptr) {
+      ::close(fds[0]);
+      ::close(fds[1]);
+      break;
+    }
+    readers.push_back(fds[0]);
+    writers.push_back(fds[1]);
+    if (::write(fds[1], "<stream>", 8)!=8) break;
+  }
+
+  const string message = "<m id='4711' type='update'>a small message</m>\n";
+  size_t expected = 0;
+  run(name, message.size()*writers.size(), 2*writers.size(), [&]() {
+    for (int fd : writers) {
+      if (::write(fd, message.data(), message.size())!=static_cast<ssize_t>(message.size())) {
+        return 0;
+      }
+    }
+    expected += writers.size();
+    while (messages < expected) {
+      if (loop.run_once(1000) <= 0) return 0;
+    }
+    return 1;
+  });
+
+  for (int fd : writers) ::close(fd);
+  loop.run();
+  for (int fd : readers) ::close(fd);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  parse_arguments(argc, argv);
+  const size_t count = max_connections();
+  if (count < CONNECTIONS) {
+    printf("descriptor limit allows %zu connections only\n", count);
+  }
+  print_header();
+  bench_trickle(event_loop::backend::EPOLL, count);
+  bench_trickle(event_loop::backend::IO_URING, count);
+  return 0;
+}
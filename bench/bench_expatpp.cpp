@@ -0,0 +1,813 @@
+/**
+ * \file bench_expatpp.cpp benchmarks of the expatpp parse paths on the
+ * synthetic corpus
+ *
+ * usage: bench_expatpp [--min-time=<seconds>] [filter]
+ *
+ * the allocation profiles of the delegates are printed at the end, run
+ * them alone with the filter "allocation profile".
+ *
+ * See LICENSE for copyright information.
+ */
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "alloc_probe.hpp"
+#include "base64.hpp"
+#include "bench.hpp"
+#include "corpus.hpp"
+#include "counting_delegate.hpp"
+#include "entity_resolver.hpp"
+#include "event_tape.hpp"
+#include "generator.hpp"
+#include "multi_delegate.hpp"
+#include "numarray.hpp"
+#include "qname.hpp"
+#include "state.hpp"
+#include "xmlparser.hpp"
+#ifdef EXPATPP_BENCH_XSDGEN
+#include "catalog.hpp"
+#endif
+
+using std::string;
+using xmlpp::parser;
+using xmlpp::State;
+using namespace xmlpp::bench;
+
+namespace {
+
+const size_t DOCUMENT_SIZE = 1024*1024;
+
+size_t count_events(const string& doc)
+{
+  counting_delegate d;
+  parser::parseString(doc.c_str(),d);
+  return d.events;
+}
+
+/** reads the flat records with the stateful dispatch */
+struct records_delegate : public xmlpp::StatefulDelegate {
+  size_t records{0};
+  size_t text{0};
+
+  State root{"records"};
+  State record{"record", [this](const XML_Char**) { ++records; }};
+  State name{"name", nullptr, nullptr, [this](const char*, int len) { text += len; }};
+  State value{"value", nullptr, nullptr, [this](const char*, int len) { text += len; }};
+  State flag{"flag", nullptr, nullptr, [this](const char*, int len) { text += len; }};
+
+  records_delegate()
+  {
+    record.addState(&name);
+    record.addState(&value);
+    record.addState(&flag);
+    root.addState(&record);
+    add_state(&root);
+  }
+};
+
+/** looks up each column of the attribute heavy rows */
+struct columns_delegate : public xmlpp::abstract_delegate {
+  enum mode { GET_VALUE, GET_ATTR_VALUE, GET_OR };
+  explicit columns_delegate(mode m) : mode_(m) {}
+
+  void onStartElement(const XML_Char *, const XML_Char **atts) override
+  {
+    static const char* COLUMNS[] = {"id", "c1", "c2", "c4", "c5", "c7", "c8", "c10", "c11", "c13", "c14"};
+    xmlpp::Attr a(atts);
+    for (const char* c : COLUMNS) {
+      switch (mode_) {
+        case GET_VALUE: sum += a.getValue(c).size(); break;
+        case GET_ATTR_VALUE: sum += parser::xmlGetAttrValue(atts,c)!=nullptr; break;
+        case GET_OR: sum += static_cast<size_t>(a.get_or(c,0.0)); break;
+      }
+    }
+  }
+  size_t sum{0};
+private:
+  mode mode_;
+};
+
+void bench_parse_string()
+{
+  for (shape s : all_shapes()) {
+    const string doc = generate(s, DOCUMENT_SIZE);
+    run(string("parseString/") + name(s), doc.size(), count_events(doc), [&doc]()
+      {
+        counting_delegate d;
+        parser::parseString(doc.c_str(),d);
+        return d.events;
+      });
+  }
+}
+
+void bench_parse_file()
+{
+  for (shape s : all_shapes()) {
+    const string doc = generate(s, DOCUMENT_SIZE);
+    const string filename = string("bench_") + name(s) + ".xml";
+    FILE* f = fopen(filename.c_str(),"wb");
+    if (!f) continue;
+    fwrite(doc.data(),1,doc.size(),f);
+    fclose(f);
+    run(string("parseFile/") + name(s), doc.size(), count_events(doc), [&filename]()
+      {
+        counting_delegate d;
+        parser::parseFile(filename,d);
+        return d.events;
+      });
+    remove(filename.c_str());
+  }
+}
+
+/** records the documents once and replays them, compare with parseString */
+void bench_tape()
+{
+  for (shape s : all_shapes()) {
+    const string doc = generate(s, DOCUMENT_SIZE);
+    const size_t events = count_events(doc);
+    run(string("tape/record/") + name(s), doc.size(), events, [&doc]()
+      {
+        xmlpp::event_tape tape;
+        xmlpp::tape_recorder rec(tape);
+        parser p(rec);
+        rec.attach(p);
+        p.parse(doc.data(),static_cast<int>(doc.size()),true);
+        return tape.events();
+      });
+    xmlpp::event_tape tape;
+    {
+      xmlpp::tape_recorder rec(tape);
+      parser p(rec);
+      rec.attach(p);
+      p.parse(doc.data(),static_cast<int>(doc.size()),true);
+    }
+    run(string("tape/replay/") + name(s), doc.size(), events, [&tape]()
+      {
+        counting_delegate d;
+        tape.replay(d);
+        return d.events;
+      });
+  }
+}
+
+/** four consumers of the same document, one parse each or one parse for
+ * all with multi_delegate */
+void bench_multi_delegate()
+{
+  const size_t CONSUMERS = 4;
+  const string doc = generate(shape::FLAT, DOCUMENT_SIZE);
+  const size_t events = count_events(doc);
+  run("multi_delegate/4 x parseString", doc.size(), events, [&doc]()
+    {
+      size_t n = 0;
+      for (size_t i = 0; i < CONSUMERS; ++i) {
+        counting_delegate d;
+        parser::parseString(doc.c_str(),d);
+        n += d.events;
+      }
+      return n;
+    });
+  for (bool parallel : {false, true}) {
+    run(string("multi_delegate/") + (parallel ? "parallel" : "sequential"), doc.size(), events,
+      [&doc, parallel]()
+      {
+        counting_delegate d[CONSUMERS];
+        xmlpp::multi_delegate all;
+        all.set_parallel(parallel);
+        for (counting_delegate& c : d) all.add(c, xmlpp::multi_delegate::CONTENT);
+        parser::parseString(doc.c_str(),all);
+        all.finish();
+        size_t n = 0;
+        for (const counting_delegate& c : d) n += c.events;
+        return n;
+      });
+  }
+}
+
+/** splits the names at the last ':' and looks their uri up, as consumers
+ * of the default separator do */
+struct colon_split_delegate : public xmlpp::abstract_delegate {
+  std::unordered_map<xmlpp::string_ref,uint32_t,xmlpp::string_ref_hash> ids;
+  std::vector<std::string> uris;
+  size_t sum{0};
+
+  void name(const XML_Char* n)
+  {
+    const char* colon = strrchr(n, ':');
+    if (!colon) return;
+    const xmlpp::string_ref uri(n, static_cast<size_t>(colon - n));
+    auto it = ids.find(uri);
+    if (it==ids.end()) {
+      uris.emplace_back(n, uri.size);
+      it = ids.emplace(xmlpp::string_ref(uris.back().data(), uri.size),
+                       static_cast<uint32_t>(uris.size())).first;
+    }
+    sum += it->second + strlen(colon + 1);
+  }
+  void onStartElement(const XML_Char *n, const XML_Char **atts) override
+  {
+    name(n);
+    for (; *atts; atts += 2) name(atts[0]);
+  }
+  void onEndElement(const XML_Char *n) override { name(n); }
+};
+
+struct qname_sum_delegate : public xmlpp::qname_delegate {
+  size_t sum{0};
+  void onStartElementNs(const xmlpp::qname& n, const xmlpp::qattribute* atts,
+                        size_t count) override
+  {
+    sum += n.uri + n.local.size;
+    for (size_t i = 0; i < count; ++i) sum += atts[i].name.uri + atts[i].name.local.size;
+  }
+  void onEndElementNs(const xmlpp::qname& n) override { sum += n.uri + n.local.size; }
+};
+
+/** namespace uri and local name of each name, split by the consumer or
+ * from triplets */
+void bench_qnames()
+{
+  // uris as long as those of real schemas
+  string doc = generate(shape::NAMESPACES, DOCUMENT_SIZE);
+  for (size_t pos = 0; (pos = doc.find("urn:", pos))!=string::npos; pos += 40) {
+    doc.replace(pos, 4, "http://www.example.com/schemas/2024/data/");
+  }
+  const size_t events = count_events(doc);
+  run("qnames/split at ':'", doc.size(), events, [&doc]()
+    {
+      colon_split_delegate d;
+      parser::parseString(doc.c_str(),d);
+      return d.sum;
+    });
+  run("qnames/qname_delegate", doc.size(), events, [&doc]()
+    {
+      qname_sum_delegate d;
+      parser p(d, parser::TRIPLET_SEPARATOR);
+      p.set_namespace_triplets(true);
+      p.parse(doc.data(), static_cast<int>(doc.size()), true);
+      return d.sum;
+    });
+}
+
+/** small documents referencing an external DTD, read for each document,
+ * from a resolver shared by the parsers or pre-parsed as compact DTD. The
+ * DTD is written in the style of the large public ones, comments and a
+ * parameter entity for the common attributes. */
+void bench_entities()
+{
+  const char* DTD_FILE = "bench_expatpp.dtd";
+  string dtd = "<!ENTITY % common 'id ID #IMPLIED class CDATA #IMPLIED"
+    " style CDATA #IMPLIED title CDATA #IMPLIED lang NMTOKEN #IMPLIED'>\n";
+  for (int i = 0; i < 200; ++i) {
+    const string n = std::to_string(i);
+    dtd += "<!-- e" + n + ": an element of the document, its content is text -->\n"
+      "<!ELEMENT e" + n + " (#PCDATA)>\n<!ATTLIST e" + n
+      + " %common; kind (a|b|c) 'a'>\n<!ENTITY t" + n + " 'text " + n + "'>\n";
+  }
+  FILE* f = fopen(DTD_FILE, "wb");
+  if (!f) return;
+  fwrite(dtd.data(), 1, dtd.size(), f);
+  fclose(f);
+  const string doc = string("<!DOCTYPE e1 SYSTEM '") + DTD_FILE + "'><e1 id='1'>&t1; &t2;</e1>";
+  const size_t DOCUMENTS = 100;
+  const size_t bytes = DOCUMENTS*doc.size();
+
+  auto parse_all = [&doc, DOCUMENTS](xmlpp::entity_resolver* shared)
+    {
+      size_t events = 0;
+      for (size_t i = 0; i < DOCUMENTS; ++i) {
+        xmlpp::entity_resolver own;
+        own.set_load_files(true);
+        counting_delegate d;
+        parser p(d);
+        p.set_entity_resolver(shared ? shared : &own);
+        p.parse(doc.data(), static_cast<int>(doc.size()), true);
+        events += d.events;
+      }
+      return events;
+    };
+  const size_t events = parse_all(nullptr);
+  run("entities/read DTD per document", bytes, events, [&parse_all]()
+    {
+      return parse_all(nullptr);
+    });
+  xmlpp::entity_resolver resolver;
+  resolver.add_file(DTD_FILE, DTD_FILE);
+  run("entities/shared resolver", bytes, events, [&parse_all, &resolver]()
+    {
+      return parse_all(&resolver);
+    });
+  xmlpp::entity_resolver compact;
+  compact.add_file(DTD_FILE, DTD_FILE);
+  compact.set_compact_dtds(true);
+  run("entities/compact DTD", bytes, events, [&parse_all, &compact]()
+    {
+      return parse_all(&compact);
+    });
+  remove(DTD_FILE);
+}
+
+void bench_stateful()
+{
+  const string doc = generate(shape::FLAT, DOCUMENT_SIZE);
+  run("StatefulDelegate/flat", doc.size(), count_events(doc), [&doc]()
+    {
+      records_delegate d;
+      parser::parseString(doc.c_str(),d);
+      return d.records;
+    });
+}
+
+void bench_attributes()
+{
+  const string doc = generate(shape::ATTRIBUTES, DOCUMENT_SIZE);
+  const size_t events = count_events(doc);
+  const char* NAMES[] = {"Attr::getValue", "xmlGetAttrValue", "Attr::get_or<double>"};
+  for (int m = columns_delegate::GET_VALUE; m <= columns_delegate::GET_OR; ++m) {
+    run(string("attribute lookup/") + NAMES[m], doc.size(), events, [&doc, m]()
+      {
+        columns_delegate d(static_cast<columns_delegate::mode>(m));
+        parser::parseString(doc.c_str(),d);
+        return d.sum;
+      });
+  }
+}
+
+/** sums the numeric attributes of all elements, converted by Attr::get_or
+ * or through std::string and stoll/stod */
+struct sum_delegate : public xmlpp::abstract_delegate {
+  explicit sum_delegate(bool t) : typed(t) {}
+
+  void onStartElement(const XML_Char *, const XML_Char **atts) override
+  {
+    xmlpp::Attr a(atts);
+    static const char* INTS[] = {"id","ts","a","b","c","d"};
+    static const char* DOUBLES[] = {"lat","lon","x","y","z","w"};
+    if (typed) {
+      for (const char* k : INTS) ints += a.get_or<int64_t>(k,0);
+      for (const char* k : DOUBLES) doubles += a.get_or(k,0.0);
+    } else {
+      for (const char* k : INTS) {
+        const string v = a.getValue(k);
+        if (!v.empty()) ints += std::stoll(v);
+      }
+      for (const char* k : DOUBLES) {
+        const string v = a.getValue(k);
+        if (!v.empty()) doubles += std::stod(v);
+      }
+    }
+  }
+  bool typed;
+  int64_t ints{0};
+  double doubles{0};
+};
+
+void bench_typed_attributes()
+{
+  string doc("<feed>");
+  for (size_t i = 0; i < 20000; ++i) {
+    const string n = std::to_string(i);
+    doc += "<p id='" + n + "' ts='1700000000" + n + "' a='-12' b='345' c='7' d='99999'"
+           " lat='48.1372" + n + "' lon='11.5756' x='-0.5' y='1e3' z='3.25' w='100'/>";
+  }
+  doc += "</feed>";
+  const size_t events = count_events(doc);
+  for (bool typed : {true, false}) {
+    run(string("typed attributes/") + (typed ? "Attr::get_or" : "Attr::getValue and stoll/stod"),
+        doc.size(), events, [&doc, typed]()
+      {
+        sum_delegate d(typed);
+        parser::parseString(doc.c_str(),d);
+        return d.ints;
+      });
+  }
+
+  // the conversions alone, 2 per iteration of the loop
+  const XML_Char* atts[] = {"lat","48.137215","id","1700000000123",nullptr};
+  xmlpp::Attr a(atts);
+  const size_t CONVERSIONS = 2000;
+  const size_t bytes = CONVERSIONS/2 * (strlen(atts[1]) + strlen(atts[3]));
+  run("typed attributes/convert only", bytes, CONVERSIONS, [&a]()
+    {
+      double sum = 0;
+      for (size_t i = 0; i < CONVERSIONS/2; ++i) {
+        sum += a.get_or("lat",0.0) + static_cast<double>(a.get_or<int64_t>("id",0));
+      }
+      return sum;
+    });
+  run("typed attributes/std::string and stod/stoll only", bytes, CONVERSIONS, [&a]()
+    {
+      double sum = 0;
+      for (size_t i = 0; i < CONVERSIONS/2; ++i) {
+        sum += std::stod(a.getValue("lat")) + static_cast<double>(std::stoll(a.getValue("id")));
+      }
+      return sum;
+    });
+}
+
+/** reads the numbers of <values> with a number_array_parser */
+struct samples_delegate : public xmlpp::StatefulDelegate {
+  std::vector<double> values;
+  xmlpp::number_array_parser<double> numbers{values};
+
+  State samples{"samples"};
+  State value_state{"values",
+    [this](const XML_Char**) { numbers.reset(); },
+    [this]() { numbers.finish(); },
+    numbers.text_handler()};
+
+  samples_delegate()
+  {
+    samples.addState(&value_state);
+    add_state(&samples);
+  }
+};
+
+/** the same with concatenating the text and std::stod */
+struct stod_delegate : public xmlpp::StatefulDelegate {
+  std::vector<double> values;
+  string text;
+
+  State samples{"samples"};
+  State value_state{"values",
+    [this](const XML_Char**) { text.clear(); },
+    [this]()
+    {
+      std::istringstream is(text);
+      string token;
+      while (is >> token) values.push_back(std::stod(token));
+    },
+    [this](const char* pBuf, int len) { text.append(pBuf,len); }};
+
+  stod_delegate()
+  {
+    samples.addState(&value_state);
+    add_state(&samples);
+  }
+};
+
+void bench_number_array()
+{
+  const size_t COUNT = 200000;
+  string doc("<samples><values>\n");
+  for (size_t i = 0; i < COUNT; ++i) {
+    doc += std::to_string(i % 1000) + "." + std::to_string(i % 97) + ((i % 8)==7 ? "\n" : " ");
+  }
+  doc += "</values></samples>";
+  // one event per number
+  run("number array/number_array_parser", doc.size(), COUNT, [&doc]()
+    {
+      samples_delegate d;
+      parser::parseString(doc.c_str(),d);
+      return d.values.size();
+    });
+  run("number array/concatenation and stod", doc.size(), COUNT, [&doc]()
+    {
+      stod_delegate d;
+      parser::parseString(doc.c_str(),d);
+      return d.values.size();
+    });
+}
+
+/** base64 of data, broken into lines of line_length characters */
+string encode_base64(const string& data, size_t line_length = 0)
+{
+  static const char ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  string out;
+  size_t i = 0;
+  for (; i + 2 < data.size(); i += 3) {
+    const uint32_t b = (uint32_t(uint8_t(data[i])) << 16) | (uint32_t(uint8_t(data[i+1])) << 8) | uint8_t(data[i+2]);
+    out += ALPHABET[b >> 18];
+    out += ALPHABET[(b >> 12) & 63];
+    out += ALPHABET[(b >> 6) & 63];
+    out += ALPHABET[b & 63];
+    if (line_length && (out.size() + 1) % (line_length + 1)==0) out += '\n';
+  }
+  if (i + 1==data.size()) {
+    const uint32_t b = uint32_t(uint8_t(data[i])) << 16;
+    out += ALPHABET[b >> 18];
+    out += ALPHABET[(b >> 12) & 63];
+    out += "==";
+  } else if (i + 2==data.size()) {
+    const uint32_t b = (uint32_t(uint8_t(data[i])) << 16) | (uint32_t(uint8_t(data[i+1])) << 8);
+    out += ALPHABET[b >> 18];
+    out += ALPHABET[(b >> 12) & 63];
+    out += ALPHABET[(b >> 6) & 63];
+    out += '=';
+  }
+  return out;
+}
+
+/** decodes 16MB of base64 without and with line breaks, compare with a
+ * memcpy of the text */
+void bench_base64()
+{
+  string data(16*1024*1024, 0);
+  for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<char>((i*131 + 7) & 0xff);
+  const string text = encode_base64(data);
+  const string lines = encode_base64(data,76);
+  for (const string* s : {&text, &lines}) {
+    run(s==&text ? "base64/decode 16MB" : "base64/decode 16MB with line breaks", s->size(), 0, [s]()
+      {
+        size_t n = 0;
+        xmlpp::base64_decoder d([&n](const unsigned char*, size_t len) { n += len; });
+        d.feed(s->data(),s->size());
+        d.finish();
+        return n;
+      });
+  }
+  string copy(text.size(),0);
+  run("base64/memcpy of the encoded text", text.size(), 0, [&text, &copy]()
+    {
+      memcpy(&copy[0],text.data(),text.size());
+      return copy.size();
+    });
+}
+
+void bench_generator()
+{
+  using namespace xmlpp::generator;
+  // the records of the flat shape
+  const size_t RECORDS = 20000;
+  // a make_shared for each node, as code building the tree for output does
+  auto build = []()
+    {
+      std::shared_ptr<composite_element> root = std::make_shared<composite_element>();
+      root->name = "records";
+      for (size_t n = 0; n < RECORDS; ++n) {
+        auto record = std::make_shared<composite_element>();
+        record->name = "record";
+        record->attributes.push_back(attribute{"id",std::to_string(n)});
+        for (const char* child : {"name", "value", "flag"}) {
+          auto e = std::make_shared<composite_element>();
+          e->name = child;
+          auto t = std::make_shared<text>();
+          t->value = "lorem ipsum";
+          e->children.push_back(t);
+          record->children.push_back(e);
+        }
+        root->children.push_back(record);
+      }
+      return root;
+    };
+  const std::shared_ptr<composite_element> root = build();
+  std::ostringstream sample;
+  static_cast<node&>(*root).serialize(sample);
+  const size_t bytes = sample.str().size();
+  const size_t events = RECORDS * 7;
+
+  run("generator/composite_element serialize", bytes, events, [&root]()
+    {
+      std::ostringstream os;
+      static_cast<node&>(*root).serialize(os);
+      return static_cast<size_t>(os.tellp());
+    });
+
+  run("generator/composite_element build+serialize", bytes, events, [&build]()
+    {
+      const std::shared_ptr<composite_element> tree = build();
+      std::ostringstream os;
+      static_cast<node&>(*tree).serialize(os);
+      return static_cast<size_t>(os.tellp());
+    });
+
+  run("generator/writer", bytes, events, []()
+    {
+      std::ostringstream os;
+      writer w(os);
+      w.raw("<records>",9);
+      for (size_t n = 0; n < RECORDS; ++n) {
+        const string id = std::to_string(n);
+        w.raw("<record id=\"",12);
+        w.attribute_value(id.data(),id.size());
+        w.raw("\">",2);
+        w.raw("<name>",6); w.text("lorem ipsum",11); w.raw("</name>",7);
+        w.raw("<value>",7); w.text("lorem ipsum",11); w.raw("</value>",8);
+        w.raw("<flag>",6); w.text("lorem ipsum",11); w.raw("</flag>",7);
+        w.raw("</record>",9);
+      }
+      w.raw("</records>",10);
+      w.flush();
+      return static_cast<size_t>(os.tellp());
+    });
+}
+
+#ifdef EXPATPP_BENCH_XSDGEN
+/** hand-written parser for the catalog schema of the xsdgen tests */
+struct catalog_delegate : public xmlpp::StatefulDelegate {
+  struct item {
+    string id;
+    string currency;
+    string title;
+    std::vector<string> authors;
+    string price;
+  };
+  string version;
+  std::vector<item> items;
+  string* text{nullptr};
+
+  static string value(const XML_Char** atts, const char* key)
+  {
+    const XML_Char* v = parser::xmlGetAttrValue(atts,key);
+    return v ? v : "";
+  }
+
+  State catalog{"catalog",
+    [this](const XML_Char** atts) { version = value(atts,"version"); }};
+  State item_state{"item",
+    [this](const XML_Char** atts)
+    {
+      items.emplace_back();
+      items.back().id = value(atts,"id");
+      items.back().currency = value(atts,"currency");
+    }};
+  State title{"title",
+    [this](const XML_Char**) { text = &items.back().title; },
+    [this]() { text = nullptr; },
+    [this](const char* pBuf, int len) { text->append(pBuf,len); }};
+  State author{"author",
+    [this](const XML_Char**) { items.back().authors.emplace_back(); text = &items.back().authors.back(); },
+    [this]() { text = nullptr; },
+    [this](const char* pBuf, int len) { text->append(pBuf,len); }};
+  State price{"price",
+    [this](const XML_Char**) { text = &items.back().price; },
+    [this]() { text = nullptr; },
+    [this](const char* pBuf, int len) { text->append(pBuf,len); }};
+
+  catalog_delegate()
+  {
+    item_state.addState(&title);
+    item_state.addState(&author);
+    item_state.addState(&price);
+    catalog.addState(&item_state);
+    add_state(&catalog);
+  }
+};
+
+string make_catalog(size_t items)
+{
+  string doc("<catalog version='1'>");
+  for (size_t i = 0; i < items; ++i) {
+    doc += "<item id='i" + std::to_string(i) + "' currency='USD'>"
+           "<title>Title number " + std::to_string(i) + "</title>"
+           "<author>First Author</author><author>Second Author</author>"
+           "<price>" + std::to_string(i % 100) + ".99</price></item>";
+  }
+  return doc + "</catalog>";
+}
+
+/** the parser generated by xsdgen against the hand-written delegate */
+void bench_xsdgen()
+{
+  const string doc = make_catalog(10000);
+  const size_t events = count_events(doc);
+  run("xsdgen/generated document_parser", doc.size(), events, [&doc]()
+    {
+      catalog::document d;
+      catalog::parse(doc.c_str(),d);
+      return d.catalog.item.size();
+    });
+  run("xsdgen/hand-written StatefulDelegate", doc.size(), events, [&doc]()
+    {
+      catalog_delegate d;
+      parser::parseString(doc.c_str(),d);
+      return d.items.size();
+    });
+}
+
+/** the generated serializer against building a composite_element tree
+ * of the parsed document */
+void bench_round_trip()
+{
+  using namespace xmlpp::generator;
+  const string doc = make_catalog(10000);
+  const size_t events = count_events(doc);
+  run("xsdgen/parse and generated serialize", doc.size(), events, [&doc]()
+    {
+      catalog::document d;
+      catalog::parse(doc.c_str(),d);
+      std::ostringstream os;
+      writer w(os);
+      catalog::serialize(w,d);
+      w.flush();
+      return static_cast<size_t>(os.tellp());
+    });
+  run("xsdgen/parse and composite_element tree", doc.size(), events, [&doc]()
+    {
+      catalog::document d;
+      catalog::parse(doc.c_str(),d);
+      std::shared_ptr<composite_element> root = std::make_shared<composite_element>();
+      root->name = "catalog";
+      root->attributes.push_back(attribute{"version",d.catalog.version.str()});
+      for (const auto& i : d.catalog.item) {
+        auto item = std::make_shared<composite_element>();
+        item->name = "item";
+        item->attributes.push_back(attribute{"id",i.id.str()});
+        item->attributes.push_back(attribute{"currency",catalog::to_string(i.currency)});
+        auto add = [&item](const char* name, xmlpp::string_ref value)
+          {
+            auto e = std::make_shared<composite_element>();
+            e->name = name;
+            auto t = std::make_shared<text>();
+            t->value = value.str();
+            e->children.push_back(t);
+            item->children.push_back(e);
+          };
+        add("title",i.title);
+        for (const auto& a : i.author) add("author",a);
+        add("price",i.price);
+        root->children.push_back(item);
+      }
+      std::ostringstream os;
+      static_cast<node&>(*root).serialize(os);
+      return static_cast<size_t>(os.tellp());
+    });
+}
+
+/** the perfect hash of the generated from_string against comparing with
+ * each enumerator */
+void bench_enumerations()
+{
+  static const char* LANGUAGES[] = {"de", "en-GB", "fr-CH", "zh", "pt", "xx", "en-US", "sv"};
+  std::vector<string> input;
+  size_t bytes = 0;
+  for (size_t i = 0; i < 4096; ++i) {
+    input.push_back(LANGUAGES[(i*7) % 8]);
+    bytes += input.back().size();
+  }
+  run("xsdgen/enumeration from_string", bytes, input.size(), [&input]()
+    {
+      size_t found = 0;
+      catalog::language_t l;
+      for (const string& s : input) {
+        found += catalog::from_string(xmlpp::string_ref(s.data(),s.size()),l);
+      }
+      return found;
+    });
+  run("xsdgen/enumeration strcmp over to_string", bytes, input.size(), [&input]()
+    {
+      size_t found = 0;
+      for (const string& s : input) {
+        for (int e = 0; e <= static_cast<int>(catalog::language_t::zh); ++e) {
+          if (s==catalog::to_string(static_cast<catalog::language_t>(e))) {
+            ++found;
+            break;
+          }
+        }
+      }
+      return found;
+    });
+}
+#endif
+
+/** prints where the delegates allocate, selected by "allocation profile" */
+void profile_allocations()
+{
+  const string flat = generate(shape::FLAT, DOCUMENT_SIZE);
+  const string attributes = generate(shape::ATTRIBUTES, DOCUMENT_SIZE);
+  if (selected("allocation profile/StatefulDelegate")) {
+    records_delegate d;
+    printf("\nallocation profile/StatefulDelegate, ");
+    xmlpp::probe::profile_parse(flat,d).print(stdout);
+  }
+  const char* NAMES[] = {"Attr::getValue", "xmlGetAttrValue", "Attr::get_or<double>"};
+  for (int m = columns_delegate::GET_VALUE; m <= columns_delegate::GET_OR; ++m) {
+    if (!selected(string("allocation profile/") + NAMES[m])) continue;
+    columns_delegate d(static_cast<columns_delegate::mode>(m));
+    printf("\nallocation profile/%s, ", NAMES[m]);
+    xmlpp::probe::profile_parse(attributes,d).print(stdout);
+  }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  parse_arguments(argc, argv);
+  print_header();
+  bench_parse_string();
+  bench_parse_file();
+  bench_tape();
+  bench_multi_delegate();
+  bench_qnames();
+  bench_entities();
+  bench_stateful();
+  bench_attributes();
+  bench_typed_attributes();
+  bench_number_array();
+  bench_base64();
+  bench_generator();
+#ifdef EXPATPP_BENCH_XSDGEN
+  bench_xsdgen();
+  bench_enumerations();
+  bench_round_trip();
+#endif
+  profile_allocations();
+  return 0;
+}
@@ -0,0 +1,241 @@
+/**
+ * \file bench_overhead.cpp measures the cost of the expatpp layers on top of
+ * libexpat by running identical documents through
+ * - raw XML_Parse with C handlers for elements and text only
+ * - raw XML_Parse with all handlers expatpp installs
+ * - C trampolines calling virtual functions, elements and text only
+ * - C trampolines calling std::function objects
+ * - xmlpp::parser with an empty abstract_delegate and a counting delegate
+ * - StatefulDelegate without and with std::function callbacks
+ *
+ * after the measurements the cost of each layer on top of the raw expat
+ * baseline (first row) is printed in ns per event.
+ *
+ * usage: bench_overhead [--min-time=<seconds>] [filter]
+ *
+ * See LICENSE for copyright information.
+ */
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "corpus.hpp"
+#include "counting_delegate.hpp"
+#include "state.hpp"
+#include "xmlparser.hpp"
+
+using std::string;
+using xmlpp::parser;
+using xmlpp::State;
+using namespace xmlpp::bench;
+
+namespace {
+
+const size_t DOCUMENT_SIZE = 1024*1024;
+
+//@{ handlers of the raw expat layers
+void XMLCALL count_start(void* ctx, const XML_Char*, const XML_Char**) { ++*static_cast<size_t*>(ctx); }
+void XMLCALL count_end(void* ctx, const XML_Char*) { ++*static_cast<size_t*>(ctx); }
+void XMLCALL count_text(void* ctx, const XML_Char*, int) { ++*static_cast<size_t*>(ctx); }
+void XMLCALL count_comment(void* ctx, const XML_Char*) { ++*static_cast<size_t*>(ctx); }
+void XMLCALL count_cdata(void* ctx) { ++*static_cast<size_t*>(ctx); }
+void XMLCALL count_pi(void* ctx, const XML_Char*, const XML_Char*) { ++*static_cast<size_t*>(ctx); }
+void XMLCALL count_start_ns(void* ctx, const XML_Char*, const XML_Char*) { ++*static_cast<size_t*>(ctx); }
+void XMLCALL count_end_ns(void* ctx, const XML_Char*) { ++*static_cast<size_t*>(ctx); }
+void XMLCALL ignore_xml_decl(void*, const XML_Char*, const XML_Char*, int) {}
+void XMLCALL ignore_entity_decl(void*, const XML_Char*, int, const XML_Char*, int,
+                                const XML_Char*, const XML_Char*, const XML_Char*,
+                                const XML_Char*) {}
+void XMLCALL ignore_unparsed_entity_decl(void*, const XML_Char*, const XML_Char*,
+                                         const XML_Char*, const XML_Char*,
+                                         const XML_Char*) {}
+void XMLCALL ignore_notation_decl(void*, const XML_Char*, const XML_Char*,
+                                  const XML_Char*, const XML_Char*) {}
+void XMLCALL ignore_attlist_decl(void*, const XML_Char*, const XML_Char*,
+                                 const XML_Char*, const XML_Char*, int) {}
+void XMLCALL ignore_start_doctype(void*, const XML_Char*, const XML_Char*,
+                                  const XML_Char*, int) {}
+void XMLCALL ignore_end_doctype(void*) {}
+void XMLCALL ignore_element_decl(void*, const XML_Char*, XML_Content*) {}
+void XMLCALL ignore_skipped_entity(void*, const XML_Char*, int) {}
+
+void XMLCALL virtual_start(void* ctx, const XML_Char* name, const XML_Char** atts)
+{ static_cast<xmlpp::delegate*>(ctx)->onStartElement(name,atts); }
+void XMLCALL virtual_end(void* ctx, const XML_Char* name)
+{ static_cast<xmlpp::delegate*>(ctx)->onEndElement(name); }
+void XMLCALL virtual_text(void* ctx, const XML_Char* s, int len)
+{ static_cast<xmlpp::delegate*>(ctx)->onCharacterData(s,len); }
+
+struct function_handlers {
+  std::function<void (const XML_Char*, const XML_Char**)> start;
+  std::function<void (const XML_Char*)> end;
+  std::function<void (const XML_Char*, int)> text;
+};
+void XMLCALL function_start(void* ctx, const XML_Char* name, const XML_Char** atts)
+{ static_cast<function_handlers*>(ctx)->start(name,atts); }
+void XMLCALL function_end(void* ctx, const XML_Char* name)
+{ static_cast<function_handlers*>(ctx)->end(name); }
+void XMLCALL function_text(void* ctx, const XML_Char* s, int len)
+{ static_cast<function_handlers*>(ctx)->text(s,len); }
+//@}
+
+void parse_raw(const string& doc, XML_Parser p)
+{
+  XML_Parse(p, doc.data(), static_cast<int>(doc.size()), 1);
+  XML_ParserFree(p);
+}
+
+size_t raw_elements(const string& doc)
+{
+  size_t events = 0;
+  XML_Parser p = XML_ParserCreateNS("UTF-8",':');
+  XML_SetUserData(p,&events);
+  XML_SetElementHandler(p,count_start,count_end);
+  XML_SetCharacterDataHandler(p,count_text);
+  parse_raw(doc,p);
+  return events;
+}
+
+size_t raw_all_handlers(const string& doc)
+{
+  size_t events = 0;
+  XML_Parser p = XML_ParserCreateNS("UTF-8",':');
+  XML_SetUserData(p,&events);
+  XML_SetElementHandler(p,count_start,count_end);
+  XML_SetCharacterDataHandler(p,count_text);
+  XML_SetCommentHandler(p,count_comment);
+  XML_SetXmlDeclHandler(p,ignore_xml_decl);
+  XML_SetEntityDeclHandler(p,ignore_entity_decl);
+  XML_SetCdataSectionHandler(p,count_cdata,count_cdata);
+  XML_SetNamespaceDeclHandler(p,count_start_ns,count_end_ns);
+  XML_SetProcessingInstructionHandler(p,count_pi);
+  XML_SetUnparsedEntityDeclHandler(p,ignore_unparsed_entity_decl);
+  XML_SetNotationDeclHandler(p,ignore_notation_decl);
+  XML_SetAttlistDeclHandler(p,ignore_attlist_decl);
+  XML_SetDoctypeDeclHandler(p,ignore_start_doctype,ignore_end_doctype);
+  XML_SetElementDeclHandler(p,ignore_element_decl);
+  XML_SetSkippedEntityHandler(p,ignore_skipped_entity);
+  parse_raw(doc,p);
+  return events;
+}
+
+size_t raw_virtual(const string& doc)
+{
+  counting_delegate d;
+  XML_Parser p = XML_ParserCreateNS("UTF-8",':');
+  XML_SetUserData(p,static_cast<xmlpp::delegate*>(&d));
+  XML_SetElementHandler(p,virtual_start,virtual_end);
+  XML_SetCharacterDataHandler(p,virtual_text);
+  parse_raw(doc,p);
+  return d.events;
+}
+
+size_t raw_function(const string& doc)
+{
+  size_t events = 0;
+  function_handlers h;
+  h.start = [&events](const XML_Char*, const XML_Char**) { ++events; };
+  h.end = [&events](const XML_Char*) { ++events; };
+  h.text = [&events](const XML_Char*, int) { ++events; };
+  XML_Parser p = XML_ParserCreateNS("UTF-8",':');
+  XML_SetUserData(p,&h);
+  XML_SetElementHandler(p,function_start,function_end);
+  XML_SetCharacterDataHandler(p,function_text);
+  parse_raw(doc,p);
+  return events;
+}
+
+struct empty_delegate : public xmlpp::abstract_delegate {};
+
+/** state tree of the flat records, optionally with callbacks */
+struct records_delegate : public xmlpp::StatefulDelegate {
+  size_t events{0};
+  State root{"records"};
+  State record{"record"};
+  State name{"name"};
+  State value{"value"};
+  State flag{"flag"};
+
+  explicit records_delegate(bool callbacks)
+  {
+    if (callbacks) {
+      for (State* s : {&root, &record, &name, &value, &flag}) {
+        s->pfStart = [this](const XML_Char**) { ++events; };
+        s->pfEnd = [this]() { ++events; };
+        s->pfText = [this](const char*, int) { ++events; };
+      }
+    }
+    record.addState(&name);
+    record.addState(&value);
+    record.addState(&flag);
+    root.addState(&record);
+    add_state(&root);
+  }
+};
+
+struct layer {
+  const char* name;
+  std::function<size_t (const string&)> parse;
+  bool flat_only;
+};
+
+}
+
+int main(int argc, char** argv)
+{
+  parse_arguments(argc, argv);
+
+  const std::vector<layer> layers = {
+    {"raw expat, element+text handlers", raw_elements, false},
+    {"raw expat, all handlers", raw_all_handlers, false},
+    {"trampoline+virtual, element+text", raw_virtual, false},
+    {"trampoline+std::function, element+text", raw_function, false},
+    {"xmlpp::parser, empty abstract_delegate",
+     [](const string& doc) { empty_delegate d; parser::parseString(doc.c_str(),d); return size_t(0); },
+     false},
+    {"xmlpp::parser, counting_delegate",
+     [](const string& doc) { counting_delegate d; parser::parseString(doc.c_str(),d); return d.events; },
+     false},
+    {"StatefulDelegate, no callbacks",
+     [](const string& doc) { records_delegate d(false); parser::parseString(doc.c_str(),d); return d.events; },
+     true},
+    {"StatefulDelegate, std::function callbacks",
+     [](const string& doc) { records_delegate d(true); parser::parseString(doc.c_str(),d); return d.events; },
+     true},
+  };
+
+  const shape SHAPES[] = {shape::FLAT, shape::ATTRIBUTES, shape::TEXT};
+  std::vector<std::vector<measurement>> results;
+  for (shape s : SHAPES) {
+    const string doc = generate(s, DOCUMENT_SIZE);
+    counting_delegate d;
+    parser::parseString(doc.c_str(),d);
+
+    printf("\n%s document, %zu bytes, %zu events\n", name(s), doc.size(), d.events);
+    print_header();
+    results.emplace_back();
+    for (const auto& l : layers) {
+      if (l.flat_only && s!=shape::FLAT) continue;
+      const std::function<size_t (const string&)>& f = l.parse;
+      measurement m = run(string(name(s)) + "/" + l.name, doc.size(), d.events,
+                          [&f, &doc]() { return f(doc); });
+      if (m.iterations) results.back().push_back(m);
+    }
+  }
+
+  printf("\noverhead compared to raw expat with element and text handlers [ns/event]\n");
+  auto ns_per_event = [](const measurement& m)
+    {
+      return m.seconds / static_cast<double>(m.iterations)
+             / static_cast<double>(m.events) * 1e9;
+    };
+  for (const auto& r : results) {
+    for (size_t i = 1; i < r.size(); ++i) {
+      printf("%-56s %+8.2f\n", r[i].name.c_str(), ns_per_event(r[i]) - ns_per_event(r[0]));
+    }
+  }
+  return 0;
+}
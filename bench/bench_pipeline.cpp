@@ -0,0 +1,124 @@
+/**
+ * \file bench_pipeline.cpp compares parseFile with the three stage
+ * parse_file_pipelined on a large file, without delegate work and with
+ * delegate work calibrated to the parse cost per event
+ *
+ * with equal parse and delegate cost the pipeline can approach twice the
+ * throughput of parseFile on a machine with three or more cores, on one
+ * core it only adds the cost of the encoding and the hand over.
+ *
+ * usage: bench_pipeline [--min-time=<seconds>] [filter]
+ *
+ * See LICENSE for copyright information.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "bench.hpp"
+#include "corpus.hpp"
+#include "counting_delegate.hpp"
+#include "pipeline.hpp"
+#include "xmlparser.hpp"
+
+using std::string;
+using xmlpp::parser;
+using namespace xmlpp::bench;
+
+namespace {
+
+const size_t DOCUMENT_SIZE = 32*1024*1024;
+const char* FILE_NAME = "bench_pipeline.xml";
+
+/** burns about iterations * 1ns */
+uint64_t work(unsigned iterations)
+{
+  uint64_t h = 1469598103934665603ull;
+  for (unsigned i = 0; i < iterations; ++i) h = (h ^ i) * 1099511628211ull;
+  return h;
+}
+
+/** counts the events and works on each of them */
+struct working_delegate : public counting_delegate {
+  unsigned iterations{0};
+  uint64_t sink{0};
+
+  void onStartElement(const XML_Char *n, const XML_Char **a) override
+  { counting_delegate::onStartElement(n,a); sink += work(iterations); }
+  void onEndElement(const XML_Char *n) override
+  { counting_delegate::onEndElement(n); sink += work(iterations); }
+  void onCharacterData(const char *s, int len) override
+  { counting_delegate::onCharacterData(s,len); sink += work(iterations); }
+};
+
+double seconds_of(const std::function<void()>& f)
+{
+  typedef std::chrono::steady_clock clock;
+  const clock::time_point start = clock::now();
+  f();
+  return std::chrono::duration<double>(clock::now() - start).count();
+}
+
+/** @return iterations of work() taking the parse time per event */
+unsigned calibrate(size_t events, double parse_seconds)
+{
+  const unsigned PROBE = 1u << 24;
+  volatile uint64_t sink = 0;
+  const double probe_seconds = seconds_of([&]() { sink = sink + work(PROBE); });
+  const double per_iteration = probe_seconds / PROBE;
+  return static_cast<unsigned>(parse_seconds / static_cast<double>(events) / per_iteration);
+}
+
+double per_iteration(const measurement& m)
+{
+  return m.iterations ? m.seconds / static_cast<double>(m.iterations) : 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  parse_arguments(argc, argv);
+  const string doc = generate(shape::FLAT, DOCUMENT_SIZE);
+  FILE* f = fopen(FILE_NAME, "wb");
+  if (!f || fwrite(doc.data(), 1, doc.size(), f)!=doc.size()) {
+    fprintf(stderr, "can not write %s\n", FILE_NAME);
+    return 1;
+  }
+  fclose(f);
+
+  counting_delegate counter;
+  const double parse_seconds = seconds_of([&]() { parser::parseFile(FILE_NAME, counter); });
+  const size_t events = counter.events;
+  working_delegate probe;
+  probe.iterations = calibrate(events, parse_seconds);
+  printf("%zu events, %.1f ns parse time per event, %u work iterations per event, "
+         "%u hardware threads\n", events, parse_seconds * 1e9 / static_cast<double>(events),
+         probe.iterations, std::thread::hardware_concurrency());
+
+  print_header();
+  for (bool with_work : {false, true}) {
+    const string suffix = with_work ? " + delegate work" : "";
+    const unsigned iterations = with_work ? probe.iterations : 0;
+    const measurement serial = run("pipeline/parseFile" + suffix, doc.size(), events, [&]() {
+        working_delegate d;
+        d.iterations = iterations;
+        parser::parseFile(FILE_NAME, d);
+        return d.events + static_cast<size_t>(d.sink & 1);
+      });
+    const measurement pipelined = run("pipeline/parse_file_pipelined" + suffix, doc.size(), events, [&]() {
+        working_delegate d;
+        d.iterations = iterations;
+        xmlpp::parse_file_pipelined(FILE_NAME, d);
+        return d.events + static_cast<size_t>(d.sink & 1);
+      });
+    if (per_iteration(serial) > 0 && per_iteration(pipelined) > 0) {
+      printf("%-56s %10.2fx\n", ("pipeline/speedup" + suffix).c_str(),
+             per_iteration(serial) / per_iteration(pipelined));
+    }
+  }
+  remove(FILE_NAME);
+  return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * \file bench_reparse.cpp compares feeding large tokens in small chunks
+ * with and without the reparse deferral of expat
+ *
+ * two documents are fed with parser::parse() in chunks of 256 bytes to
+ * 64 KB: one text node of --size megabytes (default 100) and one attribute
+ * value of --token kilobytes (default 1024). expat delivers text in pieces
+ * as it arrives but has to scan an incomplete attribute again with every
+ * chunk, without deferral the cost of small chunks grows with the square
+ * of the token size.
+ *
+ * usage: bench_reparse [--size=<MB>] [--token=<KB>] [--min-time=<seconds>] [filter]
+ *
+ * See LICENSE for copyright information.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "counting_delegate.hpp"
+#include "xmlparser.hpp"
+
+using std::string;
+using xmlpp::parser;
+using namespace xmlpp::bench;
+
+namespace {
+
+const int CHUNKS[] = {256, 4096, 64*1024};
+
+/** feeds the document in chunks of the given size
+ * @return the events */
+size_t feed(const string& doc, int chunk, bool deferral)
+{
+  counting_delegate d;
+  parser p(d);
+  p.set_reparse_deferral(deferral);
+  const char* data = doc.data();
+  const int size = static_cast<int>(doc.size());
+  for (int offset = 0; offset < size; offset += chunk) {
+    const int len = std::min(chunk, size - offset);
+    if (p.parse(data + offset, len, offset + len==size)!=parser::status_t::OK) {
+      fprintf(stderr, "parse error %d\n", static_cast<int>(p.errorcode()));
+      return 0;
+    }
+  }
+  return d.events;
+}
+
+void bench_document(const string& name, const string& doc)
+{
+  for (int chunk : CHUNKS) {
+    for (bool deferral : {true, false}) {
+      if (!deferral && !parser::reparse_deferral_available()) continue;
+      const string label = name + "/" + std::to_string(chunk) + "/deferral "
+        + (deferral ? "on" : "off");
+      if (!selected(label)) continue;
+      const size_t events = feed(doc, chunk, deferral);
+      run(label, doc.size(), events, [&doc, chunk, deferral]()
+        {
+          return feed(doc, chunk, deferral);
+        });
+    }
+  }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  size_t size = 100;
+  size_t token = 1024;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    if (strncmp(argv[i], "--size=", 7)==0) {
+      size = static_cast<size_t>(atol(argv[i] + 7));
+    } else if (strncmp(argv[i], "--token=", 8)==0) {
+      token = static_cast<size_t>(atol(argv[i] + 8));
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  parse_arguments(static_cast<int>(args.size()), args.data());
+
+  if (!parser::reparse_deferral_available()) {
+    printf("expat has no reparse deferral, running the default only\n");
+  }
+  print_header();
+  bench_document("text", "<a>" + string(size*1024*1024, 't') + "</a>");
+  bench_document("attribute", "<a x='" + string(token*1024, 'v') + "'/>");
+  return 0;
+}
@@ -0,0 +1,162 @@
+/**
+ * \file corpus.cpp implementation of the synthetic benchmark documents
+ *
+ * See LICENSE for copyright information.
+ */
+#include "corpus.hpp"
+
+using std::string;
+using xmlpp::bench::shape;
+
+namespace {
+
+/** xorshift32 generator, deterministic across platforms unlike std::rand */
+class xorshift {
+public:
+  explicit xorshift(uint32_t seed) : state_(seed ? seed : 1) {}
+  uint32_t next()
+  {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+  uint32_t below(uint32_t n) { return next() % n; }
+private:
+  uint32_t state_;
+};
+
+const char* WORDS[] = {
+  "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+  "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+  "et", "dolore", "magna", "aliqua", "enim", "minim", "veniam", "quis"
+};
+const uint32_t WORD_COUNT = sizeof(WORDS)/sizeof(WORDS[0]);
+
+void words(string& out, xorshift& r, size_t count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    if (i) out += ' ';
+    out += WORDS[r.below(WORD_COUNT)];
+  }
+}
+
+void flat(string& out, xorshift& r, size_t target)
+{
+  out += "<records>\n";
+  for (uint32_t n = 0; out.size() < target; ++n) {
+    out += "  <record id=\"" + std::to_string(n) + "\">";
+    out += "<name>";
+    words(out, r, 2);
+    out += "</name><value>" + std::to_string(r.below(100000)) + "</value>";
+    out += "<flag>" + string(r.below(2) ? "true" : "false") + "</flag>";
+    out += "</record>\n";
+  }
+  out += "</records>\n";
+}
+
+void deep(string& out, xorshift& r, size_t target)
+{
+  out += "<tree>";
+  while (out.size() < target) {
+    const uint32_t depth = 16 + r.below(48);
+    for (uint32_t d = 0; d < depth; ++d) {
+      out += "<node level=\"" + std::to_string(d) + "\">";
+    }
+    words(out, r, 1);
+    for (uint32_t d = 0; d < depth; ++d) out += "</node>";
+    out += '\n';
+  }
+  out += "</tree>\n";
+}
+
+void attributes(string& out, xorshift& r, size_t target)
+{
+  out += "<table>\n";
+  for (uint32_t n = 0; out.size() < target; ++n) {
+    out += "  <row id=\"" + std::to_string(n) + "\"";
+    for (int a = 0; a < 15; ++a) {
+      out += " c" + std::to_string(a) + "=\"";
+      if (a % 3==0) {
+        words(out, r, 1);
+      } else {
+        out += std::to_string(r.below(1000000));
+        if (a % 3==2) out += "." + std::to_string(r.below(1000));
+      }
+      out += '"';
+    }
+    out += "/>\n";
+  }
+  out += "</table>\n";
+}
+
+void text(string& out, xorshift& r, size_t target)
+{
+  out += "<article>\n";
+  while (out.size() < target) {
+    out += "<p>";
+    words(out, r, 40 + r.below(80));
+    out += " &amp; ";
+    words(out, r, 20);
+    if (r.below(4)==0) {
+      out += "<![CDATA[ a < b && c > d ]]>";
+    }
+    out += "</p>\n";
+  }
+  out += "</article>\n";
+}
+
+void namespaces(string& out, xorshift& r, size_t target)
+{
+  static const char* PREFIXES[] = {"a", "b", "c", "d", "e"};
+  out += "<a:doc";
+  for (const char* p : PREFIXES) {
+    out += string(" xmlns:") + p + "=\"urn:example:" + p + "\"";
+  }
+  out += ">\n";
+  for (uint32_t n = 0; out.size() < target; ++n) {
+    const char* p = PREFIXES[r.below(5)];
+    const char* q = PREFIXES[r.below(5)];
+    out += string("  <") + p + ":item " + q + ":ref=\"" + std::to_string(n) + "\"";
+    // some elements redeclare a namespace
+    if (n % 10==0) out += string(" xmlns:") + q + "=\"urn:example:local\"";
+    out += string("><") + q + ":name>";
+    words(out, r, 2);
+    out += string("</") + q + ":name></" + p + ":item>\n";
+  }
+  out += "</a:doc>\n";
+}
+
+}
+
+const char* xmlpp::bench::name(shape s)
+{
+  switch (s) {
+    case shape::FLAT: return "flat";
+    case shape::DEEP: return "deep";
+    case shape::ATTRIBUTES: return "attributes";
+    case shape::TEXT: return "text";
+    case shape::NAMESPACES: return "namespaces";
+  }
+  return "";
+}
+
+std::vector<shape> xmlpp::bench::all_shapes()
+{
+  return {shape::FLAT, shape::DEEP, shape::ATTRIBUTES, shape::TEXT, shape::NAMESPACES};
+}
+
+string xmlpp::bench::generate(shape s, size_t target_size, uint32_t seed)
+{
+  xorshift r(seed);
+  string out("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  out.reserve(target_size + 1024);
+  switch (s) {
+    case shape::FLAT: flat(out, r, target_size); break;
+    case shape::DEEP: deep(out, r, target_size); break;
+    case shape::ATTRIBUTES: attributes(out, r, target_size); break;
+    case shape::TEXT: text(out, r, target_size); break;
+    case shape::NAMESPACES: namespaces(out, r, target_size); break;
+  }
+  return out;
+}
@@ -0,0 +1,37 @@
+/**
+ * \file corpus.hpp contains the generator of the synthetic benchmark
+ * documents
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_corpus_hpp
+#define xmlpp_corpus_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xmlpp {
+namespace bench {
+
+/** shapes of the generated documents */
+enum class shape {
+  FLAT,       //< many small records with a few child elements
+  DEEP,       //< deeply nested elements
+  ATTRIBUTES, //< empty elements with many attributes
+  TEXT,       //< paragraphs of text with entity references and CDATA
+  NAMESPACES  //< prefixed elements and attributes of several namespaces
+};
+
+const char* name(shape s);
+std::vector<shape> all_shapes();
+
+/** generates a document of about the target size.
+ * the documents are deterministic: the same arguments give the same
+ * document on all platforms */
+std::string generate(shape s, size_t target_size, uint32_t seed = 1);
+
+}
+}
+#endif // #ifndef xmlpp_corpus_hpp
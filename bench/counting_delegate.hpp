@@ -0,0 +1,33 @@
+/**
+ * \file counting_delegate.hpp contains a delegate counting the parse events
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_counting_delegate_hpp
+#define xmlpp_counting_delegate_hpp
+
+#include <cstddef>
+
+#include "delegate.hpp"
+
+namespace xmlpp {
+namespace bench {
+
+/** counts the events of the content, the minimal work of a delegate */
+struct counting_delegate : public abstract_delegate {
+  size_t events{0};
+
+  void onStartElement(const XML_Char *, const XML_Char **) override { ++events; }
+  void onEndElement(const XML_Char *) override { ++events; }
+  void onCharacterData(const char *, int) override { ++events; }
+  void onComment(const XML_Char *) override { ++events; }
+  void onStartCdataSection() override { ++events; }
+  void onEndCdataSection() override { ++events; }
+  void onProcessingInstruction(const XML_Char *, const XML_Char *) override { ++events; }
+  void onStartNamespace(const XML_Char *, const XML_Char *) override { ++events; }
+  void onEndNamespace(const XML_Char *) override { ++events; }
+};
+
+}
+}
+#endif // #ifndef xmlpp_counting_delegate_hpp
@@ -57,6 +57,27 @@
 /* Define to 1 if you have the <unistd.h> header file. */
 #cmakedefine HAVE_UNISTD_H
 
+/* Define to 1 if you have the <linux/io_uring.h> header file. */
+#cmakedefine HAVE_LINUX_IO_URING_H
+
+/* Define to 1 if zlib is available for gzip input. */
+#cmakedefine HAVE_ZLIB
+
+/* Define to 1 if liblzma is available for xz input. */
+#cmakedefine HAVE_LZMA
+
+/* Define to 1 if libzstd is available for zstd input. */
+#cmakedefine HAVE_ZSTD
+
+/* Define to 1 if expat has XML_SetReparseDeferralEnabled (2.6 or backport). */
+#cmakedefine HAVE_XML_SETREPARSEDEFERRALENABLED
+
+/* Define to 1 if you have `strtod_l' and `newlocale' (POSIX 2008). */
+#cmakedefine HAVE_STRTOD_L
+
+/* Define to add the USDT tracepoints of trace.hpp */
+#cmakedefine EXPATPP_WITH_USDT
+
 /* Name of package */
 #define PACKAGE "@PACKAGE_NAME@"
 
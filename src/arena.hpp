@@ -0,0 +1,146 @@
+/**
+ * \file arena.hpp contains a string reference type and an arena for
+ * storing parsed strings
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_arena_hpp
+#define xmlpp_arena_hpp
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace xmlpp {
+
+/** non owning reference to a string of known length */
+struct string_ref {
+  string_ref() = default;
+  string_ref(const char* _data, size_t _size) : data(_data), size(_size) {}
+
+  const char* data{nullptr};
+  size_t size{0};
+
+  bool empty() const { return size==0; }
+  std::string str() const { return std::string(data ? data : "",size); }
+  bool operator==(const char* s) const
+  { return strlen(s)==size && (size==0 || memcmp(data,s,size)==0); }
+  bool operator==(const string_ref& o) const
+  { return o.size==size && (size==0 || memcmp(data,o.data,size)==0); }
+  bool operator!=(const char* s) const { return !(*this==s); }
+  bool operator!=(const string_ref& o) const { return !(*this==o); }
+};
+
+/** hash of string_ref for tables of interned strings */
+struct string_ref_hash {
+  size_t operator()(const string_ref& s) const
+  {
+    // FNV-1a, the strings are short or hashed once
+    size_t h = static_cast<size_t>(1469598103934665603ull);
+    for (size_t i = 0; i < s.size; ++i) {
+      h = (h ^ static_cast<unsigned char>(s.data[i])) * static_cast<size_t>(1099511628211ull);
+    }
+    return h;
+  }
+};
+
+/** bump allocator for strings.
+ *
+ * strings are copied into large blocks, the stored strings stay valid until
+ * the arena is cleared or destroyed.
+ */
+class arena {
+public:
+  explicit arena(size_t block_size = 64*1024) : block_size_(block_size) {}
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+  arena(arena&& o) noexcept
+  : block_size_(o.block_size_), blocks_(std::move(o.blocks_)),
+    pos_(o.pos_), end_(o.end_), capacity_(o.capacity_)
+  {
+    o.blocks_.clear();
+    o.pos_ = o.end_ = nullptr;
+    o.capacity_ = 0;
+  }
+  arena& operator=(arena&& o) noexcept
+  {
+    if (this!=&o) {
+      block_size_ = o.block_size_;
+      blocks_ = std::move(o.blocks_);
+      pos_ = o.pos_;
+      end_ = o.end_;
+      capacity_ = o.capacity_;
+      o.blocks_.clear();
+      o.pos_ = o.end_ = nullptr;
+      o.capacity_ = 0;
+    }
+    return *this;
+  }
+
+  /** copies the string into the arena */
+  string_ref store(const char* s, size_t len)
+  {
+    char* p = allocate(len);
+    if (len) memcpy(p,s,len);
+    return string_ref(p,len);
+  }
+
+  /** appends to a string stored in this arena.
+   * the string is extended in place if it was the last one stored,
+   * otherwise both parts are copied into a new string. A copied string
+   * gets room to grow to twice its size, appending fragments to the last
+   * string is linear. Strings appended to while others are stored keep
+   * their old copies until the arena is cleared, collect such strings
+   * outside the arena. */
+  string_ref append(string_ref s, const char* more, size_t len)
+  {
+    if (s.data && s.data + s.size==pos_ && len <= size_t(end_ - pos_)) {
+      if (len) memcpy(pos_,more,len);
+      pos_ += len;
+      return string_ref(s.data,s.size+len);
+    }
+    const size_t n = s.size + len;
+    if (2*n > size_t(end_ - pos_)) new_block(2*n);
+    char* p = allocate(n);
+    if (s.size) memcpy(p,s.data,s.size);
+    if (len) memcpy(p+s.size,more,len);
+    return string_ref(p,s.size+len);
+  }
+
+  /** bytes reserved by the arena */
+  size_t capacity() const { return capacity_; }
+
+  void clear()
+  {
+    blocks_.clear();
+    pos_ = end_ = nullptr;
+    capacity_ = 0;
+  }
+private:
+  void new_block(size_t len)
+  {
+    size_t n = len > block_size_ ? len : block_size_;
+    blocks_.emplace_back(new char[n]);
+    pos_ = blocks_.back().get();
+    end_ = pos_ + n;
+    capacity_ += n;
+  }
+
+  char* allocate(size_t len)
+  {
+    if (len > size_t(end_ - pos_)) new_block(len);
+    char* p = pos_;
+    pos_ += len;
+    return p;
+  }
+
+  size_t block_size_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* pos_{nullptr};
+  char* end_{nullptr};
+  size_t capacity_{0};
+};
+
+}
+#endif // #ifndef xmlpp_arena_hpp
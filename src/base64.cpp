@@ -0,0 +1,283 @@
+/**
+ * \file base64.cpp implementation of the streaming base64 decoder
+ *
+ * See LICENSE for copyright information.
+ */
+#include "base64.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+// SSSE3 and AVX2 kernels compiled with target attributes, selected at
+// runtime, the library itself keeps its baseline
+#define XMLPP_BASE64_SIMD
+#include <immintrin.h>
+#endif
+
+using xmlpp::base64_decoder;
+
+const size_t base64_decoder::DEFAULT_BLOCK_SIZE;
+
+namespace {
+
+const unsigned char WS = 0x40;      //< skipped
+const unsigned char PAD = 0x41;     //< '='
+const unsigned char INVALID = 0x80;
+
+struct decode_table {
+  unsigned char value[256];
+
+  decode_table()
+  {
+    static const char ALPHABET[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (auto& v : value) v = INVALID;
+    for (unsigned i = 0; i < 64; ++i) {
+      value[static_cast<unsigned char>(ALPHABET[i])] = static_cast<unsigned char>(i);
+    }
+    value[static_cast<unsigned char>(' ')] = WS;
+    value[static_cast<unsigned char>('\t')] = WS;
+    value[static_cast<unsigned char>('\n')] = WS;
+    value[static_cast<unsigned char>('\r')] = WS;
+    value[static_cast<unsigned char>('=')] = PAD;
+  }
+};
+
+const decode_table TABLE;
+
+#if defined(XMLPP_BASE64_SIMD)
+/** decodes blocks of characters without whitespace and padding into
+ * out, the block with another character up to the quantum containing it.
+ * @return number of decoded characters, a multiple of 4, out gets 3/4 of
+ * them */
+typedef size_t (*decode_blocks)(const unsigned char* in, size_t len,
+                                unsigned char* out, size_t room);
+
+/* the characters are mapped to sextets by adding an offset per high
+ * nibble ('/' separately), invalid characters are found by the and of two
+ * bit sets looked up by the low and the high nibble (W. Mula, D. Lemire:
+ * Faster Base64 Encoding and Decoding using AVX2 Instructions) */
+
+__attribute__((target("ssse3")))
+size_t decode_ssse3(const unsigned char* in, size_t len, unsigned char* out, size_t room)
+{
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                       0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                       0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                         0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2f);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  size_t done = 0;
+  // 16 characters give 12 bytes, the store writes 16
+  while (len - done >= 16 && room >= 16) {
+    const __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+    const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+    const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+    const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    const int invalid = _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi),
+                                                         _mm_setzero_si128()));
+    const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+    const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    const __m128i sextets = _mm_add_epi8(str, roll);
+    // 4 sextets to 3 bytes per 32 bit word, then the bytes in order
+    const __m128i pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+    const __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(words, pack));
+    // the quanta before an invalid character are decoded anyway, e.g. the
+    // ends of the lines
+    if (invalid) return done + static_cast<size_t>(__builtin_ctz(invalid))/4*4;
+    done += 16;
+    out += 12;
+    room -= 12;
+  }
+  return done;
+}
+
+__attribute__((target("avx2")))
+size_t decode_avx2(const unsigned char* in, size_t len, unsigned char* out, size_t room)
+{
+  const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                          0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                          0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                          0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                          0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                            0, 0, 0, 0, 0, 0, 0, 0,
+                                            0, 16, 19, 4, -65, -65, -71, -71,
+                                            0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+  const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+  size_t done = 0;
+  // 32 characters give 24 bytes, the store writes 32
+  while (len - done >= 32 && room >= 32) {
+    const __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + done));
+    const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+    const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+    const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    const unsigned invalid = static_cast<unsigned>(
+      _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())));
+    const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+    const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    const __m256i sextets = _mm256_add_epi8(str, roll);
+    const __m256i pairs = _mm256_maddubs_epi16(sextets, _mm256_set1_epi32(0x01400140));
+    const __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+    // 12 bytes per lane, joined by moving the words of the upper lane down
+    const __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(words, pack), lanes);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), bytes);
+    if (invalid) return done + static_cast<size_t>(__builtin_ctz(invalid))/4*4;
+    done += 32;
+    out += 24;
+    room -= 24;
+  }
+  return done;
+}
+
+decode_blocks select_decoder()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return decode_avx2;
+  if (__builtin_cpu_supports("ssse3")) return decode_ssse3;
+  return nullptr;
+}
+
+const decode_blocks DECODE_BLOCKS = select_decoder();
+#endif
+
+}
+
+base64_decoder::base64_decoder(binary_content handler, size_t block_size)
+: handler_(handler),
+  block_(block_size < 3 ? 3 : block_size)
+{}
+
+void base64_decoder::reset()
+{
+  pos_ = 0;
+  bits_ = 0;
+  count_ = 0;
+  padding_ = 0;
+  done_ = false;
+  failed_ = false;
+  decoded_ = 0;
+}
+
+void base64_decoder::flush()
+{
+  if (pos_ && handler_) handler_(block_.data(), pos_);
+  pos_ = 0;
+}
+
+/** appends the upper bytes of the 24 bits of a quantum */
+void base64_decoder::put(uint32_t bits, size_t bytes)
+{
+  if (block_.size() - pos_ < 3) flush();
+  unsigned char* out = block_.data() + pos_;
+  out[0] = static_cast<unsigned char>(bits >> 16);
+  if (bytes > 1) out[1] = static_cast<unsigned char>(bits >> 8);
+  if (bytes > 2) out[2] = static_cast<unsigned char>(bits);
+  pos_ += bytes;
+  decoded_ += bytes;
+}
+
+bool base64_decoder::decode_char(unsigned char c)
+{
+  const unsigned char v = TABLE.value[c];
+  if (v==WS) return true;
+  if (v==PAD) {
+    // "xx==" or "xxx=" end the content
+    if (count_ < 2 || done_) return false;
+    if (count_ + ++padding_==4) {
+      put(bits_ << (6*padding_), 3 - padding_);
+      count_ = 0;
+      done_ = true;
+    }
+    return true;
+  }
+  if (v==INVALID || padding_ || done_) return false;
+  bits_ = (bits_ << 6) | v;
+  if (++count_==4) {
+    put(bits_,3);
+    bits_ = 0;
+    count_ = 0;
+  }
+  return true;
+}
+
+bool base64_decoder::feed(const char* data, size_t len)
+{
+  if (failed_) return false;
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  const unsigned char* const end = p + len;
+  const unsigned char* const value = TABLE.value;
+  while (p < end) {
+    // fast path: complete quanta without whitespace, decoded directly into
+    // the block, blocks of them with SIMD if the CPU has it
+    if (count_==0 && !done_) {
+      unsigned char* out = block_.data() + pos_;
+      unsigned char* const out_end = block_.data() + block_.size() - 3;
+      const unsigned char* const start = p;
+#if defined(XMLPP_BASE64_SIMD)
+      if (DECODE_BLOCKS) {
+        const size_t n = DECODE_BLOCKS(p, static_cast<size_t>(end - p), out,
+                                       block_.size() - pos_);
+        p += n;
+        out += n/4*3;
+      }
+#endif
+      while (end - p >= 4 && out <= out_end) {
+        const unsigned a = value[p[0]];
+        const unsigned b = value[p[1]];
+        const unsigned c = value[p[2]];
+        const unsigned d = value[p[3]];
+        if ((a | b | c | d) >= 0x40) break;
+        const uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+        out[0] = static_cast<unsigned char>(bits >> 16);
+        out[1] = static_cast<unsigned char>(bits >> 8);
+        out[2] = static_cast<unsigned char>(bits);
+        out += 3;
+        p += 4;
+      }
+      const size_t written = static_cast<size_t>(out - (block_.data() + pos_));
+      pos_ += written;
+      decoded_ += written;
+      if (p==end) break;
+      if (p!=start && out > out_end) {
+        flush();
+        continue;
+      }
+    }
+    if (!decode_char(*p++)) {
+      failed_ = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool base64_decoder::finish()
+{
+  if (!failed_) {
+    if (count_==1 || (padding_ && !done_)) {
+      failed_ = true;
+    } else if (count_ > 1) {
+      // missing padding
+      put(bits_ << (6*(4-count_)), count_ - 1);
+      count_ = 0;
+      bits_ = 0;
+    }
+  }
+  flush();
+  return !failed_;
+}
+
+std::function<void (const char *pBuf, int len)> base64_decoder::text_handler()
+{
+  return [this](const char *pBuf, int len) { feed(pBuf,static_cast<size_t>(len)); };
+}
@@ -0,0 +1,83 @@
+/**
+ * \file base64.hpp contains a streaming base64 decoder for binary element
+ * content
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_base64_hpp
+#define xmlpp_base64_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace xmlpp {
+
+/** decodes base64 character data incrementally.
+ *
+ * the fragments of the text node are decoded as they arrive, a quantum
+ * split by a fragment boundary is kept in the decoder. The decoded bytes
+ * are collected in a block of fixed size which is handed to the
+ * binary_content callback when it is full and on finish(), so memory stays
+ * bounded by the block size regardless of the size of the content.
+ *
+ * runs of base64 characters are decoded with SSSE3 or AVX2 if the CPU
+ * has them (x86 with GCC or clang), other input per quantum.
+ *
+ * whitespace is skipped, padding is accepted only at the end, missing
+ * padding is tolerated. After an invalid character the decoder ignores
+ * further input until reset().
+ *
+ * usage with a State:
+ * \code
+ * base64_decoder d([&](const unsigned char* p, size_t len) { out.write(p,len); });
+ * State s{"attachment",
+ *         [&](const XML_Char**) { d.reset(); },
+ *         [&]() { d.finish(); },
+ *         d.text_handler()};
+ * \endcode
+ */
+class base64_decoder {
+public:
+  /** receives the decoded bytes, the data is valid during the call */
+  typedef std::function<void (const unsigned char* data, size_t len)> binary_content;
+
+  static const size_t DEFAULT_BLOCK_SIZE = 16*1024;
+
+  explicit base64_decoder(binary_content handler,
+                          size_t block_size = DEFAULT_BLOCK_SIZE);
+
+  /** decodes a fragment @return false if invalid input was found */
+  bool feed(const char* data, size_t len);
+  /** decodes the last quantum and passes the remaining decoded bytes to
+   * the handler @return false if the content was no valid base64 */
+  bool finish();
+  /** prepares for the next content */
+  void reset();
+
+  bool failed() const { return failed_; }
+  /** number of bytes decoded since reset() */
+  uint64_t decoded_size() const { return decoded_; }
+
+  /** @return callback feeding the fragments, usable as State::pfText */
+  std::function<void (const char *pBuf, int len)> text_handler();
+private:
+  void put(uint32_t bits, size_t bytes);
+  void flush();
+  bool decode_char(unsigned char c);
+
+  binary_content handler_;
+  std::vector<unsigned char> block_;
+  size_t pos_{0};
+  /** sextets of the incomplete quantum */
+  uint32_t bits_{0};
+  size_t count_{0};
+  size_t padding_{0};
+  bool done_{false};
+  bool failed_{false};
+  uint64_t decoded_{0};
+};
+
+}
+#endif // #ifndef xmlpp_base64_hpp
@@ -0,0 +1,345 @@
+/**
+ * \file decompressor.cpp implementation of the streaming decompression
+ *
+ * See LICENSE for copyright information.
+ */
+#include "expatpp_config.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "decompressor.hpp"
+
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(HAVE_LZMA)
+#include <lzma.h>
+#endif
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+using xmlpp::compression;
+using xmlpp::decompressor;
+
+/** decompression state of one format */
+class decompressor::codec {
+public:
+  enum status { MORE, STREAM_END, FAILED, NO_MEMORY };
+
+  virtual ~codec() = default;
+  /** decompresses from [in,in_end) into [out,out_end) and advances in and
+   * out
+   * @param finish no input follows the given one */
+  virtual status run(const unsigned char*& in, const unsigned char* in_end,
+                     unsigned char*& out, unsigned char* out_end, bool finish) = 0;
+  /** prepares for the next concatenated stream
+   * @return false on errors */
+  virtual bool restart() = 0;
+};
+
+namespace {
+
+const size_t MAGIC_SIZE = 6;
+
+#if defined(HAVE_ZLIB)
+class gzip_codec : public decompressor::codec {
+public:
+  gzip_codec()
+  {
+    memset(&z_, 0, sizeof(z_));
+    // 16 selects the gzip wrapper
+    ok_ = inflateInit2(&z_, 16 + MAX_WBITS)==Z_OK;
+  }
+  ~gzip_codec() override { if (ok_) inflateEnd(&z_); }
+  bool ok() const { return ok_; }
+
+  status run(const unsigned char*& in, const unsigned char* in_end,
+             unsigned char*& out, unsigned char* out_end, bool) override
+  {
+    z_.next_in = const_cast<Bytef*>(in);
+    z_.avail_in = static_cast<uInt>(std::min<size_t>(static_cast<size_t>(in_end - in), UINT_MAX));
+    z_.next_out = out;
+    z_.avail_out = static_cast<uInt>(std::min<size_t>(static_cast<size_t>(out_end - out), UINT_MAX));
+    const int r = inflate(&z_, Z_NO_FLUSH);
+    in = z_.next_in;
+    out = z_.next_out;
+    switch (r) {
+    case Z_OK:
+    case Z_BUF_ERROR:
+      return MORE;
+    case Z_STREAM_END:
+      return STREAM_END;
+    case Z_MEM_ERROR:
+      return NO_MEMORY;
+    default:
+      return FAILED;
+    }
+  }
+  bool restart() override { return inflateReset(&z_)==Z_OK; }
+private:
+  z_stream z_;
+  bool ok_;
+};
+#endif
+
+#if defined(HAVE_LZMA)
+class xz_codec : public decompressor::codec {
+public:
+  xz_codec()
+  {
+    // concatenated streams are decoded as one, the end is reported after
+    // LZMA_FINISH only
+    ok_ = lzma_stream_decoder(&s_, UINT64_MAX, LZMA_CONCATENATED)==LZMA_OK;
+  }
+  ~xz_codec() override { lzma_end(&s_); }
+  bool ok() const { return ok_; }
+
+  status run(const unsigned char*& in, const unsigned char* in_end,
+             unsigned char*& out, unsigned char* out_end, bool finish) override
+  {
+    s_.next_in = in;
+    s_.avail_in = static_cast<size_t>(in_end - in);
+    s_.next_out = out;
+    s_.avail_out = static_cast<size_t>(out_end - out);
+    const lzma_ret r = lzma_code(&s_, finish ? LZMA_FINISH : LZMA_RUN);
+    in = s_.next_in;
+    out = s_.next_out;
+    switch (r) {
+    case LZMA_OK:
+    case LZMA_BUF_ERROR:
+      return MORE;
+    case LZMA_STREAM_END:
+      return STREAM_END;
+    case LZMA_MEM_ERROR:
+      return NO_MEMORY;
+    default:
+      return FAILED;
+    }
+  }
+  bool restart() override { return true; }
+private:
+  lzma_stream s_ = LZMA_STREAM_INIT;
+  bool ok_;
+};
+#endif
+
+#if defined(HAVE_ZSTD)
+class zstd_codec : public decompressor::codec {
+public:
+  zstd_codec() : d_(ZSTD_createDStream())
+  {
+    if (d_ && ZSTD_isError(ZSTD_initDStream(d_))) {
+      ZSTD_freeDStream(d_);
+      d_ = nullptr;
+    }
+  }
+  ~zstd_codec() override { if (d_) ZSTD_freeDStream(d_); }
+  bool ok() const { return d_!=nullptr; }
+
+  status run(const unsigned char*& in, const unsigned char* in_end,
+             unsigned char*& out, unsigned char* out_end, bool) override
+  {
+    ZSTD_inBuffer src = { in, static_cast<size_t>(in_end - in), 0 };
+    ZSTD_outBuffer dst = { out, static_cast<size_t>(out_end - out), 0 };
+    const size_t r = ZSTD_decompressStream(d_, &dst, &src);
+    in += src.pos;
+    out += dst.pos;
+    if (ZSTD_isError(r)) return FAILED;
+    // 0 when a frame is decoded and flushed completely
+    return r==0 ? STREAM_END : MORE;
+  }
+  // the stream continues with the next frame
+  bool restart() override { return true; }
+private:
+  ZSTD_DStream* d_;
+};
+#endif
+
+/** @return the codec or nullptr if the format is not built in, an
+ * initialization failure is reported as NO_MEMORY */
+std::unique_ptr<decompressor::codec> make_codec(compression format, decompressor::error_t& error)
+{
+  error = decompressor::error_t::UNSUPPORTED;
+  switch (format) {
+#if defined(HAVE_ZLIB)
+  case compression::GZIP: {
+    std::unique_ptr<gzip_codec> c(new gzip_codec);
+    error = c->ok() ? decompressor::error_t::NONE : decompressor::error_t::NO_MEMORY;
+    return std::unique_ptr<decompressor::codec>(c.release());
+  }
+#endif
+#if defined(HAVE_LZMA)
+  case compression::XZ: {
+    std::unique_ptr<xz_codec> c(new xz_codec);
+    error = c->ok() ? decompressor::error_t::NONE : decompressor::error_t::NO_MEMORY;
+    return std::unique_ptr<decompressor::codec>(c.release());
+  }
+#endif
+#if defined(HAVE_ZSTD)
+  case compression::ZSTD: {
+    std::unique_ptr<zstd_codec> c(new zstd_codec);
+    error = c->ok() ? decompressor::error_t::NONE : decompressor::error_t::NO_MEMORY;
+    return std::unique_ptr<decompressor::codec>(c.release());
+  }
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+}
+
+compression xmlpp::detect_compression(const void* data, size_t len)
+{
+  static const unsigned char GZIP[] = { 0x1f, 0x8b, 0x08 };
+  static const unsigned char ZSTD[] = { 0x28, 0xb5, 0x2f, 0xfd };
+  static const unsigned char XZ[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  if (len >= sizeof(GZIP) && memcmp(p, GZIP, sizeof(GZIP))==0) return compression::GZIP;
+  if (len >= sizeof(ZSTD) && memcmp(p, ZSTD, sizeof(ZSTD))==0) return compression::ZSTD;
+  if (len >= sizeof(XZ) && memcmp(p, XZ, sizeof(XZ))==0) return compression::XZ;
+  return compression::NONE;
+}
+
+bool xmlpp::compression_available(compression format)
+{
+  switch (format) {
+  case compression::NONE:
+    return true;
+  case compression::GZIP:
+#if defined(HAVE_ZLIB)
+    return true;
+#else
+    return false;
+#endif
+  case compression::ZSTD:
+#if defined(HAVE_ZSTD)
+    return true;
+#else
+    return false;
+#endif
+  case compression::XZ:
+#if defined(HAVE_LZMA)
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+const char* xmlpp::to_string(compression format)
+{
+  switch (format) {
+  case compression::NONE: return "none";
+  case compression::GZIP: return "gzip";
+  case compression::ZSTD: return "zstd";
+  case compression::XZ: return "xz";
+  }
+  return "unknown";
+}
+
+xmlpp::parser::result xmlpp::to_result(decompressor::error_t error)
+{
+  switch (error) {
+  case decompressor::error_t::NONE:
+    return parser::OK;
+  case decompressor::error_t::UNSUPPORTED:
+  case decompressor::error_t::CORRUPT:
+    return parser::INVALID_INPUT;
+  default:
+    return parser::READ_ERROR;
+  }
+}
+
+decompressor::decompressor(FILE* file)
+: file_(file), in_(INPUT_SIZE)
+{}
+
+decompressor::~decompressor() = default;
+
+bool decompressor::fill()
+{
+  if (in_pos_ > 0) {
+    memmove(in_.data(), in_.data() + in_pos_, in_end_ - in_pos_);
+    in_end_ -= in_pos_;
+    in_pos_ = 0;
+  }
+  const size_t n = fread(in_.data() + in_end_, 1, in_.size() - in_end_, file_);
+  if (n==0) {
+    if (ferror(file_)) error_ = error_t::READ;
+    eof_ = true;
+    return false;
+  }
+  in_end_ += n;
+  return true;
+}
+
+long decompressor::fail(error_t e)
+{
+  error_ = e;
+  return -1;
+}
+
+long decompressor::read(char* buffer, size_t size)
+{
+  if (error_!=error_t::NONE) return -1;
+  if (!started_) {
+    started_ = true;
+    while (in_end_ - in_pos_ < MAGIC_SIZE && fill()) {}
+    if (error_!=error_t::NONE) return -1;
+    format_ = detect_compression(in_.data() + in_pos_, in_end_ - in_pos_);
+    if (format_!=compression::NONE) {
+      error_t e;
+      codec_ = make_codec(format_, e);
+      if (e!=error_t::NONE) return fail(e);
+    }
+  }
+
+  if (format_==compression::NONE) {
+    size_t n = std::min(size, in_end_ - in_pos_);
+    if (n) memcpy(buffer, in_.data() + in_pos_, n);
+    in_pos_ += n;
+    if (n < size && !eof_) {
+      const size_t r = fread(buffer + n, 1, size - n, file_);
+      if (r==0) {
+        eof_ = true;
+        if (ferror(file_)) return fail(error_t::READ);
+      }
+      n += r;
+    }
+    return static_cast<long>(n);
+  }
+
+  unsigned char* out = reinterpret_cast<unsigned char*>(buffer);
+  unsigned char* const out_end = out + size;
+  while (out < out_end && !done_) {
+    if (in_pos_==in_end_ && !eof_ && !fill() && error_!=error_t::NONE) return -1;
+    const unsigned char* in = in_.data() + in_pos_;
+    const unsigned char* const in_before = in;
+    unsigned char* const out_before = out;
+    const codec::status s = codec_->run(in, in_.data() + in_end_, out, out_end, eof_);
+    in_pos_ = static_cast<size_t>(in - in_.data());
+    if (s==codec::FAILED) return fail(error_t::CORRUPT);
+    if (s==codec::NO_MEMORY) return fail(error_t::NO_MEMORY);
+    if (s==codec::STREAM_END) {
+      // another stream may follow, e.g. of concatenated gzip files
+      if (in_pos_==in_end_ && !eof_) fill();
+      if (error_!=error_t::NONE) return -1;
+      if (in_pos_==in_end_) {
+        done_ = true;
+      } else if (!codec_->restart()) {
+        return fail(error_t::CORRUPT);
+      }
+      continue;
+    }
+    if (in==in_before && out==out_before && (in_pos_!=in_end_ || eof_)) {
+      // no progress without more input, the input is truncated
+      return fail(error_t::CORRUPT);
+    }
+  }
+  return static_cast<long>(out - reinterpret_cast<unsigned char*>(buffer));
+}
@@ -0,0 +1,98 @@
+/**
+ * \file decompressor.hpp contains the streaming decompression of
+ * compressed input files
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_decompressor_hpp
+#define xmlpp_decompressor_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "xmlparser.hpp"
+
+namespace xmlpp {
+
+/** formats of compressed input, detected by their magic bytes */
+enum class compression : uint8_t {
+  NONE,
+  GZIP,
+  ZSTD,
+  XZ
+};
+
+/** @return the format of data starting with the given bytes, NONE if no
+ * magic matches */
+compression detect_compression(const void* data, size_t len);
+/** @return true if the library was built with support for the format */
+bool compression_available(compression format);
+const char* to_string(compression format);
+
+/** reads a file and decompresses it on the fly.
+ *
+ * the format is detected from the first bytes of the file, uncompressed
+ * files are passed through. Concatenated gzip members, zstd frames and xz
+ * streams are decompressed as one stream. gzip needs zlib, zstd libzstd
+ * and xz liblzma at build time (EXPATPP_WITH_ZLIB, EXPATPP_WITH_ZSTD,
+ * EXPATPP_WITH_LZMA), formats without their library are reported as
+ * UNSUPPORTED.
+ */
+class decompressor {
+public:
+  enum class error_t : uint8_t {
+    NONE,
+    READ,           //< reading the file failed
+    UNSUPPORTED,    //< compressed with a format not built in
+    CORRUPT,        //< invalid or truncated compressed data
+    NO_MEMORY
+  };
+
+  static const size_t INPUT_SIZE = 256*1024;
+
+  /** @param file is read from its current position and not closed */
+  explicit decompressor(FILE* file);
+  ~decompressor();
+  decompressor(const decompressor&) = delete;
+  decompressor& operator=(const decompressor&) = delete;
+
+  /** fills buffer with up to size decompressed bytes, less only at the end
+   * of the input
+   * @return bytes stored, 0 at the end of the input, -1 on errors, see
+   * error() */
+  long read(char* buffer, size_t size);
+
+  /** format of the file, valid after the first read() */
+  compression format() const { return format_; }
+  error_t error() const { return error_; }
+
+  /** decompression state of one format */
+  class codec;
+private:
+  /** reads the next block of the file into in_
+   * @return false at the end of the file or on errors */
+  bool fill();
+  long fail(error_t e);
+
+  FILE* file_;
+  std::vector<unsigned char> in_;
+  size_t in_pos_{0};
+  size_t in_end_{0};
+  bool eof_{false};
+  bool started_{false};
+  /** the last stream of the input is complete */
+  bool done_{false};
+  compression format_{compression::NONE};
+  error_t error_{error_t::NONE};
+  std::unique_ptr<codec> codec_;
+};
+
+/** @return the parser result for a failed read of the decompressor,
+ * INVALID_INPUT for unsupported or corrupt compressed data */
+parser::result to_result(decompressor::error_t error);
+
+}
+#endif // #ifndef xmlpp_decompressor_hpp
@@ -7,6 +7,7 @@
 #include "delegate.hpp"
 
 #include "state.hpp"
+#include "xmlparser.hpp"
 
 using std::string;
 
@@ -21,7 +22,16 @@ Error::Error (XML_Error _error) noexcept
 
 std::string Error::to_string() const
 {
-  return XML_ErrorString(error);
+  switch (static_cast<parser::error_t>(error)) {
+  case parser::error_t::DEADLINE_EXCEEDED: return "document exceeds the time limit";
+  case parser::error_t::TOO_MANY_BYTES: return "document exceeds the size limit";
+  case parser::error_t::TOO_DEEP: return "elements nested deeper than the limit";
+  case parser::error_t::TOO_MANY_ATTRIBUTES: return "element has more attributes than the limit";
+  case parser::error_t::TEXT_TOO_LONG: return "character data exceeds the limit";
+  default: break;
+  }
+  const XML_LChar* text = XML_ErrorString(error);
+  return text ? text : "unknown error";
 }
 
 XML_Error Error::errorcode() const
@@ -106,4 +116,139 @@ void abstract_delegate::onParseError(size_t  /* line */,
 				     Error  /* error */)
 {}
 
+void forwarding_delegate::onStartElement(const XML_Char *fullname,
+                                         const XML_Char **atts)
+{
+  if (next_) next_->onStartElement(fullname,atts);
+}
+
+void forwarding_delegate::onEndElement(const XML_Char *fullname)
+{
+  if (next_) next_->onEndElement(fullname);
+}
+
+void forwarding_delegate::onCharacterData(const char * pBuf, int len)
+{
+  if (next_) next_->onCharacterData(pBuf,len);
+}
+
+void forwarding_delegate::onProcessingInstruction(const XML_Char* target,
+                                                  const XML_Char* data)
+{
+  if (next_) next_->onProcessingInstruction(target,data);
+}
+
+void forwarding_delegate::onUnparsedEntityDecl(const XML_Char* entityName,
+                                               const XML_Char* base,
+                                               const XML_Char* systemId,
+                                               const XML_Char* publicId,
+                                               const XML_Char* notationName)
+{
+  if (next_) next_->onUnparsedEntityDecl(entityName,base,systemId,
+                                         publicId,notationName);
+}
+
+void forwarding_delegate::onNotationDecl(const XML_Char* notationName,
+                                         const XML_Char* base,
+                                         const XML_Char* systemId,
+                                         const XML_Char* publicId)
+{
+  if (next_) next_->onNotationDecl(notationName,base,systemId,publicId);
+}
+
+void forwarding_delegate::onStartNamespace(const XML_Char* prefix,
+                                           const XML_Char* uri)
+{
+  if (next_) next_->onStartNamespace(prefix,uri);
+}
+
+void forwarding_delegate::onEndNamespace(const XML_Char* prefix)
+{
+  if (next_) next_->onEndNamespace(prefix);
+}
+
+void forwarding_delegate::onAttlistDecl(const XML_Char *elname,
+                                        const XML_Char *attname,
+                                        const XML_Char *att_type,
+                                        const XML_Char *dflt,
+                                        bool            isrequired)
+{
+  if (next_) next_->onAttlistDecl(elname,attname,att_type,dflt,isrequired);
+}
+
+void forwarding_delegate::onStartCdataSection()
+{
+  if (next_) next_->onStartCdataSection();
+}
+
+void forwarding_delegate::onEndCdataSection()
+{
+  if (next_) next_->onEndCdataSection();
+}
+
+void forwarding_delegate::onStartDoctypeDecl(const XML_Char *doctypeName,
+                                             const XML_Char *sysid,
+                                             const XML_Char *pubid,
+                                             int has_internal_subset)
+{
+  if (next_) next_->onStartDoctypeDecl(doctypeName,sysid,pubid,
+                                       has_internal_subset);
+}
+
+void forwarding_delegate::onEndDoctypeDecl()
+{
+  if (next_) next_->onEndDoctypeDecl();
+}
+
+void forwarding_delegate::onComment(const XML_Char *data)
+{
+  if (next_) next_->onComment(data);
+}
+
+void forwarding_delegate::onElementDecl(const XML_Char *name,
+                                        XML_Content *model)
+{
+  if (next_) next_->onElementDecl(name,model);
+}
+
+void forwarding_delegate::onEntityDecl(const XML_Char *entityName,
+                                       int is_parameter_entity,
+                                       const XML_Char *value,
+                                       int value_length,
+                                       const XML_Char *base,
+                                       const XML_Char *systemId,
+                                       const XML_Char *publicId,
+                                       const XML_Char *notationName)
+{
+  if (next_) next_->onEntityDecl(entityName,is_parameter_entity,
+                                 value,value_length,
+                                 base,systemId,publicId,notationName);
+}
+
+void forwarding_delegate::onSkippedEntity(const XML_Char *entityName,
+                                          int is_parameter_entity)
+{
+  if (next_) next_->onSkippedEntity(entityName,is_parameter_entity);
+}
+
+void forwarding_delegate::onXmlDecl(const XML_Char *version,
+                                    const XML_Char *encoding,
+                                    int standalone)
+{
+  if (next_) next_->onXmlDecl(version,encoding,standalone);
+}
+
+void forwarding_delegate::onParseError(size_t line,
+                                       size_t column,
+                                       size_t pos,
+                                       Error error)
+{
+  if (next_) next_->onParseError(line,column,pos,error);
+}
+
+void forwarding_delegate::onEndDocument(size_t index)
+{
+  if (next_) next_->onEndDocument(index);
+}
+
 }
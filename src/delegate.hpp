@@ -15,7 +15,8 @@
 
 namespace xmlpp {
 
-/** wrapper class type for expats XML_Error */
+/** wrapper class type for expats XML_Error, also carries the codes of
+ * violated parser limits beyond those of expat (see parser::error_t) */
 class Error  {
 public:
   explicit Error (XML_Error error) noexcept;
@@ -210,6 +211,15 @@ public:
   virtual void onSkippedEntity(const XML_Char *entityName,
                                int is_parameter_entity) = 0;
 //@}
+
+  /**
+   * in multi document mode (parser::set_multi_document) called after the
+   * root element of each document was closed, before the parser is reset
+   * for the next document. Has an empty default implementation.
+   *
+   * @param index number of the document in the stream, starting with 0
+   */
+  virtual void onEndDocument(size_t index) { (void)index; }
 };
 
 /** default base class for delegates.
@@ -265,5 +275,67 @@ public:
                  int standalone) override;
   void onParseError(size_t line,size_t column, size_t pos, Error error) override;
 };
+
+/** base class for delegate decorators.
+ all events are forwarded to the next delegate (if there is one), derived
+ classes override the events they are interested in and call the
+ forwarding_delegate implementation to pass the event on */
+class forwarding_delegate : public delegate {
+public:
+  explicit forwarding_delegate(delegate* next = nullptr) : next_(next) {}
+
+  delegate* next() const { return next_; }
+  void set_next(delegate* next) { next_ = next; }
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override;
+  void onEndElement(	const XML_Char *fullname) override;
+  void onCharacterData(const char * pBuf, int len) override;
+  void onProcessingInstruction(const XML_Char* target,
+                               const XML_Char* data) override;
+  void onUnparsedEntityDecl(const XML_Char* entityName,
+			    const XML_Char* base,
+                            const XML_Char* systemId,
+                            const XML_Char* publicId,
+                            const XML_Char* notationName) override;
+  void onNotationDecl(const XML_Char* notationName,
+                      const XML_Char* base,
+                      const XML_Char* systemId,
+                      const XML_Char* publicId) override;
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override;
+  void onEndNamespace(const XML_Char* prefix) override;
+  void onAttlistDecl(const XML_Char *elname,
+                     const XML_Char *attname,
+                     const XML_Char *att_type,
+                     const XML_Char *dflt,
+                     bool            isrequired) override;
+  void onStartCdataSection() override;
+  void onEndCdataSection() override;
+
+  void onStartDoctypeDecl(const XML_Char *doctypeName,
+                          const XML_Char *sysid,
+                          const XML_Char *pubid,
+                          int has_internal_subset) override;
+  void onEndDoctypeDecl() override;
+
+  void onComment( const XML_Char *data) override;
+  void onElementDecl( const XML_Char *name, XML_Content *model) override;
+  void onEntityDecl(const XML_Char *entityName,
+                    int is_parameter_entity,
+                    const XML_Char *value,
+                    int value_length,
+                    const XML_Char *base,
+                    const XML_Char *systemId,
+                    const XML_Char *publicId,
+                    const XML_Char *notationName) override;
+  void onSkippedEntity(const XML_Char *entityName,
+                       int is_parameter_entity) override;
+  void onXmlDecl( const XML_Char      *version,
+                 const XML_Char      *encoding,
+                 int standalone) override;
+  void onParseError(size_t line,size_t column, size_t pos, Error error) override;
+  void onEndDocument(size_t index) override;
+private:
+  delegate* next_{nullptr};
+};
 }
 #endif // #ifndef xmlpp_delegate_hpp
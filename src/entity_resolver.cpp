@@ -0,0 +1,342 @@
+/**
+ * \file entity_resolver.cpp implementation of the resolution of external
+ * entities
+ *
+ * See LICENSE for copyright information.
+ */
+#include <cctype>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+
+#include <expat.h>
+
+#include "entity_resolver.hpp"
+#include "mapped_file.hpp"
+
+using xmlpp::entity_resolver;
+
+namespace {
+
+const char FILE_SCHEME[] = "file://";
+
+bool has_scheme(const std::string& id)
+{
+  const size_t colon = id.find(':');
+  if (colon==std::string::npos || colon < 2) return false;  // c:\ on windows
+  for (size_t i = 0; i < colon; ++i) {
+    const char c = id[i];
+    if (!isalnum(static_cast<unsigned char>(c)) && c!='+' && c!='-' && c!='.') return false;
+  }
+  return true;
+}
+
+/** @return the local path of the system id resolved against base, empty
+ * for URLs of other schemes */
+std::string local_path(const char* base, const std::string& system_id)
+{
+  std::string id = system_id;
+  if (id.compare(0, sizeof(FILE_SCHEME) - 1, FILE_SCHEME)==0) {
+    id.erase(0, sizeof(FILE_SCHEME) - 1);
+  } else if (has_scheme(id)) {
+    return std::string();
+  }
+  if (id.empty() || id[0]=='/' || base==nullptr) return id;
+  std::string directory(base);
+  if (directory.compare(0, sizeof(FILE_SCHEME) - 1, FILE_SCHEME)==0) {
+    directory.erase(0, sizeof(FILE_SCHEME) - 1);
+  }
+  const size_t slash = directory.rfind('/');
+  if (slash==std::string::npos) return id;
+  return directory.substr(0, slash + 1) + id;
+}
+
+/** @return the file as entity, nullptr if it can not be read */
+entity_resolver::entity_ptr read_file(const std::string& filename)
+{
+  xmlpp::mapped_file file;
+  if (!file.open(filename)) return nullptr;
+  std::shared_ptr<entity_resolver::entity> e(new entity_resolver::entity);
+  e->data.assign(file.data(), file.size());
+  e->base = filename;
+  return e;
+}
+
+/** appends a quoted literal, char references for the characters which
+ * would change the value when it is parsed again
+ * @param special characters replaced besides the quote and '&' */
+void append_literal(std::string& out, const char* value, size_t len, const char* special)
+{
+  out += " '";
+  for (size_t i = 0; i < len; ++i) {
+    const char c = value[i];
+    if (c=='\'' || c=='&' || c=='\r' || (c && strchr(special, c))) {
+      out += "&#" + std::to_string(static_cast<int>(c)) + ";";
+    } else {
+      out += c;
+    }
+  }
+  out += '\'';
+}
+
+/** appends a system or public id, quoted with the quote it does not contain */
+void append_id(std::string& out, const char* id)
+{
+  const char quote = strchr(id, '\'') ? '"' : '\'';
+  out += ' ';
+  out += quote;
+  out += id;
+  out += quote;
+}
+
+void append_external_id(std::string& out, const char* system_id, const char* public_id)
+{
+  if (public_id) {
+    out += " PUBLIC";
+    append_id(out, public_id);
+  } else if (system_id) {
+    out += " SYSTEM";
+  }
+  if (system_id) append_id(out, system_id);
+}
+
+/** parses a DTD with its parameter entities and writes the declarations
+ * of general entities, attribute lists and notations again */
+class dtd_compactor {
+public:
+  dtd_compactor(entity_resolver& resolver, const entity_resolver::entity_ptr& dtd)
+  : resolver_(resolver), dtd_(dtd) {}
+
+  /** @return the compact DTD, nullptr if the DTD is not well-formed or one
+   * of its parameter entities could not be resolved in strict mode */
+  entity_resolver::entity_ptr run()
+  {
+    XML_Parser p = XML_ParserCreate(nullptr);
+    if (p==nullptr) return nullptr;
+    XML_SetUserData(p, this);
+    XML_SetParamEntityParsing(p, XML_PARAM_ENTITY_PARSING_ALWAYS);
+    XML_SetEntityDeclHandler(p, EntityDecl);
+    XML_SetAttlistDeclHandler(p, AttlistDecl);
+    XML_SetNotationDeclHandler(p, NotationDecl);
+    XML_SetExternalEntityRefHandler(p, ExternalEntityRef);
+    XML_SetExternalEntityRefHandlerArg(p, this);
+    parsers_.push_back(p);
+    static const char DOCUMENT[] = "<!DOCTYPE d SYSTEM 'dtd'><d/>";
+    const bool ok = XML_Parse(p, DOCUMENT, sizeof(DOCUMENT) - 1, XML_TRUE)==XML_STATUS_OK && ok_;
+    XML_ParserFree(p);
+    if (!ok) return nullptr;
+    std::shared_ptr<entity_resolver::entity> e(new entity_resolver::entity);
+    e->data.swap(out_);
+    e->base = dtd_->base;
+    return e;
+  }
+private:
+  static void XMLCALL EntityDecl(void* userData, const XML_Char* entityName,
+                                 int is_parameter_entity, const XML_Char* value,
+                                 int value_length, const XML_Char* base,
+                                 const XML_Char* systemId, const XML_Char* publicId,
+                                 const XML_Char* notationName)
+  {
+    if (is_parameter_entity) return;
+    dtd_compactor* c = static_cast<dtd_compactor*>(userData);
+    std::string& out = c->out_;
+    out += "<!ENTITY ";
+    out += entityName;
+    if (value) {
+      append_literal(out, value, static_cast<size_t>(value_length), "%");
+    } else {
+      const std::string id = c->system_id(base, systemId);
+      append_external_id(out, id.c_str(), publicId);
+      if (notationName) {
+        out += " NDATA ";
+        out += notationName;
+      }
+    }
+    out += ">\n";
+  }
+
+  /** writes the attributes of an element into one declaration, attributes
+   * which do not change the events, CDATA #IMPLIED, are dropped */
+  static void XMLCALL AttlistDecl(void* userData, const XML_Char* elname,
+                                  const XML_Char* attname, const XML_Char* att_type,
+                                  const XML_Char* dflt, int isrequired)
+  {
+    dtd_compactor* c = static_cast<dtd_compactor*>(userData);
+    // the first declaration of an attribute is binding, expat reports all
+    std::string key(elname);
+    key += ' ';
+    key += attname;
+    if (!c->attributes_.insert(key).second) return;
+    if (dflt==nullptr && !isrequired && strcmp(att_type, "CDATA")==0) return;
+    std::string& out = c->out_;
+    if (out.size()==c->attlist_end_ && c->attlist_element_==elname) {
+      out.resize(out.size() - 2);
+    } else {
+      out += "<!ATTLIST ";
+      out += elname;
+      c->attlist_element_ = elname;
+    }
+    out += ' ';
+    out += attname;
+    out += ' ';
+    static const char NOTATION[] = "NOTATION";
+    if (strncmp(att_type, NOTATION, sizeof(NOTATION) - 1)==0) {
+      // expat drops the space before the list of notations
+      out += NOTATION;
+      out += ' ';
+      out += att_type + sizeof(NOTATION) - 1;
+    } else {
+      out += att_type;
+    }
+    if (dflt==nullptr) {
+      out += isrequired ? " #REQUIRED" : " #IMPLIED";
+    } else {
+      if (isrequired) out += " #FIXED";
+      append_literal(out, dflt, strlen(dflt), "<\t\n");
+    }
+    out += ">\n";
+    c->attlist_end_ = out.size();
+  }
+
+  static void XMLCALL NotationDecl(void* userData, const XML_Char* notationName,
+                                   const XML_Char* base, const XML_Char* systemId,
+                                   const XML_Char* publicId)
+  {
+    dtd_compactor* c = static_cast<dtd_compactor*>(userData);
+    std::string& out = c->out_;
+    out += "<!NOTATION ";
+    out += notationName;
+    const std::string id = systemId ? c->system_id(base, systemId) : std::string();
+    append_external_id(out, systemId ? id.c_str() : nullptr, publicId);
+    out += ">\n";
+  }
+
+  /** the handler argument is the compactor, the DTD itself is the first
+   * reference, parameter entities are resolved by the resolver */
+  static int XMLCALL ExternalEntityRef(XML_Parser arg, const XML_Char* context,
+                                       const XML_Char* base, const XML_Char* systemId,
+                                       const XML_Char* publicId)
+  {
+    dtd_compactor* c = reinterpret_cast<dtd_compactor*>(arg);
+    entity_resolver::entity_ptr e = c->dtd_;
+    if (c->started_) {
+      e = c->resolver_.resolve(base, systemId, publicId);
+      if (!e) {
+        c->ok_ = !c->resolver_.strict();
+        return c->ok_ ? XML_STATUS_OK : XML_STATUS_ERROR;
+      }
+    }
+    c->started_ = true;
+    XML_Parser child = XML_ExternalEntityParserCreate(c->parsers_.back(), context, nullptr);
+    if (child==nullptr) return XML_STATUS_ERROR;
+    XML_SetBase(child, e->base.c_str());
+    c->parsers_.push_back(child);
+    const bool ok = XML_Parse(child, e->data.data(), static_cast<int>(e->data.size()),
+                              XML_TRUE)==XML_STATUS_OK;
+    c->parsers_.pop_back();
+    XML_ParserFree(child);
+    return ok ? XML_STATUS_OK : XML_STATUS_ERROR;
+  }
+
+  /** @return the system id of a declaration, relative ids of parameter
+   * entities with another base resolved, the compact DTD has the base of
+   * the DTD */
+  std::string system_id(const XML_Char* base, const XML_Char* system_id) const
+  {
+    if (base==nullptr || dtd_->base==base) return system_id;
+    const std::string path = local_path(base, system_id);
+    return path.empty() ? std::string(system_id) : path;
+  }
+
+  entity_resolver& resolver_;
+  entity_resolver::entity_ptr dtd_;
+  /** the parser of the document and of the entities being parsed */
+  std::vector<XML_Parser> parsers_;
+  std::string out_;
+  /** declared attributes, "element attribute" */
+  std::unordered_set<std::string> attributes_;
+  /** the last attribute list, extended by the next attribute of its
+   * element */
+  std::string attlist_element_;
+  size_t attlist_end_{0};
+  bool started_{false};
+  bool ok_{true};
+};
+
+}
+
+void entity_resolver::add(const std::string& id, const std::string& data)
+{
+  std::shared_ptr<entity> e(new entity);
+  e->data = data;
+  e->base = id;
+  std::lock_guard<std::mutex> lock(mutex_);
+  entry& en = entries_[id];
+  if (en.content) compact_.erase(en.content.get());
+  en.filename.clear();
+  en.content = e;
+}
+
+void entity_resolver::add_file(const std::string& id, const std::string& filename)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  entry& en = entries_[id];
+  if (en.content) compact_.erase(en.content.get());
+  en.filename = filename;
+  en.content = nullptr;
+}
+
+entity_resolver::entity_ptr entity_resolver::lookup(const std::string& id)
+{
+  const auto it = entries_.find(id);
+  if (it==entries_.end()) return nullptr;
+  entry& en = it->second;
+  if (!en.content && !en.filename.empty()) {
+    en.content = read_file(en.filename);
+    if (en.content) ++loads_;
+  } else if (en.content) {
+    ++hits_;
+  }
+  return en.content;
+}
+
+entity_resolver::entity_ptr entity_resolver::resolve(const char* base, const char* system_id,
+                                                     const char* public_id)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  entity_ptr e;
+  if (public_id) e = lookup(public_id);
+  if (!e && system_id) e = lookup(system_id);
+  if (!e && system_id) {
+    const std::string path = local_path(base, system_id);
+    if (!path.empty() && path!=system_id) e = lookup(path);
+    if (!e && !path.empty() && load_files_) {
+      // cached under the path for the following references
+      e = read_file(path);
+      if (e) {
+        ++loads_;
+        entries_[path].content = e;
+      }
+    }
+  }
+  if (!e) ++misses_;
+  return e;
+}
+
+entity_resolver::entity_ptr entity_resolver::resolve_dtd(const char* base, const char* system_id,
+                                                         const char* public_id)
+{
+  const entity_ptr e = resolve(base, system_id, public_id);
+  if (!e || !compact_dtds_) return e;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = compact_.find(e.get());
+    if (it!=compact_.end()) return it->second.second;
+  }
+  // compacted without the lock, the parameter entities are resolved by
+  // resolve(), threads racing for the same DTD keep the first result
+  entity_ptr compact = dtd_compactor(*this, e).run();
+  if (!compact) compact = e;
+  std::lock_guard<std::mutex> lock(mutex_);
+  return compact_.emplace(e.get(), std::make_pair(e, compact)).first->second.second;
+}
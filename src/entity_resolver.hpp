@@ -0,0 +1,113 @@
+/**
+ * \file entity_resolver.hpp contains the resolution of external entities
+ * from an in memory catalog
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_entity_resolver_hpp
+#define xmlpp_entity_resolver_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace xmlpp {
+
+/** catalog and cache of external entities, e.g. DTDs, shared by parsers on
+ * any number of threads (see parser::set_entity_resolver()).
+ *
+ * an entity is looked up by its public id, then by its system id and then
+ * by its system id resolved against the base of the referencing document.
+ * Entries of files are read on first use, the content stays in memory for
+ * all following parsers. Other local files are read only with
+ * set_load_files(), documents could name any file otherwise. Network URLs
+ * are never fetched.
+ *
+ * expat parses an entity for each document that references it, the
+ * resolver saves the lookup on disk and the reading of the file. With
+ * set_compact_dtds() DTDs are also parsed only once.
+ */
+class entity_resolver {
+public:
+  /** content of a resolved entity, immutable */
+  struct entity {
+    std::string data;
+    /** base for the system ids of references inside the entity */
+    std::string base;
+  };
+  typedef std::shared_ptr<const entity> entity_ptr;
+
+  entity_resolver() = default;
+  entity_resolver(const entity_resolver&) = delete;
+  entity_resolver& operator=(const entity_resolver&) = delete;
+
+  /** adds the content of an entity
+   * @param id public or system id */
+  void add(const std::string& id, const std::string& data);
+  /** adds a file read at the first reference to id */
+  void add_file(const std::string& id, const std::string& filename);
+
+  /** reads files named by system ids without entry, relative ids are
+   * resolved against the base of the reference, off by default */
+  void set_load_files(bool enable) { load_files_ = enable; }
+  bool load_files() const { return load_files_; }
+  /** entities without entry or file are an error of the parse
+   * (EXTERNAL_ENTITY_HANDLING) instead of being skipped */
+  void set_strict(bool enable) { strict_ = enable; }
+  bool strict() const { return strict_; }
+  /** serves DTDs pre-parsed: the declarations which change the events of
+   * the documents, general entities, attribute lists and notations, are
+   * parsed once with the parameter entities of the DTD resolved and
+   * cached as a compact DTD without element declarations, attributes of
+   * type CDATA without default, parameter entities, comments and
+   * processing instructions. The delegates do not get those declarations,
+   * and parameter entities declared in the internal subset of a document
+   * do not change the DTD. Off by default.
+   */
+  void set_compact_dtds(bool enable) { compact_dtds_ = enable; }
+  bool compact_dtds() const { return compact_dtds_; }
+
+  /** @param base of the reference, may be null
+   * @param public_id may be null
+   * @return the entity or nullptr if it is unknown or can not be read */
+  entity_ptr resolve(const char* base, const char* system_id, const char* public_id);
+  /** resolve() for the external DTD subset and parameter entities, the
+   * compact DTD if enabled. A DTD which can not be compacted, e.g. for a
+   * syntax error, is served as it is. */
+  entity_ptr resolve_dtd(const char* base, const char* system_id, const char* public_id);
+
+  /** references resolved from memory */
+  uint64_t hits() const { return hits_; }
+  /** files read */
+  uint64_t loads() const { return loads_; }
+  /** references not resolved */
+  uint64_t misses() const { return misses_; }
+private:
+  /** a catalog entry, its entity is nullptr until the file is read */
+  struct entry {
+    std::string filename;
+    entity_ptr content;
+  };
+
+  /** @return the entity of the entry, reads its file if needed, nullptr if
+   * there is no such entry, called with mutex_ held */
+  entity_ptr lookup(const std::string& id);
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, entry> entries_;
+  /** the DTDs, kept alive for their address, and their compact form */
+  std::unordered_map<const entity*, std::pair<entity_ptr, entity_ptr>> compact_;
+  bool load_files_{false};
+  bool strict_{false};
+  bool compact_dtds_{false};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> loads_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+}
+#endif // #ifndef xmlpp_entity_resolver_hpp
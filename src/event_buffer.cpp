@@ -0,0 +1,439 @@
+/**
+ * \file event_buffer.cpp implementation of the event encoding
+ *
+ * See LICENSE for copyright information.
+ */
+#include <cstring>
+
+#include "event_buffer.hpp"
+
+using xmlpp::event_buffer;
+using xmlpp::event_replayer;
+
+const event_buffer::event_mask event_buffer::ALL_EVENTS;
+
+namespace {
+
+const uint32_t NULL_STRING = 0xffffffffu;
+
+/** reads the fields of the events */
+class decoder {
+public:
+  explicit decoder(const char* p) : p_(p) {}
+
+  uint8_t byte() { return static_cast<uint8_t>(*p_++); }
+  uint32_t u32()
+  {
+    uint32_t v;
+    memcpy(&v, p_, sizeof(v));
+    p_ += sizeof(v);
+    return v;
+  }
+  uint64_t u64()
+  {
+    uint64_t v;
+    memcpy(&v, p_, sizeof(v));
+    p_ += sizeof(v);
+    return v;
+  }
+  const char* string() { return string(nullptr); }
+  const char* string(uint32_t* len)
+  {
+    const uint32_t n = u32();
+    if (len) *len = n==NULL_STRING ? 0 : n;
+    if (n==NULL_STRING) return nullptr;
+    const char* s = p_;
+    p_ += n + 1;
+    return s;
+  }
+  const char* position() const { return p_; }
+private:
+  const char* p_;
+};
+
+size_t count_nodes(const XML_Content* model)
+{
+  size_t n = 1;
+  for (unsigned i = 0; i < model->numchildren; ++i) n += count_nodes(&model->children[i]);
+  return n;
+}
+
+/** restores the node into model[slot], the children of a node are
+ * allocated as one block after next */
+void decode_node(decoder& in, std::vector<XML_Content>& model, size_t slot, size_t& next)
+{
+  XML_Content& c = model[slot];
+  c.type = static_cast<XML_Content_Type>(in.u32());
+  c.quant = static_cast<XML_Content_Quant>(in.u32());
+  c.name = const_cast<XML_Char*>(in.string());
+  c.numchildren = in.u32();
+  c.children = nullptr;
+  if (c.numchildren==0) return;
+  const size_t block = next;
+  next += c.numchildren;
+  c.children = &model[block];
+  for (unsigned i = 0; i < c.numchildren; ++i) decode_node(in, model, block + i, next);
+}
+
+}
+
+void event_buffer::clear()
+{
+  data_.clear();
+  events_ = 0;
+}
+
+void event_buffer::put(event e)
+{
+  data_.push_back(static_cast<char>(e));
+  ++events_;
+}
+
+void event_buffer::put_u32(uint32_t v)
+{
+  const char* p = reinterpret_cast<const char*>(&v);
+  data_.insert(data_.end(), p, p + sizeof(v));
+}
+
+void event_buffer::put_u64(uint64_t v)
+{
+  const char* p = reinterpret_cast<const char*>(&v);
+  data_.insert(data_.end(), p, p + sizeof(v));
+}
+
+void event_buffer::put_string(const char* s)
+{
+  if (s==nullptr) {
+    put_u32(NULL_STRING);
+  } else {
+    put_string(s, strlen(s));
+  }
+}
+
+void event_buffer::put_string(const char* s, size_t len)
+{
+  put_u32(static_cast<uint32_t>(len));
+  data_.insert(data_.end(), s, s + len);
+  data_.push_back('\0');
+}
+
+void event_buffer::put_model(const XML_Content* model)
+{
+  put_u32(static_cast<uint32_t>(model->type));
+  put_u32(static_cast<uint32_t>(model->quant));
+  put_string(model->name);
+  put_u32(model->numchildren);
+  for (unsigned i = 0; i < model->numchildren; ++i) put_model(&model->children[i]);
+}
+
+void event_buffer::onStartElement(const XML_Char *fullname, const XML_Char **atts)
+{
+  put(event::START_ELEMENT);
+  put_string(fullname);
+  uint32_t count = 0;
+  for (const XML_Char** a = atts; *a; ++a) ++count;
+  put_u32(count);
+  for (const XML_Char** a = atts; *a; ++a) put_string(*a);
+}
+
+void event_buffer::onEndElement(const XML_Char *fullname)
+{
+  put(event::END_ELEMENT);
+  put_string(fullname);
+}
+
+void event_buffer::onCharacterData(const char * pBuf, int len)
+{
+  put(event::CHARACTER_DATA);
+  put_string(pBuf, static_cast<size_t>(len));
+}
+
+void event_buffer::onProcessingInstruction(const XML_Char* target, const XML_Char* data)
+{
+  put(event::PROCESSING_INSTRUCTION);
+  put_string(target);
+  put_string(data);
+}
+
+void event_buffer::onUnparsedEntityDecl(const XML_Char* entityName,
+                                        const XML_Char* base,
+                                        const XML_Char* systemId,
+                                        const XML_Char* publicId,
+                                        const XML_Char* notationName)
+{
+  put(event::UNPARSED_ENTITY_DECL);
+  put_string(entityName);
+  put_string(base);
+  put_string(systemId);
+  put_string(publicId);
+  put_string(notationName);
+}
+
+void event_buffer::onNotationDecl(const XML_Char* notationName,
+                                  const XML_Char* base,
+                                  const XML_Char* systemId,
+                                  const XML_Char* publicId)
+{
+  put(event::NOTATION_DECL);
+  put_string(notationName);
+  put_string(base);
+  put_string(systemId);
+  put_string(publicId);
+}
+
+void event_buffer::onStartNamespace(const XML_Char* prefix, const XML_Char* uri)
+{
+  put(event::START_NAMESPACE);
+  put_string(prefix);
+  put_string(uri);
+}
+
+void event_buffer::onEndNamespace(const XML_Char* prefix)
+{
+  put(event::END_NAMESPACE);
+  put_string(prefix);
+}
+
+void event_buffer::onAttlistDecl(const XML_Char *elname,
+                                 const XML_Char *attname,
+                                 const XML_Char *att_type,
+                                 const XML_Char *dflt,
+                                 bool            isrequired)
+{
+  put(event::ATTLIST_DECL);
+  put_string(elname);
+  put_string(attname);
+  put_string(att_type);
+  put_string(dflt);
+  put_u32(isrequired ? 1 : 0);
+}
+
+void event_buffer::onStartCdataSection()
+{
+  put(event::START_CDATA_SECTION);
+}
+
+void event_buffer::onEndCdataSection()
+{
+  put(event::END_CDATA_SECTION);
+}
+
+void event_buffer::onStartDoctypeDecl(const XML_Char *doctypeName,
+                                      const XML_Char *sysid,
+                                      const XML_Char *pubid,
+                                      int has_internal_subset)
+{
+  put(event::START_DOCTYPE_DECL);
+  put_string(doctypeName);
+  put_string(sysid);
+  put_string(pubid);
+  put_u32(static_cast<uint32_t>(has_internal_subset));
+}
+
+void event_buffer::onEndDoctypeDecl()
+{
+  put(event::END_DOCTYPE_DECL);
+}
+
+void event_buffer::onComment(const XML_Char *data)
+{
+  put(event::COMMENT);
+  put_string(data);
+}
+
+void event_buffer::onElementDecl(const XML_Char *name, XML_Content *model)
+{
+  put(event::ELEMENT_DECL);
+  put_string(name);
+  put_u32(static_cast<uint32_t>(count_nodes(model)));
+  put_model(model);
+}
+
+void event_buffer::onEntityDecl(const XML_Char *entityName,
+                                int is_parameter_entity,
+                                const XML_Char *value,
+                                int value_length,
+                                const XML_Char *base,
+                                const XML_Char *systemId,
+                                const XML_Char *publicId,
+                                const XML_Char *notationName)
+{
+  put(event::ENTITY_DECL);
+  put_string(entityName);
+  put_u32(static_cast<uint32_t>(is_parameter_entity));
+  if (value==nullptr) {
+    put_string(nullptr);
+  } else {
+    put_string(value, static_cast<size_t>(value_length));
+  }
+  put_string(base);
+  put_string(systemId);
+  put_string(publicId);
+  put_string(notationName);
+}
+
+void event_buffer::onSkippedEntity(const XML_Char *entityName, int is_parameter_entity)
+{
+  put(event::SKIPPED_ENTITY);
+  put_string(entityName);
+  put_u32(static_cast<uint32_t>(is_parameter_entity));
+}
+
+void event_buffer::onXmlDecl(const XML_Char *version, const XML_Char *encoding, int standalone)
+{
+  put(event::XML_DECL);
+  put_string(version);
+  put_string(encoding);
+  put_u32(static_cast<uint32_t>(standalone));
+}
+
+void event_buffer::onParseError(size_t line, size_t column, size_t pos, Error error)
+{
+  put(event::PARSE_ERROR);
+  put_u64(line);
+  put_u64(column);
+  put_u64(pos);
+  put_u32(static_cast<uint32_t>(error.errorcode()));
+}
+
+void event_buffer::onEndDocument(size_t index)
+{
+  put(event::END_DOCUMENT);
+  put_u64(index);
+}
+
+void event_buffer::replay(delegate& d, event_mask events) const
+{
+  event_replayer replayer;
+  replayer.replay(*this, d, events);
+}
+
+void event_replayer::replay(const event_buffer& buffer, delegate& target,
+                            event_buffer::event_mask events)
+{
+  typedef event_buffer::event event;
+  // events outside the mask are decoded into a delegate ignoring them
+  static abstract_delegate ignore;
+  decoder in(buffer.data_.data());
+  const char* end = buffer.data_.data() + buffer.data_.size();
+  while (in.position() < end) {
+    const event e = static_cast<event>(in.byte());
+    delegate& d = (events & event_buffer::mask(e)) ? target : ignore;
+    switch (e) {
+    case event::START_ELEMENT: {
+      const char* name = in.string();
+      const uint32_t count = in.u32();
+      atts_.clear();
+      for (uint32_t i = 0; i < count; ++i) atts_.push_back(in.string());
+      atts_.push_back(nullptr);
+      d.onStartElement(name, atts_.data());
+      break;
+    }
+    case event::END_ELEMENT:
+      d.onEndElement(in.string());
+      break;
+    case event::CHARACTER_DATA: {
+      uint32_t len;
+      const char* s = in.string(&len);
+      d.onCharacterData(s, static_cast<int>(len));
+      break;
+    }
+    case event::PROCESSING_INSTRUCTION: {
+      const char* target = in.string();
+      d.onProcessingInstruction(target, in.string());
+      break;
+    }
+    case event::COMMENT:
+      d.onComment(in.string());
+      break;
+    case event::START_CDATA_SECTION:
+      d.onStartCdataSection();
+      break;
+    case event::END_CDATA_SECTION:
+      d.onEndCdataSection();
+      break;
+    case event::START_NAMESPACE: {
+      const char* prefix = in.string();
+      d.onStartNamespace(prefix, in.string());
+      break;
+    }
+    case event::END_NAMESPACE:
+      d.onEndNamespace(in.string());
+      break;
+    case event::XML_DECL: {
+      const char* version = in.string();
+      const char* encoding = in.string();
+      d.onXmlDecl(version, encoding, static_cast<int>(in.u32()));
+      break;
+    }
+    case event::START_DOCTYPE_DECL: {
+      const char* name = in.string();
+      const char* sysid = in.string();
+      const char* pubid = in.string();
+      d.onStartDoctypeDecl(name, sysid, pubid, static_cast<int>(in.u32()));
+      break;
+    }
+    case event::END_DOCTYPE_DECL:
+      d.onEndDoctypeDecl();
+      break;
+    case event::ELEMENT_DECL: {
+      const char* name = in.string();
+      model_.resize(in.u32());
+      size_t next = 1;
+      decode_node(in, model_, 0, next);
+      d.onElementDecl(name, model_.data());
+      break;
+    }
+    case event::ATTLIST_DECL: {
+      const char* elname = in.string();
+      const char* attname = in.string();
+      const char* att_type = in.string();
+      const char* dflt = in.string();
+      d.onAttlistDecl(elname, attname, att_type, dflt, in.u32()!=0);
+      break;
+    }
+    case event::ENTITY_DECL: {
+      const char* name = in.string();
+      const int is_parameter_entity = static_cast<int>(in.u32());
+      uint32_t value_length;
+      const char* value = in.string(&value_length);
+      const char* base = in.string();
+      const char* system_id = in.string();
+      const char* public_id = in.string();
+      d.onEntityDecl(name, is_parameter_entity, value, static_cast<int>(value_length),
+                     base, system_id, public_id, in.string());
+      break;
+    }
+    case event::NOTATION_DECL: {
+      const char* name = in.string();
+      const char* base = in.string();
+      const char* system_id = in.string();
+      d.onNotationDecl(name, base, system_id, in.string());
+      break;
+    }
+    case event::UNPARSED_ENTITY_DECL: {
+      const char* name = in.string();
+      const char* base = in.string();
+      const char* system_id = in.string();
+      const char* public_id = in.string();
+      d.onUnparsedEntityDecl(name, base, system_id, public_id, in.string());
+      break;
+    }
+    case event::SKIPPED_ENTITY: {
+      const char* name = in.string();
+      d.onSkippedEntity(name, static_cast<int>(in.u32()));
+      break;
+    }
+    case event::PARSE_ERROR: {
+      const uint64_t line = in.u64();
+      const uint64_t column = in.u64();
+      const uint64_t pos = in.u64();
+      d.onParseError(line, column, pos, Error(static_cast<XML_Error>(in.u32())));
+      break;
+    }
+    case event::END_DOCUMENT:
+      d.onEndDocument(in.u64());
+      break;
+    }
+  }
+}
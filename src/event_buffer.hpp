@@ -0,0 +1,155 @@
+/**
+ * \file event_buffer.hpp contains a compact binary encoding of the parse
+ * events
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_event_buffer_hpp
+#define xmlpp_event_buffer_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "delegate.hpp"
+
+namespace xmlpp {
+
+/** records the events of the parser as a delegate and replays them to
+ * another delegate, e.g. on another thread.
+ *
+ * each event is a type byte followed by its fields, strings are stored
+ * with a 32 bit length and a terminating zero so the replay passes
+ * pointers into the buffer without copying. The content models of element
+ * declarations are copied, the one passed on replay is owned by the
+ * buffer and must not be freed.
+ */
+class event_buffer : public delegate {
+public:
+  enum class event : uint8_t {
+    START_ELEMENT = 1,
+    END_ELEMENT,
+    CHARACTER_DATA,
+    PROCESSING_INSTRUCTION,
+    COMMENT,
+    START_CDATA_SECTION,
+    END_CDATA_SECTION,
+    START_NAMESPACE,
+    END_NAMESPACE,
+    XML_DECL,
+    START_DOCTYPE_DECL,
+    END_DOCTYPE_DECL,
+    ELEMENT_DECL,
+    ATTLIST_DECL,
+    ENTITY_DECL,
+    NOTATION_DECL,
+    UNPARSED_ENTITY_DECL,
+    SKIPPED_ENTITY,
+    PARSE_ERROR,
+    END_DOCUMENT
+  };
+
+  /** set of events, bit e is the event with value e */
+  typedef uint32_t event_mask;
+  static constexpr event_mask mask(event e) { return 1u << static_cast<unsigned>(e); }
+  static const event_mask ALL_EVENTS = 0xffffffffu;
+
+  event_buffer() = default;
+
+  /** bytes of the encoded events */
+  size_t size() const { return data_.size(); }
+  bool empty() const { return data_.empty(); }
+  /** number of recorded events */
+  size_t events() const { return events_; }
+  void clear();
+  void reserve(size_t bytes) { data_.reserve(bytes); }
+
+  /** calls the delegate for each recorded event in order, with the
+   * scratch of a temporary event_replayer
+   * @param events only the events in the mask are delivered */
+  void replay(delegate& d, event_mask events = ALL_EVENTS) const;
+
+  //@{ recording
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override;
+  void onEndElement(const XML_Char *fullname) override;
+  void onCharacterData(const char * pBuf, int len) override;
+  void onProcessingInstruction(const XML_Char* target,
+                               const XML_Char* data) override;
+  void onUnparsedEntityDecl(const XML_Char* entityName,
+                            const XML_Char* base,
+                            const XML_Char* systemId,
+                            const XML_Char* publicId,
+                            const XML_Char* notationName) override;
+  void onNotationDecl(const XML_Char* notationName,
+                      const XML_Char* base,
+                      const XML_Char* systemId,
+                      const XML_Char* publicId) override;
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override;
+  void onEndNamespace(const XML_Char* prefix) override;
+  void onAttlistDecl(const XML_Char *elname,
+                     const XML_Char *attname,
+                     const XML_Char *att_type,
+                     const XML_Char *dflt,
+                     bool            isrequired) override;
+  void onStartCdataSection() override;
+  void onEndCdataSection() override;
+  void onStartDoctypeDecl(const XML_Char *doctypeName,
+                          const XML_Char *sysid,
+                          const XML_Char *pubid,
+                          int has_internal_subset) override;
+  void onEndDoctypeDecl() override;
+  void onComment(const XML_Char *data) override;
+  void onElementDecl(const XML_Char *name, XML_Content *model) override;
+  void onEntityDecl(const XML_Char *entityName,
+                    int is_parameter_entity,
+                    const XML_Char *value,
+                    int value_length,
+                    const XML_Char *base,
+                    const XML_Char *systemId,
+                    const XML_Char *publicId,
+                    const XML_Char *notationName) override;
+  void onSkippedEntity(const XML_Char *entityName,
+                       int is_parameter_entity) override;
+  void onXmlDecl(const XML_Char *version,
+                 const XML_Char *encoding,
+                 int standalone) override;
+  void onParseError(size_t line, size_t column, size_t pos, Error error) override;
+  void onEndDocument(size_t index) override;
+  //@}
+
+private:
+  void put(event e);
+  void put_u32(uint32_t v);
+  void put_u64(uint64_t v);
+  /** nullptr is stored as length 0xffffffff */
+  void put_string(const char* s);
+  void put_string(const char* s, size_t len);
+  void put_model(const XML_Content* model);
+
+  friend class event_replayer;
+
+  std::vector<char> data_;
+  size_t events_{0};
+};
+
+/** replays event buffers into delegates reusing its scratch memory.
+ *
+ * a buffer is not changed by the replay, several replayers e.g. on
+ * different threads may replay the same buffer at once.
+ */
+class event_replayer {
+public:
+  /** calls the delegate for each event of the buffer in order
+   * @param events only the events in the mask are delivered */
+  void replay(const event_buffer& buffer, delegate& d,
+              event_buffer::event_mask events = event_buffer::ALL_EVENTS);
+
+private:
+  //@{ scratch of replay(), reused
+  std::vector<const XML_Char*> atts_;
+  std::vector<XML_Content> model_;
+  //@}
+};
+
+}
+#endif // #ifndef xmlpp_event_buffer_hpp
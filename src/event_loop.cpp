@@ -0,0 +1,528 @@
+/**
+ * \file event_loop.cpp implementation of the event loop with the epoll and
+ * the io_uring backend
+ *
+ * io_uring is used through the system calls and the kernel header, it
+ * needs IORING_FEAT_EXT_ARG (linux 5.11) for the timeout of the wait.
+ *
+ * See LICENSE for copyright information.
+ */
+#ifdef HAVE_EXPATPP_CONFIG_H
+#include "expatpp_config.h"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unordered_set>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#if defined(HAVE_LINUX_IO_URING_H)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(IORING_FEAT_EXT_ARG) && defined(__NR_io_uring_setup)
+#define XMLPP_IO_URING 1
+#endif
+#endif
+
+#include "event_loop.hpp"
+
+using xmlpp::event_loop;
+using xmlpp::parser;
+
+const int event_loop::DEFAULT_READ_SIZE;
+
+struct event_loop::connection {
+  connection(int f, delegate& d, close_handler h)
+  : fd(f), p(d), on_close(std::move(h))
+  {}
+
+  int fd;
+  parser p;
+  close_handler on_close;
+  /** read buffer in multi document mode, where parse() copies anyway */
+  std::vector<char> buffer;
+  bool own_buffer{false};
+  bool closed{false};
+  /** the delegate suspended the parser, no reads until resume() */
+  bool suspended{false};
+  /** the input ended while suspended */
+  bool eof{false};
+  /** io_uring: an operation of the kernel refers to the connection */
+  bool in_flight{false};
+};
+
+class event_loop::poller {
+public:
+  explicit poller(event_loop& loop) : loop_(loop) {}
+  virtual ~poller() = default;
+  virtual backend kind() const = 0;
+  virtual bool add(connection& c) = 0;
+  virtual void remove(connection& c) = 0;
+  /** stops and restarts the reads of a suspended connection */
+  virtual void pause(connection& c) = 0;
+  virtual void rearm(connection& c) = 0;
+  /** @return handled events or -1 */
+  virtual int wait(int timeout_ms) = 0;
+protected:
+  event_loop& loop_;
+};
+
+/** level triggered epoll, one read per readiness keeps the connections
+ * fair */
+class event_loop::epoll_poller : public poller {
+public:
+  explicit epoll_poller(event_loop& loop)
+  : poller(loop), fd_(epoll_create1(EPOLL_CLOEXEC))
+  {}
+  ~epoll_poller() override { if (fd_ >= 0) ::close(fd_); }
+
+  backend kind() const override { return backend::EPOLL; }
+
+  bool add(connection& c) override
+  {
+    epoll_event e;
+    memset(&e, 0, sizeof(e));
+    e.events = EPOLLIN;
+    e.data.ptr = &c;
+    return fd_ >= 0 && epoll_ctl(fd_, EPOLL_CTL_ADD, c.fd, &e)==0;
+  }
+
+  void remove(connection& c) override
+  {
+    epoll_ctl(fd_, EPOLL_CTL_DEL, c.fd, nullptr);
+  }
+
+  /** hang ups are reported without EPOLLIN too, the descriptor leaves
+   * the set while suspended */
+  void pause(connection& c) override { remove(c); }
+  void rearm(connection& c) override { add(c); }
+
+  int wait(int timeout_ms) override
+  {
+    epoll_event events[MAX_EVENTS];
+    const int n = epoll_wait(fd_, events, MAX_EVENTS, timeout_ms);
+    if (n < 0) return errno==EINTR ? 0 : -1;
+    for (int i = 0; i < n; ++i) {
+      connection& c = *static_cast<connection*>(events[i].data.ptr);
+      // removed by an earlier event of this batch
+      if (c.closed) continue;
+      char* buffer = loop_.lease(c);
+      if (buffer==nullptr) {
+        loop_.deliver(c, -ENOMEM);
+        continue;
+      }
+      const ssize_t r = ::read(c.fd, buffer, static_cast<size_t>(loop_.read_size_));
+      if (r < 0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)) continue;
+      loop_.deliver(c, r < 0 ? -errno : static_cast<long>(r));
+    }
+    return n;
+  }
+private:
+  static const int MAX_EVENTS = 256;
+  int fd_;
+};
+
+#ifdef XMLPP_IO_URING
+/** io_uring with a read in flight for each connection, the kernel reads
+ * into the leased buffer as soon as data arrives. Reads answered with
+ * EAGAIN wait for POLLIN first. */
+class event_loop::uring_poller : public poller {
+public:
+  explicit uring_poller(event_loop& loop) : poller(loop) { setup(ENTRIES); }
+  ~uring_poller() override { release(); }
+
+  bool ok() const { return fd_ >= 0; }
+  backend kind() const override { return backend::IO_URING; }
+
+  /** the first read is submitted by the next wait, the parser may still
+   * be configured after event_loop::add() */
+  bool add(connection& c) override
+  {
+    starting_.push_back(&c);
+    return true;
+  }
+
+  void remove(connection& c) override
+  {
+    starting_.erase(std::remove(starting_.begin(), starting_.end(), &c), starting_.end());
+    if (!c.in_flight) return;
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = tag(c, pending_op(c));
+    sqe->user_data = CANCEL;
+  }
+
+  /** the completion of the suspending read submits no further read */
+  void pause(connection&) override {}
+  void rearm(connection& c) override { starting_.push_back(&c); }
+
+  int wait(int timeout_ms) override
+  {
+    std::vector<connection*> starting;
+    starting.swap(starting_);
+    for (connection* c : starting) {
+      if (!submit_read(*c)) loop_.deliver(*c, -ENOMEM);
+    }
+
+    unsigned flags = 0;
+    unsigned min_complete = 0;
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms!=0 && ready()==0) {
+      flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+      min_complete = 1;
+      if (timeout_ms > 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+      }
+    }
+    if (enter(min_complete, flags, &arg) < 0
+        && errno!=ETIME && errno!=EINTR && errno!=EBUSY) {
+      return -1;
+    }
+
+    int handled = 0;
+    unsigned head = *cq_head_;
+    while (head!=__atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+      const uint64_t user_data = cqe.user_data;
+      const int res = cqe.res;
+      __atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+      complete(user_data, res);
+      ++handled;
+    }
+    return handled;
+  }
+
+  /** waits for the operations of removed connections */
+  void drain()
+  {
+    for (int i = 0; i < 100 && std::any_of(loop_.retired_.begin(), loop_.retired_.end(),
+                                           [](const std::unique_ptr<connection>& c) { return c->in_flight; }); ++i) {
+      wait(10);
+    }
+  }
+private:
+  enum : uint64_t { READ = 0, POLL = 1, TAG_MASK = 3, CANCEL = 0 };
+  static const unsigned ENTRIES = 1024;
+
+  static uint64_t tag(connection& c, uint64_t op)
+  {
+    return reinterpret_cast<uint64_t>(&c) | op;
+  }
+  uint64_t pending_op(connection& c) const
+  {
+    return polling_.count(&c) ? POLL : READ;
+  }
+
+  bool submit_read(connection& c)
+  {
+    char* buffer = loop_.lease(c);
+    if (buffer==nullptr) return false;
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = c.fd;
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<unsigned>(loop_.read_size_);
+    sqe->user_data = tag(c, READ);
+    c.in_flight = true;
+    return true;
+  }
+
+  void submit_poll(connection& c)
+  {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = c.fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = tag(c, POLL);
+    c.in_flight = true;
+    polling_.insert(&c);
+  }
+
+  void complete(uint64_t user_data, int res)
+  {
+    if (user_data==CANCEL) return;
+    connection& c = *reinterpret_cast<connection*>(user_data & ~static_cast<uint64_t>(TAG_MASK));
+    c.in_flight = false;
+    if ((user_data & TAG_MASK)==POLL) polling_.erase(&c);
+    // removed, freed by the loop now that the kernel is done with it
+    if (c.closed) return;
+
+    if ((user_data & TAG_MASK)==POLL) {
+      if (res < 0) {
+        loop_.deliver(c, res);
+      } else if (!submit_read(c)) {
+        loop_.deliver(c, -ENOMEM);
+      }
+      return;
+    }
+    if (res==-EAGAIN || res==-EINTR) {
+      submit_poll(c);
+      return;
+    }
+    loop_.deliver(c, res);
+    if (!c.closed && !c.suspended && !submit_read(c)) loop_.deliver(c, -ENOMEM);
+  }
+
+  unsigned ready() const
+  {
+    return __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - *cq_head_;
+  }
+
+  int enter(unsigned min_complete, unsigned flags, io_uring_getevents_arg* arg)
+  {
+    const unsigned to_submit = *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    const bool ext = (flags & IORING_ENTER_EXT_ARG)!=0;
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd_, to_submit, min_complete,
+                                    flags, ext ? arg : nullptr, ext ? sizeof(*arg) : 0));
+  }
+
+  io_uring_sqe* next_sqe()
+  {
+    unsigned tail = *sq_tail_;
+    while (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+      io_uring_getevents_arg arg;
+      memset(&arg, 0, sizeof(arg));
+      if (enter(0, 0, &arg) < 0 && errno!=EINTR && errno!=EBUSY) break;
+    }
+    const unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+  }
+
+  void setup(unsigned entries)
+  {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd_ < 0) return;
+    if ((p.features & IORING_FEAT_EXT_ARG)==0) {
+      release();
+      return;
+    }
+    sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single = (p.features & IORING_FEAT_SINGLE_MMAP)!=0;
+    if (single) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    sq_ring_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd_, IORING_OFF_SQ_RING);
+    cq_ring_ = single ? sq_ring_
+                      : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd_, IORING_OFF_SQES);
+    if (sq_ring_==MAP_FAILED || cq_ring_==MAP_FAILED || sqes==MAP_FAILED) {
+      if (sqes!=MAP_FAILED) munmap(sqes, sqes_size_);
+      release();
+      return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_entries_ = p.sq_entries;
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+  }
+
+  void release()
+  {
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (cq_ring_!=MAP_FAILED && cq_ring_!=sq_ring_) munmap(cq_ring_, cq_size_);
+    if (sq_ring_!=MAP_FAILED) munmap(sq_ring_, sq_size_);
+    sqes_ = nullptr;
+    sq_ring_ = cq_ring_ = MAP_FAILED;
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+  }
+
+  int fd_{-1};
+  void* sq_ring_{MAP_FAILED};
+  void* cq_ring_{MAP_FAILED};
+  size_t sq_size_{0};
+  size_t cq_size_{0};
+  size_t sqes_size_{0};
+  io_uring_sqe* sqes_{nullptr};
+  unsigned* sq_head_{nullptr};
+  unsigned* sq_tail_{nullptr};
+  unsigned* sq_array_{nullptr};
+  unsigned sq_mask_{0};
+  unsigned sq_entries_{0};
+  unsigned* cq_head_{nullptr};
+  unsigned* cq_tail_{nullptr};
+  unsigned cq_mask_{0};
+  io_uring_cqe* cqes_{nullptr};
+  /** connections waiting for POLLIN instead of a read */
+  std::unordered_set<connection*> polling_;
+  /** added connections without a read yet */
+  std::vector<connection*> starting_;
+};
+#endif
+
+event_loop::event_loop(backend b, int read_size)
+: read_size_(read_size)
+{
+#ifdef XMLPP_IO_URING
+  if (b!=backend::EPOLL) {
+    std::unique_ptr<uring_poller> uring(new uring_poller(*this));
+    if (uring->ok()) poller_ = std::move(uring);
+  }
+#else
+  (void)b;
+#endif
+  if (!poller_) poller_.reset(new epoll_poller(*this));
+}
+
+event_loop::~event_loop()
+{
+  while (!connections_.empty()) remove(connections_.begin()->first);
+#ifdef XMLPP_IO_URING
+  if (poller_->kind()==backend::IO_URING) {
+    static_cast<uring_poller&>(*poller_).drain();
+  }
+#endif
+  collect();
+  // reads the kernel did not give back must not write into freed memory
+  for (std::unique_ptr<connection>& c : retired_) c.release();
+  poller_.reset();
+}
+
+event_loop::backend event_loop::active_backend() const
+{
+  return poller_->kind();
+}
+
+parser* event_loop::add(int fd, delegate& d, close_handler on_close)
+{
+  if (connections_.count(fd)) return nullptr;
+  std::unique_ptr<connection> c(new connection(fd, d, std::move(on_close)));
+  if (!poller_->add(*c)) return nullptr;
+  parser* p = &c->p;
+  connections_[fd] = std::move(c);
+  return p;
+}
+
+void event_loop::remove(int fd)
+{
+  auto it = connections_.find(fd);
+  if (it==connections_.end()) return;
+  std::unique_ptr<connection> c = std::move(it->second);
+  connections_.erase(it);
+  c->closed = true;
+  poller_->remove(*c);
+  retire(std::move(c));
+}
+
+int event_loop::run_once(int timeout_ms)
+{
+  running_ = true;
+  const int n = poller_->wait(timeout_ms);
+  running_ = false;
+  collect();
+  return n;
+}
+
+bool event_loop::resume(int fd)
+{
+  auto it = connections_.find(fd);
+  if (it==connections_.end() || !it->second->suspended) return false;
+  connection& c = *it->second;
+  // keeps the connection alive if the delegate removes it
+  const bool running = running_;
+  running_ = true;
+  c.suspended = false;
+  const parser::status_t status = c.p.resume();
+  handle(c, status, c.eof);
+  if (!c.closed && !c.suspended && !c.eof) poller_->rearm(c);
+  running_ = running;
+  if (!running_) collect();
+  return true;
+}
+
+void event_loop::run()
+{
+  while (!connections_.empty()) {
+    if (run_once(-1) < 0) break;
+  }
+}
+
+char* event_loop::lease(connection& c)
+{
+  c.own_buffer = c.p.multi_document();
+  if (c.own_buffer) {
+    c.buffer.resize(static_cast<size_t>(read_size_));
+    return c.buffer.data();
+  }
+  return static_cast<char*>(c.p.get_buffer(read_size_));
+}
+
+void event_loop::deliver(connection& c, long n)
+{
+  if (n < 0) {
+    errno = static_cast<int>(-n);
+    close(c, close_reason::READ_ERROR);
+    return;
+  }
+  const int len = static_cast<int>(n);
+  const parser::status_t status = c.own_buffer ? c.p.parse(c.buffer.data(), len, len==0)
+                                               : c.p.parse_buffer(len, len==0);
+  handle(c, status, len==0);
+}
+
+void event_loop::handle(connection& c, parser::status_t status, bool eof)
+{
+  // removed by the delegate
+  if (c.closed) return;
+  if (status==parser::status_t::ERROR) {
+    close(c, close_reason::PARSE_ERROR);
+  } else if (status==parser::status_t::SUSPENDED) {
+    c.suspended = true;
+    c.eof = eof;
+    poller_->pause(c);
+  } else if (eof) {
+    close(c, close_reason::END_OF_STREAM);
+  }
+}
+
+void event_loop::close(connection& c, close_reason reason)
+{
+  const int fd = c.fd;
+  auto it = connections_.find(fd);
+  std::unique_ptr<connection> owned = std::move(it->second);
+  connections_.erase(it);
+  c.closed = true;
+  poller_->remove(c);
+  if (c.on_close) c.on_close(fd, reason, c.p);
+  retire(std::move(owned));
+}
+
+void event_loop::retire(std::unique_ptr<connection> c)
+{
+  if (running_ || c->in_flight) retired_.push_back(std::move(c));
+}
+
+void event_loop::collect()
+{
+  retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                [](const std::unique_ptr<connection>& c) { return !c->in_flight; }),
+                 retired_.end());
+}
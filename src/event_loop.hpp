@@ -0,0 +1,119 @@
+/**
+ * \file event_loop.hpp contains an event loop parsing the input of many
+ * non-blocking file descriptors (linux only)
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_event_loop_hpp
+#define xmlpp_event_loop_hpp
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "xmlparser.hpp"
+
+namespace xmlpp {
+
+/** parses the input of non-blocking sockets or pipes with one parser per
+ * file descriptor.
+ *
+ * the loop reads directly into buffers leased from expat
+ * (parser::get_buffer) and parses them in place. It waits with io_uring
+ * where the kernel supports it, io_uring reads into the leased buffer
+ * without a readiness notification first, and with epoll otherwise. In
+ * the multi document mode of the parser the loop reads into a buffer of
+ * the connection and calls parser::parse(), which copies.
+ *
+ * at the end of the input or on errors the connection is removed and the
+ * close handler is called, the file descriptor is never closed by the
+ * loop. Delegates may call remove() for their own connection while
+ * parsing.
+ *
+ * a delegate falling behind calls parser::suspend(), the loop stops
+ * reading from the connection, so the sender is slowed down by the socket
+ * buffers, until resume() is called for it.
+ *
+ * \code
+ * event_loop loop;
+ * loop.add(fd, my_delegate, [](int fd, event_loop::close_reason, parser&) { close(fd); });
+ * loop.run();
+ * \endcode
+ *
+ * with backend::IO_URING the loop falls back to epoll if the kernel or
+ * the headers lack io_uring, see active_backend().
+ */
+class event_loop {
+public:
+  enum class backend {
+    AUTO,       //< io_uring if available, epoll otherwise
+    EPOLL,
+    IO_URING
+  };
+  enum class close_reason {
+    END_OF_STREAM,  //< the input ended and the document was complete
+    PARSE_ERROR,    //< see parser::errorcode()
+    READ_ERROR      //< see errno
+  };
+  typedef std::function<void (int fd, close_reason reason, parser& p)> close_handler;
+
+  static const int DEFAULT_READ_SIZE = 4096;
+
+  /** @param read_size bytes read per call, each parser keeps a buffer of
+   * this size */
+  explicit event_loop(backend b = backend::AUTO, int read_size = DEFAULT_READ_SIZE);
+  event_loop(const event_loop&) = delete;
+  event_loop& operator=(const event_loop&) = delete;
+  ~event_loop();
+
+  /** @return the backend in use, never AUTO */
+  backend active_backend() const;
+
+  /** registers a non-blocking file descriptor
+   * @return the parser of the connection, e.g. to enable the multi
+   * document mode, or nullptr if the descriptor can not be polled */
+  parser* add(int fd, delegate& d, close_handler on_close = nullptr);
+  /** unregisters the file descriptor without calling the close handler */
+  void remove(int fd);
+
+  /** resumes the parser of a connection suspended by its delegate and
+   * reads again afterwards
+   * @return false if fd is not a suspended connection */
+  bool resume(int fd);
+
+  /** waits up to timeout_ms milliseconds (-1 without limit) for input and
+   * parses it
+   * @return number of handled events, -1 on errors of the wait */
+  int run_once(int timeout_ms);
+  /** runs until all connections are removed */
+  void run();
+
+  size_t connections() const { return connections_.size(); }
+private:
+  struct connection;
+  class poller;
+  class epoll_poller;
+  class uring_poller;
+
+  /** handles n bytes read into the buffer of c, 0 at the end of the input
+   * and -errno on errors */
+  void deliver(connection& c, long n);
+  /** closes or pauses c after parsing */
+  void handle(connection& c, parser::status_t status, bool eof);
+  /** @return buffer of c to read read_size_ bytes into */
+  char* lease(connection& c);
+  void close(connection& c, close_reason reason);
+  void retire(std::unique_ptr<connection> c);
+  void collect();
+
+  int read_size_;
+  std::unique_ptr<poller> poller_;
+  std::unordered_map<int, std::unique_ptr<connection>> connections_;
+  /** removed connections still referenced by the loop or the kernel */
+  std::vector<std::unique_ptr<connection>> retired_;
+  bool running_{false};
+};
+
+}
+#endif // #ifndef xmlpp_event_loop_hpp
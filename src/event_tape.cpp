@@ -0,0 +1,712 @@
+/**
+ * \file event_tape.cpp implementation of the event tape
+ *
+ * See LICENSE for copyright information.
+ */
+#include <cstdio>
+#include <cstring>
+
+#include "event_tape.hpp"
+
+using std::string;
+using xmlpp::event_tape;
+using xmlpp::string_ref;
+using xmlpp::tape_recorder;
+using xmlpp::tape_replayer;
+
+namespace {
+
+const char TAPE_MAGIC[4] = { 'X', 'P', 'P', 'T' };
+const unsigned char TAPE_VERSION = 1;
+const unsigned char FLAG_POSITIONS = 1;
+
+/** file header, followed by the zero terminated names and the events */
+struct tape_header {
+  char magic[4];
+  unsigned char version;
+  unsigned char flags;
+  unsigned char reserved[2];
+  uint64_t events;
+  uint64_t names;
+  uint64_t names_size;  //< bytes of the names
+  uint64_t size;        //< bytes of the events
+};
+
+enum event : uint8_t {
+  START_ELEMENT = 1,
+  END_ELEMENT,
+  CHARACTER_DATA,
+  PROCESSING_INSTRUCTION,
+  COMMENT,
+  START_CDATA_SECTION,
+  END_CDATA_SECTION,
+  START_NAMESPACE,
+  END_NAMESPACE,
+  XML_DECL,
+  START_DOCTYPE_DECL,
+  END_DOCTYPE_DECL,
+  ELEMENT_DECL,
+  ATTLIST_DECL,
+  ENTITY_DECL,
+  NOTATION_DECL,
+  UNPARSED_ENTITY_DECL,
+  SKIPPED_ENTITY,
+  PARSE_ERROR,
+  END_DOCUMENT
+};
+
+uint64_t zigzag(int64_t v)
+{
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v)
+{
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+size_t count_nodes(const XML_Content* model)
+{
+  size_t n = 1;
+  for (unsigned i = 0; i < model->numchildren; ++i) n += count_nodes(&model->children[i]);
+  return n;
+}
+
+/** bounds checked reader of the events, reads past the end or into
+ * invalid strings clear ok */
+class decoder {
+public:
+  decoder(const char* begin, const char* end, const event_tape& tape)
+  : p_(reinterpret_cast<const unsigned char*>(begin)),
+    end_(reinterpret_cast<const unsigned char*>(end)),
+    tape_(tape)
+  {}
+
+  bool ok{true};
+  bool at_end() const { return p_==end_; }
+
+  uint8_t byte()
+  {
+    if (p_==end_) return fail();
+    return *p_++;
+  }
+  uint64_t varint()
+  {
+    uint64_t v = 0;
+    for (unsigned shift = 0; shift < 64 && p_!=end_; shift += 7) {
+      const unsigned char b = *p_++;
+      v |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if (!(b & 0x80)) return v;
+    }
+    return fail();
+  }
+  uint32_t u32()
+  {
+    const uint64_t v = varint();
+    if (v > 0xffffffffu) return fail();
+    return static_cast<uint32_t>(v);
+  }
+  const char* name()
+  {
+    const uint64_t id = varint();
+    if (id >= tape_.names()) {
+      fail();
+      return "";
+    }
+    return tape_.name(static_cast<uint32_t>(id));
+  }
+  const char* string() { return string(nullptr); }
+  /** @return nullptr for stored null strings */
+  const char* string(uint32_t* len)
+  {
+    const uint64_t n = varint();
+    if (len) *len = 0;
+    if (n==0) return nullptr;
+    if (n - 1 >= static_cast<uint64_t>(end_ - p_) || p_[n-1]!='\0') {
+      fail();
+      return "";
+    }
+    const char* s = reinterpret_cast<const char*>(p_);
+    if (len) *len = static_cast<uint32_t>(n - 1);
+    p_ += n;
+    return s;
+  }
+private:
+  uint8_t fail()
+  {
+    ok = false;
+    p_ = end_;
+    return 0;
+  }
+
+  const unsigned char* p_;
+  const unsigned char* end_;
+  const event_tape& tape_;
+};
+
+/** restores the node into model[slot], the children of a node are
+ * allocated as one block after next */
+void decode_node(decoder& in, std::vector<XML_Content>& model, size_t slot, size_t& next)
+{
+  XML_Content& c = model[slot];
+  c.type = static_cast<XML_Content_Type>(in.u32());
+  c.quant = static_cast<XML_Content_Quant>(in.u32());
+  c.name = const_cast<XML_Char*>(in.string());
+  c.numchildren = in.u32();
+  c.children = nullptr;
+  if (c.numchildren==0) return;
+  if (c.numchildren > model.size() - next) {
+    in.ok = false;
+    c.numchildren = 0;
+    return;
+  }
+  const size_t block = next;
+  next += c.numchildren;
+  c.children = &model[block];
+  for (unsigned i = 0; i < c.numchildren && in.ok; ++i) decode_node(in, model, block + i, next);
+}
+
+}
+
+void event_tape::clear()
+{
+  data_.clear();
+  events_ = 0;
+  positions_ = false;
+  names_.clear();
+  names_arena_.clear();
+  ids_.clear();
+  file_.close();
+  mapped_ = false;
+  mapped_data_ = nullptr;
+  mapped_size_ = 0;
+}
+
+void event_tape::make_writable()
+{
+  if (!mapped_) return;
+  data_.assign(mapped_data_, mapped_data_ + mapped_size_);
+  std::vector<const char*> mapped_names;
+  mapped_names.swap(names_);
+  for (const char* n : mapped_names) intern(n);
+  file_.close();
+  mapped_ = false;
+  mapped_data_ = nullptr;
+  mapped_size_ = 0;
+}
+
+uint32_t event_tape::intern(const XML_Char* s)
+{
+  const string_ref key(s, strlen(s));
+  auto it = ids_.find(key);
+  if (it!=ids_.end()) return it->second;
+  const string_ref stored = names_arena_.store(s, key.size + 1);
+  const uint32_t id = static_cast<uint32_t>(names_.size());
+  names_.push_back(stored.data);
+  ids_.emplace(string_ref(stored.data, key.size), id);
+  return id;
+}
+
+bool event_tape::save(const string& filename) const
+{
+  tape_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, TAPE_MAGIC, sizeof(TAPE_MAGIC));
+  h.version = TAPE_VERSION;
+  h.flags = positions_ ? FLAG_POSITIONS : 0;
+  h.events = events_;
+  h.names = names_.size();
+  for (const char* n : names_) h.names_size += strlen(n) + 1;
+  h.size = size();
+
+  FILE* f = fopen(filename.c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(&h, sizeof(h), 1, f)==1;
+  for (const char* n : names_) {
+    if (!ok) break;
+    ok = fwrite(n, strlen(n) + 1, 1, f)==1;
+  }
+  if (ok && size() > 0) ok = fwrite(data(), size(), 1, f)==1;
+  return fclose(f)==0 && ok;
+}
+
+bool event_tape::load(const string& filename)
+{
+  clear();
+  tape_header h;
+  if (!file_.open(filename) || file_.size() < sizeof(h)) {
+    clear();
+    return false;
+  }
+  memcpy(&h, file_.data(), sizeof(h));
+  const uint64_t available = file_.size() - sizeof(h);
+  if (memcmp(h.magic, TAPE_MAGIC, sizeof(TAPE_MAGIC))!=0 || h.version!=TAPE_VERSION
+      || h.names_size > available || h.size!=available - h.names_size
+      || h.names > h.names_size) {
+    clear();
+    return false;
+  }
+  // the names are used in place, the name table points into the mapping
+  const char* p = file_.data() + sizeof(h);
+  const char* end = p + h.names_size;
+  names_.reserve(static_cast<size_t>(h.names));
+  while (p < end) {
+    const char* zero = static_cast<const char*>(memchr(p, '\0', static_cast<size_t>(end - p)));
+    if (!zero) break;
+    names_.push_back(p);
+    p = zero + 1;
+  }
+  if (p!=end || names_.size()!=h.names) {
+    clear();
+    return false;
+  }
+  positions_ = (h.flags & FLAG_POSITIONS)!=0;
+  events_ = static_cast<size_t>(h.events);
+  mapped_ = true;
+  mapped_data_ = end;
+  mapped_size_ = static_cast<size_t>(h.size);
+  return true;
+}
+
+bool event_tape::replay(delegate& d) const
+{
+  tape_replayer r(*this);
+  return r.replay(d);
+}
+
+tape_recorder::tape_recorder(event_tape& tape, delegate* next)
+: forwarding_delegate(next), tape_(tape)
+{
+  tape_.make_writable();
+}
+
+void tape_recorder::attach(const parser& p)
+{
+  parser_ = &p;
+  if (tape_.events_==0) tape_.positions_ = true;
+}
+
+void tape_recorder::put(uint8_t e)
+{
+  tape_.data_.push_back(static_cast<char>(e));
+  ++tape_.events_;
+  if (!tape_.positions_) return;
+  // the byte index and the line as differences to the last event, they
+  // restart with each document of a stream
+  uint64_t byte_index = 0;
+  uint64_t line = 0;
+  uint64_t column = 0;
+  if (parser_) {
+    byte_index = parser_->current_byte_index();
+    line = parser_->current_line_number();
+    column = parser_->current_column_number();
+  }
+  put_varint(zigzag(static_cast<int64_t>(byte_index - byte_index_)));
+  put_varint(zigzag(static_cast<int64_t>(line - line_)));
+  put_varint(column);
+  byte_index_ = byte_index;
+  line_ = line;
+}
+
+void tape_recorder::put_varint(uint64_t v)
+{
+  std::vector<char>& out = tape_.data_;
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+void tape_recorder::put_string(const char* s)
+{
+  if (s==nullptr) {
+    put_varint(0);
+  } else {
+    put_string(s, strlen(s));
+  }
+}
+
+void tape_recorder::put_string(const char* s, size_t len)
+{
+  put_varint(len + 1);
+  std::vector<char>& out = tape_.data_;
+  const size_t at = out.size();
+  out.resize(at + len + 1);
+  if (len) memcpy(&out[at], s, len);
+  out[at + len] = '\0';
+}
+
+void tape_recorder::put_model(const XML_Content* model)
+{
+  put_varint(static_cast<uint32_t>(model->type));
+  put_varint(static_cast<uint32_t>(model->quant));
+  put_string(model->name);
+  put_varint(model->numchildren);
+  for (unsigned i = 0; i < model->numchildren; ++i) put_model(&model->children[i]);
+}
+
+void tape_recorder::onStartElement(const XML_Char *fullname, const XML_Char **atts)
+{
+  put(START_ELEMENT);
+  put_varint(tape_.intern(fullname));
+  uint32_t count = 0;
+  for (const XML_Char** a = atts; *a; a += 2) ++count;
+  put_varint(count);
+  for (const XML_Char** a = atts; *a; a += 2) {
+    put_varint(tape_.intern(a[0]));
+    put_string(a[1]);
+  }
+  forwarding_delegate::onStartElement(fullname, atts);
+}
+
+void tape_recorder::onEndElement(const XML_Char *fullname)
+{
+  put(END_ELEMENT);
+  put_varint(tape_.intern(fullname));
+  forwarding_delegate::onEndElement(fullname);
+}
+
+void tape_recorder::onCharacterData(const char * pBuf, int len)
+{
+  put(CHARACTER_DATA);
+  put_string(pBuf, static_cast<size_t>(len));
+  forwarding_delegate::onCharacterData(pBuf, len);
+}
+
+void tape_recorder::onProcessingInstruction(const XML_Char* target, const XML_Char* data)
+{
+  put(PROCESSING_INSTRUCTION);
+  put_string(target);
+  put_string(data);
+  forwarding_delegate::onProcessingInstruction(target, data);
+}
+
+void tape_recorder::onUnparsedEntityDecl(const XML_Char* entityName,
+                                         const XML_Char* base,
+                                         const XML_Char* systemId,
+                                         const XML_Char* publicId,
+                                         const XML_Char* notationName)
+{
+  put(UNPARSED_ENTITY_DECL);
+  put_string(entityName);
+  put_string(base);
+  put_string(systemId);
+  put_string(publicId);
+  put_string(notationName);
+  forwarding_delegate::onUnparsedEntityDecl(entityName, base, systemId, publicId, notationName);
+}
+
+void tape_recorder::onNotationDecl(const XML_Char* notationName,
+                                   const XML_Char* base,
+                                   const XML_Char* systemId,
+                                   const XML_Char* publicId)
+{
+  put(NOTATION_DECL);
+  put_string(notationName);
+  put_string(base);
+  put_string(systemId);
+  put_string(publicId);
+  forwarding_delegate::onNotationDecl(notationName, base, systemId, publicId);
+}
+
+void tape_recorder::onStartNamespace(const XML_Char* prefix, const XML_Char* uri)
+{
+  put(START_NAMESPACE);
+  put_string(prefix);
+  put_string(uri);
+  forwarding_delegate::onStartNamespace(prefix, uri);
+}
+
+void tape_recorder::onEndNamespace(const XML_Char* prefix)
+{
+  put(END_NAMESPACE);
+  put_string(prefix);
+  forwarding_delegate::onEndNamespace(prefix);
+}
+
+void tape_recorder::onAttlistDecl(const XML_Char *elname,
+                                  const XML_Char *attname,
+                                  const XML_Char *att_type,
+                                  const XML_Char *dflt,
+                                  bool            isrequired)
+{
+  put(ATTLIST_DECL);
+  put_string(elname);
+  put_string(attname);
+  put_string(att_type);
+  put_string(dflt);
+  put_varint(isrequired ? 1 : 0);
+  forwarding_delegate::onAttlistDecl(elname, attname, att_type, dflt, isrequired);
+}
+
+void tape_recorder::onStartCdataSection()
+{
+  put(START_CDATA_SECTION);
+  forwarding_delegate::onStartCdataSection();
+}
+
+void tape_recorder::onEndCdataSection()
+{
+  put(END_CDATA_SECTION);
+  forwarding_delegate::onEndCdataSection();
+}
+
+void tape_recorder::onStartDoctypeDecl(const XML_Char *doctypeName,
+                                       const XML_Char *sysid,
+                                       const XML_Char *pubid,
+                                       int has_internal_subset)
+{
+  put(START_DOCTYPE_DECL);
+  put_string(doctypeName);
+  put_string(sysid);
+  put_string(pubid);
+  put_varint(static_cast<uint32_t>(has_internal_subset));
+  forwarding_delegate::onStartDoctypeDecl(doctypeName, sysid, pubid, has_internal_subset);
+}
+
+void tape_recorder::onEndDoctypeDecl()
+{
+  put(END_DOCTYPE_DECL);
+  forwarding_delegate::onEndDoctypeDecl();
+}
+
+void tape_recorder::onComment(const XML_Char *data)
+{
+  put(COMMENT);
+  put_string(data);
+  forwarding_delegate::onComment(data);
+}
+
+void tape_recorder::onElementDecl(const XML_Char *name, XML_Content *model)
+{
+  put(ELEMENT_DECL);
+  put_string(name);
+  put_varint(count_nodes(model));
+  put_model(model);
+  forwarding_delegate::onElementDecl(name, model);
+}
+
+void tape_recorder::onEntityDecl(const XML_Char *entityName,
+                                 int is_parameter_entity,
+                                 const XML_Char *value,
+                                 int value_length,
+                                 const XML_Char *base,
+                                 const XML_Char *systemId,
+                                 const XML_Char *publicId,
+                                 const XML_Char *notationName)
+{
+  put(ENTITY_DECL);
+  put_string(entityName);
+  put_varint(static_cast<uint32_t>(is_parameter_entity));
+  if (value==nullptr) {
+    put_string(nullptr);
+  } else {
+    put_string(value, static_cast<size_t>(value_length));
+  }
+  put_string(base);
+  put_string(systemId);
+  put_string(publicId);
+  put_string(notationName);
+  forwarding_delegate::onEntityDecl(entityName, is_parameter_entity, value, value_length,
+                                    base, systemId, publicId, notationName);
+}
+
+void tape_recorder::onSkippedEntity(const XML_Char *entityName, int is_parameter_entity)
+{
+  put(SKIPPED_ENTITY);
+  put_string(entityName);
+  put_varint(static_cast<uint32_t>(is_parameter_entity));
+  forwarding_delegate::onSkippedEntity(entityName, is_parameter_entity);
+}
+
+void tape_recorder::onXmlDecl(const XML_Char *version, const XML_Char *encoding, int standalone)
+{
+  put(XML_DECL);
+  put_string(version);
+  put_string(encoding);
+  put_varint(zigzag(standalone));
+  forwarding_delegate::onXmlDecl(version, encoding, standalone);
+}
+
+void tape_recorder::onParseError(size_t line, size_t column, size_t pos, Error error)
+{
+  put(PARSE_ERROR);
+  put_varint(line);
+  put_varint(column);
+  put_varint(pos);
+  put_varint(static_cast<uint32_t>(error.errorcode()));
+  forwarding_delegate::onParseError(line, column, pos, error);
+}
+
+void tape_recorder::onEndDocument(size_t index)
+{
+  put(END_DOCUMENT);
+  put_varint(index);
+  forwarding_delegate::onEndDocument(index);
+}
+
+bool tape_replayer::replay(delegate& d)
+{
+  const char* begin = tape_.data();
+  decoder in(begin, begin + tape_.size(), tape_);
+  const bool positions = tape_.has_positions();
+  line_ = column_ = byte_index_ = 0;
+  while (in.ok && !in.at_end()) {
+    const uint8_t e = in.byte();
+    if (positions) {
+      byte_index_ += static_cast<size_t>(unzigzag(in.varint()));
+      line_ += static_cast<size_t>(unzigzag(in.varint()));
+      column_ = static_cast<size_t>(in.varint());
+    }
+    if (!in.ok) break;
+    switch (e) {
+    case START_ELEMENT: {
+      const char* name = in.name();
+      const uint32_t count = in.u32();
+      atts_.clear();
+      for (uint32_t i = 0; i < count && in.ok; ++i) {
+        atts_.push_back(in.name());
+        const char* value = in.string();
+        atts_.push_back(value ? value : "");
+      }
+      atts_.push_back(nullptr);
+      if (in.ok) d.onStartElement(name, atts_.data());
+      break;
+    }
+    case END_ELEMENT: {
+      const char* name = in.name();
+      if (in.ok) d.onEndElement(name);
+      break;
+    }
+    case CHARACTER_DATA: {
+      uint32_t len;
+      const char* s = in.string(&len);
+      if (in.ok && s) d.onCharacterData(s, static_cast<int>(len));
+      break;
+    }
+    case PROCESSING_INSTRUCTION: {
+      const char* target = in.string();
+      const char* data = in.string();
+      if (in.ok) d.onProcessingInstruction(target, data);
+      break;
+    }
+    case COMMENT: {
+      const char* data = in.string();
+      if (in.ok) d.onComment(data);
+      break;
+    }
+    case START_CDATA_SECTION:
+      d.onStartCdataSection();
+      break;
+    case END_CDATA_SECTION:
+      d.onEndCdataSection();
+      break;
+    case START_NAMESPACE: {
+      const char* prefix = in.string();
+      const char* uri = in.string();
+      if (in.ok) d.onStartNamespace(prefix, uri);
+      break;
+    }
+    case END_NAMESPACE: {
+      const char* prefix = in.string();
+      if (in.ok) d.onEndNamespace(prefix);
+      break;
+    }
+    case XML_DECL: {
+      const char* version = in.string();
+      const char* encoding = in.string();
+      const int standalone = static_cast<int>(unzigzag(in.varint()));
+      if (in.ok) d.onXmlDecl(version, encoding, standalone);
+      break;
+    }
+    case START_DOCTYPE_DECL: {
+      const char* name = in.string();
+      const char* sysid = in.string();
+      const char* pubid = in.string();
+      const int has_internal_subset = static_cast<int>(in.u32());
+      if (in.ok) d.onStartDoctypeDecl(name, sysid, pubid, has_internal_subset);
+      break;
+    }
+    case END_DOCTYPE_DECL:
+      d.onEndDoctypeDecl();
+      break;
+    case ELEMENT_DECL: {
+      const char* name = in.string();
+      const uint32_t nodes = in.u32();
+      if (!in.ok || nodes==0 || nodes > tape_.size()) {
+        in.ok = false;
+        break;
+      }
+      model_.resize(nodes);
+      size_t next = 1;
+      decode_node(in, model_, 0, next);
+      if (in.ok) d.onElementDecl(name, model_.data());
+      break;
+    }
+    case ATTLIST_DECL: {
+      const char* elname = in.string();
+      const char* attname = in.string();
+      const char* att_type = in.string();
+      const char* dflt = in.string();
+      const bool isrequired = in.u32()!=0;
+      if (in.ok) d.onAttlistDecl(elname, attname, att_type, dflt, isrequired);
+      break;
+    }
+    case ENTITY_DECL: {
+      const char* name = in.string();
+      const int is_parameter_entity = static_cast<int>(in.u32());
+      uint32_t value_length;
+      const char* value = in.string(&value_length);
+      const char* base = in.string();
+      const char* system_id = in.string();
+      const char* public_id = in.string();
+      const char* notation = in.string();
+      if (in.ok) {
+        d.onEntityDecl(name, is_parameter_entity, value, static_cast<int>(value_length),
+                       base, system_id, public_id, notation);
+      }
+      break;
+    }
+    case NOTATION_DECL: {
+      const char* name = in.string();
+      const char* base = in.string();
+      const char* system_id = in.string();
+      const char* public_id = in.string();
+      if (in.ok) d.onNotationDecl(name, base, system_id, public_id);
+      break;
+    }
+    case UNPARSED_ENTITY_DECL: {
+      const char* name = in.string();
+      const char* base = in.string();
+      const char* system_id = in.string();
+      const char* public_id = in.string();
+      const char* notation = in.string();
+      if (in.ok) d.onUnparsedEntityDecl(name, base, system_id, public_id, notation);
+      break;
+    }
+    case SKIPPED_ENTITY: {
+      const char* name = in.string();
+      const int is_parameter_entity = static_cast<int>(in.u32());
+      if (in.ok) d.onSkippedEntity(name, is_parameter_entity);
+      break;
+    }
+    case PARSE_ERROR: {
+      const uint64_t line = in.varint();
+      const uint64_t column = in.varint();
+      const uint64_t pos = in.varint();
+      const uint32_t code = in.u32();
+      if (in.ok) d.onParseError(line, column, pos, Error(static_cast<XML_Error>(code)));
+      break;
+    }
+    case END_DOCUMENT: {
+      const uint64_t index = in.varint();
+      if (in.ok) d.onEndDocument(static_cast<size_t>(index));
+      break;
+    }
+    default:
+      in.ok = false;
+    }
+  }
+  return in.ok;
+}
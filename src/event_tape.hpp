@@ -0,0 +1,195 @@
+/**
+ * \file event_tape.hpp contains a compact binary tape of the parse events
+ * which is recorded once and replayed many times
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_event_tape_hpp
+#define xmlpp_event_tape_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.hpp"
+#include "mapped_file.hpp"
+#include "xmlparser.hpp"
+
+namespace xmlpp {
+
+/** append-only tape of the events of one or more parses.
+ *
+ * element and attribute names are interned and stored as ids, all other
+ * strings are stored inline with their length and a terminating zero,
+ * integers are varints. Replay passes pointers into the tape without
+ * copying, also when the tape is mapped from a file with load().
+ *
+ * the file format is the in memory format behind a header, it uses the
+ * byte order of the machine that saved it.
+ */
+class event_tape {
+public:
+  event_tape() = default;
+  event_tape(const event_tape&) = delete;
+  event_tape& operator=(const event_tape&) = delete;
+
+  /** number of recorded events */
+  size_t events() const { return events_; }
+  bool empty() const { return events_==0; }
+  /** bytes of the encoded events */
+  size_t size() const { return mapped_ ? mapped_size_ : data_.size(); }
+  /** number of interned names */
+  size_t names() const { return names_.size(); }
+  const char* name(uint32_t id) const { return names_[id]; }
+  /** the events carry the line, column and byte index of the parser */
+  bool has_positions() const { return positions_; }
+
+  void clear();
+
+  /** writes the tape as file
+   * @return true on success */
+  bool save(const std::string& filename) const;
+  /** maps a saved tape read only into memory, recording into the tape
+   * copies it into memory first
+   * @return true on success, the tape is empty on failure */
+  bool load(const std::string& filename);
+
+  /** calls the delegate for each event of the tape
+   * @return false if the tape is corrupt, the events up to the damage are
+   * delivered */
+  bool replay(delegate& d) const;
+
+private:
+  friend class tape_recorder;
+  friend class tape_replayer;
+
+  const char* data() const { return mapped_ ? mapped_data_ : data_.data(); }
+  /** copies a mapped tape into memory to append to it */
+  void make_writable();
+  uint32_t intern(const XML_Char* s);
+
+  std::vector<char> data_;
+  size_t events_{0};
+  bool positions_{false};
+  /** names by id, point into names_arena_ or into the mapped file */
+  std::vector<const char*> names_;
+  arena names_arena_;
+  std::unordered_map<string_ref,uint32_t,string_ref_hash> ids_;
+  mapped_file file_;
+  bool mapped_{false};
+  const char* mapped_data_{nullptr};
+  size_t mapped_size_{0};
+};
+
+/** delegate which records the events into a tape.
+ *
+ * all events are forwarded to the next delegate, so the tape can be
+ * recorded during a normal parse. Attached to the parser the positions of
+ * the events are recorded as well:
+ * @code
+ * event_tape tape;
+ * tape_recorder rec(tape,&my_delegate);
+ * parser p(rec);
+ * rec.attach(p);
+ * @endcode
+ * the first attached event decides if the tape has positions, events of
+ * a tape with positions recorded without parser get position 0.
+ */
+class tape_recorder : public forwarding_delegate {
+public:
+  explicit tape_recorder(event_tape& tape, delegate* next = nullptr);
+  void attach(const parser& p);
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override;
+  void onEndElement(const XML_Char *fullname) override;
+  void onCharacterData(const char * pBuf, int len) override;
+  void onProcessingInstruction(const XML_Char* target,
+                               const XML_Char* data) override;
+  void onUnparsedEntityDecl(const XML_Char* entityName,
+                            const XML_Char* base,
+                            const XML_Char* systemId,
+                            const XML_Char* publicId,
+                            const XML_Char* notationName) override;
+  void onNotationDecl(const XML_Char* notationName,
+                      const XML_Char* base,
+                      const XML_Char* systemId,
+                      const XML_Char* publicId) override;
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override;
+  void onEndNamespace(const XML_Char* prefix) override;
+  void onAttlistDecl(const XML_Char *elname,
+                     const XML_Char *attname,
+                     const XML_Char *att_type,
+                     const XML_Char *dflt,
+                     bool            isrequired) override;
+  void onStartCdataSection() override;
+  void onEndCdataSection() override;
+  void onStartDoctypeDecl(const XML_Char *doctypeName,
+                          const XML_Char *sysid,
+                          const XML_Char *pubid,
+                          int has_internal_subset) override;
+  void onEndDoctypeDecl() override;
+  void onComment(const XML_Char *data) override;
+  void onElementDecl(const XML_Char *name, XML_Content *model) override;
+  void onEntityDecl(const XML_Char *entityName,
+                    int is_parameter_entity,
+                    const XML_Char *value,
+                    int value_length,
+                    const XML_Char *base,
+                    const XML_Char *systemId,
+                    const XML_Char *publicId,
+                    const XML_Char *notationName) override;
+  void onSkippedEntity(const XML_Char *entityName,
+                       int is_parameter_entity) override;
+  void onXmlDecl(const XML_Char *version,
+                 const XML_Char *encoding,
+                 int standalone) override;
+  void onParseError(size_t line, size_t column, size_t pos, Error error) override;
+  void onEndDocument(size_t index) override;
+
+private:
+  /** starts an event, with its position if the tape has positions */
+  void put(uint8_t e);
+  void put_varint(uint64_t v);
+  /** nullptr is stored as length 0 */
+  void put_string(const char* s);
+  void put_string(const char* s, size_t len);
+  void put_model(const XML_Content* model);
+
+  event_tape& tape_;
+  const parser* parser_{nullptr};
+  uint64_t byte_index_{0};
+  uint64_t line_{0};
+};
+
+/** replays a tape into a delegate without expat.
+ *
+ * during the callbacks the position of the current event is available as
+ * from the parser, 0 if the tape has no positions.
+ */
+class tape_replayer {
+public:
+  explicit tape_replayer(const event_tape& tape) : tape_(tape) {}
+
+  /** calls the delegate for each event of the tape
+   * @return false if the tape is corrupt */
+  bool replay(delegate& d);
+
+  size_t current_line_number() const { return line_; }
+  size_t current_column_number() const { return column_; }
+  size_t current_byte_index() const { return byte_index_; }
+
+private:
+  const event_tape& tape_;
+  size_t line_{0};
+  size_t column_{0};
+  size_t byte_index_{0};
+  //@{ scratch of replay(), reused
+  std::vector<const XML_Char*> atts_;
+  std::vector<XML_Content> model_;
+  //@}
+};
+
+}
+#endif // #ifndef xmlpp_event_tape_hpp
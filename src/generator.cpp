@@ -39,3 +39,62 @@ void xmlpp::generator::composite_element::serialize(std::ostream &os) {
 void xmlpp::generator::text::serialize(std::ostream &os) {
    os << value;
 }
+
+const size_t xmlpp::generator::writer::DEFAULT_BUFFER_SIZE;
+
+xmlpp::generator::writer::writer(std::ostream& os, size_t buffer_size)
+: os_(os), buf_(buffer_size ? buffer_size : 1)
+{}
+
+xmlpp::generator::writer::~writer() {
+  flush();
+}
+
+void xmlpp::generator::writer::flush() {
+  if (pos_) os_.write(buf_.data(), static_cast<std::streamsize>(pos_));
+  pos_ = 0;
+}
+
+void xmlpp::generator::writer::text(const char* s, size_t len) {
+  escaped(s, len, false);
+}
+
+void xmlpp::generator::writer::attribute_value(const char* s, size_t len) {
+  escaped(s, len, true);
+}
+
+void xmlpp::generator::writer::escaped(const char* s, size_t len, bool attribute) {
+  // runs without special characters are copied at once
+  size_t run = 0;
+  for (size_t i = 0; i < len; ++i) {
+    const char* entity = nullptr;
+    size_t entity_len = 0;
+    switch (s[i]) {
+      case '&': entity = "&amp;"; entity_len = 5; break;
+      case '<': entity = "&lt;"; entity_len = 4; break;
+      case '>':
+        if (!attribute) { entity = "&gt;"; entity_len = 4; }
+        break;
+      case '"':
+        if (attribute) { entity = "&quot;"; entity_len = 6; }
+        break;
+      // attribute value normalization would turn them into spaces
+      case '\t':
+        if (attribute) { entity = "&#9;"; entity_len = 4; }
+        break;
+      case '\n':
+        if (attribute) { entity = "&#10;"; entity_len = 5; }
+        break;
+      case '\r':
+        if (attribute) { entity = "&#13;"; entity_len = 5; }
+        break;
+      default: break;
+    }
+    if (entity) {
+      raw(s + run, i - run);
+      raw(entity, entity_len);
+      run = i + 1;
+    }
+  }
+  raw(s + run, len - run);
+}
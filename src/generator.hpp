@@ -6,10 +6,12 @@
 #ifndef xmlpp_generator_hpp
 #define xmlpp_generator_hpp
 
+#include <cstring>
 #include <string>
 #include <list>
 #include <memory>
 #include <iostream>
+#include <vector>
 
 namespace xmlpp {
 /** generating xml elements */
@@ -41,6 +43,51 @@ struct text: public node {
 protected:
   void serialize(std::ostream& os) override;
 };
+
+/** buffered output of xml, used by the serializers generated by xsdgen.
+ *
+ * markup is copied unchanged into the buffer, text and attribute values
+ * are escaped, tab, newline and carriage return in attribute values as
+ * character references so they survive the normalization. The buffer is written to the stream when it is full, on
+ * flush() and on destruction.
+ */
+class writer {
+public:
+  static const size_t DEFAULT_BUFFER_SIZE = 64*1024;
+
+  explicit writer(std::ostream& os, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+  writer(const writer&) = delete;
+  writer& operator=(const writer&) = delete;
+  ~writer();
+
+  /** appends markup without escaping */
+  void raw(const char* s, size_t len)
+  {
+    if (len > buf_.size() - pos_) {
+      flush();
+      if (len > buf_.size()) {
+        os_.write(s, static_cast<std::streamsize>(len));
+        return;
+      }
+    }
+    // &buf_[pos_] is undefined for a full buffer
+    memcpy(buf_.data() + pos_, s, len);
+    pos_ += len;
+  }
+  /** appends character data, escapes '&', '<' and '>' */
+  void text(const char* s, size_t len);
+  /** appends an attribute value to be enclosed in '"', escapes '&', '<'
+   * and '"' */
+  void attribute_value(const char* s, size_t len);
+  /** writes the buffered output to the stream */
+  void flush();
+private:
+  void escaped(const char* s, size_t len, bool attribute);
+
+  std::ostream& os_;
+  std::vector<char> buf_;
+  size_t pos_{0};
+};
 } // end namespace generator
 } // end: namespace xmlpp
 #endif // #ifndef xmlpp_generator_hpp
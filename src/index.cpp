@@ -0,0 +1,594 @@
+/**
+ * \file index.cpp implementation of the structural index
+ *
+ * See LICENSE for copyright information.
+ */
+#include <cstdio>
+#include <cstring>
+
+#include "index.hpp"
+
+using std::string;
+using std::vector;
+
+using xmlpp::structural_index;
+using xmlpp::indexer;
+using xmlpp::parser;
+using xmlpp::delegate;
+
+namespace {
+
+const char INDEX_MAGIC[4] = { 'X', 'P', 'P', 'I' };
+const unsigned char INDEX_VERSION = 1;
+const size_t READ_BUFFER_SIZE = 64*1024;
+const char SUBTREE_ELEMENT[] = "xmlpp-subtree";
+
+bool seek(FILE* f, uint64_t offset)
+{
+#if defined(_WIN32)
+  return _fseeki64(f, static_cast<__int64>(offset), SEEK_SET)==0;
+#else
+  return fseeko(f, static_cast<off_t>(offset), SEEK_SET)==0;
+#endif
+}
+
+void put_varint(string& out, uint64_t v)
+{
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+/** bounds checked reader for the sidecar format */
+struct varint_reader {
+  varint_reader(const unsigned char* begin, const unsigned char* _end)
+  : p(begin), end(_end)
+  {}
+
+  const unsigned char* p;
+  const unsigned char* end;
+  bool ok{true};
+
+  uint64_t get()
+  {
+    uint64_t v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (p==end) { ok = false; return 0; }
+      unsigned char b = *p++;
+      v |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if (!(b & 0x80)) return v;
+    }
+    ok = false;
+    return 0;
+  }
+  uint32_t get32()
+  {
+    uint64_t v = get();
+    if (v > 0xffffffffu) ok = false;
+    return static_cast<uint32_t>(v);
+  }
+};
+
+void append_escaped(string& out, const string& value)
+{
+  for (char c : value) {
+    switch (c) {
+      case '&': out += "&amp;"; break;
+      case '<': out += "&lt;"; break;
+      case '"': out += "&quot;"; break;
+      default: out.push_back(c);
+    }
+  }
+}
+
+/** line and column of a position in the document, counted as expat does:
+ * lines from 1, columns from 0 in characters, CR LF is one line break */
+struct text_position {
+  size_t line{1};
+  size_t column{0};
+  bool cr{false};
+
+  void advance(const char* p, size_t len)
+  {
+    for (const char* end = p + len; p!=end; ++p) {
+      const unsigned char c = static_cast<unsigned char>(*p);
+      if (c=='\n') {
+        if (!cr) ++line;
+        column = 0;
+        cr = false;
+      } else if (c=='\r') {
+        ++line;
+        column = 0;
+        cr = true;
+      } else {
+        // continuation bytes of UTF-8 sequences are no characters
+        if ((c & 0xc0)!=0x80) ++column;
+        cr = false;
+      }
+    }
+  }
+};
+
+/** position of offset in the document file */
+bool position_in_file(FILE* f, uint64_t offset, text_position& position)
+{
+  if (!seek(f, 0)) return false;
+  char buff[READ_BUFFER_SIZE];
+  while (offset > 0) {
+    size_t n = offset > sizeof(buff) ? sizeof(buff) : static_cast<size_t>(offset);
+    n = fread(buff, 1, n, f);
+    if (n==0) return false;
+    position.advance(buff, n);
+    offset -= n;
+  }
+  return true;
+}
+
+/** hides the synthetic element which carries the namespace declarations
+ * of a subtree from the delegate */
+class subtree_filter : public xmlpp::forwarding_delegate {
+public:
+  subtree_filter(delegate& next, uint64_t offset, const string& prologue)
+  : forwarding_delegate(&next), offset_(offset), prologue_len_(prologue.size())
+  {
+    head_.advance(prologue.data(), prologue.size());
+  }
+
+  /** sets the position of the subtree in the document, needed to map the
+   * line and column of errors */
+  void locate(const text_position& start)
+  {
+    start_ = start;
+    located_ = true;
+  }
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override
+  {
+    if (depth_++ > 0) forwarding_delegate::onStartElement(fullname,atts);
+  }
+  void onEndElement(const XML_Char *fullname) override
+  {
+    if (--depth_ > 0) forwarding_delegate::onEndElement(fullname);
+  }
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override
+  {
+    if (depth_ > 0) forwarding_delegate::onStartNamespace(prefix,uri);
+  }
+  void onEndNamespace(const XML_Char* prefix) override
+  {
+    if (depth_ > 0) forwarding_delegate::onEndNamespace(prefix);
+  }
+  /** positions are reported relative to the begin of the document, line
+   * and column only after locate() */
+  void onParseError(size_t line, size_t column, size_t pos,
+                    xmlpp::Error error) override
+  {
+    if (pos >= prologue_len_) {
+      pos = pos - prologue_len_ + offset_;
+      if (located_) {
+        // the prologue is the first line, the subtree starts behind it
+        if (line==head_.line) {
+          column = column - head_.column + start_.column;
+        }
+        line = line - head_.line + start_.line;
+      }
+    }
+    forwarding_delegate::onParseError(line,column,pos,error);
+  }
+private:
+  uint64_t offset_;
+  size_t prologue_len_;
+  text_position head_;
+  text_position start_;
+  bool located_{false};
+  size_t depth_{0};
+};
+
+parser::result report_error(parser& p, delegate& d)
+{
+  d.onParseError(p.current_line_number(),
+                 p.current_column_number(),
+                 p.current_byte_index(),
+                 xmlpp::Error(static_cast<XML_Error>(p.errorcode())));
+  return parser::result::PARSE_ERROR;
+}
+
+} // end namespace
+
+const uint32_t structural_index::NO_NAME;
+const uint32_t structural_index::NO_SCOPE;
+
+uint32_t structural_index::name_id(const string& name) const
+{
+  auto it = ids_.find(name);
+  return it==ids_.end() ? NO_NAME : it->second;
+}
+
+vector<size_t> structural_index::find(const string& name) const
+{
+  vector<size_t> found;
+  uint32_t id = name_id(name);
+  if (id!=NO_NAME) {
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      if (entries_[i].name==id) found.push_back(i);
+    }
+  }
+  return found;
+}
+
+uint32_t structural_index::intern(const XML_Char* s)
+{
+  string key(s);
+  auto it = ids_.find(key);
+  if (it!=ids_.end()) return it->second;
+  uint32_t id = static_cast<uint32_t>(names_.size());
+  names_.push_back(key);
+  ids_.emplace(std::move(key),id);
+  return id;
+}
+
+void structural_index::clear()
+{
+  entries_.clear();
+  scopes_.clear();
+  names_.clear();
+  ids_.clear();
+  document_size_ = 0;
+}
+
+bool structural_index::save(const string& filename) const
+{
+  string out(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  out.push_back(static_cast<char>(INDEX_VERSION));
+  put_varint(out, document_size_);
+
+  put_varint(out, names_.size());
+  for (const auto& n : names_) {
+    put_varint(out, n.size());
+    out += n;
+  }
+
+  // ids are stored incremented by one so that the NO_* markers become 0
+  put_varint(out, scopes_.size());
+  for (const auto& s : scopes_) {
+    put_varint(out, s.parent==NO_SCOPE ? 0 : uint64_t(s.parent)+1);
+    put_varint(out, s.bindings.size());
+    for (const auto& b : s.bindings) {
+      put_varint(out, b.prefix==NO_NAME ? 0 : uint64_t(b.prefix)+1);
+      put_varint(out, b.uri);
+    }
+  }
+
+  // entries are in document order, offsets are stored as deltas
+  put_varint(out, entries_.size());
+  uint64_t last = 0;
+  for (const auto& e : entries_) {
+    put_varint(out, e.begin - last);
+    put_varint(out, e.end - e.begin);
+    put_varint(out, e.name);
+    put_varint(out, e.depth);
+    put_varint(out, e.scope==NO_SCOPE ? 0 : uint64_t(e.scope)+1);
+    last = e.begin;
+  }
+
+  FILE* f = fopen(filename.c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(out.data(), 1, out.size(), f)==out.size();
+  return (fclose(f)==0) && ok;
+}
+
+bool structural_index::load(const string& filename)
+{
+  clear();
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (!f) return false;
+  string in;
+  char buff[READ_BUFFER_SIZE];
+  size_t bytes_read;
+  while ((bytes_read = fread(buff, 1, sizeof(buff), f)) > 0) {
+    in.append(buff, bytes_read);
+  }
+  bool read_ok = !ferror(f);
+  fclose(f);
+  if (!read_ok || in.size() < sizeof(INDEX_MAGIC)+1
+      || memcmp(in.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC))!=0
+      || static_cast<unsigned char>(in[sizeof(INDEX_MAGIC)])!=INDEX_VERSION) {
+    return false;
+  }
+
+  const unsigned char* begin = reinterpret_cast<const unsigned char*>(in.data());
+  varint_reader r(begin + sizeof(INDEX_MAGIC) + 1, begin + in.size());
+  document_size_ = r.get();
+
+  uint64_t count = r.get();
+  for (uint64_t i = 0; r.ok && i < count; ++i) {
+    uint64_t len = r.get();
+    if (!r.ok || len > static_cast<uint64_t>(r.end - r.p)) { r.ok = false; break; }
+    names_.emplace_back(reinterpret_cast<const char*>(r.p), static_cast<size_t>(len));
+    ids_.emplace(names_.back(), static_cast<uint32_t>(i));
+    r.p += len;
+  }
+
+  count = r.get();
+  for (uint64_t i = 0; r.ok && i < count; ++i) {
+    scope s;
+    uint32_t parent = r.get32();
+    s.parent = parent==0 ? NO_SCOPE : parent-1;
+    uint64_t nbindings = r.get();
+    for (uint64_t j = 0; r.ok && j < nbindings; ++j) {
+      uint32_t prefix = r.get32();
+      binding b{ prefix==0 ? NO_NAME : prefix-1, r.get32() };
+      s.bindings.push_back(b);
+    }
+    scopes_.push_back(std::move(s));
+  }
+
+  count = r.get();
+  uint64_t last = 0;
+  for (uint64_t i = 0; r.ok && i < count; ++i) {
+    entry e;
+    e.begin = last + r.get();
+    e.end = e.begin + r.get();
+    e.name = r.get32();
+    e.depth = r.get32();
+    uint32_t s = r.get32();
+    e.scope = s==0 ? NO_SCOPE : s-1;
+    entries_.push_back(e);
+    last = e.begin;
+  }
+
+  // reject references out of range, they would be used for indexing later
+  for (const auto& e : entries_) {
+    if (e.name >= names_.size() || (e.scope!=NO_SCOPE && e.scope >= scopes_.size())) {
+      r.ok = false;
+    }
+  }
+  for (const auto& s : scopes_) {
+    if (s.parent!=NO_SCOPE && s.parent >= scopes_.size()) r.ok = false;
+    for (const auto& b : s.bindings) {
+      if (b.uri >= names_.size() || (b.prefix!=NO_NAME && b.prefix >= names_.size())) {
+        r.ok = false;
+      }
+    }
+  }
+
+  if (!r.ok) clear();
+  return r.ok;
+}
+
+parser::result structural_index::build(const char* data, size_t len,
+                                       structural_index& index,
+                                       size_t max_depth,
+                                       delegate* next)
+{
+  if (data==nullptr) return parser::result::INVALID_INPUT;
+  index.clear();
+
+  abstract_delegate none;
+  indexer ix(index, next ? next : &none, max_depth);
+  parser p(ix);
+  ix.attach(p);
+  index.document_size_ = len;
+  // feed in pieces, parse() takes the length as int
+  do {
+    size_t n = len > READ_BUFFER_SIZE ? READ_BUFFER_SIZE : len;
+    len -= n;
+    if (p.parse(data, static_cast<int>(n), len==0)==parser::status_t::ERROR) {
+      return report_error(p, ix);
+    }
+    data += n;
+  } while (len > 0);
+  return parser::result::OK;
+}
+
+parser::result structural_index::build_file(const string& filename,
+                                            structural_index& index,
+                                            size_t max_depth,
+                                            delegate* next)
+{
+  FILE* docfd = fopen(filename.c_str(), "rb");
+  if (!docfd) return parser::result::ERROR_OPEN_FILE;
+  index.clear();
+
+  parser::result res = parser::result::OK;
+  abstract_delegate none;
+  indexer ix(index, next ? next : &none, max_depth);
+  parser p(ix);
+  ix.attach(p);
+  char buff[READ_BUFFER_SIZE];
+  for (;;) {
+    size_t bytes_read = fread(buff, 1, sizeof(buff), docfd);
+    index.document_size_ += bytes_read;
+    if (p.parse(buff, static_cast<int>(bytes_read), bytes_read==0)==parser::status_t::ERROR) {
+      res = report_error(p, ix);
+      break;
+    }
+    if (bytes_read==0) {
+      res = std::feof(docfd) ? parser::result::OK : parser::result::READ_ERROR;
+      break;
+    }
+  }
+  fclose(docfd);
+  return res;
+}
+
+string structural_index::prologue(size_t entry) const
+{
+  string s("<");
+  s += SUBTREE_ELEMENT;
+  vector<uint32_t> seen;
+  // innermost declarations shadow the outer ones
+  for (uint32_t sc = entries_[entry].scope; sc!=NO_SCOPE; sc = scopes_[sc].parent) {
+    for (const auto& b : scopes_[sc].bindings) {
+      bool shadowed = false;
+      for (auto p : seen) {
+        if (p==b.prefix) { shadowed = true; break; }
+      }
+      if (shadowed) continue;
+      seen.push_back(b.prefix);
+      if (b.prefix==NO_NAME) {
+        s += " xmlns=\"";
+      } else {
+        s += " xmlns:";
+        s += names_[b.prefix];
+        s += "=\"";
+      }
+      append_escaped(s, names_[b.uri]);
+      s += '"';
+    }
+  }
+  s += '>';
+  return s;
+}
+
+parser::result structural_index::parse_subtree(const char* data, size_t len,
+                                               size_t entry,
+                                               delegate& delegate) const
+{
+  if (data==nullptr || entry >= entries_.size()
+      || entries_[entry].end > len) {
+    return parser::result::INVALID_INPUT;
+  }
+  const structural_index::entry& e = entries_[entry];
+  const string head = prologue(entry);
+  const string tail = string("</") + SUBTREE_ELEMENT + ">";
+
+  subtree_filter filter(delegate, e.begin, head);
+  parser p(filter);
+  // the lines before the subtree are only counted for an error
+  auto fail = [&]()
+    {
+      text_position start;
+      start.advance(data, static_cast<size_t>(e.begin));
+      filter.locate(start);
+      return report_error(p, filter);
+    };
+  if (p.parse(head.data(), static_cast<int>(head.size()), false)==parser::status_t::ERROR) {
+    return fail();
+  }
+  const char* pos = data + e.begin;
+  uint64_t remaining = e.end - e.begin;
+  while (remaining > 0) {
+    size_t n = remaining > READ_BUFFER_SIZE ? READ_BUFFER_SIZE : static_cast<size_t>(remaining);
+    if (p.parse(pos, static_cast<int>(n), false)==parser::status_t::ERROR) {
+      return fail();
+    }
+    pos += n;
+    remaining -= n;
+  }
+  if (p.parse(tail.data(), static_cast<int>(tail.size()), true)==parser::status_t::ERROR) {
+    return fail();
+  }
+  return parser::result::OK;
+}
+
+parser::result structural_index::parse_subtree_file(const string& filename,
+                                                    size_t entry,
+                                                    delegate& delegate) const
+{
+  if (entry >= entries_.size()) return parser::result::INVALID_INPUT;
+  FILE* docfd = fopen(filename.c_str(), "rb");
+  if (!docfd) return parser::result::ERROR_OPEN_FILE;
+
+  const structural_index::entry& e = entries_[entry];
+  const string head = prologue(entry);
+  const string tail = string("</") + SUBTREE_ELEMENT + ">";
+
+  parser::result res = parser::result::OK;
+  subtree_filter filter(delegate, e.begin, head);
+  parser p(filter);
+  // the lines before the subtree are only counted for an error
+  auto fail = [&]()
+    {
+      text_position start;
+      if (position_in_file(docfd, e.begin, start)) filter.locate(start);
+      return report_error(p, filter);
+    };
+  if (!seek(docfd, e.begin)) {
+    res = parser::result::READ_ERROR;
+  } else if (p.parse(head.data(), static_cast<int>(head.size()), false)==parser::status_t::ERROR) {
+    res = fail();
+  } else {
+    char buff[READ_BUFFER_SIZE];
+    uint64_t remaining = e.end - e.begin;
+    while (remaining > 0) {
+      size_t n = remaining > sizeof(buff) ? sizeof(buff) : static_cast<size_t>(remaining);
+      size_t bytes_read = fread(buff, 1, n, docfd);
+      if (bytes_read==0) {
+        res = parser::result::READ_ERROR;
+        break;
+      }
+      if (p.parse(buff, static_cast<int>(bytes_read), false)==parser::status_t::ERROR) {
+        res = fail();
+        break;
+      }
+      remaining -= bytes_read;
+    }
+    if (res==parser::result::OK
+        && p.parse(tail.data(), static_cast<int>(tail.size()), true)==parser::status_t::ERROR) {
+      res = fail();
+    }
+  }
+  fclose(docfd);
+  return res;
+}
+
+indexer::indexer(structural_index& index, delegate* next, size_t max_depth)
+: forwarding_delegate(next), index_(index), max_depth_(max_depth)
+{}
+
+void indexer::onStartElement(const XML_Char *fullname, const XML_Char **atts)
+{
+  const size_t depth = open_.size() + 1;
+  uint32_t scope = scopes_.empty() ? structural_index::NO_SCOPE : scopes_.back();
+
+  if (max_depth_==0 || depth <= max_depth_) {
+    if (!pending_.empty()) {
+      structural_index::scope s;
+      s.parent = scope;
+      s.bindings.swap(pending_);
+      scope = static_cast<uint32_t>(index_.scopes_.size());
+      index_.scopes_.push_back(std::move(s));
+    }
+    structural_index::entry e;
+    e.begin = parser_ ? parser_->current_byte_index() : 0;
+    e.end = e.begin;
+    e.name = index_.intern(fullname);
+    e.depth = static_cast<uint32_t>(depth);
+    e.scope = scope;
+    open_.push_back(index_.entries_.size());
+    index_.entries_.push_back(e);
+  } else {
+    pending_.clear();
+    open_.push_back(SIZE_MAX);
+  }
+  scopes_.push_back(scope);
+  forwarding_delegate::onStartElement(fullname,atts);
+}
+
+void indexer::onEndElement(const XML_Char *fullname)
+{
+  if (!open_.empty()) {
+    if (open_.back()!=SIZE_MAX && parser_) {
+      index_.entries_[open_.back()].end = parser_->current_byte_index()
+                                        + parser_->current_byte_count();
+    }
+    open_.pop_back();
+    scopes_.pop_back();
+  }
+  forwarding_delegate::onEndElement(fullname);
+}
+
+void indexer::onStartNamespace(const XML_Char* prefix, const XML_Char* uri)
+{
+  // prefixes can not be undeclared in xml 1.0, only the default namespace
+  if ((max_depth_==0 || open_.size() < max_depth_) && (uri || !prefix)) {
+    structural_index::binding b;
+    b.prefix = prefix ? index_.intern(prefix) : structural_index::NO_NAME;
+    b.uri = index_.intern(uri ? uri : "");
+    pending_.push_back(b);
+  }
+  forwarding_delegate::onStartNamespace(prefix,uri);
+}
@@ -0,0 +1,151 @@
+/**
+ * \file index.hpp contains the structural index for random access into
+ * large xml documents
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_index_hpp
+#define xmlpp_index_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "xmlparser.hpp"
+
+namespace xmlpp {
+
+/** structural index of the elements of an xml document.
+ *
+ * the index keeps for each element the byte range of the element in the
+ * document, its depth, the id of its (expanded) name and the namespace
+ * bindings in scope. It is built by the indexer delegate during a normal
+ * parse, can be saved to and loaded from a compact sidecar file and allows
+ * to parse a single indexed subtree without parsing the document from its
+ * beginning.
+ *
+ * @note entities declared in the internal DTD subset are not known when
+ * parsing a subtree, subtrees referencing them can not be parsed.
+ */
+class structural_index {
+public:
+  /** marks a missing name, e.g. the prefix of a default namespace binding */
+  static const uint32_t NO_NAME = 0xffffffffu;
+  /** id of the empty namespace scope */
+  static const uint32_t NO_SCOPE = 0xffffffffu;
+
+  /** an indexed element */
+  struct entry {
+    uint64_t begin; //< byte offset of the start tag
+    uint64_t end;   //< byte offset behind the end tag
+    uint32_t name;  //< id of the elements name
+    uint32_t depth; //< nesting depth, 1 for the root element
+    uint32_t scope; //< namespace scope in effect for the element
+  };
+
+  /** a namespace declaration */
+  struct binding {
+    uint32_t prefix; //< id of the prefix or NO_NAME for default namespace
+    uint32_t uri;    //< id of the namespace uri
+  };
+
+  /** namespace declarations of one element and the scope they extend */
+  struct scope {
+    uint32_t parent{NO_SCOPE};
+    std::vector<binding> bindings;
+  };
+
+  const std::vector<entry>& entries() const { return entries_; }
+  const std::vector<scope>& scopes() const { return scopes_; }
+  const std::string& name(uint32_t id) const { return names_[id]; }
+  /** @return id of name or NO_NAME if the name is not in the index */
+  uint32_t name_id(const std::string& name) const;
+  /** @return indices of all entries with the given (expanded) name */
+  std::vector<size_t> find(const std::string& name) const;
+  /** size in bytes of the indexed document */
+  uint64_t document_size() const { return document_size_; }
+
+  /** writes the index as sidecar file
+   * @return true on success */
+  bool save(const std::string& filename) const;
+  /** reads the index from sidecar file
+   * @return true on success, the index is empty on failure */
+  bool load(const std::string& filename);
+
+  /** parses a complete document held in memory and indexes its elements
+   * @param max_depth only elements up to this depth are indexed, 0 for all
+   * @param next optional delegate receiving the events of the parse */
+  static parser::result build(const char* data, size_t len,
+                              structural_index& index,
+                              size_t max_depth = 0,
+                              delegate* next = nullptr);
+  /** parses a document file and indexes its elements */
+  static parser::result build_file(const std::string& filename,
+                                   structural_index& index,
+                                   size_t max_depth = 0,
+                                   delegate* next = nullptr);
+
+  /** parses the subtree of the indexed element from the document held in
+   * memory. the parser is primed with the namespace declarations in scope
+   * of the element, only the bytes of the subtree are parsed. Parse errors
+   * are reported with their line, column and byte position in the
+   * document, the lines before the subtree are counted only then.
+   */
+  parser::result parse_subtree(const char* data, size_t len,
+                               size_t entry, delegate& delegate) const;
+  /** reads and parses the subtree of the indexed element from the document
+   * file. For a parse error the file is read up to the subtree to count
+   * its lines. */
+  parser::result parse_subtree_file(const std::string& filename,
+                                    size_t entry, delegate& delegate) const;
+
+  void clear();
+private:
+  friend class indexer;
+  uint32_t intern(const XML_Char* s);
+  std::string prologue(size_t entry) const;
+
+  std::vector<entry> entries_;
+  std::vector<scope> scopes_;
+  std::vector<std::string> names_;
+  std::unordered_map<std::string,uint32_t> ids_;
+  uint64_t document_size_{0};
+};
+
+/** delegate which records the structural index during a parse.
+ *
+ * all events are forwarded to the next delegate, so the index can be built
+ * during a normal parse. The indexer needs the parser to query the byte
+ * positions of the events:
+ * @code
+ * structural_index idx;
+ * indexer ix(idx,&my_delegate);
+ * parser p(ix);
+ * ix.attach(p);
+ * @endcode
+ */
+class indexer : public forwarding_delegate {
+public:
+  explicit indexer(structural_index& index,
+                   delegate* next = nullptr,
+                   size_t max_depth = 0);
+  void attach(const parser& p) { parser_ = &p; }
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override;
+  void onEndElement(const XML_Char *fullname) override;
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override;
+private:
+  structural_index& index_;
+  const parser* parser_{nullptr};
+  size_t max_depth_;
+  /** open elements, index of entry or SIZE_MAX for not recorded ones */
+  std::vector<size_t> open_;
+  /** scope in effect for each open element */
+  std::vector<uint32_t> scopes_;
+  /** bindings declared for the next start element */
+  std::vector<structural_index::binding> pending_;
+};
+
+}
+#endif // #ifndef xmlpp_index_hpp
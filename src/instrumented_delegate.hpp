@@ -0,0 +1,409 @@
+/**
+ * \file instrumented_delegate.hpp contains a delegate wrapper measuring the
+ * event counts and the time spent in the delegate callbacks and in expat
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_instrumented_delegate_hpp
+#define xmlpp_instrumented_delegate_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "delegate.hpp"
+
+namespace xmlpp {
+
+/** cheap timestamp counter, the time stamp counter on x86, the virtual
+ * counter on aarch64 and the steady clock elsewhere */
+struct tsc_clock {
+  static uint64_t now()
+  {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+  }
+
+  /** ticks per nanosecond, calibrated once against the steady clock */
+  static double ticks_per_ns()
+  {
+    static const double ratio = calibrate();
+    return ratio;
+  }
+private:
+  static double calibrate()
+  {
+    typedef std::chrono::steady_clock clock;
+    const clock::time_point start = clock::now();
+    const uint64_t ticks = now();
+    clock::time_point end;
+    do {
+      end = clock::now();
+    } while (end - start < std::chrono::milliseconds(2));
+    const double ns = static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    const double r = static_cast<double>(now() - ticks) / ns;
+    return r > 0 ? r : 1.0;
+  }
+};
+
+/** histogram of latencies with logarithmic buckets divided into 16 linear
+ * sub buckets (as in HdrHistogram), the relative error of the recorded
+ * values is below 1/16 */
+class latency_histogram {
+public:
+  enum : unsigned {
+    SUB_BUCKET_BITS = 4,
+    SUB_BUCKETS = 1u << SUB_BUCKET_BITS,
+    /** values above 2^48 ticks are recorded as 2^48 */
+    MAX_BITS = 48,
+    SIZE = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS
+  };
+
+  void record(uint64_t value)
+  {
+    ++counts_[index(value)];
+    ++count_;
+    if (value < min_) min_ = value;
+    if (value > max_) max_ = value;
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return count_ ? min_ : 0; }
+  uint64_t max() const { return max_; }
+
+  /** @return upper bound of the values below the given percentile (0-100) */
+  uint64_t percentile(double p) const
+  {
+    if (count_==0) return 0;
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(count_) + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < SIZE; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        const uint64_t upper = upper_bound(i);
+        return upper < max_ ? upper : max_;
+      }
+    }
+    return max_;
+  }
+
+  void merge(const latency_histogram& other)
+  {
+    for (unsigned i = 0; i < SIZE; ++i) counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    if (other.count_ && other.min_ < min_) min_ = other.min_;
+    if (other.max_ > max_) max_ = other.max_;
+  }
+
+  static unsigned index(uint64_t value)
+  {
+    if (value >= (uint64_t(1) << MAX_BITS)) value = (uint64_t(1) << MAX_BITS) - 1;
+    if (value < SUB_BUCKETS) return static_cast<unsigned>(value);
+    unsigned msb = 0;
+    for (uint64_t v = value; v >>= 1; ) ++msb;
+    const unsigned bucket = msb - SUB_BUCKET_BITS + 1;
+    const unsigned sub = static_cast<unsigned>(value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return bucket * SUB_BUCKETS + sub;
+  }
+
+  /** largest value recorded in bucket i */
+  static uint64_t upper_bound(unsigned i)
+  {
+    const unsigned bucket = i / SUB_BUCKETS;
+    const uint64_t sub = i % SUB_BUCKETS;
+    if (bucket==0) return sub;
+    return ((SUB_BUCKETS + sub + 1) << (bucket - 1)) - 1;
+  }
+private:
+  uint64_t counts_[SIZE] = {};
+  uint64_t count_{0};
+  uint64_t min_{UINT64_MAX};
+  uint64_t max_{0};
+};
+
+/** statistics collected by instrumented_delegate */
+struct parse_stats {
+  enum callback {
+    START_ELEMENT,
+    END_ELEMENT,
+    CHARACTER_DATA,
+    COMMENT,
+    START_CDATA_SECTION,
+    END_CDATA_SECTION,
+    PROCESSING_INSTRUCTION,
+    START_NAMESPACE,
+    END_NAMESPACE,
+    XML_DECL,
+    START_DOCTYPE_DECL,
+    END_DOCTYPE_DECL,
+    ELEMENT_DECL,
+    ATTLIST_DECL,
+    ENTITY_DECL,
+    UNPARSED_ENTITY_DECL,
+    NOTATION_DECL,
+    SKIPPED_ENTITY,
+    PARSE_ERROR,
+    END_DOCUMENT,
+    CALLBACK_COUNT
+  };
+
+  struct callback_stats {
+    uint64_t count{0};
+    uint64_t ticks{0};           //< time spent in the callback
+    latency_histogram latency;   //< ticks per call
+  };
+
+  callback_stats callbacks[CALLBACK_COUNT];
+  /** time between the callbacks, spent in expat and in the code feeding it */
+  uint64_t expat_ticks{0};
+
+  uint64_t events() const
+  {
+    uint64_t n = 0;
+    for (const auto& c : callbacks) n += c.count;
+    return n;
+  }
+  uint64_t delegate_ticks() const
+  {
+    uint64_t n = 0;
+    for (const auto& c : callbacks) n += c.ticks;
+    return n;
+  }
+  static double to_ns(uint64_t ticks)
+  {
+    return static_cast<double>(ticks) / tsc_clock::ticks_per_ns();
+  }
+  double delegate_ns() const { return to_ns(delegate_ticks()); }
+  double expat_ns() const { return to_ns(expat_ticks); }
+
+  static const char* name(callback c)
+  {
+    static const char* NAMES[] = {
+      "start_element", "end_element", "character_data", "comment",
+      "start_cdata_section", "end_cdata_section", "processing_instruction",
+      "start_namespace", "end_namespace", "xml_decl", "start_doctype_decl",
+      "end_doctype_decl", "element_decl", "attlist_decl", "entity_decl",
+      "unparsed_entity_decl", "notation_decl", "skipped_entity", "parse_error",
+      "end_document"
+    };
+    return c < CALLBACK_COUNT ? NAMES[c] : "";
+  }
+};
+
+/** delegate wrapper counting the events of each callback and measuring the
+ * time spent inside the callbacks of D and between them (inside expat).
+ *
+ * \code
+ * instrumented_delegate<my_delegate> d(ctor args of my_delegate);
+ * d.begin();
+ * parser::parseString(xml,d);
+ * d.finish();
+ * report(d.stats());
+ * \endcode
+ *
+ * with Enabled false the wrapper is D itself without any instrumentation,
+ * so it can be switched off at compile time without changing the code
+ * using it, stats() then returns empty statistics.
+ */
+template<class D, bool Enabled = true>
+class instrumented_delegate : public D {
+public:
+  template<typename... Args>
+  explicit instrumented_delegate(Args&&... args)
+  : D(std::forward<Args>(args)...),
+    stats_(new parse_stats())
+  {}
+
+  const parse_stats& stats() const { return *stats_; }
+  void reset_stats()
+  {
+    stats_.reset(new parse_stats());
+    last_exit_ = 0;
+  }
+  /** marks the start of parsing, the time until the first callback is
+   * counted as expat time */
+  void begin() { last_exit_ = tsc_clock::now(); }
+  /** counts the time since the last callback as expat time */
+  void finish()
+  {
+    if (last_exit_) stats_->expat_ticks += tsc_clock::now() - last_exit_;
+    last_exit_ = 0;
+  }
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override
+  {
+    scope s(*this, parse_stats::START_ELEMENT);
+    D::onStartElement(fullname,atts);
+  }
+  void onEndElement(const XML_Char *fullname) override
+  {
+    scope s(*this, parse_stats::END_ELEMENT);
+    D::onEndElement(fullname);
+  }
+  void onCharacterData(const char * pBuf, int len) override
+  {
+    scope s(*this, parse_stats::CHARACTER_DATA);
+    D::onCharacterData(pBuf,len);
+  }
+  void onComment(const XML_Char *data) override
+  {
+    scope s(*this, parse_stats::COMMENT);
+    D::onComment(data);
+  }
+  void onStartCdataSection() override
+  {
+    scope s(*this, parse_stats::START_CDATA_SECTION);
+    D::onStartCdataSection();
+  }
+  void onEndCdataSection() override
+  {
+    scope s(*this, parse_stats::END_CDATA_SECTION);
+    D::onEndCdataSection();
+  }
+  void onProcessingInstruction(const XML_Char* target, const XML_Char* data) override
+  {
+    scope s(*this, parse_stats::PROCESSING_INSTRUCTION);
+    D::onProcessingInstruction(target,data);
+  }
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override
+  {
+    scope s(*this, parse_stats::START_NAMESPACE);
+    D::onStartNamespace(prefix,uri);
+  }
+  void onEndNamespace(const XML_Char* prefix) override
+  {
+    scope s(*this, parse_stats::END_NAMESPACE);
+    D::onEndNamespace(prefix);
+  }
+  void onXmlDecl(const XML_Char *version, const XML_Char *encoding, int standalone) override
+  {
+    scope s(*this, parse_stats::XML_DECL);
+    D::onXmlDecl(version,encoding,standalone);
+  }
+  void onStartDoctypeDecl(const XML_Char *doctypeName, const XML_Char *sysid,
+                          const XML_Char *pubid, int has_internal_subset) override
+  {
+    scope s(*this, parse_stats::START_DOCTYPE_DECL);
+    D::onStartDoctypeDecl(doctypeName,sysid,pubid,has_internal_subset);
+  }
+  void onEndDoctypeDecl() override
+  {
+    scope s(*this, parse_stats::END_DOCTYPE_DECL);
+    D::onEndDoctypeDecl();
+  }
+  void onElementDecl(const XML_Char *name, XML_Content *model) override
+  {
+    scope s(*this, parse_stats::ELEMENT_DECL);
+    D::onElementDecl(name,model);
+  }
+  void onAttlistDecl(const XML_Char *elname, const XML_Char *attname,
+                     const XML_Char *att_type, const XML_Char *dflt,
+                     bool isrequired) override
+  {
+    scope s(*this, parse_stats::ATTLIST_DECL);
+    D::onAttlistDecl(elname,attname,att_type,dflt,isrequired);
+  }
+  void onEntityDecl(const XML_Char *entityName, int is_parameter_entity,
+                    const XML_Char *value, int value_length,
+                    const XML_Char *base, const XML_Char *systemId,
+                    const XML_Char *publicId, const XML_Char *notationName) override
+  {
+    scope s(*this, parse_stats::ENTITY_DECL);
+    D::onEntityDecl(entityName,is_parameter_entity,value,value_length,
+                    base,systemId,publicId,notationName);
+  }
+  void onUnparsedEntityDecl(const XML_Char* entityName, const XML_Char* base,
+                            const XML_Char* systemId, const XML_Char* publicId,
+                            const XML_Char* notationName) override
+  {
+    scope s(*this, parse_stats::UNPARSED_ENTITY_DECL);
+    D::onUnparsedEntityDecl(entityName,base,systemId,publicId,notationName);
+  }
+  void onNotationDecl(const XML_Char* notationName, const XML_Char* base,
+                      const XML_Char* systemId, const XML_Char* publicId) override
+  {
+    scope s(*this, parse_stats::NOTATION_DECL);
+    D::onNotationDecl(notationName,base,systemId,publicId);
+  }
+  void onSkippedEntity(const XML_Char *entityName, int is_parameter_entity) override
+  {
+    scope s(*this, parse_stats::SKIPPED_ENTITY);
+    D::onSkippedEntity(entityName,is_parameter_entity);
+  }
+  void onParseError(size_t line, size_t column, size_t pos, Error error) override
+  {
+    scope s(*this, parse_stats::PARSE_ERROR);
+    D::onParseError(line,column,pos,error);
+  }
+  void onEndDocument(size_t index) override
+  {
+    scope s(*this, parse_stats::END_DOCUMENT);
+    D::onEndDocument(index);
+  }
+private:
+  /** measures one callback */
+  struct scope {
+    scope(instrumented_delegate& d, parse_stats::callback c)
+    : d_(d), c_(c), enter_(tsc_clock::now())
+    {
+      if (d_.last_exit_) d_.stats_->expat_ticks += enter_ - d_.last_exit_;
+    }
+    ~scope()
+    {
+      const uint64_t exit = tsc_clock::now();
+      const uint64_t ticks = exit - enter_;
+      parse_stats::callback_stats& s = d_.stats_->callbacks[c_];
+      ++s.count;
+      s.ticks += ticks;
+      s.latency.record(ticks);
+      d_.last_exit_ = exit;
+    }
+    instrumented_delegate& d_;
+    parse_stats::callback c_;
+    uint64_t enter_;
+  };
+
+  std::unique_ptr<parse_stats> stats_;
+  uint64_t last_exit_{0};
+};
+
+/** instrumentation switched off: D without any overhead */
+template<class D>
+class instrumented_delegate<D,false> : public D {
+public:
+  template<typename... Args>
+  explicit instrumented_delegate(Args&&... args)
+  : D(std::forward<Args>(args)...)
+  {}
+
+  const parse_stats& stats() const
+  {
+    static const parse_stats empty;
+    return empty;
+  }
+  void reset_stats() {}
+  void begin() {}
+  void finish() {}
+};
+
+}
+#endif // #ifndef xmlpp_instrumented_delegate_hpp
@@ -0,0 +1,301 @@
+/**
+ * \file lazy_dom.cpp implementation of the lazy materialized document tree
+ *
+ * See LICENSE for copyright information.
+ */
+#include <cstring>
+
+#include "lazy_dom.hpp"
+
+using std::string;
+using std::vector;
+
+using xmlpp::lazy_document;
+using xmlpp::lazy_element;
+using xmlpp::parser;
+using xmlpp::string_ref;
+
+const size_t lazy_document::DEFAULT_MEMORY_CAP;
+const size_t lazy_document::ROOT_SLOT;
+const uint32_t lazy_document::NO_NODE;
+
+/** builds the nodes of a subtree from the parse events */
+class lazy_document::builder : public abstract_delegate {
+public:
+  explicit builder(subtree& tree) : tree_(tree) {}
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override
+  {
+    node n;
+    n.name = tree_.strings.store(fullname,strlen(fullname));
+    n.parent = open_.empty() ? NO_NODE : open_.back();
+    n.first_attribute = static_cast<uint32_t>(tree_.attributes.size());
+    for (; *atts; atts += 2) {
+      attribute a;
+      a.name = tree_.strings.store(atts[0],strlen(atts[0]));
+      a.value = tree_.strings.store(atts[1],strlen(atts[1]));
+      tree_.attributes.push_back(a);
+      n.attribute_count++;
+    }
+    if (!open_.empty()) tree_.nodes[open_.back()].child_count++;
+    open_.push_back(static_cast<uint32_t>(tree_.nodes.size()));
+    tree_.nodes.push_back(n);
+    if (text_.size() < open_.size()) text_.resize(open_.size());
+  }
+
+  void onEndElement(const XML_Char *) override
+  {
+    if (open_.empty()) return;
+    // the text is stored once, fragments between the children of an
+    // element would be copied again for every fragment
+    string& text = text_[open_.size() - 1];
+    if (!text.empty()) {
+      tree_.nodes[open_.back()].text = tree_.strings.store(text.data(),text.size());
+      text.clear();
+    }
+    open_.pop_back();
+  }
+
+  void onCharacterData(const char * pBuf, int len) override
+  {
+    if (!open_.empty()) text_[open_.size() - 1].append(pBuf,static_cast<size_t>(len));
+  }
+
+  /** lays out the child lists, nodes are in document order so the children
+   * of each node are collected in order */
+  void finish()
+  {
+    uint32_t offset = 0;
+    for (auto& n : tree_.nodes) {
+      n.first_child = offset;
+      offset += n.child_count;
+    }
+    tree_.children.assign(offset, 0);
+    vector<uint32_t> filled(tree_.nodes.size(), 0);
+    for (uint32_t i = 0; i < tree_.nodes.size(); ++i) {
+      const node& n = tree_.nodes[i];
+      if (n.parent!=NO_NODE) {
+        node& p = tree_.nodes[n.parent];
+        tree_.children[p.first_child + filled[n.parent]++] = i;
+      }
+    }
+  }
+private:
+  subtree& tree_;
+  vector<uint32_t> open_;
+  /** text of the open elements, by depth */
+  vector<string> text_;
+};
+
+/** keeps name, attributes and direct text of the root element during the
+ * quick pass */
+class lazy_document::root_builder : public abstract_delegate {
+public:
+  explicit root_builder(subtree& tree) : tree_(tree) {}
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override
+  {
+    if (depth_++==0) builder(tree_).onStartElement(fullname,atts);
+  }
+  void onEndElement(const XML_Char *) override
+  {
+    if (--depth_==0 && !text_.empty()) {
+      tree_.nodes[0].text = tree_.strings.store(text_.data(),text_.size());
+    }
+  }
+  void onCharacterData(const char * pBuf, int len) override
+  {
+    if (depth_==1) text_.append(pBuf,static_cast<size_t>(len));
+  }
+private:
+  subtree& tree_;
+  size_t depth_{0};
+  string text_;
+};
+
+size_t lazy_document::subtree::memory() const
+{
+  return sizeof(subtree)
+       + strings.capacity()
+       + nodes.capacity()*sizeof(node)
+       + attributes.capacity()*sizeof(attribute)
+       + children.capacity()*sizeof(uint32_t);
+}
+
+lazy_document::lazy_document(size_t memory_cap)
+: memory_cap_(memory_cap)
+{}
+
+parser::result lazy_document::load(const char* data, size_t len)
+{
+  data_ = data;
+  size_ = len;
+  root_.strings.clear();
+  root_.nodes.clear();
+  root_.attributes.clear();
+  second_level_.clear();
+  slots_.clear();
+  lru_.clear();
+  memory_used_ = 0;
+  last_error_ = parser::result::OK;
+
+  root_builder rb(root_);
+  parser::result res = structural_index::build(data, len, index_, 2, &rb);
+  if (res!=parser::result::OK) {
+    root_.nodes.clear();
+    return res;
+  }
+  const auto& entries = index_.entries();
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].depth==2) second_level_.push_back(i);
+  }
+  slots_.resize(second_level_.size());
+  return res;
+}
+
+parser::result lazy_document::load_file(const string& filename)
+{
+  if (!file_.open(filename)) return parser::result::ERROR_OPEN_FILE;
+  return load(file_.data(), file_.size());
+}
+
+lazy_element lazy_document::root()
+{
+  return root_.nodes.empty() ? lazy_element() : lazy_element(this, ROOT_SLOT, 0);
+}
+
+lazy_document::subtree& lazy_document::materialize(size_t slot)
+{
+  cache_slot& s = slots_[slot];
+  if (s.tree) {
+    lru_.splice(lru_.begin(), lru_, s.lru);
+    return *s.tree;
+  }
+
+  const structural_index::entry& e = index_.entries()[second_level_[slot]];
+  // small subtrees do not need the default block size
+  size_t block = static_cast<size_t>(e.end - e.begin);
+  block = block < 256 ? 256 : (block > 64*1024 ? 64*1024 : block);
+
+  s.tree.reset(new subtree(block));
+  builder b(*s.tree);
+  const parser::result res = index_.parse_subtree(data_, size_, second_level_[slot], b);
+  if (res==parser::result::OK) {
+    b.finish();
+  } else {
+    // a partial tree would miss elements silently
+    s.tree->nodes.clear();
+    s.tree->attributes.clear();
+    s.tree->strings.clear();
+    last_error_ = res;
+  }
+  ++materializations_;
+
+  memory_used_ += s.tree->memory();
+  lru_.push_front(slot);
+  s.lru = lru_.begin();
+  evict(slot);
+  return *s.tree;
+}
+
+void lazy_document::evict(size_t keep)
+{
+  while (memory_used_ > memory_cap_ && lru_.size() > 1) {
+    size_t victim = lru_.back();
+    if (victim==keep) break;
+    lru_.pop_back();
+    memory_used_ -= slots_[victim].tree->memory();
+    slots_[victim].tree.reset();
+  }
+}
+
+const lazy_document::subtree& lazy_document::tree_of(const lazy_element& e)
+{
+  return e.slot_==ROOT_SLOT ? root_ : materialize(e.slot_);
+}
+
+const lazy_document::node& lazy_document::node_of(const lazy_element& e)
+{
+  static const node EMPTY;
+  const subtree& t = tree_of(e);
+  return e.node_ < t.nodes.size() ? t.nodes[e.node_] : EMPTY;
+}
+
+string_ref lazy_element::name() const
+{
+  if (!doc_) return string_ref();
+  if (slot_!=lazy_document::ROOT_SLOT && node_==0) {
+    // the name of a second level element is known from the quick pass
+    const auto& e = doc_->index_.entries()[doc_->second_level_[slot_]];
+    const string& n = doc_->index_.name(e.name);
+    return string_ref(n.data(),n.size());
+  }
+  return doc_->node_of(*this).name;
+}
+
+string_ref lazy_element::text() const
+{
+  return doc_ ? doc_->node_of(*this).text : string_ref();
+}
+
+size_t lazy_element::attribute_count() const
+{
+  return doc_ ? doc_->node_of(*this).attribute_count : 0;
+}
+
+string_ref lazy_element::attribute_name(size_t i) const
+{
+  if (i >= attribute_count()) return string_ref();
+  const auto& t = doc_->tree_of(*this);
+  return t.attributes[t.nodes[node_].first_attribute + i].name;
+}
+
+string_ref lazy_element::attribute_value(size_t i) const
+{
+  if (i >= attribute_count()) return string_ref();
+  const auto& t = doc_->tree_of(*this);
+  return t.attributes[t.nodes[node_].first_attribute + i].value;
+}
+
+string_ref lazy_element::attribute(const char* key) const
+{
+  if (!doc_) return string_ref();
+  const auto& t = doc_->tree_of(*this);
+  const auto& n = doc_->node_of(*this);
+  for (uint32_t i = 0; i < n.attribute_count; ++i) {
+    const auto& a = t.attributes[n.first_attribute + i];
+    if (a.name==key) return a.value;
+  }
+  return string_ref();
+}
+
+size_t lazy_element::child_count() const
+{
+  if (!doc_) return 0;
+  if (slot_==lazy_document::ROOT_SLOT) return doc_->second_level_.size();
+  return doc_->node_of(*this).child_count;
+}
+
+lazy_element lazy_element::child(size_t i) const
+{
+  if (i >= child_count()) return lazy_element();
+  if (slot_==lazy_document::ROOT_SLOT) return lazy_element(doc_, i, 0);
+  const auto& t = doc_->tree_of(*this);
+  return lazy_element(doc_, slot_, t.children[t.nodes[node_].first_child + i]);
+}
+
+vector<lazy_element> lazy_element::children() const
+{
+  vector<lazy_element> result;
+  const size_t n = child_count();
+  result.reserve(n);
+  for (size_t i = 0; i < n; ++i) result.push_back(child(i));
+  return result;
+}
+
+lazy_element lazy_element::parent() const
+{
+  if (!doc_ || slot_==lazy_document::ROOT_SLOT) return lazy_element();
+  if (node_==0) return lazy_element(doc_, lazy_document::ROOT_SLOT, 0);
+  return lazy_element(doc_, slot_, doc_->node_of(*this).parent);
+}
@@ -0,0 +1,166 @@
+/**
+ * \file lazy_dom.hpp contains a document tree which materializes its
+ * subtrees on demand
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_lazy_dom_hpp
+#define xmlpp_lazy_dom_hpp
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "index.hpp"
+#include "mapped_file.hpp"
+
+namespace xmlpp {
+
+class lazy_document;
+
+/** handle of an element of a lazy_document.
+ *
+ * handles stay valid as long as the document exists, evicted subtrees are
+ * materialized again when accessed. The string_refs returned point into
+ * the arena of the materialized subtree, they are valid until the next
+ * access of another subtree, which may evict it.
+ */
+class lazy_element {
+public:
+  lazy_element() = default;
+
+  bool valid() const { return doc_!=nullptr; }
+  string_ref name() const;
+  /** direct character data of the element */
+  string_ref text() const;
+
+  size_t attribute_count() const;
+  string_ref attribute_name(size_t i) const;
+  string_ref attribute_value(size_t i) const;
+  /** @return value of the attribute, an empty ref if there is none */
+  string_ref attribute(const char* key) const;
+
+  size_t child_count() const;
+  lazy_element child(size_t i) const;
+  std::vector<lazy_element> children() const;
+  lazy_element parent() const;
+private:
+  friend class lazy_document;
+  lazy_element(lazy_document* doc, size_t slot, uint32_t node)
+  : doc_(doc), slot_(slot), node_(node)
+  {}
+
+  lazy_document* doc_{nullptr};
+  /** second level element the subtree belongs to, ROOT_SLOT for the root */
+  size_t slot_{0};
+  /** node in the materialized subtree */
+  uint32_t node_{0};
+};
+
+/** xml document with tree navigation for documents too big to be held in
+ * memory completely.
+ *
+ * loading does a quick pass which records only the byte ranges of the root
+ * element and its children (second level elements). The subtree of a
+ * second level element is parsed and stored in a compact arena when it is
+ * accessed first. When the memory used by materialized subtrees exceeds
+ * the memory cap, the least recently used subtrees are evicted.
+ *
+ * a subtree which can not be parsed alone, e.g. because it references an
+ * entity of the internal DTD subset (see structural_index), is empty: its
+ * second level element has its name but no attributes, text or children,
+ * last_error() tells the reason.
+ *
+ * the document data has to stay valid and unchanged as long as the
+ * document is used, load_file() maps the file into memory.
+ */
+class lazy_document {
+public:
+  static const size_t DEFAULT_MEMORY_CAP = 64*1024*1024;
+
+  explicit lazy_document(size_t memory_cap = DEFAULT_MEMORY_CAP);
+  lazy_document(const lazy_document&) = delete;
+  lazy_document& operator=(const lazy_document&) = delete;
+
+  /** does the quick pass over the document in memory */
+  parser::result load(const char* data, size_t len);
+  /** maps the file into memory and does the quick pass over it */
+  parser::result load_file(const std::string& filename);
+
+  /** root element, invalid if no document is loaded */
+  lazy_element root();
+
+  /** memory used by the materialized subtrees */
+  size_t memory_used() const { return memory_used_; }
+  size_t memory_cap() const { return memory_cap_; }
+  /** number of currently materialized subtrees */
+  size_t materialized() const { return lru_.size(); }
+  /** number of subtree materializations done so far */
+  size_t materializations() const { return materializations_; }
+  /** result of the last subtree which failed to parse, OK if none did
+   * since load() */
+  parser::result last_error() const { return last_error_; }
+private:
+  friend class lazy_element;
+  static const size_t ROOT_SLOT = SIZE_MAX;
+  static const uint32_t NO_NODE = 0xffffffffu;
+
+  struct node {
+    string_ref name;
+    string_ref text;
+    uint32_t parent{NO_NODE};
+    uint32_t first_attribute{0};
+    uint32_t attribute_count{0};
+    uint32_t first_child{0}; //< offset of the child list in children
+    uint32_t child_count{0};
+  };
+  struct attribute {
+    string_ref name;
+    string_ref value;
+  };
+  /** a materialized subtree, node 0 is the second level element */
+  struct subtree {
+    explicit subtree(size_t block_size = 64*1024) : strings(block_size) {}
+
+    arena strings;
+    std::vector<node> nodes;
+    std::vector<attribute> attributes;
+    /** child lists of the nodes, children of a node are adjacent */
+    std::vector<uint32_t> children;
+    size_t memory() const;
+  };
+  struct cache_slot {
+    std::unique_ptr<subtree> tree;
+    std::list<size_t>::iterator lru;
+  };
+  class builder;
+  class root_builder;
+
+  /** materializes the subtree of a second level element if needed */
+  subtree& materialize(size_t slot);
+  void evict(size_t keep);
+  const node& node_of(const lazy_element& e);
+  const subtree& tree_of(const lazy_element& e);
+
+  size_t memory_cap_;
+  size_t memory_used_{0};
+  size_t materializations_{0};
+  parser::result last_error_{parser::result::OK};
+  const char* data_{nullptr};
+  size_t size_{0};
+  mapped_file file_;
+  structural_index index_;
+  /** the root element with its attributes and text, children are slots */
+  subtree root_;
+  /** index entries of the second level elements */
+  std::vector<size_t> second_level_;
+  std::vector<cache_slot> slots_;
+  /** materialized slots, most recently used first */
+  std::list<size_t> lru_;
+};
+
+}
+#endif // #ifndef xmlpp_lazy_dom_hpp
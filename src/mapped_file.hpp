@@ -0,0 +1,40 @@
+/**
+ * \file mapped_file.hpp contains a read only memory mapped file
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_mapped_file_hpp
+#define xmlpp_mapped_file_hpp
+
+#include <string>
+
+namespace xmlpp {
+
+/** maps a file read only into memory */
+class mapped_file {
+public:
+  mapped_file() = default;
+  ~mapped_file();
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  /** maps the file, a mapped file is closed before
+   * @return true on success */
+  bool open(const std::string& filename);
+  void close();
+
+  bool is_open() const { return open_; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+private:
+  const char* data_{nullptr};
+  size_t size_{0};
+  bool open_{false};
+#if defined(_WIN32)
+  void* file_{nullptr};
+  void* mapping_{nullptr};
+#endif
+};
+
+}
+#endif // #ifndef xmlpp_mapped_file_hpp
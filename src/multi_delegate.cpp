@@ -0,0 +1,275 @@
+/**
+ * \file multi_delegate.cpp implementation of the fan out delegate
+ *
+ * See LICENSE for copyright information.
+ */
+#include <algorithm>
+#include <chrono>
+
+#include "multi_delegate.hpp"
+
+using xmlpp::multi_delegate;
+
+const multi_delegate::event_mask multi_delegate::ALL_EVENTS;
+constexpr multi_delegate::event_mask multi_delegate::CONTENT;
+
+namespace {
+
+/** waits until the consumers released the batch */
+template<typename Batch>
+void wait_released(const Batch& b)
+{
+  for (unsigned spins = 0; b.pending.load(std::memory_order_acquire)!=0; ++spins) {
+    if (spins < 64) continue;
+    if (spins < 128) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+}
+
+}
+
+multi_delegate::~multi_delegate()
+{
+  stop();
+}
+
+void multi_delegate::add(delegate& d, event_mask events)
+{
+  if (started_) return;
+  consumers_.emplace_back(d, events);
+  events_ |= events;
+  for (size_t e = 1; e < EVENT_TYPES; ++e) {
+    if (events & event_buffer::mask(static_cast<event>(e))) lists_[e].push_back(&d);
+  }
+}
+
+void multi_delegate::set_parallel(bool enable, size_t batch_bytes, unsigned batches)
+{
+  if (started_) return;
+  parallel_ = enable;
+  batch_bytes_ = std::max<size_t>(batch_bytes, 1);
+  batch_count_ = std::max(batches, 2u);
+}
+
+void multi_delegate::start()
+{
+  started_ = true;
+  if (!parallel_) return;
+  for (unsigned i = 0; i < batch_count_; ++i) {
+    batches_.emplace_back(new batch);
+    batches_.back()->events.reserve(batch_bytes_ + batch_bytes_/4);
+  }
+  current_ = 0;
+  recorder_.assign(1, &batches_[0]->events);
+  for (consumer& c : consumers_) {
+    c.queue.reset(new spsc_queue<batch*>(batch_count_ + 1));
+    consumer* self = &c;
+    c.thread = std::thread([self]() {
+        // the consumers replay the same batches, each with its own scratch
+        event_replayer replayer;
+        batch* b = nullptr;
+        while (self->queue->pop(b) && b) {
+          replayer.replay(b->events, *self->d, self->events);
+          b->pending.fetch_sub(1, std::memory_order_release);
+        }
+      });
+  }
+}
+
+const std::vector<xmlpp::delegate*>& multi_delegate::targets(event e)
+{
+  if (!started_) start();
+  if (!parallel_) return lists_[static_cast<size_t>(e)];
+  static const std::vector<delegate*> none;
+  return (events_ & event_buffer::mask(e)) ? recorder_ : none;
+}
+
+void multi_delegate::flush(bool force)
+{
+  if (!parallel_ || !started_) return;
+  batch& b = *batches_[current_];
+  if (b.events.empty() || (!force && b.events.size() < batch_bytes_)) return;
+  b.pending.store(static_cast<unsigned>(consumers_.size()), std::memory_order_relaxed);
+  for (consumer& c : consumers_) c.queue->push(&b);
+  current_ = (current_ + 1) % batches_.size();
+  batch& next = *batches_[current_];
+  wait_released(next);
+  next.events.clear();
+  recorder_[0] = &next.events;
+}
+
+void multi_delegate::finish()
+{
+  if (!parallel_ || !started_) return;
+  flush(true);
+  for (const std::unique_ptr<batch>& b : batches_) wait_released(*b);
+}
+
+void multi_delegate::stop()
+{
+  if (!parallel_ || !started_) return;
+  finish();
+  for (consumer& c : consumers_) {
+    c.queue->push(nullptr);
+    c.thread.join();
+  }
+}
+
+void multi_delegate::onStartElement(const XML_Char *fullname, const XML_Char **atts)
+{
+  for (delegate* d : targets(event::START_ELEMENT)) d->onStartElement(fullname, atts);
+  flush(false);
+}
+
+void multi_delegate::onEndElement(const XML_Char *fullname)
+{
+  for (delegate* d : targets(event::END_ELEMENT)) d->onEndElement(fullname);
+  flush(false);
+}
+
+void multi_delegate::onCharacterData(const char * pBuf, int len)
+{
+  for (delegate* d : targets(event::CHARACTER_DATA)) d->onCharacterData(pBuf, len);
+  flush(false);
+}
+
+void multi_delegate::onProcessingInstruction(const XML_Char* target, const XML_Char* data)
+{
+  for (delegate* d : targets(event::PROCESSING_INSTRUCTION)) {
+    d->onProcessingInstruction(target, data);
+  }
+  flush(false);
+}
+
+void multi_delegate::onUnparsedEntityDecl(const XML_Char* entityName,
+                                          const XML_Char* base,
+                                          const XML_Char* systemId,
+                                          const XML_Char* publicId,
+                                          const XML_Char* notationName)
+{
+  for (delegate* d : targets(event::UNPARSED_ENTITY_DECL)) {
+    d->onUnparsedEntityDecl(entityName, base, systemId, publicId, notationName);
+  }
+  flush(false);
+}
+
+void multi_delegate::onNotationDecl(const XML_Char* notationName,
+                                    const XML_Char* base,
+                                    const XML_Char* systemId,
+                                    const XML_Char* publicId)
+{
+  for (delegate* d : targets(event::NOTATION_DECL)) {
+    d->onNotationDecl(notationName, base, systemId, publicId);
+  }
+  flush(false);
+}
+
+void multi_delegate::onStartNamespace(const XML_Char* prefix, const XML_Char* uri)
+{
+  for (delegate* d : targets(event::START_NAMESPACE)) d->onStartNamespace(prefix, uri);
+  flush(false);
+}
+
+void multi_delegate::onEndNamespace(const XML_Char* prefix)
+{
+  for (delegate* d : targets(event::END_NAMESPACE)) d->onEndNamespace(prefix);
+  flush(false);
+}
+
+void multi_delegate::onAttlistDecl(const XML_Char *elname,
+                                   const XML_Char *attname,
+                                   const XML_Char *att_type,
+                                   const XML_Char *dflt,
+                                   bool            isrequired)
+{
+  for (delegate* d : targets(event::ATTLIST_DECL)) {
+    d->onAttlistDecl(elname, attname, att_type, dflt, isrequired);
+  }
+  flush(false);
+}
+
+void multi_delegate::onStartCdataSection()
+{
+  for (delegate* d : targets(event::START_CDATA_SECTION)) d->onStartCdataSection();
+  flush(false);
+}
+
+void multi_delegate::onEndCdataSection()
+{
+  for (delegate* d : targets(event::END_CDATA_SECTION)) d->onEndCdataSection();
+  flush(false);
+}
+
+void multi_delegate::onStartDoctypeDecl(const XML_Char *doctypeName,
+                                        const XML_Char *sysid,
+                                        const XML_Char *pubid,
+                                        int has_internal_subset)
+{
+  for (delegate* d : targets(event::START_DOCTYPE_DECL)) {
+    d->onStartDoctypeDecl(doctypeName, sysid, pubid, has_internal_subset);
+  }
+  flush(false);
+}
+
+void multi_delegate::onEndDoctypeDecl()
+{
+  for (delegate* d : targets(event::END_DOCTYPE_DECL)) d->onEndDoctypeDecl();
+  flush(false);
+}
+
+void multi_delegate::onComment(const XML_Char *data)
+{
+  for (delegate* d : targets(event::COMMENT)) d->onComment(data);
+  flush(false);
+}
+
+void multi_delegate::onElementDecl(const XML_Char *name, XML_Content *model)
+{
+  for (delegate* d : targets(event::ELEMENT_DECL)) d->onElementDecl(name, model);
+  flush(false);
+}
+
+void multi_delegate::onEntityDecl(const XML_Char *entityName,
+                                  int is_parameter_entity,
+                                  const XML_Char *value,
+                                  int value_length,
+                                  const XML_Char *base,
+                                  const XML_Char *systemId,
+                                  const XML_Char *publicId,
+                                  const XML_Char *notationName)
+{
+  for (delegate* d : targets(event::ENTITY_DECL)) {
+    d->onEntityDecl(entityName, is_parameter_entity, value, value_length,
+                    base, systemId, publicId, notationName);
+  }
+  flush(false);
+}
+
+void multi_delegate::onSkippedEntity(const XML_Char *entityName, int is_parameter_entity)
+{
+  for (delegate* d : targets(event::SKIPPED_ENTITY)) {
+    d->onSkippedEntity(entityName, is_parameter_entity);
+  }
+  flush(false);
+}
+
+void multi_delegate::onXmlDecl(const XML_Char *version, const XML_Char *encoding, int standalone)
+{
+  for (delegate* d : targets(event::XML_DECL)) d->onXmlDecl(version, encoding, standalone);
+  flush(false);
+}
+
+void multi_delegate::onParseError(size_t line, size_t column, size_t pos, Error error)
+{
+  for (delegate* d : targets(event::PARSE_ERROR)) d->onParseError(line, column, pos, error);
+  flush(false);
+}
+
+void multi_delegate::onEndDocument(size_t index)
+{
+  for (delegate* d : targets(event::END_DOCUMENT)) d->onEndDocument(index);
+  flush(false);
+}
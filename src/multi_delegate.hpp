@@ -0,0 +1,154 @@
+/**
+ * \file multi_delegate.hpp contains a delegate passing the events of one
+ * parse to several delegates
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_multi_delegate_hpp
+#define xmlpp_multi_delegate_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "event_buffer.hpp"
+#include "spsc_queue.hpp"
+
+namespace xmlpp {
+
+/** forwards each event to all registered delegates, several extractions
+ * from a document in one parse instead of one parse each.
+ *
+ * a delegate is registered with the set of events it handles, each event
+ * is dispatched only to the delegates registered for it:
+ * @code
+ * multi_delegate all;
+ * all.add(titles, multi_delegate::CONTENT);
+ * all.add(links, event_buffer::mask(event_buffer::event::START_ELEMENT));
+ * parser::parseFile(filename, all);
+ * @endcode
+ *
+ * in parallel mode each delegate runs on its own thread. The events are
+ * encoded into batches of event_buffer which all delegates replay, the
+ * delegates see the same events as in sequential mode but later. Call
+ * finish() after the parse before using the results of the delegates.
+ */
+class multi_delegate : public delegate {
+public:
+  typedef event_buffer::event event;
+  typedef event_buffer::event_mask event_mask;
+  static const event_mask ALL_EVENTS = event_buffer::ALL_EVENTS;
+  /** elements and character data */
+  static constexpr event_mask CONTENT = event_buffer::mask(event::START_ELEMENT)
+    | event_buffer::mask(event::END_ELEMENT) | event_buffer::mask(event::CHARACTER_DATA);
+
+  multi_delegate() = default;
+  ~multi_delegate() override;
+  multi_delegate(const multi_delegate&) = delete;
+  multi_delegate& operator=(const multi_delegate&) = delete;
+
+  /** registers a delegate for the events in the mask, before the first
+   * event only */
+  void add(delegate& d, event_mask events = ALL_EVENTS);
+  size_t size() const { return consumers_.size(); }
+
+  /** runs each delegate on its own thread, before the first event only
+   * @param batch_bytes the encoded events are handed to the threads in
+   * batches of about this size
+   * @param batches number of batches in flight, the parse waits for the
+   * slowest delegate when all are in use */
+  void set_parallel(bool enable, size_t batch_bytes = 64*1024, unsigned batches = 8);
+  bool parallel() const { return parallel_; }
+  /** hands the pending events to the threads and waits until all
+   * delegates processed them, does nothing in sequential mode */
+  void finish();
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override;
+  void onEndElement(const XML_Char *fullname) override;
+  void onCharacterData(const char * pBuf, int len) override;
+  void onProcessingInstruction(const XML_Char* target,
+                               const XML_Char* data) override;
+  void onUnparsedEntityDecl(const XML_Char* entityName,
+                            const XML_Char* base,
+                            const XML_Char* systemId,
+                            const XML_Char* publicId,
+                            const XML_Char* notationName) override;
+  void onNotationDecl(const XML_Char* notationName,
+                      const XML_Char* base,
+                      const XML_Char* systemId,
+                      const XML_Char* publicId) override;
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override;
+  void onEndNamespace(const XML_Char* prefix) override;
+  void onAttlistDecl(const XML_Char *elname,
+                     const XML_Char *attname,
+                     const XML_Char *att_type,
+                     const XML_Char *dflt,
+                     bool            isrequired) override;
+  void onStartCdataSection() override;
+  void onEndCdataSection() override;
+  void onStartDoctypeDecl(const XML_Char *doctypeName,
+                          const XML_Char *sysid,
+                          const XML_Char *pubid,
+                          int has_internal_subset) override;
+  void onEndDoctypeDecl() override;
+  void onComment(const XML_Char *data) override;
+  void onElementDecl(const XML_Char *name, XML_Content *model) override;
+  void onEntityDecl(const XML_Char *entityName,
+                    int is_parameter_entity,
+                    const XML_Char *value,
+                    int value_length,
+                    const XML_Char *base,
+                    const XML_Char *systemId,
+                    const XML_Char *publicId,
+                    const XML_Char *notationName) override;
+  void onSkippedEntity(const XML_Char *entityName,
+                       int is_parameter_entity) override;
+  void onXmlDecl(const XML_Char *version,
+                 const XML_Char *encoding,
+                 int standalone) override;
+  void onParseError(size_t line, size_t column, size_t pos, Error error) override;
+  void onEndDocument(size_t index) override;
+
+private:
+  static const size_t EVENT_TYPES = static_cast<size_t>(event::END_DOCUMENT) + 1;
+
+  /** events of a batch, released when all consumers replayed them */
+  struct batch {
+    event_buffer events;
+    std::atomic<unsigned> pending{0};
+  };
+  struct consumer {
+    consumer(delegate& _d, event_mask _events) : d(&_d), events(_events) {}
+    delegate* d;
+    event_mask events;
+    /** batches to replay, nullptr stops the thread */
+    std::unique_ptr<spsc_queue<batch*>> queue;
+    std::thread thread;
+  };
+
+  /** @return the delegates of the event in sequential mode, the event
+   * buffer of the current batch in parallel mode */
+  const std::vector<delegate*>& targets(event e);
+  void start();
+  /** passes the current batch to the consumers if it is full enough */
+  void flush(bool force);
+  void stop();
+
+  std::vector<consumer> consumers_;
+  std::vector<delegate*> lists_[EVENT_TYPES];
+  /** events of all consumers */
+  event_mask events_{0};
+  bool parallel_{false};
+  bool started_{false};
+  size_t batch_bytes_{64*1024};
+  unsigned batch_count_{8};
+  std::vector<std::unique_ptr<batch>> batches_;
+  size_t current_{0};
+  /** the events of the current batch as only target */
+  std::vector<delegate*> recorder_;
+};
+
+}
+#endif // #ifndef xmlpp_multi_delegate_hpp
@@ -0,0 +1,145 @@
+/**
+ * \file numarray.cpp implementation of the number array parser
+ *
+ * See LICENSE for copyright information.
+ */
+#include "numarray.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XMLPP_NUMARRAY_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+using xmlpp::conv_error;
+using xmlpp::number_array_parser;
+
+namespace {
+
+inline bool is_space(char c)
+{
+  return c==' ' || c=='\t' || c=='\n' || c=='\r';
+}
+
+#ifdef XMLPP_NUMARRAY_SSE2
+/** @return bit i set if byte i of the 16 bytes at p is xml whitespace */
+inline unsigned space_mask(const char* p)
+{
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  const __m128i m = _mm_or_si128(
+    _mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8(' ')),
+                 _mm_cmpeq_epi8(v,_mm_set1_epi8('\t'))),
+    _mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8('\n')),
+                 _mm_cmpeq_epi8(v,_mm_set1_epi8('\r'))));
+  return static_cast<unsigned>(_mm_movemask_epi8(m));
+}
+
+inline unsigned lowest_bit(unsigned mask)
+{
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanForward(&i,mask);
+  return static_cast<unsigned>(i);
+#else
+  return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+}
+
+template<typename T>
+bool number_array_parser<T>::feed(const char* data, size_t len)
+{
+  if (error_!=conv_error::NONE) return false;
+  const char* const end = data + len;
+  const char* p = data;
+  // a pending number continues at the beginning of the fragment
+  bool in_token = !pending_.empty();
+  const char* begin = data;
+
+  auto token_end = [&](const char* last)
+    {
+      if (pending_.empty()) {
+        convert_token(begin,last);
+      } else {
+        pending_.append(begin,last);
+        convert_token(pending_.data(),pending_.data()+pending_.size());
+        pending_.clear();
+      }
+    };
+
+#ifdef XMLPP_NUMARRAY_SSE2
+  for (; end - p >= 16; p += 16) {
+    const unsigned spaces = space_mask(p);
+    // bits where the byte differs in being whitespace from its predecessor
+    unsigned edges = (spaces ^ ((spaces << 1) | (in_token ? 0u : 1u))) & 0xffffu;
+    while (edges) {
+      const char* q = p + lowest_bit(edges);
+      edges &= edges - 1;
+      if (in_token) {
+        token_end(q);
+        if (error_!=conv_error::NONE) return false;
+      } else {
+        begin = q;
+      }
+      in_token = !in_token;
+    }
+  }
+#endif
+  for (; p < end; ++p) {
+    const bool space = is_space(*p);
+    if (in_token && space) {
+      token_end(p);
+      if (error_!=conv_error::NONE) return false;
+      in_token = false;
+    } else if (!in_token && !space) {
+      begin = p;
+      in_token = true;
+    }
+  }
+  if (in_token) pending_.append(begin,end);
+  return true;
+}
+
+template<typename T>
+conv_error number_array_parser<T>::finish()
+{
+  if (!pending_.empty() && error_==conv_error::NONE) {
+    convert_token(pending_.data(),pending_.data()+pending_.size());
+  }
+  pending_.clear();
+  return error_;
+}
+
+template<typename T>
+void number_array_parser<T>::reset()
+{
+  pending_.clear();
+  error_ = conv_error::NONE;
+  error_index_ = 0;
+}
+
+template<typename T>
+std::function<void (const char *pBuf, int len)> number_array_parser<T>::text_handler()
+{
+  return [this](const char *pBuf, int len) { feed(pBuf,static_cast<size_t>(len)); };
+}
+
+template<typename T>
+void number_array_parser<T>::convert_token(const char* first, const char* last)
+{
+  T value;
+  const conv_error e = convert(first,last,value);
+  if (e==conv_error::NONE) {
+    values_->push_back(value);
+  } else {
+    error_ = e;
+    error_index_ = values_->size();
+  }
+}
+
+template class xmlpp::number_array_parser<double>;
+template class xmlpp::number_array_parser<int64_t>;
@@ -0,0 +1,76 @@
+/**
+ * \file numarray.hpp contains a parser for whitespace separated number
+ * arrays in character data
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_numarray_hpp
+#define xmlpp_numarray_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "numconv.hpp"
+
+namespace xmlpp {
+
+/** converts the whitespace separated numbers of a text node into a vector.
+ *
+ * the character data of a text node arrives in fragments split at
+ * arbitrary positions, feed() tokenizes each fragment and converts the
+ * complete numbers directly from the parser buffer. A number at the end of
+ * a fragment is kept until the following fragment or finish(). The
+ * tokenizer classifies 16 bytes at once with SSE2 where available.
+ *
+ * conversion stops at the first invalid number, error() and error_index()
+ * report it. Instantiated for double and int64_t.
+ *
+ * usage with a State:
+ * \code
+ * std::vector<double> values;
+ * number_array_parser<double> p(values);
+ * State s{"values",
+ *         [&](const XML_Char**) { p.reset(); },
+ *         [&]() { p.finish(); },
+ *         p.text_handler()};
+ * \endcode
+ */
+template<typename T>
+class number_array_parser {
+public:
+  explicit number_array_parser(std::vector<T>& values) : values_(&values) {}
+
+  /** converts the complete numbers of the fragment
+   * @return false if an invalid number was found */
+  bool feed(const char* data, size_t len);
+  /** converts a number pending from the last fragment, to be called at the
+   * end of the text node
+   * @return the first error of the text node */
+  conv_error finish();
+  /** prepares for the next text node, the values are appended */
+  void reset();
+
+  conv_error error() const { return error_; }
+  /** index in the vector the first invalid number would have had */
+  size_t error_index() const { return error_index_; }
+
+  /** @return callback feeding the fragments, usable as State::pfText */
+  std::function<void (const char *pBuf, int len)> text_handler();
+private:
+  void convert_token(const char* first, const char* last);
+
+  std::vector<T>* values_;
+  /** beginning of a number split by the fragment boundary */
+  std::string pending_;
+  conv_error error_{conv_error::NONE};
+  size_t error_index_{0};
+};
+
+extern template class number_array_parser<double>;
+extern template class number_array_parser<int64_t>;
+
+}
+#endif // #ifndef xmlpp_numarray_hpp
@@ -0,0 +1,278 @@
+/**
+ * \file numconv.cpp implementation of the numeric conversions
+ *
+ * See LICENSE for copyright information.
+ */
+#include "expatpp_config.h"
+
+#include <cerrno>
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#if defined(HAVE_STRTOD_L)
+#include <locale.h>
+#if defined(__APPLE__) || defined(__FreeBSD__)
+#include <xlocale.h>
+#endif
+#endif
+
+#include "numconv.hpp"
+
+using xmlpp::conv_error;
+
+namespace {
+
+bool is_space(char c)
+{
+  return c==' ' || c=='\t' || c=='\n' || c=='\r';
+}
+
+bool is_digit(char c)
+{
+  return c>='0' && c<='9';
+}
+
+void trim(const char*& first, const char*& last)
+{
+  while (first < last && is_space(*first)) ++first;
+  while (first < last && is_space(last[-1])) --last;
+}
+
+/** converts sign and digits to the magnitude */
+conv_error magnitude(const char* first, const char* last, bool& negative, uint64_t& value)
+{
+  trim(first,last);
+  negative = false;
+  if (first < last && (*first=='+' || *first=='-')) {
+    negative = *first=='-';
+    ++first;
+  }
+  if (first==last) return conv_error::INVALID;
+  uint64_t v = 0;
+  for (; first < last; ++first) {
+    if (!is_digit(*first)) return conv_error::INVALID;
+    const unsigned d = static_cast<unsigned>(*first - '0');
+    if (v > (UINT64_MAX - d) / 10) {
+      // the remaining characters have to be digits all the same
+      while (++first < last) {
+        if (!is_digit(*first)) return conv_error::INVALID;
+      }
+      return conv_error::OUT_OF_RANGE;
+    }
+    v = v*10 + d;
+  }
+  value = v;
+  return conv_error::NONE;
+}
+
+template<typename T>
+conv_error convert_signed(const char* first, const char* last, T& value)
+{
+  bool negative;
+  uint64_t m;
+  conv_error e = magnitude(first,last,negative,m);
+  if (e!=conv_error::NONE) return e;
+  const uint64_t max = static_cast<uint64_t>(std::numeric_limits<T>::max());
+  if (negative) {
+    if (m > max + 1) return conv_error::OUT_OF_RANGE;
+    // negate in unsigned arithmetic to handle the minimum
+    value = m==max+1 ? std::numeric_limits<T>::min() : -static_cast<T>(m);
+  } else {
+    if (m > max) return conv_error::OUT_OF_RANGE;
+    value = static_cast<T>(m);
+  }
+  return conv_error::NONE;
+}
+
+template<typename T>
+conv_error convert_unsigned(const char* first, const char* last, T& value)
+{
+  bool negative;
+  uint64_t m;
+  conv_error e = magnitude(first,last,negative,m);
+  if (e!=conv_error::NONE) return e;
+  if (negative && m!=0) return conv_error::OUT_OF_RANGE;
+  if (m > std::numeric_limits<T>::max()) return conv_error::OUT_OF_RANGE;
+  value = static_cast<T>(m);
+  return conv_error::NONE;
+}
+
+/** powers of ten exactly representable as double */
+const double POW10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/** conversion of the values the fast path cannot convert exactly,
+ * strtod needs a terminated string. The literal is converted in the C
+ * locale, strtod alone would read "1.5" as 1 in a locale with a decimal
+ * comma */
+conv_error convert_strtod(const char* first, const char* last, double& value)
+{
+  const size_t len = static_cast<size_t>(last - first);
+  char buf[64];
+  std::string long_literal;
+  char* s = buf;
+  if (len < sizeof(buf)) {
+    memcpy(buf,first,len);
+    buf[len] = 0;
+  } else {
+    long_literal.assign(first,len);
+    s = &long_literal[0];
+  }
+  char* end = nullptr;
+  errno = 0;
+#if defined(HAVE_STRTOD_L)
+  static const locale_t c_locale = newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0));
+  const double v = strtod_l(s,&end,c_locale);
+#else
+  // the literal has passed the syntax check, only the decimal point
+  // differs between the locales
+  const char point = *localeconv()->decimal_point;
+  if (point!='.') {
+    char* dot = static_cast<char*>(memchr(s,'.',len));
+    if (dot) *dot = point;
+  }
+  const double v = strtod(s,&end);
+#endif
+  if (end!=s + len) return conv_error::INVALID;
+  if (errno==ERANGE && std::isinf(v)) return conv_error::OUT_OF_RANGE;
+  value = v;
+  return conv_error::NONE;
+}
+
+}
+
+conv_error xmlpp::convert(const char* first, const char* last, int32_t& value)
+{
+  return convert_signed(first,last,value);
+}
+
+conv_error xmlpp::convert(const char* first, const char* last, int64_t& value)
+{
+  return convert_signed(first,last,value);
+}
+
+conv_error xmlpp::convert(const char* first, const char* last, uint32_t& value)
+{
+  return convert_unsigned(first,last,value);
+}
+
+conv_error xmlpp::convert(const char* first, const char* last, uint64_t& value)
+{
+  return convert_unsigned(first,last,value);
+}
+
+conv_error xmlpp::convert(const char* first, const char* last, double& value)
+{
+  trim(first,last);
+  const char* p = first;
+  bool negative = false;
+  if (p < last && (*p=='+' || *p=='-')) {
+    negative = *p=='-';
+    ++p;
+  }
+  if (last - p==3 && memcmp(p,"INF",3)==0) {
+    value = negative ? -std::numeric_limits<double>::infinity()
+                     : std::numeric_limits<double>::infinity();
+    return conv_error::NONE;
+  }
+  if (last - first==3 && memcmp(first,"NaN",3)==0) {
+    value = std::numeric_limits<double>::quiet_NaN();
+    return conv_error::NONE;
+  }
+
+  // up to 19 significant digits fit into the mantissa
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool truncated = false;
+  bool any = false;
+  for (; p < last && is_digit(*p); ++p) {
+    any = true;
+    if (mantissa==0 && *p=='0') continue;
+    if (digits < 19) {
+      mantissa = mantissa*10 + static_cast<unsigned>(*p - '0');
+      ++digits;
+    } else {
+      ++exponent;
+      truncated = truncated || *p!='0';
+    }
+  }
+  if (p < last && *p=='.') {
+    for (++p; p < last && is_digit(*p); ++p) {
+      any = true;
+      if (mantissa==0 && *p=='0') {
+        --exponent;
+      } else if (digits < 19) {
+        mantissa = mantissa*10 + static_cast<unsigned>(*p - '0');
+        ++digits;
+        --exponent;
+      } else {
+        truncated = truncated || *p!='0';
+      }
+    }
+  }
+  if (!any) return conv_error::INVALID;
+  if (p < last && (*p=='e' || *p=='E')) {
+    ++p;
+    bool negative_exponent = false;
+    if (p < last && (*p=='+' || *p=='-')) {
+      negative_exponent = *p=='-';
+      ++p;
+    }
+    if (p==last) return conv_error::INVALID;
+    int e = 0;
+    for (; p < last && is_digit(*p); ++p) {
+      if (e < 100000) e = e*10 + (*p - '0');
+    }
+    exponent += negative_exponent ? -e : e;
+  }
+  if (p!=last) return conv_error::INVALID;
+
+  if (mantissa==0) {
+    value = negative ? -0.0 : 0.0;
+    return conv_error::NONE;
+  }
+  // Clinger's fast path: mantissa and power of ten are exact doubles so
+  // one correctly rounded operation gives the correctly rounded result
+  if (!truncated && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+    double v = static_cast<double>(mantissa);
+    v = exponent < 0 ? v / POW10[-exponent] : v * POW10[exponent];
+    value = negative ? -v : v;
+    return conv_error::NONE;
+  }
+  return convert_strtod(first,last,value);
+}
+
+conv_error xmlpp::convert(const char* first, const char* last, bool& value)
+{
+  trim(first,last);
+  switch (last - first) {
+    case 1:
+      if (*first=='1' || *first=='0') {
+        value = *first=='1';
+        return conv_error::NONE;
+      }
+      break;
+    case 4:
+      if (memcmp(first,"true",4)==0) {
+        value = true;
+        return conv_error::NONE;
+      }
+      break;
+    case 5:
+      if (memcmp(first,"false",5)==0) {
+        value = false;
+        return conv_error::NONE;
+      }
+      break;
+    default:
+      break;
+  }
+  return conv_error::INVALID;
+}
@@ -0,0 +1,40 @@
+/**
+ * \file numconv.hpp contains allocation free conversions of xml values to
+ * numbers and booleans
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_numconv_hpp
+#define xmlpp_numconv_hpp
+
+#include <cstdint>
+
+namespace xmlpp {
+
+/** result of a conversion */
+enum class conv_error : uint8_t {
+  NONE,         //< converted
+  MISSING,      //< no value, e.g. the attribute is not present
+  INVALID,      //< the value is no valid literal of the type
+  OUT_OF_RANGE  //< the value does not fit into the type
+};
+
+/** @name conversions of the characters [first,last)
+ *
+ * leading and trailing xml whitespace is ignored as the xsd numeric and
+ * boolean types collapse whitespace. The integers accept an optional sign
+ * followed by decimal digits, the floating point conversion accepts the
+ * xsd:double lexical space including INF, -INF and NaN, booleans are
+ * true, false, 1 or 0. The value is only written on success.
+ */
+///@{
+conv_error convert(const char* first, const char* last, int32_t& value);
+conv_error convert(const char* first, const char* last, int64_t& value);
+conv_error convert(const char* first, const char* last, uint32_t& value);
+conv_error convert(const char* first, const char* last, uint64_t& value);
+conv_error convert(const char* first, const char* last, double& value);
+conv_error convert(const char* first, const char* last, bool& value);
+///@}
+
+}
+#endif // #ifndef xmlpp_numconv_hpp
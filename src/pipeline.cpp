@@ -0,0 +1,234 @@
+/**
+ * \file pipeline.cpp implementation of the pipelined parse
+ *
+ * See LICENSE for copyright information.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "decompressor.hpp"
+#include "event_buffer.hpp"
+#include "pipeline.hpp"
+#include "spsc_queue.hpp"
+
+using xmlpp::event_buffer;
+using xmlpp::event_replayer;
+using xmlpp::parser;
+using xmlpp::spsc_queue;
+
+namespace {
+
+/** read buffer, passed from the reader to the parser and back */
+struct chunk {
+  std::vector<char> data;
+  size_t size{0};
+  bool final{false};
+  bool error{false};
+};
+
+/** the reader thread, fills a ring of chunks until the end of the input */
+class read_stage {
+public:
+  read_stage(const xmlpp::read_function& read, const xmlpp::pipeline_options& options)
+  : chunks_(std::max(options.read_buffers, 2u)),
+    // the queues hold all buffers, pushing never waits
+    free_(chunks_.size()),
+    full_(chunks_.size())
+  {
+    for (chunk& c : chunks_) {
+      c.data.resize(std::max<size_t>(options.read_size, 1));
+      free_.push(&c);
+    }
+    thread_ = std::thread([this, &read]() {
+        chunk* c = nullptr;
+        while (!stop_.load(std::memory_order_relaxed) && free_.pop(c, &stop_)) {
+          const long n = read(c->data.data(), c->data.size());
+          c->error = n < 0;
+          c->size = n > 0 ? static_cast<size_t>(n) : 0;
+          c->final = n <= 0;
+          full_.push(c);
+          if (c->final) return;
+        }
+      });
+  }
+  ~read_stage() { stop(); }
+
+  /** waits for the next chunk of the input */
+  chunk* next()
+  {
+    chunk* c = nullptr;
+    full_.pop(c);
+    return c;
+  }
+  void release(chunk* c) { free_.push(c); }
+  /** stops reading and waits for the thread */
+  void stop()
+  {
+    if (!thread_.joinable()) return;
+    stop_.store(true, std::memory_order_relaxed);
+    thread_.join();
+  }
+private:
+  std::vector<chunk> chunks_;
+  spsc_queue<chunk*> free_;
+  spsc_queue<chunk*> full_;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+/** events of a parse slice, passed from the parser to the consumer and
+ * back */
+struct event_batch {
+  event_buffer events;
+  bool last{false};     //< the parser stopped after this batch
+};
+
+/** opens the file and runs parse with a read function decompressing it */
+template<typename Parse>
+parser::result parse_file_with(const std::string& filename, Parse parse)
+{
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (!file) return parser::ERROR_OPEN_FILE;
+  xmlpp::decompressor input(file);
+  parser::result result = parse([&input](char* buffer, size_t size) {
+      return input.read(buffer, size);
+    });
+  if (result==parser::READ_ERROR && input.error()!=xmlpp::decompressor::error_t::NONE) {
+    result = xmlpp::to_result(input.error());
+  }
+  fclose(file);
+  return result;
+}
+
+}
+
+parser::result xmlpp::parse_pipelined(const read_function& read, delegate& d,
+                                      const pipeline_options& options,
+                                      parser::statistics* stats)
+{
+  const size_t slice = std::max<size_t>(options.parse_slice, 1);
+  std::vector<event_batch> batches(std::max(options.event_buffers, 2u));
+  // the queues hold all buffers, pushing never waits
+  spsc_queue<event_batch*> free_batches(batches.size());
+  spsc_queue<event_batch*> full_batches(batches.size());
+  for (event_batch& b : batches) {
+    b.events.reserve(2*slice);
+    free_batches.push(&b);
+  }
+  parser::result result = parser::OK;
+  read_stage reader(read, options);
+
+  std::thread parsing([&]() {
+    forwarding_delegate forward;
+    parser p(forward);
+    p.set_limits(options.limits);
+    if (!options.reparse_deferral) p.set_reparse_deferral(false);
+    event_batch* batch = nullptr;
+    auto take = [&]() {
+      free_batches.pop(batch);
+      batch->events.clear();
+      forward.set_next(&batch->events);
+    };
+    take();
+    for (;;) {
+      chunk* c = reader.next();
+      const bool final = c->final;
+      if (c->error) {
+        result = parser::READ_ERROR;
+        reader.release(c);
+        break;
+      }
+      parser::status_t status = parser::status_t::OK;
+      for (size_t offset = 0;;) {
+        const size_t len = std::min(slice, c->size - offset);
+        const bool last_slice = offset + len==c->size;
+        status = p.parse(c->data.data() + offset, static_cast<int>(len), final && last_slice);
+        if (status==parser::status_t::ERROR) break;
+        offset += len;
+        if (!batch->events.empty()) {
+          full_batches.push(batch);
+          take();
+        }
+        if (last_slice) break;
+      }
+      reader.release(c);
+      if (status==parser::status_t::ERROR) {
+        batch->events.onParseError(p.current_line_number(), p.current_column_number(),
+                                   p.current_byte_index(),
+                                   Error(static_cast<XML_Error>(p.errorcode())));
+        result = parser::PARSE_ERROR;
+        break;
+      }
+      if (final) break;
+    }
+    reader.stop();
+    if (stats) *stats = p.stats();
+    batch->last = true;
+    full_batches.push(batch);
+  });
+
+  event_replayer replayer;
+  for (;;) {
+    event_batch* batch = nullptr;
+    full_batches.pop(batch);
+    replayer.replay(batch->events, d);
+    const bool last = batch->last;
+    batch->last = false;
+    free_batches.push(batch);
+    if (last) break;
+  }
+  parsing.join();
+  return result;
+}
+
+parser::result xmlpp::parse_file_pipelined(const std::string& filename, delegate& d,
+                                           const pipeline_options& options,
+                                           parser::statistics* stats)
+{
+  return parse_file_with(filename, [&](const read_function& read) {
+      return parse_pipelined(read, d, options, stats);
+    });
+}
+
+parser::result xmlpp::parse_read_ahead(const read_function& read, delegate& d,
+                                       const pipeline_options& options,
+                                       parser::statistics* stats)
+{
+  parser p(d);
+  p.set_limits(options.limits);
+  if (!options.reparse_deferral) p.set_reparse_deferral(false);
+  parser::result result = parser::OK;
+  read_stage reader(read, options);
+  for (;;) {
+    chunk* c = reader.next();
+    const bool final = c->final;
+    if (c->error) {
+      result = parser::READ_ERROR;
+      break;
+    }
+    const parser::status_t status = p.parse(c->data.data(), static_cast<int>(c->size), final);
+    reader.release(c);
+    if (status==parser::status_t::ERROR) {
+      d.onParseError(p.current_line_number(), p.current_column_number(),
+                     p.current_byte_index(), Error(static_cast<XML_Error>(p.errorcode())));
+      result = parser::PARSE_ERROR;
+      break;
+    }
+    if (final) break;
+  }
+  reader.stop();
+  if (stats) *stats = p.stats();
+  return result;
+}
+
+parser::result xmlpp::parse_file_read_ahead(const std::string& filename, delegate& d,
+                                            const pipeline_options& options,
+                                            parser::statistics* stats)
+{
+  return parse_file_with(filename, [&](const read_function& read) {
+      return parse_read_ahead(read, d, options, stats);
+    });
+}
@@ -0,0 +1,80 @@
+/**
+ * \file pipeline.hpp contains the three stage pipelined parse of large
+ * inputs
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_pipeline_hpp
+#define xmlpp_pipeline_hpp
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include "xmlparser.hpp"
+
+namespace xmlpp {
+
+/** sizes of the buffers connecting the stages and the limits of the parser */
+struct pipeline_options {
+  size_t read_size{1024*1024};     //< bytes per read buffer
+  unsigned read_buffers{4};
+  /** input passed to expat per call, the events of a slice are handed
+   * to the consumer as one event_buffer */
+  size_t parse_slice{64*1024};
+  unsigned event_buffers{8};
+  /** limits of the parser, see parser::set_limits() */
+  parser::limits limits;
+  /** see parser::set_reparse_deferral() */
+  bool reparse_deferral{true};
+};
+
+/** parses the input with three threads connected by lock-free single
+ * producer single consumer queues:
+ * - a reader thread calls read into a ring of read buffers
+ * - a parser thread runs expat and encodes the events into event_buffer
+ *   objects
+ * - the calling thread decodes the events and calls the delegate
+ *
+ * the delegate is called on the calling thread only, the events are the
+ * same as those of parser::parseFile() except that character data may be
+ * split at other positions. Pays off when the delegate does work in the
+ * order of the parse cost and the machine has cores to spare, otherwise
+ * the encoding and the hand over cost throughput.
+ *
+ * @param stats receives the statistics of the parser if not null
+ * @return parser::OK, READ_ERROR or PARSE_ERROR after onParseError()
+ */
+parser::result parse_pipelined(const read_function& read, delegate& d,
+                               const pipeline_options& options = pipeline_options(),
+                               parser::statistics* stats = nullptr);
+
+/** parse_pipelined() of a file, compressed files are decompressed by the
+ * reader thread (see decompressor)
+ * @return ERROR_OPEN_FILE if the file can not be opened, INVALID_INPUT for
+ * corrupt compressed data or a compression not built in */
+parser::result parse_file_pipelined(const std::string& filename, delegate& d,
+                                    const pipeline_options& options = pipeline_options(),
+                                    parser::statistics* stats = nullptr);
+
+/** parses the input with two threads: a reader thread calls read into a
+ * ring of read buffers (options.read_size and read_buffers), the calling
+ * thread parses them and calls the delegate.
+ *
+ * pays off when reading costs, e.g. decompression, the events are those
+ * of parser::parseFile().
+ * @return parser::OK, READ_ERROR or PARSE_ERROR after onParseError()
+ */
+parser::result parse_read_ahead(const read_function& read, delegate& d,
+                                const pipeline_options& options = pipeline_options(),
+                                parser::statistics* stats = nullptr);
+
+/** parse_read_ahead() of a file, compressed files are decompressed by the
+ * reader thread
+ * @return as parse_file_pipelined() */
+parser::result parse_file_read_ahead(const std::string& filename, delegate& d,
+                                     const pipeline_options& options = pipeline_options(),
+                                     parser::statistics* stats = nullptr);
+
+}
+#endif // #ifndef xmlpp_pipeline_hpp
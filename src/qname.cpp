@@ -0,0 +1,154 @@
+/**
+ * \file qname.cpp implementation of the split namespace qualified names
+ *
+ * See LICENSE for copyright information.
+ */
+#include <cstring>
+
+#include "qname.hpp"
+#include "xmlparser.hpp"
+
+using xmlpp::qname;
+using xmlpp::qname_delegate;
+using xmlpp::string_ref;
+
+namespace {
+
+const char SEPARATOR = xmlpp::parser::TRIPLET_SEPARATOR;
+/** bound to the prefix xml without declaration */
+const char XML_NAMESPACE[] = "http://www.w3.org/XML/1998/namespace";
+
+/** @return the position of the last separator before end, -1 if none */
+long last_separator(const char* s, size_t end)
+{
+  while (end > 0) {
+    if (s[--end]==SEPARATOR) return static_cast<long>(end);
+  }
+  return -1;
+}
+
+string_ref ref(const XML_Char* s)
+{
+  return s ? string_ref(s, strlen(s)) : string_ref("", 0);
+}
+
+}
+
+const uint32_t qname_delegate::NO_NAMESPACE;
+
+qname_delegate::qname_delegate()
+{
+  clear_uris();
+}
+
+uint32_t qname_delegate::intern_uri(string_ref uri)
+{
+  if (uri.empty()) return NO_NAMESPACE;
+  const auto it = ids_.find(uri);
+  if (it!=ids_.end()) return it->second;
+  const uint32_t id = static_cast<uint32_t>(uris_.size());
+  const string_ref stored = strings_.store(uri.data, uri.size);
+  uris_.push_back(stored);
+  ids_.emplace(stored, id);
+  return id;
+}
+
+uint32_t qname_delegate::find_uri(string_ref uri) const
+{
+  const auto it = ids_.find(uri);
+  return it==ids_.end() ? NO_NAMESPACE : it->second;
+}
+
+void qname_delegate::clear_uris()
+{
+  ids_.clear();
+  uris_.clear();
+  strings_.clear();
+  bindings_.clear();
+  uris_.push_back(string_ref("", 0));
+  const uint32_t xml = intern_uri(string_ref(XML_NAMESPACE, sizeof(XML_NAMESPACE) - 1));
+  bindings_.push_back(binding{string_ref("xml", 3), xml});
+}
+
+qname qname_delegate::split(const XML_Char* name, bool attribute)
+{
+  qname q;
+  const size_t size = strlen(name);
+  const long last = last_separator(name, size);
+  if (last < 0) {
+    q.local = string_ref(name, size);
+    return q;
+  }
+  const size_t first = static_cast<size_t>(last);
+  const string_ref tail(name + first + 1, size - first - 1);
+
+  // uri, local name and prefix: the prefix in scope gives the length of
+  // the uri
+  for (auto b = bindings_.rbegin(); b!=bindings_.rend(); ++b) {
+    if (b->prefix!=tail) continue;
+    const size_t uri_size = uris_[b->uri].size;
+    if (b->uri!=NO_NAMESPACE && uri_size < first && name[uri_size]==SEPARATOR) {
+      q.uri = b->uri;
+      q.local = string_ref(name + uri_size + 1, first - uri_size - 1);
+      q.prefix = tail;
+      return q;
+    }
+    break;
+  }
+  // uri and local name of the default namespace, not for attributes
+  if (!attribute) {
+    for (auto b = bindings_.rbegin(); b!=bindings_.rend(); ++b) {
+      if (!b->prefix.empty()) continue;
+      if (b->uri!=NO_NAMESPACE && uris_[b->uri].size==first) {
+        q.uri = b->uri;
+        q.local = tail;
+        return q;
+      }
+      break;
+    }
+  }
+  // undeclared, intern the uri
+  const long before = last_separator(name, first);
+  if (before < 0) {
+    q.local = tail;
+    q.uri = intern_uri(string_ref(name, first));
+  } else {
+    const size_t uri_size = static_cast<size_t>(before);
+    q.local = string_ref(name + uri_size + 1, first - uri_size - 1);
+    q.prefix = tail;
+    q.uri = intern_uri(string_ref(name, uri_size));
+  }
+  return q;
+}
+
+void qname_delegate::onStartElement(const XML_Char *fullname, const XML_Char **atts)
+{
+  const qname name = split(fullname);
+  atts_.clear();
+  for (; *atts; atts += 2) {
+    atts_.push_back(qattribute{split(atts[0], true), atts[1]});
+  }
+  onStartElementNs(name, atts_.data(), atts_.size());
+}
+
+void qname_delegate::onEndElement(const XML_Char *fullname)
+{
+  onEndElementNs(split(fullname));
+}
+
+void qname_delegate::onStartNamespace(const XML_Char* prefix, const XML_Char* uri)
+{
+  // expat keeps the prefixes until the parser is reset
+  bindings_.push_back(binding{ref(prefix), intern_uri(ref(uri))});
+}
+
+void qname_delegate::onEndNamespace(const XML_Char*)
+{
+  // the declarations end in reverse order, the binding of xml stays
+  if (bindings_.size() > 1) bindings_.pop_back();
+}
+
+void qname_delegate::onEndDocument(size_t)
+{
+  bindings_.resize(1);
+}
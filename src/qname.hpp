@@ -0,0 +1,99 @@
+/**
+ * \file qname.hpp contains the delegate which receives namespace qualified
+ * names split into namespace, local name and prefix
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_qname_hpp
+#define xmlpp_qname_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.hpp"
+#include "delegate.hpp"
+
+namespace xmlpp {
+
+/** a name split into its parts, the views point into the strings of expat
+ * and are valid during the callback only. local and prefix are not zero
+ * terminated. */
+struct qname {
+  uint32_t uri{0};          //< id of the namespace, NO_NAMESPACE if none
+  string_ref local;
+  string_ref prefix;        //< empty for the default namespace
+};
+
+struct qattribute {
+  qname name;
+  const XML_Char* value;
+};
+
+/** delegate which receives the names of elements and attributes split
+ * into the id of their namespace URI, local name and prefix.
+ *
+ * the parser has to pass triplets with parser::TRIPLET_SEPARATOR:
+ * @code
+ * parser p(d, parser::TRIPLET_SEPARATOR);
+ * p.set_namespace_triplets(true);
+ * @endcode
+ * The URIs are interned when they are declared, the ids stay the same for
+ * all documents of a stream until clear_uris(). A name is resolved by the
+ * prefix at its end against the declarations in scope, the URI in front
+ * of it is neither compared nor hashed. Names with an undeclared URI, e.g.
+ * of a parser without triplets, are split at their last separators and
+ * their URI is interned.
+ *
+ * derived classes which override onStartNamespace(), onEndNamespace() or
+ * onEndDocument() have to call the implementation of qname_delegate.
+ */
+class qname_delegate : public abstract_delegate {
+public:
+  static const uint32_t NO_NAMESPACE = 0;
+
+  qname_delegate();
+
+  /** called for each element with its split name and attributes */
+  virtual void onStartElementNs(const qname& name, const qattribute* atts,
+                                size_t count) = 0;
+  virtual void onEndElementNs(const qname& name) = 0;
+
+  /** @return the id of the URI, interned if new, e.g. to compare the
+   * names of the events with the namespaces of interest */
+  uint32_t intern_uri(string_ref uri);
+  /** @return the id of the URI or NO_NAMESPACE if it was not seen */
+  uint32_t find_uri(string_ref uri) const;
+  /** @return the URI of the id, empty for NO_NAMESPACE */
+  string_ref uri(uint32_t id) const { return uris_[id]; }
+  size_t uris() const { return uris_.size(); }
+  /** forgets the URIs except that of the xml prefix, the ids of
+   * following documents start again */
+  void clear_uris();
+
+  /** splits the name of expat, for delegates driven otherwise */
+  qname split(const XML_Char* name, bool attribute = false);
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override;
+  void onEndElement(const XML_Char *fullname) override;
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override;
+  void onEndNamespace(const XML_Char* prefix) override;
+  void onEndDocument(size_t index) override;
+private:
+  /** a namespace declaration in scope, prefix empty for the default */
+  struct binding {
+    string_ref prefix;
+    uint32_t uri;
+  };
+
+  arena strings_;
+  std::vector<string_ref> uris_;
+  std::unordered_map<string_ref,uint32_t,string_ref_hash> ids_;
+  /** the innermost declaration last */
+  std::vector<binding> bindings_;
+  std::vector<qattribute> atts_;
+};
+
+}
+#endif // #ifndef xmlpp_qname_hpp
@@ -0,0 +1,117 @@
+/**
+ * \file spsc_queue.hpp contains a bounded lock-free queue for one producer
+ * and one consumer thread
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_spsc_queue_hpp
+#define xmlpp_spsc_queue_hpp
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace xmlpp {
+
+/** bounded ring buffer, push() is called by one thread and pop() by one
+ * other thread.
+ *
+ * head and tail live in separate cache lines, each side caches the index
+ * of the other side and reloads it only when the ring looks full or empty.
+ */
+template<typename T>
+class spsc_queue {
+public:
+  /** @param capacity rounded up to a power of two */
+  explicit spsc_queue(size_t capacity)
+  {
+    size_t size = 2;
+    while (size < capacity) size *= 2;
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+  spsc_queue(const spsc_queue&) = delete;
+  spsc_queue& operator=(const spsc_queue&) = delete;
+
+  size_t capacity() const { return slots_.size(); }
+
+  /** @return false if the queue is full */
+  bool try_push(T value)
+  {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == slots_.size()) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == slots_.size()) return false;
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** @return false if the queue is empty */
+  bool try_pop(T& value)
+  {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) return false;
+    }
+    value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** waits while the queue is full or until stop becomes true
+   * @return false if stopped */
+  bool push(T value, const std::atomic<bool>* stop = nullptr)
+  {
+    for (unsigned spins = 0; !try_push(value); ++spins) {
+      if (stop && stop->load(std::memory_order_relaxed)) return false;
+      backoff(spins);
+    }
+    return true;
+  }
+
+  /** waits while the queue is empty or until stop becomes true
+   * @return false if stopped */
+  bool pop(T& value, const std::atomic<bool>* stop = nullptr)
+  {
+    for (unsigned spins = 0; !try_pop(value); ++spins) {
+      if (stop && stop->load(std::memory_order_relaxed)) return false;
+      backoff(spins);
+    }
+    return true;
+  }
+
+private:
+  /** spins shortly, then gives the core to the other side and finally
+   * sleeps, the other side works on a whole buffer meanwhile */
+  static void backoff(unsigned spins)
+  {
+    if (spins < 64) return;
+    if (spins < 128) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  static const size_t CACHE_LINE = 64;
+
+  // padded instead of aligned, C++11 new does not align beyond max_align_t
+  std::vector<T> slots_;
+  size_t mask_{0};
+  char pad0_[CACHE_LINE];
+  std::atomic<size_t> head_{0};
+  size_t tail_cache_{0};   //< consumer side
+  char pad1_[CACHE_LINE];
+  std::atomic<size_t> tail_{0};
+  size_t head_cache_{0};   //< producer side
+  char pad2_[CACHE_LINE];
+};
+
+}
+#endif // #ifndef xmlpp_spsc_queue_hpp
@@ -0,0 +1,46 @@
+/**
+ * \file trace.hpp contains the static tracepoints of the parser
+ *
+ * with -D EXPATPP_WITH_USDT=On the tracepoints are USDT probes of the
+ * provider "expatpp" (sys/sdt.h), an unattached probe costs a nop. They
+ * can be listed with `bpftrace -l 'usdt:/path/to/binary:expatpp:*'` or
+ * `perf list sdt_expatpp:*`. Without the option the macros are empty.
+ *
+ * probes, arg0 is the address of the xmlpp::parser:
+ * - doc_start(parser)                    first parse() of a document
+ * - doc_end(parser, bytes, status)       final parse() returned, bytes of
+ *                                        the document
+ * - chunk_start(parser, len, is_final)   parse() called, len 0 for resume()
+ * - chunk_end(parser, len, status)       parse() returns
+ * - start_element(parser, name, depth)
+ * - end_element(parser, name, depth)
+ * - parse_error(parser, error, line, column)
+ * - suspend(parser, bytes)               the delegate called suspend()
+ * - resume(parser)                       resume() continues parsing
+ * - limit(parser, error)                 a limit of parser::limits stopped
+ *                                        the parser
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_trace_hpp
+#define xmlpp_trace_hpp
+
+#ifdef HAVE_EXPATPP_CONFIG_H
+#include "expatpp_config.h"
+#endif
+
+#ifdef EXPATPP_WITH_USDT
+#include <sys/sdt.h>
+
+#define XMLPP_TRACE1(name,a1) DTRACE_PROBE1(expatpp,name,a1)
+#define XMLPP_TRACE2(name,a1,a2) DTRACE_PROBE2(expatpp,name,a1,a2)
+#define XMLPP_TRACE3(name,a1,a2,a3) DTRACE_PROBE3(expatpp,name,a1,a2,a3)
+#define XMLPP_TRACE4(name,a1,a2,a3,a4) DTRACE_PROBE4(expatpp,name,a1,a2,a3,a4)
+#else
+#define XMLPP_TRACE1(name,a1) do {} while (0)
+#define XMLPP_TRACE2(name,a1,a2) do {} while (0)
+#define XMLPP_TRACE3(name,a1,a2,a3) do {} while (0)
+#define XMLPP_TRACE4(name,a1,a2,a3,a4) do {} while (0)
+#endif
+
+#endif // #ifndef xmlpp_trace_hpp
@@ -3,10 +3,16 @@
  *
  * See LICENSE for copyright information.
  */
+#include "expatpp_config.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <expat.h>
 
+#include "decompressor.hpp"
+#include "entity_resolver.hpp"
+#include "trace.hpp"
 #include "xmlparser.hpp"
 
 using std::string;
@@ -15,226 +21,749 @@ using xmlpp::parser;
 using xmlpp::delegate;
 using xmlpp::Attr;
 
-static void XMLParser_xmlSAX2StartElement		(void *ctx,
-                                             const XML_Char *fullname,
-                                             const XML_Char **atts)
+namespace {
+
+/** statistics of the parser calling into expat on this thread, receives
+ * the allocations of the memory suite */
+thread_local parser::statistics* current_stats = nullptr;
+
+/** sets current_stats while expat runs for a parser, nests for parsers
+ * created inside callbacks */
+class memory_scope {
+public:
+  explicit memory_scope(parser::statistics* stats) : previous_(current_stats)
+  { current_stats = stats; }
+  ~memory_scope() { current_stats = previous_; }
+private:
+  parser::statistics* previous_;
+};
+
+/** every block starts with the owning statistics and its size, the header
+ * keeps the alignment of malloc */
+struct alloc_header {
+  parser::statistics* owner;
+  size_t size;
+};
+const size_t HEADER_SIZE = 16;
+static_assert(sizeof(alloc_header) <= HEADER_SIZE, "alloc_header too big");
+
+void count_alloc(parser::statistics* s, size_t size)
 {
-  if (ctx) {
-    ((delegate*)ctx)->onStartElement(fullname,atts);
+  if (s) {
+    ++s->allocations;
+    s->memory += size;
+    if (s->memory > s->peak_memory) s->peak_memory = s->memory;
   }
 }
 
-static void XMLParser_xmlSAX2EndElement(void *ctx,const XML_Char *name)
+void* counting_malloc(size_t size)
 {
-  if (ctx) {
-    ((delegate*)ctx)->onEndElement(name);
-  }
+  void* block = malloc(size + HEADER_SIZE);
+  if (block==nullptr) return nullptr;
+  alloc_header* h = static_cast<alloc_header*>(block);
+  h->owner = current_stats;
+  h->size = size;
+  count_alloc(h->owner, size);
+  return static_cast<char*>(block) + HEADER_SIZE;
 }
 
-static void XMLParser_OnCharacterData(void * ctx, const char * pBuf, int len)
+void counting_free(void* ptr)
 {
-  if (ctx) {
-    ((delegate*)ctx)->onCharacterData(pBuf,len);
-  }
+  if (ptr==nullptr) return;
+  alloc_header* h = reinterpret_cast<alloc_header*>(static_cast<char*>(ptr) - HEADER_SIZE);
+  if (h->owner) h->owner->memory -= h->size;
+  free(h);
 }
 
-static void XMLParser_CommentHandler(void * ctx, const XML_Char *data)
+void* counting_realloc(void* ptr, size_t size)
 {
-  if (ctx) {
-    ((delegate*)ctx)->onComment(data);
+  if (ptr==nullptr) return counting_malloc(size);
+  alloc_header* h = reinterpret_cast<alloc_header*>(static_cast<char*>(ptr) - HEADER_SIZE);
+  const size_t old_size = h->size;
+  void* block = realloc(h, size + HEADER_SIZE);
+  if (block==nullptr) return nullptr;
+  h = static_cast<alloc_header*>(block);
+  h->size = size;
+  if (h->owner) {
+    h->owner->memory -= old_size;
+    count_alloc(h->owner, size);
   }
+  return static_cast<char*>(block) + HEADER_SIZE;
 }
 
-static void XMLParser_XmlDeclHandler(void * ctx,
-                                     const XML_Char *version,
-                                     const XML_Char *encoding,
-                                     int standalone)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onXmlDecl(version,encoding, standalone);
-  }
+const XML_Memory_Handling_Suite COUNTING_MEMORY_SUITE = {
+  counting_malloc, counting_realloc, counting_free
+};
+
+/** sets a flag for the lifetime of the scope */
+class flag_scope {
+public:
+  explicit flag_scope(bool& flag) : flag_(flag), previous_(flag) { flag_ = true; }
+  ~flag_scope() { flag_ = previous_; }
+private:
+  bool& flag_;
+  bool previous_;
+};
+
 }
 
-static void XMLParser_EntityDeclHandler(void * ctx,
-                                        const XML_Char *entityName,
-                                        int is_parameter_entity,
-                                        const XML_Char *value,
-                                        int value_length,
-                                        const XML_Char *base,
-                                        const XML_Char *systemId,
-                                        const XML_Char *publicId,
-                                        const XML_Char *notationName)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onEntityDecl(entityName,
-                                   is_parameter_entity,
-                                   value, value_length,
-                                   base,
-                                   systemId,
-                                   publicId,
-                                   notationName);
+struct parser::handlers {
+  static delegate& d(void* ctx) { return *static_cast<parser*>(ctx)->m_delegate; }
+  /** multi document mode: expat parsed the input before the event */
+  static void parsed(parser* p)
+  {
+    if (!p->m_multi_document) return;
+    const XML_Index index = XML_GetCurrentByteIndex(p->m_parser);
+    if (index > 0) p->m_parsed_to = static_cast<uint64_t>(index);
   }
-}
 
-static void XMLParser_StartCdataSectionHandler(void * ctx)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onStartCdataSection();
+  static void XMLCALL StartElement(void *ctx,
+                                   const XML_Char *fullname,
+                                   const XML_Char **atts)
+  {
+    parser* p = static_cast<parser*>(ctx);
+    statistics& s = p->m_stats;
+    ++s.elements;
+    uint32_t count = 0;
+    for (const XML_Char** a = atts; *a; a += 2) ++count;
+    s.attributes += count;
+    if (++s.depth > s.max_depth) s.max_depth = s.depth;
+    p->m_text_run = 0;
+    parsed(p);
+    const limits& l = p->m_limits;
+    if (l.depth && s.depth > l.depth) return p->fail(error_t::TOO_DEEP);
+    if (l.attributes && count > l.attributes) return p->fail(error_t::TOO_MANY_ATTRIBUTES);
+    if (--p->m_deadline_countdown==0) {
+      p->check_deadline();
+      if (p->m_limit_error!=error_t::NONE) return;
+    }
+    XMLPP_TRACE3(start_element, ctx, fullname, s.depth);
+    d(ctx).onStartElement(fullname,atts);
   }
-}
 
-static void XMLParser_EndCdataSectionHandler(void * ctx)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onEndCdataSection();
+  static void XMLCALL EndElement(void *ctx,const XML_Char *name)
+  {
+    parser* p = static_cast<parser*>(ctx);
+    --p->m_stats.depth;
+    p->m_text_run = 0;
+    parsed(p);
+    // expat reports the end of an empty element stopped at
+    if (p->m_limit_error!=error_t::NONE) return;
+    XMLPP_TRACE3(end_element, ctx, name, p->m_stats.depth);
+    d(ctx).onEndElement(name);
+    if (p->m_multi_document && p->m_stats.depth==0) {
+      // the root element is closed, stop at the end of its end tag
+      p->m_document_complete = true;
+      p->m_document_end = static_cast<uint64_t>(XML_GetCurrentByteIndex(p->m_parser)
+                                                + XML_GetCurrentByteCount(p->m_parser));
+      XML_StopParser(p->m_parser, XML_TRUE);
+    }
   }
-}
 
-static void XMLParser_StartNamespaceDeclHandler(void * ctx,
-                                                const XML_Char *prefix,
-                                                const XML_Char *uri)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onStartNamespace(prefix,uri);
+  static void XMLCALL CharacterData(void * ctx, const char * pBuf, int len)
+  {
+    parser* p = static_cast<parser*>(ctx);
+    statistics& s = p->m_stats;
+    ++s.text_events;
+    s.text_bytes += static_cast<uint64_t>(len);
+    // the fragments of an entity expansion report the reference as event
+    const int64_t index = XML_GetCurrentByteIndex(p->m_parser);
+    if (index!=p->m_text_index) {
+      p->m_text_index = index;
+      p->m_text_token_bytes = static_cast<uint64_t>(XML_GetCurrentByteCount(p->m_parser));
+      p->m_text_token_data = 0;
+    }
+    const uint64_t before = std::max(p->m_text_token_data, p->m_text_token_bytes);
+    p->m_text_token_data += static_cast<uint64_t>(len);
+    if (p->m_text_token_data > before) s.entity_text_bytes += p->m_text_token_data - before;
+    p->m_text_run += static_cast<uint64_t>(len);
+    parsed(p);
+    if (p->m_limits.text_bytes && p->m_text_run > p->m_limits.text_bytes) {
+      return p->fail(error_t::TEXT_TOO_LONG);
+    }
+    if (--p->m_deadline_countdown==0) {
+      p->check_deadline();
+      if (p->m_limit_error!=error_t::NONE) return;
+    }
+    d(ctx).onCharacterData(pBuf,len);
   }
-}
 
-static void XMLParser_EndNamespaceDeclHandler(void * ctx,const XML_Char *prefix)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onEndNamespace(prefix);
+  static void XMLCALL Comment(void * ctx, const XML_Char *data)
+  {
+    static_cast<parser*>(ctx)->m_text_run = 0;
+    parsed(static_cast<parser*>(ctx));
+    d(ctx).onComment(data);
+  }
+
+  static void XMLCALL XmlDecl(void * ctx,
+                              const XML_Char *version,
+                              const XML_Char *encoding,
+                              int standalone)
+  {
+    d(ctx).onXmlDecl(version,encoding, standalone);
+  }
+
+  static void XMLCALL EntityDecl(void * ctx,
+                                 const XML_Char *entityName,
+                                 int is_parameter_entity,
+                                 const XML_Char *value,
+                                 int value_length,
+                                 const XML_Char *base,
+                                 const XML_Char *systemId,
+                                 const XML_Char *publicId,
+                                 const XML_Char *notationName)
+  {
+    d(ctx).onEntityDecl(entityName,
+                        is_parameter_entity,
+                        value, value_length,
+                        base,
+                        systemId,
+                        publicId,
+                        notationName);
+  }
+
+  static void XMLCALL StartCdataSection(void * ctx)
+  {
+    d(ctx).onStartCdataSection();
   }
-}
 
-static void XMLParser_ProcessingInstruction(void * ctx,
+  static void XMLCALL EndCdataSection(void * ctx)
+  {
+    d(ctx).onEndCdataSection();
+  }
+
+  static void XMLCALL StartNamespaceDecl(void * ctx,
+                                         const XML_Char *prefix,
+                                         const XML_Char *uri)
+  {
+    d(ctx).onStartNamespace(prefix,uri);
+  }
+
+  static void XMLCALL EndNamespaceDecl(void * ctx,const XML_Char *prefix)
+  {
+    d(ctx).onEndNamespace(prefix);
+  }
+
+  static void XMLCALL ProcessingInstruction(void * ctx,
                                             const XML_Char* target,
                                             const XML_Char* data)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onProcessingInstruction(target,data);
+  {
+    static_cast<parser*>(ctx)->m_text_run = 0;
+    parsed(static_cast<parser*>(ctx));
+    d(ctx).onProcessingInstruction(target,data);
   }
-}
 
-static void XMLParser_UnparsedEntityDecl(void * ctx,
+  static void XMLCALL UnparsedEntityDecl(void * ctx,
                                          const XML_Char* entityName,
                                          const XML_Char* base,
                                          const XML_Char* systemId,
                                          const XML_Char* publicId,
                                          const XML_Char* notationName)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onUnparsedEntityDecl(entityName,
-                                           base,
-                                           systemId,
-                                           publicId,
-                                           notationName);
+  {
+    d(ctx).onUnparsedEntityDecl(entityName,
+                                base,
+                                systemId,
+                                publicId,
+                                notationName);
   }
-}
 
-static void XMLParser_NotationDecl(void * ctx,const XML_Char* notationName,
+  static void XMLCALL NotationDecl(void * ctx,const XML_Char* notationName,
                                    const XML_Char* base,
                                    const XML_Char* systemId,
                                    const XML_Char* publicId)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onNotationDecl(notationName,
-                                     base,
-                                     systemId,
-                                     publicId);
+  {
+    d(ctx).onNotationDecl(notationName,
+                          base,
+                          systemId,
+                          publicId);
   }
-}
 
-static void XMLParser_AttlistDecl(void * ctx,const XML_Char *elname,
+  static void XMLCALL AttlistDecl(void * ctx,const XML_Char *elname,
                                   const XML_Char *attname,
                                   const XML_Char *att_type,
                                   const XML_Char *dflt,
                                   int             isrequired)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onAttlistDecl(elname,
-                                    attname,
-                                    att_type,
-                                    dflt,
-                                    isrequired);
+  {
+    d(ctx).onAttlistDecl(elname,
+                         attname,
+                         att_type,
+                         dflt,
+                         isrequired);
   }
-}
 
-static void XMLParser_StartDoctypeDecl(void * ctx,const XML_Char *doctypeName,
+  static void XMLCALL StartDoctypeDecl(void * ctx,const XML_Char *doctypeName,
                                        const XML_Char *sysid,
                                        const XML_Char *pubid,
                                        int has_internal_subset)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onStartDoctypeDecl(doctypeName,
-                                         sysid,
-                                         pubid,
-                                         has_internal_subset);
+  {
+    d(ctx).onStartDoctypeDecl(doctypeName,
+                              sysid,
+                              pubid,
+                              has_internal_subset);
   }
-}
 
-static void XMLParser_EndDoctypeDecl(void * ctx)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onEndDoctypeDecl();
+  static void XMLCALL EndDoctypeDecl(void * ctx)
+  {
+    d(ctx).onEndDoctypeDecl();
   }
-}
 
-static void XMLParser_ElementDecl(void * ctx, const XML_Char *name, XML_Content *model)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onElementDecl(name,model);
+  static void XMLCALL ElementDecl(void * ctx, const XML_Char *name, XML_Content *model)
+  {
+    d(ctx).onElementDecl(name,model);
   }
-}
 
-static void XMLParser_SkippedEntity(void * ctx,const XML_Char *entityName,
+  static void XMLCALL SkippedEntity(void * ctx,const XML_Char *entityName,
                                     int is_parameter_entity)
-{
-  if (ctx) {
-    ((delegate*)ctx)->onSkippedEntity(entityName,is_parameter_entity);
+  {
+    d(ctx).onSkippedEntity(entityName,is_parameter_entity);
+  }
+
+  /** the handler argument is the parser, see install_handlers() */
+  static int XMLCALL ExternalEntityRef(XML_Parser arg,
+                                       const XML_Char *context,
+                                       const XML_Char *base,
+                                       const XML_Char *systemId,
+                                       const XML_Char *publicId)
+  {
+    parser* p = reinterpret_cast<parser*>(arg);
+    return p->parse_external_entity(context, base, systemId, publicId)
+      ? XML_STATUS_OK : XML_STATUS_ERROR;
   }
+};
+
+const int parser::MULTI_DOCUMENT_SLICE;
+const int parser::FILE_CHUNK;
+const unsigned parser::DEADLINE_EVENTS;
+const char parser::TRIPLET_SEPARATOR;
+
+parser::parser(delegate& delegate, char namespaceSeparator)
+: m_delegate(&delegate)
+{
+  const XML_Char separator[2] = {namespaceSeparator, 0};
+  memory_scope scope(&m_stats);
+  m_parser = XML_ParserCreate_MM("UTF-8", &COUNTING_MEMORY_SUITE, separator);
+  install_handlers();
 }
 
-parser::parser(delegate& delegate, char namespaceSeparator) {
-  m_parser = XML_ParserCreateNS("UTF-8",namespaceSeparator);
-  XML_SetUserData(m_parser, &delegate);
+void parser::install_handlers()
+{
+  XML_SetUserData(m_parser, this);
 
   XML_SetElementHandler(m_parser,
-                        XMLParser_xmlSAX2StartElement,
-                        XMLParser_xmlSAX2EndElement);
-  XML_SetCharacterDataHandler(m_parser, XMLParser_OnCharacterData);
-  XML_SetCommentHandler(m_parser, XMLParser_CommentHandler);
-  XML_SetXmlDeclHandler(m_parser,XMLParser_XmlDeclHandler);
-  XML_SetEntityDeclHandler(m_parser, XMLParser_EntityDeclHandler);
+                        handlers::StartElement,
+                        handlers::EndElement);
+  XML_SetCharacterDataHandler(m_parser, handlers::CharacterData);
+  XML_SetCommentHandler(m_parser, handlers::Comment);
+  XML_SetXmlDeclHandler(m_parser,handlers::XmlDecl);
+  XML_SetEntityDeclHandler(m_parser, handlers::EntityDecl);
 
   XML_SetCdataSectionHandler(m_parser,
-                             XMLParser_StartCdataSectionHandler,
-                             XMLParser_EndCdataSectionHandler);
+                             handlers::StartCdataSection,
+                             handlers::EndCdataSection);
   XML_SetNamespaceDeclHandler(m_parser,
-                              XMLParser_StartNamespaceDeclHandler,
-                              XMLParser_EndNamespaceDeclHandler);
+                              handlers::StartNamespaceDecl,
+                              handlers::EndNamespaceDecl);
   XML_SetProcessingInstructionHandler(m_parser,
-                                      XMLParser_ProcessingInstruction);
+                                      handlers::ProcessingInstruction);
   // TODO OBSOLete replace by XML_EntityDeclHandler
-  XML_SetUnparsedEntityDeclHandler(m_parser,XMLParser_UnparsedEntityDecl);
-  XML_SetNotationDeclHandler(m_parser,XMLParser_NotationDecl);
-  XML_SetAttlistDeclHandler(m_parser, XMLParser_AttlistDecl);
+  XML_SetUnparsedEntityDeclHandler(m_parser,handlers::UnparsedEntityDecl);
+  XML_SetNotationDeclHandler(m_parser,handlers::NotationDecl);
+  XML_SetAttlistDeclHandler(m_parser, handlers::AttlistDecl);
   XML_SetDoctypeDeclHandler(m_parser,
-                            XMLParser_StartDoctypeDecl,
-                            XMLParser_EndDoctypeDecl);
-  XML_SetElementDeclHandler(m_parser,XMLParser_ElementDecl);
-  XML_SetSkippedEntityHandler(m_parser,XMLParser_SkippedEntity);
+                            handlers::StartDoctypeDecl,
+                            handlers::EndDoctypeDecl);
+  XML_SetElementDeclHandler(m_parser,handlers::ElementDecl);
+  XML_SetSkippedEntityHandler(m_parser,handlers::SkippedEntity);
+  // expat resets them with the parser
+  apply_amplification_limits();
+  if (m_namespace_triplets) XML_SetReturnNSTriplet(m_parser, XML_TRUE);
+  if (!m_base.empty()) XML_SetBase(m_parser, m_base.c_str());
+  if (m_resolver) {
+    XML_SetExternalEntityRefHandler(m_parser, handlers::ExternalEntityRef);
+    XML_SetExternalEntityRefHandlerArg(m_parser, this);
+    XML_SetParamEntityParsing(m_parser, XML_PARAM_ENTITY_PARSING_UNLESS_STANDALONE);
+  }
+#if defined(HAVE_XML_SETREPARSEDEFERRALENABLED)
+  if (!m_reparse_deferral) XML_SetReparseDeferralEnabled(m_parser, XML_FALSE);
+#endif
+}
+
+bool parser::set_reparse_deferral(bool enable)
+{
+  m_reparse_deferral = enable;
+#if defined(HAVE_XML_SETREPARSEDEFERRALENABLED)
+  return XML_SetReparseDeferralEnabled(m_parser, enable ? XML_TRUE : XML_FALSE)==XML_TRUE;
+#else
+  return false;
+#endif
+}
+
+void parser::set_namespace_triplets(bool enable)
+{
+  m_namespace_triplets = enable;
+  XML_SetReturnNSTriplet(m_parser, enable ? XML_TRUE : XML_FALSE);
+}
+
+bool parser::set_entity_resolver(entity_resolver* resolver)
+{
+  m_resolver = resolver;
+  if (resolver==nullptr) {
+    XML_SetExternalEntityRefHandler(m_parser, nullptr);
+    return XML_SetParamEntityParsing(m_parser, XML_PARAM_ENTITY_PARSING_NEVER)!=0;
+  }
+  XML_SetExternalEntityRefHandler(m_parser, handlers::ExternalEntityRef);
+  XML_SetExternalEntityRefHandlerArg(m_parser, this);
+  return XML_SetParamEntityParsing(m_parser, XML_PARAM_ENTITY_PARSING_UNLESS_STANDALONE)!=0;
+}
+
+void parser::set_base(const std::string& base)
+{
+  memory_scope scope(&m_stats);
+  m_base = base;
+  XML_SetBase(m_parser, m_base.empty() ? nullptr : m_base.c_str());
+}
+
+bool parser::parse_external_entity(const XML_Char* context, const XML_Char* base,
+                                   const XML_Char* systemId, const XML_Char* publicId)
+{
+  // no context for the external DTD subset and parameter entities
+  const entity_resolver::entity_ptr e = context ? m_resolver->resolve(base, systemId, publicId)
+    : m_resolver->resolve_dtd(base, systemId, publicId);
+  if (!e) return !m_resolver->strict();
+  XML_Parser outer = m_entity_parser ? m_entity_parser : m_parser;
+  XML_Parser child = XML_ExternalEntityParserCreate(outer, context, nullptr);
+  if (child==nullptr) return false;
+  XML_SetBase(child, e->base.c_str());
+  m_entity_parser = child;
+  const bool ok = XML_Parse(child, e->data.data(), static_cast<int>(e->data.size()),
+                            XML_TRUE)==XML_STATUS_OK;
+  m_entity_parser = outer==m_parser ? nullptr : outer;
+  XML_ParserFree(child);
+  return ok;
+}
+
+bool parser::reparse_deferral_available()
+{
+#if defined(HAVE_XML_SETREPARSEDEFERRALENABLED)
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool parser::apply_amplification_limits()
+{
+  bool ok = true;
+#if defined(XML_DTD)
+  if (m_limits.amplification > 0) {
+    ok = XML_SetBillionLaughsAttackProtectionMaximumAmplification(m_parser,
+                                                                  m_limits.amplification)==XML_TRUE;
+  }
+  if (m_limits.amplification_threshold > 0) {
+    ok = XML_SetBillionLaughsAttackProtectionActivationThreshold(m_parser,
+                                                                 m_limits.amplification_threshold)==XML_TRUE
+      && ok;
+  }
+#else
+  ok = m_limits.amplification==0 && m_limits.amplification_threshold==0;
+#endif
+  return ok;
+}
+
+bool parser::set_limits(const limits& limits)
+{
+  m_limits = limits;
+  return apply_amplification_limits();
+}
+
+void parser::fail(error_t error)
+{
+  if (m_limit_error!=error_t::NONE) return;
+  m_limit_error = error;
+  XMLPP_TRACE2(limit, this, static_cast<int>(error));
+  // outside of parsing expat refuses further input
+  if (m_entity_parser) XML_StopParser(m_entity_parser, XML_FALSE);
+  XML_StopParser(m_parser, XML_FALSE);
+}
+
+void parser::check_deadline()
+{
+  m_deadline_countdown = DEADLINE_EVENTS;
+  if (m_limits.time.count() && std::chrono::steady_clock::now() > m_deadline) {
+    fail(error_t::DEADLINE_EXCEEDED);
+  }
 }
 
 parser::~parser()
 {
+  memory_scope scope(&m_stats);
   XML_ParserFree(m_parser);
 }
 
 parser::status_t parser::parse(const char* buffer, int len, bool isFinal)
-{ return (status_t)XML_Parse(m_parser,buffer, len, isFinal); }
+{
+  if (m_suspended || m_limit_error!=error_t::NONE) return status_t::ERROR;
+  memory_scope scope(&m_stats);
+  flag_scope parsing(m_parsing);
+  return m_multi_document ? parse_stream(buffer,len,isFinal)
+                          : parse_document(buffer,len,isFinal);
+}
+
+bool parser::suspend()
+{
+  // expat can not suspend inside an external entity
+  if (!m_parsing || m_suspended || m_entity_parser) return false;
+  XML_ParsingStatus status;
+  XML_GetParsingStatus(m_parser, &status);
+  // in multi document mode expat may be stopped at the end of the document
+  // already, the stream stops before the next one
+  if (status.parsing==XML_PARSING && XML_StopParser(m_parser, XML_TRUE)!=XML_STATUS_OK) {
+    return false;
+  }
+  m_suspended = true;
+  XMLPP_TRACE2(suspend, this, m_stats.bytes);
+  return true;
+}
+
+parser::status_t parser::resume()
+{
+  memory_scope scope(&m_stats);
+  // expat reports XML_ERROR_NOT_SUSPENDED
+  if (!m_suspended) return (status_t)XML_ResumeParser(m_parser);
+  flag_scope parsing(m_parsing);
+  m_suspended = false;
+  XMLPP_TRACE1(resume, this);
+
+  status_t status = status_t::OK;
+  XML_ParsingStatus expat_status;
+  XML_GetParsingStatus(m_parser, &expat_status);
+  if (expat_status.parsing==XML_SUSPENDED) {
+    XMLPP_TRACE3(chunk_start, this, 0, static_cast<int>(m_suspend_final));
+    status = (status_t)XML_ResumeParser(m_parser);
+    XMLPP_TRACE3(chunk_end, this, 0, static_cast<int>(status));
+    status = finish_chunk(status, m_suspend_final);
+  }
+  if (!m_multi_document) return status;
+
+  std::vector<char> pending;
+  pending.swap(m_pending);
+  return parse_stream(pending.data(), static_cast<int>(pending.size()), m_pending_final,
+                      m_pending_fed, status);
+}
+
+parser::status_t parser::parse_file(FILE* file, int chunk)
+{
+  return parse_input([file](char* buffer, size_t size) -> long {
+      const size_t n = fread(buffer, 1, size, file);
+      if (n==0 && ferror(file)) return -1;
+      return static_cast<long>(n);
+    }, chunk);
+}
+
+parser::status_t parser::parse_input(const read_function& read, int chunk)
+{
+  if (m_suspended) {
+    const bool final = m_multi_document ? m_pending_final : m_suspend_final;
+    const status_t status = resume();
+    if (status!=status_t::OK || final) return status;
+  }
+  // parse_buffer() is not available in multi document mode
+  std::vector<char> own;
+  for (;;) {
+    char* buffer = nullptr;
+    if (m_multi_document) {
+      own.resize(static_cast<size_t>(chunk));
+      buffer = own.data();
+    } else {
+      buffer = static_cast<char*>(get_buffer(chunk));
+      if (buffer==nullptr) return status_t::ERROR;
+    }
+    const long n = read(buffer, static_cast<size_t>(chunk));
+    if (n < 0) return status_t::ERROR;
+    const int len = static_cast<int>(n);
+    const status_t status = m_multi_document ? parse(buffer, len, n==0)
+                                             : parse_buffer(len, n==0);
+    if (status!=status_t::OK || n==0) return status;
+  }
+}
+
+void* parser::get_buffer(int len)
+{
+  memory_scope scope(&m_stats);
+  return XML_GetBuffer(m_parser, len);
+}
+
+parser::status_t parser::parse_buffer(int len, bool isFinal)
+{
+  if (m_multi_document || m_suspended) return status_t::ERROR;
+  memory_scope scope(&m_stats);
+  flag_scope parsing(m_parsing);
+  return parse_document(nullptr, len, isFinal, true);
+}
+
+parser::status_t parser::parse_document(const char* buffer, int len, bool isFinal,
+                                        bool leased)
+{
+  if (!m_in_document) {
+    m_in_document = true;
+    m_document_start = m_stats.bytes;
+    m_text_run = 0;
+    if (m_limits.time.count()) m_deadline = std::chrono::steady_clock::now() + m_limits.time;
+    XMLPP_TRACE1(doc_start, this);
+  }
+  check_deadline();
+  // multi document mode feeds no more than the limit
+  if (m_limits.bytes && !m_multi_document
+      && m_stats.bytes - m_document_start + static_cast<uint64_t>(len) > m_limits.bytes) {
+    fail(error_t::TOO_MANY_BYTES);
+  }
+  if (m_limit_error!=error_t::NONE) return finish_chunk(status_t::ERROR, isFinal);
+  XMLPP_TRACE3(chunk_start, this, len, static_cast<int>(isFinal));
+  if (len > 0) m_stats.bytes += static_cast<uint64_t>(len);
+  const status_t status = leased ? (status_t)XML_ParseBuffer(m_parser, len, isFinal)
+                                : (status_t)XML_Parse(m_parser,buffer, len, isFinal);
+  XMLPP_TRACE3(chunk_end, this, len, static_cast<int>(status));
+  return finish_chunk(status, isFinal);
+}
+
+parser::status_t parser::finish_chunk(status_t status, bool isFinal)
+{
+  if (status==status_t::ERROR) {
+    XMLPP_TRACE4(parse_error, this, static_cast<int>(errorcode()),
+                 XML_GetCurrentLineNumber(m_parser), XML_GetCurrentColumnNumber(m_parser));
+  }
+  if (status==status_t::SUSPENDED) {
+    m_suspend_final = isFinal;
+  } else if (isFinal || status==status_t::ERROR) {
+    m_in_document = false;
+    if (status==status_t::OK) ++m_stats.documents;
+    XMLPP_TRACE3(doc_end, this, m_stats.bytes - m_document_start, static_cast<int>(status));
+  }
+  return status;
+}
+
+void parser::keep_unparsed(const char* buffer, int fed)
+{
+  const uint64_t slice = m_document_bytes - static_cast<uint64_t>(fed);
+  if (m_parsed_to >= slice) {
+    m_unparsed.assign(buffer + (m_parsed_to - slice), buffer + fed);
+    return;
+  }
+  // expat may hold input of the earlier slices
+  const uint64_t kept = slice - m_unparsed.size();
+  if (m_parsed_to > kept) {
+    m_unparsed.erase(m_unparsed.begin(),
+                     m_unparsed.begin() + static_cast<std::ptrdiff_t>(m_parsed_to - kept));
+  }
+  m_unparsed.insert(m_unparsed.end(), buffer, buffer + fed);
+}
+
+void parser::reset_document()
+{
+  m_in_document = false;
+  m_document_complete = false;
+  m_document_bytes = 0;
+  m_parsed_to = 0;
+  m_unparsed.clear();
+  m_text_index = -1;
+  XML_ParserReset(m_parser, "UTF-8");
+  install_handlers();
+}
+
+parser::status_t parser::parse_stream(const char* buffer, int len, bool isFinal,
+                                      int fed, status_t status)
+{
+  for (;;) {
+    if (fed==0) {
+      if (!m_in_document) {
+        // whitespace between the documents
+        const char* start = buffer;
+        while (len > 0 && (*buffer==' ' || *buffer=='\n' || *buffer=='\r' || *buffer=='\t')) {
+          ++buffer;
+          --len;
+        }
+        m_stats.bytes += static_cast<uint64_t>(buffer - start);
+        if (len==0) return status_t::OK;
+      }
+      fed = std::min(len, MULTI_DOCUMENT_SLICE);
+      if (m_limits.bytes) {
+        // the document may end within the limit
+        if (m_document_bytes >= m_limits.bytes) {
+          fail(error_t::TOO_MANY_BYTES);
+          return finish_chunk(status_t::ERROR, isFinal);
+        }
+        fed = static_cast<int>(std::min<uint64_t>(static_cast<uint64_t>(fed),
+                                                  m_limits.bytes - m_document_bytes));
+      }
+      m_document_bytes += static_cast<uint64_t>(fed);
+      status = parse_document(buffer, fed, isFinal && fed==len);
+      if (status!=status_t::ERROR) keep_unparsed(buffer, fed);
+    }
+    if (status==status_t::ERROR) {
+      if (isFinal && len==fed && m_limit_error==error_t::NONE && m_stats.documents > 0
+          && m_stats.depth==0 && XML_GetErrorCode(m_parser)==XML_ERROR_NO_ELEMENTS) {
+        // only comments and processing instructions after the last document,
+        // expat misses the root element
+        reset_document();
+        return status_t::OK;
+      }
+      return status;
+    }
+
+    int consumed = fed;
+    std::vector<char> held;
+    if (m_document_complete) {
+      // the rest of the slice belongs to the next document, with reparse
+      // deferral it may start in an earlier slice
+      const uint64_t rest = m_document_bytes - m_document_end;
+      if (rest > static_cast<uint64_t>(fed)) {
+        held.assign(m_unparsed.end() - static_cast<std::ptrdiff_t>(rest), m_unparsed.end());
+      } else {
+        consumed -= static_cast<int>(rest);
+      }
+      m_stats.bytes -= rest;
+      m_in_document = false;
+      XMLPP_TRACE3(doc_end, this, m_document_end, static_cast<int>(status_t::OK));
+      m_delegate->onEndDocument(m_stats.documents++);
+      reset_document();
+    } else if (status==status_t::SUSPENDED) {
+      // suspended by the delegate inside the document, expat holds the
+      // unparsed part of the slice, the input is kept from the slice on in
+      // case the document ends inside it
+      m_pending.assign(buffer, buffer + len);
+      m_pending_fed = fed;
+      m_pending_final = isFinal;
+      return status;
+    }
+    fed = 0;
+    buffer += consumed;
+    len -= consumed;
+    if (m_suspended) {
+      // suspended at the end of the document
+      m_pending.assign(held.begin(), held.end());
+      m_pending.insert(m_pending.end(), buffer, buffer + len);
+      m_pending_fed = 0;
+      m_pending_final = isFinal;
+      return status_t::SUSPENDED;
+    }
+    if (!held.empty()) {
+      status = parse_stream(held.data(), static_cast<int>(held.size()), false);
+      if (status==status_t::ERROR) return status;
+      if (status==status_t::SUSPENDED) {
+        m_pending.insert(m_pending.end(), buffer, buffer + len);
+        m_pending_final = isFinal;
+        return status;
+      }
+    }
+    // a document continued from the held input still needs the final parse
+    if (len==0 && !(isFinal && m_in_document)) return status_t::OK;
+  }
+}
 
 xmlpp::parser::result  parser::parseString(const char* pszString,
-					   delegate& delegate)
+					   delegate& delegate,
+					   statistics* stats,
+					   const limits* limits)
 {
   result res = result::READ_ERROR;
 
@@ -243,6 +772,7 @@ xmlpp::parser::result  parser::parseString(const char* pszString,
   } else {
 
     parser p(delegate);
+    if (limits) p.set_limits(*limits);
 
     const char* pBuf = pszString;
     size_t len = strlen(pszString);
@@ -252,61 +782,92 @@ xmlpp::parser::result  parser::parseString(const char* pszString,
       delegate.onParseError(XML_GetCurrentLineNumber(p.m_parser),
                             XML_GetCurrentColumnNumber(p.m_parser),
                             XML_GetCurrentByteIndex(p.m_parser),
-                            xmlpp::Error(XML_GetErrorCode(p.m_parser)));
+                            xmlpp::Error(static_cast<XML_Error>(p.errorcode())));
     } else {
       res = result::OK;
     }
+    if (stats) *stats = p.m_stats;
   }
   return res;
 }
 
 xmlpp::parser::result parser::parseFile(const std::string& filename,
-					delegate& delegate) {
+					delegate& delegate,
+					statistics* stats,
+					const limits* limits) {
   result res = result::READ_ERROR;
-  const size_t BUFF_SIZE = 255;
 
-  FILE* docfd = fopen(filename.c_str(), "r");
+  FILE* docfd = fopen(filename.c_str(), "rb");
 
   if (!docfd) {
     res = result::ERROR_OPEN_FILE;
     //  Logger::error("cant open ", filename);
   } else {
     parser p(delegate);
-
-    char buff[BUFF_SIZE];
-    for (;;) {
-      size_t bytes_read;
-
-      bytes_read = fread(buff, 1, BUFF_SIZE, docfd);
-
-      if (p.parse(buff, static_cast<int>(bytes_read), bytes_read == 0)==status_t::ERROR) {
+    if (limits) p.set_limits(*limits);
+    decompressor input(docfd);
+
+    if (p.parse_input([&input](char* buffer, size_t size) {
+          return input.read(buffer, size);
+        })==status_t::ERROR) {
+      if (input.error()!=decompressor::error_t::NONE) {
+	res = to_result(input.error());
+      } else {
 	/* handle parse error */
 	res = result::PARSE_ERROR;
 	delegate.onParseError(XML_GetCurrentLineNumber(p.m_parser),
 			      XML_GetCurrentColumnNumber(p.m_parser),
 			      XML_GetCurrentByteIndex(p.m_parser),
-			      Error(XML_GetErrorCode(p.m_parser)));
-	break;
-      }
-
-      if (bytes_read == 0) {
-	res = std::feof(docfd) ? result::OK : result::READ_ERROR;
-	break;
-
+			      Error(static_cast<XML_Error>(p.errorcode())));
       }
+    } else {
+      res = result::OK;
     }
+    if (stats) *stats = p.m_stats;
 
     fclose(docfd);
   }
   return res;
 }
 parser::error_t parser::errorcode() const
-{ return (error_t)XML_GetErrorCode(m_parser); }
+{
+  if (m_suspended) return error_t::SUSPENDED;
+  if (m_limit_error!=error_t::NONE) return m_limit_error;
+  return (error_t)XML_GetErrorCode(m_parser);
+}
 
 size_t parser::current_line_number() const
 { return XML_GetCurrentLineNumber(m_parser); }
 size_t parser::current_column_number() const
 { return XML_GetCurrentColumnNumber(m_parser); }
+size_t parser::current_byte_index() const
+{ return static_cast<size_t>(XML_GetCurrentByteIndex(m_parser)); }
+size_t parser::current_byte_count() const
+{ return static_cast<size_t>(XML_GetCurrentByteCount(m_parser)); }
+
+double parser::statistics::entity_amplification() const
+{
+  if (bytes==0) return 1.0;
+  return static_cast<double>(bytes + entity_text_bytes) / static_cast<double>(bytes);
+}
+
+std::vector<std::pair<const char*, double>> parser::statistics::key_values() const
+{
+  return {
+    {"bytes", static_cast<double>(bytes)},
+    {"documents", static_cast<double>(documents)},
+    {"elements", static_cast<double>(elements)},
+    {"attributes", static_cast<double>(attributes)},
+    {"text_events", static_cast<double>(text_events)},
+    {"text_bytes", static_cast<double>(text_bytes)},
+    {"entity_text_bytes", static_cast<double>(entity_text_bytes)},
+    {"max_depth", static_cast<double>(max_depth)},
+    {"allocations", static_cast<double>(allocations)},
+    {"memory", static_cast<double>(memory)},
+    {"peak_memory", static_cast<double>(peak_memory)},
+    {"entity_amplification", entity_amplification()}
+  };
+}
 
 const XML_Char* parser::xmlGetAttrValue(const XML_Char** attrs,
                                         const XML_Char* key)
@@ -6,11 +6,24 @@
 #ifndef xmlpp_parser_hpp
 #define xmlpp_parser_hpp
 
+#include <chrono>
 #include <cstdint>
-#include "delegate.hpp" 
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "delegate.hpp"
+#include "numconv.hpp"
 
 namespace xmlpp {
 
+class entity_resolver;
+
+/** reads up to size bytes into buffer
+ * @return bytes read, 0 at the end of the input, -1 on errors */
+typedef std::function<long (char* buffer, size_t size)> read_function;
 
 /** namespace for SAX2 xml Parser based on expat */
 class parser {
@@ -71,14 +84,84 @@ public:
     RESERVED_PREFIX_XML,
     RESERVED_PREFIX_XMLNS,
     RESERVED_NAMESPACE_URI,
-    INVALID_ARGUMENT
+    INVALID_ARGUMENT,
+    NO_BUFFER,
+    AMPLIFICATION_LIMIT_BREACH,     //< billion laughs protection of expat
+    /** violations of the limits, no codes of expat, passed to
+     * onParseError() as Error like those */
+    DEADLINE_EXCEEDED = 48,
+    TOO_MANY_BYTES,
+    TOO_DEEP,
+    TOO_MANY_ATTRIBUTES,
+    TEXT_TOO_LONG
+  };
+
+  /** budgets of each document against pathological input, 0 disables a
+   * limit. A violation stops the parser at once, parse() returns ERROR
+   * and errorcode() the error of the limit. */
+  struct limits {
+    /** wall clock time from the first parse() of the document on,
+     * checked before each chunk and every DEADLINE_EVENTS events */
+    std::chrono::steady_clock::duration time{0};
+    /** bytes of the document, it is rejected before parsing beyond */
+    uint64_t bytes{0};
+    uint32_t depth{0};
+    uint32_t attributes{0};         //< attributes of an element
+    /** character data between two tags, comments or processing
+     * instructions, after entity expansion */
+    uint64_t text_bytes{0};
+    /** billion laughs protection of expat: the maximum ratio of the
+     * input plus the entity expansions to the input (at least 1.0), and
+     * the output from which on it is enforced. 0 keeps the defaults of
+     * expat (100 and 8 MiB). */
+    float amplification{0};
+    uint64_t amplification_threshold{0};
+  };
+  static const unsigned DEADLINE_EVENTS = 1024;
+
+  /** counters of the parsed input, cheap enough to be always enabled.
+   * The memory counters cover all allocations of expat for this parser. */
+  struct statistics {
+    uint64_t bytes{0};              //< bytes passed to parse()
+    uint64_t elements{0};
+    uint64_t attributes{0};
+    uint64_t text_events{0};        //< character data callbacks
+    uint64_t text_bytes{0};         //< character data delivered
+    /** character data added by the expansion of entity references,
+     * beyond the length of the references */
+    uint64_t entity_text_bytes{0};
+    uint32_t depth{0};
+    uint32_t max_depth{0};
+    uint64_t documents{0};          //< completed documents
+    uint64_t allocations{0};
+    uint64_t memory{0};             //< bytes currently allocated by expat
+    uint64_t peak_memory{0};
+
+    /** ratio of the input plus the character data added by entity
+     * expansion to the input, the same measure expat uses against the
+     * billion laughs attack but for character data only */
+    double entity_amplification() const;
+    /** all counters with stable keys for export into metrics systems */
+    std::vector<std::pair<const char*, double>> key_values() const;
   };
 
   explicit parser(delegate& delegate,char namespaceSeparator = ':');
+  parser(const parser&) = delete;
+  parser& operator=(const parser&) = delete;
   virtual ~parser();
 
-  static result parseString(const char*pszString, delegate& delegate);
-  static result parseFile(const std::string& filename, delegate& delegate);
+  /** @param stats receives the statistics of the parser if not null
+   * @param limits of the document if not null, see set_limits() */
+  static result parseString(const char*pszString, delegate& delegate,
+                            statistics* stats = nullptr,
+                            const limits* limits = nullptr);
+  /** parses the file, gzip, zstd and xz compressed files are
+   * decompressed on the fly (see decompressor)
+   * @return INVALID_INPUT for compressed files with corrupt data or a
+   * format not built in */
+  static result parseFile(const std::string& filename, delegate& delegate,
+                          statistics* stats = nullptr,
+                          const limits* limits = nullptr);
   /** get value of xml attribute identifeid by key from attrs
    * @param attrs xml attribute array as array of strings
    * @param key attribute key to search for
@@ -89,11 +172,198 @@ public:
                                   const XML_Char* key);
 
 
+  /** parses the next chunk of the input
+   * @return SUSPENDED if the delegate called suspend(), expat keeps the
+   * unparsed rest of the buffer and resume() continues with it. ERROR
+   * while the parser is suspended, see errorcode(). */
   status_t parse(const char* buffer, int len, bool isFinal);
+
+  /** stops parsing after the current callback, only valid inside the
+   * callbacks of the delegate (and onEndDocument()). The running parse()
+   * returns SUSPENDED, e.g. to apply back-pressure when the consumer of
+   * the events falls behind instead of blocking inside the callback.
+   * @return false if the parser is not parsing, already suspended or
+   * inside an external entity */
+  bool suspend();
+  /** continues parsing the input buffered at suspend() time
+   * @return the status as parse() would, ERROR if not suspended */
+  status_t resume();
+  bool suspended() const { return m_suspended; }
+
+  static const int FILE_CHUNK = 64*1024;
+  /** reads the file in chunks into buffers of expat and parses them until
+   * the end of the file, a suspension or an error
+   * @return SUSPENDED if the delegate suspended the parser, parse_file()
+   * resumes and continues reading when called again. ERROR on parse
+   * errors and on read errors (ferror(file)). */
+  status_t parse_file(FILE* file, int chunk = FILE_CHUNK);
+  /** parse_file() with the input of read, which fills the buffers of
+   * expat, e.g. a decompressor
+   * @return ERROR also if read fails */
+  status_t parse_input(const read_function& read, int chunk = FILE_CHUNK);
+
+  /** leases a buffer of len bytes from expat to read the input into, it
+   * is parsed in place by parse_buffer() without copying.
+   * @return the buffer or nullptr if out of memory, valid until the next
+   * call of the parser */
+  void* get_buffer(int len);
+  /** parses the first len bytes of the buffer of get_buffer(), not
+   * available in multi document mode (parse() copies there anyway) */
+  status_t parse_buffer(int len, bool isFinal);
+
+  /** enables parsing of a stream of concatenated documents.
+   *
+   * at the end of each root element the delegate gets onEndDocument(),
+   * expat is reset with XML_ParserReset keeping its memory and the rest of
+   * the buffer is parsed as the next document. Whitespace between the
+   * documents is skipped. The buffer is passed to expat in slices of
+   * MULTI_DOCUMENT_SLICE bytes, expat copies the unparsed part of a slice
+   * into its buffer and it is fed again after the reset, so the slices
+   * bound these copies. With reparse deferral expat may hold input of
+   * earlier parse() calls beyond the end of the root, the parser keeps a
+   * copy of the input after the last event for it. Comments, processing
+   * instructions and whitespace after the last document are accepted,
+   * parse() with isFinal fails if the last document is incomplete.
+   */
+  void set_multi_document(bool enable) { m_multi_document = enable; }
+  bool multi_document() const { return m_multi_document; }
+  static const int MULTI_DOCUMENT_SLICE = 16*1024;
+  /** sets the limits of the following documents, also in multi document
+   * mode.
+   * @return false if expat rejects the amplification limits or was built
+   * without them (XML_DTD), the other limits are set anyway */
+  bool set_limits(const limits& limits);
+  const limits& document_limits() const { return m_limits; }
+
+  /** enables or disables the reparse deferral of expat (2.6 on, enabled
+   * by default). A token which does not fit into the fed input, e.g. a
+   * large attribute value or comment, is scanned again with every chunk;
+   * with deferral expat waits until the buffered input has grown enough,
+   * which bounds the rescans when the input comes in small chunks.
+   * Disabling it delivers each complete token as early as possible, for
+   * latency on interactive streams with small tokens.
+   * @return false if expat has no reparse deferral, the setting is kept
+   * for the following documents anyway */
+  bool set_reparse_deferral(bool enable);
+  bool reparse_deferral() const { return m_reparse_deferral; }
+  /** @return true if expat has reparse deferral */
+  static bool reparse_deferral_available();
+
+  /** namespace separator for triplets, a control character which is no
+   * valid character of XML 1.0 and so never part of a name or URI */
+  static const char TRIPLET_SEPARATOR = '\x1F';
+  /** passes names of a namespace as uri, local name and prefix, joined by
+   * the namespace separator of the constructor (XML_SetReturnNSTriplet).
+   * Names in the default namespace have no prefix part. Set it before
+   * parsing, it is kept for all documents in multi document mode. See
+   * qname_delegate for the split names. */
+  void set_namespace_triplets(bool enable);
+  bool namespace_triplets() const { return m_namespace_triplets; }
+
+  /** resolves external entities and the external DTD subset with the
+   * resolver, which may be shared with other parsers and threads and has
+   * to outlive the parsing. The entities are parsed by child parsers of
+   * expat into the events of the delegate. Set it before parsing, nullptr
+   * skips external entities again (the default).
+   * @return false if expat can not read the external DTD subset (built
+   * without XML_DTD), external general entities are resolved anyway */
+  bool set_entity_resolver(entity_resolver* resolver);
+  entity_resolver* resolver() const { return m_resolver; }
+  /** base for relative system ids of the document, e.g. its filename */
+  void set_base(const std::string& base);
+  /** @return error of the last call, SUSPENDED while suspended, the
+   * violated limit after a limit stopped the parser */
   error_t errorcode() const;
   size_t current_line_number() const ;
   size_t current_column_number() const ;
+  /** byte offset of the current event from begin of parsing */
+  size_t current_byte_index() const ;
+  /** number of bytes of the current event, 0 for events inside entities and
+   * for the end event of an empty element */
+  size_t current_byte_count() const ;
+
+  const statistics& stats() const { return m_stats; }
 private:
+  /** the expat callbacks, userData of expat is the parser */
+  struct handlers;
+
+  /** sets the user data, the handlers and the settings expat resets,
+   * after creation and reset */
+  void install_handlers();
+  /** @return false if expat rejects the amplification limits */
+  bool apply_amplification_limits();
+  /** stops the parser for the violated limit, inside callbacks expat
+   * aborts on return */
+  void fail(error_t error);
+  /** checks the deadline and restarts the count down of events */
+  void check_deadline();
+  /** parses the external entity with a child parser of the parser which
+   * met the reference
+   * @return false on errors */
+  bool parse_external_entity(const XML_Char* context, const XML_Char* base,
+                             const XML_Char* systemId, const XML_Char* publicId);
+  /** parses a chunk of the current document */
+  status_t parse_document(const char* buffer, int len, bool isFinal,
+                          bool leased = false);
+  /** bookkeeping after expat returned from a chunk of the document */
+  status_t finish_chunk(status_t status, bool isFinal);
+  /** parses a chunk of a stream of documents, the first fed bytes were
+   * passed to expat already and returned status */
+  status_t parse_stream(const char* buffer, int len, bool isFinal,
+                        int fed = 0, status_t status = status_t::OK);
+  /** multi document mode: keeps the part of the fed slice expat may not
+   * have parsed yet in m_unparsed */
+  void keep_unparsed(const char* buffer, int fed);
+  /** multi document mode: starts the next document after the root */
+  void reset_document();
+
+  delegate* m_delegate;
+  statistics m_stats;
+  /** byte index and size of the token of the last character data and the
+   * character data it produced so far, detects entity expansions */
+  int64_t m_text_index{-1};
+  uint64_t m_text_token_bytes{0};
+  uint64_t m_text_token_data{0};
+  limits m_limits;
+  error_t m_limit_error{error_t::NONE};
+  /** end of the time of the current document */
+  std::chrono::steady_clock::time_point m_deadline;
+  unsigned m_deadline_countdown{DEADLINE_EVENTS};
+  /** statistics.bytes at the begin of the current document */
+  uint64_t m_document_start{0};
+  /** character data since the last tag, comment or processing instruction */
+  uint64_t m_text_run{0};
+  /** between the first and the final parse() of a document */
+  bool m_in_document{false};
+  bool m_multi_document{false};
+  bool m_reparse_deferral{true};
+  bool m_namespace_triplets{false};
+  entity_resolver* m_resolver{nullptr};
+  std::string m_base;
+  /** child parser of the external entity being parsed */
+  XML_Parser m_entity_parser{nullptr};
+  /** multi document mode: the root element was closed, the parser stops
+   * at the end offset of the root in the document */
+  bool m_document_complete{false};
+  uint64_t m_document_end{0};
+  /** multi document mode: bytes of the document passed to expat */
+  uint64_t m_document_bytes{0};
+  /** multi document mode: byte index of the last event in the document,
+   * expat parsed the input before it */
+  uint64_t m_parsed_to{0};
+  /** multi document mode: copy of the last bytes of the document passed
+   * to expat, from m_parsed_to or before */
+  std::vector<char> m_unparsed;
+  /** inside parse() or resume() */
+  bool m_parsing{false};
+  bool m_suspended{false};
+  /** isFinal of the chunk expat suspended in */
+  bool m_suspend_final{false};
+  /** multi document mode: input after the suspension, its first
+   * m_pending_fed bytes were passed to expat already */
+  std::vector<char> m_pending;
+  int m_pending_fed{0};
+  bool m_pending_final{false};
   XML_Parser m_parser;
 };
 
@@ -104,6 +374,29 @@ class Attr {
 public:
   explicit Attr(const XML_Char** attrs) : attrs_(attrs){};
   std::string getValue(const char* key);
+
+  /** typed value of the attribute, converted in place without copying
+   * @param key attribute key to search for
+   * @param value receives the value, unchanged on errors
+   * @return conv_error::MISSING if there is no such attribute or the
+   * error of the conversion, see numconv.hpp for the accepted literals
+   */
+  template<typename T>
+  conv_error get(const char* key, T& value) const
+  {
+    const XML_Char* v = parser::xmlGetAttrValue(attrs_,key);
+    if (v==nullptr) return conv_error::MISSING;
+    return convert(v, v + strlen(v), value);
+  }
+
+  /** @return typed value of the attribute or fallback if it is missing or
+   * not convertible */
+  template<typename T>
+  T get_or(const char* key, T fallback) const
+  {
+    T value;
+    return get(key,value)==conv_error::NONE ? value : fallback;
+  }
 private:
   const XML_Char** attrs_{nullptr};
 };
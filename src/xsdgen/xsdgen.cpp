@@ -1,45 +1,45 @@
 /**
  * \file implementation of xsd codegenerator
  *
+ * generates from a xml schema a C++ header with
+ * - an enum class for each simpleType restriction with enumerations
+ * - a struct for each complexType
+ * - a document struct holding the top level elements and the arena the
+ *   parsed strings are stored in
+ * - a statically dispatched document_parser delegate, the elements are
+ *   dispatched by a generated switch on their interned names
+ *
+ * names are matched with their namespace: top level elements in the
+ * targetNamespace of the schema, local elements and attributes in it if
+ * elementFormDefault or attributeFormDefault are qualified, otherwise
+ * without namespace. Elements of other namespaces are skipped.
+ *
  * See LICENSE for copyright information.
  */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <set>
 #include <vector>
 #include "xmlparser.hpp"
 #include "state.hpp"
 
 using std::cout;
+using std::cerr;
 using std::endl;
+using std::ostream;
+using std::string;
+using std::vector;
 
 using xmlpp::parser;
 using xmlpp::State;
 using xmlpp::StatefulDelegate;
 
-void print(const XML_Char **atts) {
-  for (size_t i = 0; atts[i]!=NULL;i+=2)
-  {
-    cout << atts[i] << "=" << atts[i+1] << endl;
-  }
-}
-
-void StartElement(const XML_Char **atts)
-{
-  cout << "@" << " start element" << endl;
-  print(atts);
-}
-
-void EndElement()
-{
-  cout << "@" //<< parseStates.top()->tag
-  << " end element" << endl;
-}
-
-void CharacterData(const char *pBuf, int len)
-{
-  std::string s(pBuf,len);
-//  cout << "@" //<< parseStates.top()->tag
-//  << " text:"  << s << ":"<< endl;
-}
+/** the parser expands the names of the schema elements with their uri */
+static const string XSD = "http://www.w3.org/2001/XMLSchema:";
 
 namespace xsd {
 struct schema_t {
@@ -50,7 +50,7 @@ struct schema_t {
     std::string name;
     std::string type;
     int minOccurs{1};
-    int maxOccurs{1};
+    int maxOccurs{1}; //< -1 for unbounded
 
   };
   struct attribute_t {
@@ -77,85 +77,944 @@ struct schema_t {
     restriction_t restriction;
     std::string name;
   };
+  std::string targetNamespace;
+  bool elementsQualified{false};
+  bool attributesQualified{false};
   std::vector<element_t> elements;
   std::vector<complexType_t> complexTypes;
   std::vector<simpleType_t> simpleTypes;
+
+  const complexType_t* complexType(const std::string& name) const;
+  const simpleType_t* simpleType(const std::string& name) const;
 };
 
 } // end namespace: xsd
 
-void generate(const xsd::schema_t::simpleType_t& s) {
-  cout << "enum class " << s.name << " {" << endl;
+/** @return value of attribute or empty string if not present */
+static const char* attr(const XML_Char **atts, const char* key)
+{
+  const XML_Char* v = parser::xmlGetAttrValue(atts,key);
+  return v ? v : "";
+}
+
+static int occurs(const XML_Char **atts, const char* key)
+{
+  const XML_Char* v = parser::xmlGetAttrValue(atts,key);
+  if (v==nullptr || *v==0) return 1;
+  if (strcmp(v,"unbounded")==0) return -1;
+  return atoi(v);
+}
+
+/** strips the namespace prefix of a qualified name */
+static string local_type(const string& type)
+{
+  size_t pos = type.rfind(':');
+  return pos==string::npos ? type : type.substr(pos+1);
+}
+
+static bool is_builtin(const string& type)
+{
+  return type.compare(0,4,"xsd:")==0 || type.compare(0,3,"xs:")==0;
+}
+
+const xsd::schema_t::complexType_t* xsd::schema_t::complexType(const string& name) const
+{
+  if (is_builtin(name)) return nullptr;
+  const string n = local_type(name);
+  for (const auto& c : complexTypes) {
+    if (c.name==n) return &c;
+  }
+  return nullptr;
+}
+
+const xsd::schema_t::simpleType_t* xsd::schema_t::simpleType(const string& name) const
+{
+  if (is_builtin(name)) return nullptr;
+  const string n = local_type(name);
+  for (const auto& s : simpleTypes) {
+    if (s.name==n) return &s;
+  }
+  return nullptr;
+}
+
+/** makes a valid C++ identifier from a xml name */
+static string identifier(const string& name)
+{
+  static const std::set<string> keywords = {
+    "alignas", "alignof", "and", "asm", "auto", "bool", "break", "case",
+    "catch", "char", "class", "const", "constexpr", "continue", "default",
+    "delete", "do", "double", "else", "enum", "explicit", "export", "extern",
+    "false", "float", "for", "friend", "goto", "if", "inline", "int", "long",
+    "mutable", "namespace", "new", "noexcept", "not", "nullptr", "operator",
+    "or", "private", "protected", "public", "register", "return", "short",
+    "signed", "sizeof", "static", "struct", "switch", "template", "this",
+    "throw", "true", "try", "typedef", "typename", "union", "unsigned",
+    "using", "virtual", "void", "volatile", "while", "xor"
+  };
+  string id;
+  for (char c : name) {
+    id += (isalnum(static_cast<unsigned char>(c)) || c=='_') ? c : '_';
+  }
+  if (id.empty() || isdigit(static_cast<unsigned char>(id[0]))) id = "_" + id;
+  if (keywords.count(id)) id += "_";
+  return id;
+}
+
+/** C++ literal for a string, non printable bytes are written octal */
+static string literal(const string& s)
+{
+  string l("\"");
+  for (char c : s) {
+    unsigned char u = static_cast<unsigned char>(c);
+    if (c=='"' || c=='\\') {
+      l += '\\';
+      l += c;
+    } else if (u < 0x20 || u >= 0x7f) {
+      char oct[5];
+      snprintf(oct, sizeof(oct), "\\%03o", u);
+      l += oct;
+    } else {
+      l += c;
+    }
+  }
+  return l + "\"";
+}
+
+static string char_literal(char c)
+{
+  unsigned char u = static_cast<unsigned char>(c);
+  if (c=='\'' || c=='\\') return string("'\\") + c + "'";
+  if (u < 0x20 || u >= 0x7f) return std::to_string(static_cast<int>(static_cast<signed char>(c)));
+  return string("'") + c + "'";
+}
+
+/** emits a lookup of the string (s,len) as switch on the length and
+ * the first character of the candidates followed by a memcmp.
+ * @param cases string and statement executed if it matches
+ * @param notfound statement executed if no string matches */
+static void emit_string_switch(ostream& out,
+                               const vector<std::pair<string,string>>& cases,
+                               const string& notfound,
+                               const string& indent)
+{
+  std::map<size_t,std::map<char,vector<std::pair<string,string>>>> by_len;
+  for (const auto& c : cases) {
+    if (c.first.empty()) {
+      out << indent << "if (len==0) " << c.second << endl;
+    } else {
+      by_len[c.first.size()][c.first[0]].push_back(c);
+    }
+  }
+  out << indent << "switch (len) {" << endl;
+  for (const auto& l : by_len) {
+    out << indent << "  case " << l.first << ":" << endl;
+    const bool by_char = l.second.size() > 1;
+    string in = indent + "    ";
+    if (by_char) out << in << "switch (s[0]) {" << endl;
+    for (const auto& f : l.second) {
+      if (by_char) {
+        out << in << "  case " << char_literal(f.first) << ":" << endl;
+      }
+      for (const auto& c : f.second) {
+        out << in << (by_char ? "    " : "")
+            << "if (memcmp(s," << literal(c.first) << "," << l.first
+            << ")==0) " << c.second << endl;
+      }
+      if (by_char) out << in << "    break;" << endl;
+    }
+    if (by_char) out << in << "}" << endl;
+    out << in << "break;" << endl;
+  }
+  out << indent << "}" << endl
+      << indent << notfound << endl;
+}
+
+/** hash functions used by the generated perfect hash lookups, the
+ * generated code contains the same functions */
+static uint32_t sample_hash(const char* s, size_t len, uint32_t seed)
+{
+  uint32_t h = static_cast<uint32_t>(len) * 0x9e3779b1u + seed;
+  h ^= static_cast<unsigned char>(s[0]) * 0x85ebca6bu;
+  h ^= static_cast<unsigned char>(s[len/2]) * 0xc2b2ae35u;
+  h ^= static_cast<unsigned char>(s[len-1]) * 0x27d4eb2fu;
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 12;
+  return h;
+}
+
+static uint32_t full_hash(const char* s, size_t len, uint32_t seed)
+{
+  uint32_t h = 2166136261u ^ seed;
+  for (size_t i = 0; i < len; ++i) {
+    h = (h ^ static_cast<unsigned char>(s[i])) * 16777619u;
+  }
+  return h;
+}
+
+/** murmur3 finalizer, spreads the displaced hashes over the table */
+static uint32_t mix(uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+static const char* HASH_FUNCTIONS =
+  "namespace detail {\n"
+  "/** hash of length and three sampled characters */\n"
+  "inline uint32_t sample_hash(const char* s, size_t len, uint32_t seed) {\n"
+  "  uint32_t h = static_cast<uint32_t>(len) * 0x9e3779b1u + seed;\n"
+  "  h ^= static_cast<unsigned char>(s[0]) * 0x85ebca6bu;\n"
+  "  h ^= static_cast<unsigned char>(s[len/2]) * 0xc2b2ae35u;\n"
+  "  h ^= static_cast<unsigned char>(s[len-1]) * 0x27d4eb2fu;\n"
+  "  h ^= h >> 15;\n"
+  "  h *= 0x2c1b3c6du;\n"
+  "  h ^= h >> 12;\n"
+  "  return h;\n"
+  "}\n\n"
+  "/** FNV-1a hash of all characters */\n"
+  "inline uint32_t full_hash(const char* s, size_t len, uint32_t seed) {\n"
+  "  uint32_t h = 2166136261u ^ seed;\n"
+  "  for (size_t i = 0; i < len; ++i) {\n"
+  "    h = (h ^ static_cast<unsigned char>(s[i])) * 16777619u;\n"
+  "  }\n"
+  "  return h;\n"
+  "}\n\n"
+  "/** murmur3 finalizer, spreads the displaced hashes over the table */\n"
+  "inline uint32_t mix(uint32_t h) {\n"
+  "  h ^= h >> 16;\n"
+  "  h *= 0x85ebca6bu;\n"
+  "  h ^= h >> 13;\n"
+  "  h *= 0xc2b2ae35u;\n"
+  "  h ^= h >> 16;\n"
+  "  return h;\n"
+  "}\n"
+  "} // end namespace detail\n";
+
+/** a collision free hash table layout for a set of strings */
+struct perfect_hash {
+  bool sampled{true};
+  uint32_t seed{0};
+  size_t size{0};
+  /** index of the string for each slot, -1 for empty slots */
+  vector<int> slots;
+  /** displacement of the buckets of full_hash, the slot of a string is
+   * mix(h ^ displacement[h & (buckets-1)]), empty for a single hash */
+  vector<uint32_t> displacement;
+};
+
+/** searches a seed for full_hash and a power of two table size for
+ * which a displacement per bucket of about four strings maps all
+ * strings to different slots (hash and displace), the buckets are
+ * placed from the largest on.
+ * @return false if no seed separates the strings */
+static bool find_displacement(const vector<string>& keys, size_t base, perfect_hash& ph)
+{
+  static const uint32_t MAX_DISPLACEMENT = 1u << 20;
+  for (uint32_t seed = 0; seed < 64; ++seed) {
+    vector<uint32_t> hashes;
+    for (const auto& k : keys) hashes.push_back(full_hash(k.data(),k.size(),seed));
+    vector<uint32_t> sorted(hashes);
+    std::sort(sorted.begin(),sorted.end());
+    if (std::adjacent_find(sorted.begin(),sorted.end())!=sorted.end()) continue;
+
+    for (size_t size = base; size <= base*64; size <<= 1) {
+      const size_t buckets = std::max<size_t>(1, size/4);
+      vector<vector<size_t>> members(buckets);
+      for (size_t i = 0; i < keys.size(); ++i) members[hashes[i] & (buckets-1)].push_back(i);
+      vector<size_t> order(buckets);
+      for (size_t b = 0; b < buckets; ++b) order[b] = b;
+      std::stable_sort(order.begin(),order.end(), [&members](size_t a, size_t b) {
+          return members[a].size() > members[b].size();
+        });
+
+      vector<int> slots(size,-1);
+      vector<uint32_t> displacement(buckets,0);
+      vector<size_t> placed;
+      bool ok = true;
+      for (size_t b : order) {
+        if (members[b].empty()) break;
+        uint32_t d = 0;
+        for (; d < MAX_DISPLACEMENT; ++d) {
+          placed.clear();
+          for (size_t i : members[b]) {
+            const size_t slot = mix(hashes[i] ^ d) & (size-1);
+            if (slots[slot]!=-1) break;
+            slots[slot] = static_cast<int>(i);
+            placed.push_back(slot);
+          }
+          if (placed.size()==members[b].size()) break;
+          for (size_t slot : placed) slots[slot] = -1;
+        }
+        if (d==MAX_DISPLACEMENT) {
+          ok = false;
+          break;
+        }
+        displacement[b] = d;
+      }
+      if (ok) {
+        ph.sampled = false;
+        ph.seed = seed;
+        ph.size = size;
+        ph.slots.swap(slots);
+        ph.displacement.swap(displacement);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/** searches hash function, seed and a power of two table size
+ * which map all (non empty, distinct) strings to different slots,
+ * larger sets fall back to find_displacement().
+ * @return false if no layout was found */
+static bool find_perfect_hash(const vector<string>& keys, perfect_hash& ph)
+{
+  size_t base = 1;
+  while (base < keys.size()) base <<= 1;
+  for (int pass = 0; pass < 2; ++pass) {
+    ph.sampled = pass==0;
+    for (size_t size = base; size <= base*8; size <<= 1) {
+      for (uint32_t seed = 0; seed < 2000; ++seed) {
+        vector<int> slots(size,-1);
+        bool ok = true;
+        for (size_t i = 0; ok && i < keys.size(); ++i) {
+          const string& k = keys[i];
+          uint32_t h = ph.sampled ? sample_hash(k.data(),k.size(),seed)
+                                  : full_hash(k.data(),k.size(),seed);
+          int& slot = slots[h & (size-1)];
+          if (slot!=-1) ok = false;
+          slot = static_cast<int>(i);
+        }
+        if (ok) {
+          ph.seed = seed;
+          ph.size = size;
+          ph.slots.swap(slots);
+          return true;
+        }
+      }
+    }
+  }
+  return find_displacement(keys, base, ph);
+}
+
+/** @return simple type with enumerations or nullptr */
+static const xsd::schema_t::simpleType_t* enum_type(const xsd::schema_t& s,
+                                                    const string& type)
+{
+  const auto* t = s.simpleType(type);
+  return (t && !t->restriction.values.empty()) ? t : nullptr;
+}
+
+/** C++ type of an element or attribute of the given schema type */
+static string member_type(const xsd::schema_t& s, const string& type)
+{
+  if (const auto* c = s.complexType(type)) return identifier(c->name);
+  if (const auto* e = enum_type(s,type)) return identifier(e->name);
+  return "xmlpp::string_ref";
+}
+
+static string attribute_name(const xsd::schema_t::attribute_t& a)
+{
+  return a.name.empty() ? local_type(a.ref) : a.name;
+}
+
+/** @return true if the member gets a flag has_<name>, set for present
+ * optional complex elements and for valid values of single enumerations,
+ * the first enumerator can not tell missing or unknown values otherwise */
+static bool has_flag(const xsd::schema_t& s, const xsd::schema_t::element_t& m)
+{
+  return m.maxOccurs==1 && (enum_type(s,m.type) || (m.minOccurs==0 && s.complexType(m.type)));
+}
+
+static bool has_flag(const xsd::schema_t& s, const xsd::schema_t::attribute_t& a)
+{
+  return enum_type(s,a.type)!=nullptr;
+}
+
+/** @return true if local names of the schema are in its target namespace
+ * for the given elementFormDefault or attributeFormDefault */
+static bool qualified(const xsd::schema_t& s, bool form_qualified)
+{
+  return form_qualified && !s.targetNamespace.empty();
+}
+
+/** maximum number of enumerators looked up with a switch, bigger sets use
+ * a perfect hash */
+static const size_t MAX_SWITCH_ENUMERATORS = 8;
+
+/** emits the reverse mapping of to_string for an enumeration
+ * @return false if no perfect hash was found for the enumerators */
+bool generate_from_string(ostream& out, const xsd::schema_t::simpleType_t& s)
+{
+  const string t = identifier(s.name);
+  vector<string> keys;
+  string empty_value;
+  std::set<string> seen;
+  for (const auto& v : s.restriction.values) {
+    if (!seen.insert(v.value).second) continue;
+    if (v.value.empty()) {
+      empty_value = t + "::" + identifier(v.value);
+    } else {
+      keys.push_back(v.value);
+    }
+  }
+
+  out << "/** converts the string to the enumerator\n"
+         " * @return false if the string is no enumerator */" << endl
+      << "inline bool from_string(xmlpp::string_ref str, " << t << "& e) {" << endl
+      << "  const char* s = str.data;" << endl
+      << "  const size_t len = str.size;" << endl;
+
+  if (keys.size() <= MAX_SWITCH_ENUMERATORS) {
+    vector<std::pair<string,string>> cases;
+    for (const auto& k : keys) {
+      cases.emplace_back(k, "{ e = " + t + "::" + identifier(k) + "; return true; }");
+    }
+    if (!empty_value.empty()) {
+      cases.emplace_back("", "{ e = " + empty_value + "; return true; }");
+    }
+    emit_string_switch(out, cases, "return false;", "  ");
+  } else {
+    perfect_hash ph;
+    if (!find_perfect_hash(keys, ph)) return false;
+    out << "  struct entry {" << endl
+        << "    const char* str;" << endl
+        << "    size_t len;" << endl
+        << "    " << t << " value;" << endl
+        << "  };" << endl
+        << "  static const entry table[" << ph.size << "] = {" << endl;
+    for (size_t i = 0; i < ph.size; ++i) {
+      out << "    ";
+      if (ph.slots[i] < 0) {
+        out << "{\"\", 0, " << t << "()}";
+      } else {
+        const string& k = keys[static_cast<size_t>(ph.slots[i])];
+        out << "{" << literal(k) << ", " << k.size() << ", " << t << "::" << identifier(k) << "}";
+      }
+      out << (i+1 < ph.size ? "," : "") << endl;
+    }
+    out << "  };" << endl
+        << "  if (len==0) ";
+    if (empty_value.empty()) {
+      out << "return false;" << endl;
+    } else {
+      out << "{ e = " << empty_value << "; return true; }" << endl;
+    }
+    if (ph.displacement.empty()) {
+      out << "  const entry& x = table[detail::" << (ph.sampled ? "sample_hash" : "full_hash")
+          << "(s,len," << ph.seed << "u) & " << (ph.size-1) << "u];" << endl;
+    } else {
+      const size_t buckets = ph.displacement.size();
+      out << "  static const uint32_t displacement[" << buckets << "] = {";
+      for (size_t i = 0; i < buckets; ++i) {
+        out << (i%12==0 ? "\n    " : " ") << ph.displacement[i] << "u" << (i+1 < buckets ? "," : "");
+      }
+      out << endl << "  };" << endl
+          << "  const uint32_t h = detail::full_hash(s,len," << ph.seed << "u);" << endl
+          << "  const entry& x = table[detail::mix(h ^ displacement[h & " << (buckets-1)
+          << "u]) & " << (ph.size-1) << "u];" << endl;
+    }
+    out << "  if (x.len==len && memcmp(x.str,s,len)==0) {" << endl
+        << "    e = x.value;" << endl
+        << "    return true;" << endl
+        << "  }" << endl
+        << "  return false;" << endl;
+  }
+  out << "}" << endl << endl;
+  return true;
+}
+
+/** @return false if the lookup of the enumerators can not be generated */
+bool generate(ostream& out, const xsd::schema_t::simpleType_t& s) {
+  out << "enum class " << identifier(s.name) << " {" << endl;
   bool first = true;
   for (auto v: s.restriction.values) {
     if (first) {
       first = false;
-      cout << v.value;
+      out << "  " << identifier(v.value);
     } else
-      cout << ", " << endl << v.value;
-// TODO:uppercase
+      out << "," << endl << "  " << identifier(v.value);
   }
-  cout << endl << "};" << endl << endl;
+  out << endl << "};" << endl << endl;
 
-  cout << "std::string to_string(" << s.name <<" e) {" << endl
-       << "  switch(e) {" << endl;
+  out << "inline const char* to_string(" << identifier(s.name) <<" e) {" << endl
+      << "  switch(e) {" << endl;
   for (auto v: s.restriction.values) {
-    cout << "    case " << s.name << "::"<< v.value << " : return \"" << v.value << "\";" << endl;
+    out << "    case " << identifier(s.name) << "::"<< identifier(v.value)
+        << " : return " << literal(v.value) << ";" << endl;
   }
-  cout << "  }" << endl << "}" << endl;
+  out << "  }" << endl
+      << "  return \"\";" << endl
+      << "}" << endl << endl;
 
+  return generate_from_string(out,s);
 }
 
-const std::string& map_type(const std::string& type) {
-  static const std::string XSD_STRING="std::string";
-  if (type=="xsd:string") {
-    return XSD_STRING;
+void generate(ostream& out, const xsd::schema_t& s, const xsd::schema_t::complexType_t& c)
+{
+  out << "struct " << identifier(c.name) << " {" << endl;
+  for (const auto& m : c.elements) {
+    const string t = member_type(s,m.type);
+    if (m.maxOccurs==1) {
+      out << "  " << t << " " << identifier(m.name) << ";" << endl;
+      if (has_flag(s,m)) out << "  bool has_" << identifier(m.name) << "{false};" << endl;
+    } else {
+      out << "  std::vector<" << t << "> " << identifier(m.name) << ";" << endl;
+    }
+  }
+  for (const auto& a : c.attributes) {
+    out << "  " << member_type(s,a.type) << " " << identifier(attribute_name(a))
+        << "; //< attribute" << (a.use.empty() ? "" : ", " + a.use) << endl;
+    if (has_flag(s,a)) out << "  bool has_" << identifier(attribute_name(a)) << "{false};" << endl;
+  }
+  out << "};" << endl << endl;
+}
+
+/** complex types ordered so that each type is declared before its use */
+static vector<const xsd::schema_t::complexType_t*> ordered_types(const xsd::schema_t& s)
+{
+  vector<const xsd::schema_t::complexType_t*> order;
+  std::set<const xsd::schema_t::complexType_t*> visited;
+  std::function<void (const xsd::schema_t::complexType_t*)> visit =
+    [&](const xsd::schema_t::complexType_t* c)
+    {
+      if (!visited.insert(c).second) return;
+      for (const auto& m : c->elements) {
+        if (const auto* d = s.complexType(m.type)) visit(d);
+      }
+      order.push_back(c);
+    };
+  for (const auto& c : s.complexTypes) visit(&c);
+  return order;
+}
+
+/** all element and attribute names used in the schema */
+static vector<string> names(const xsd::schema_t& s)
+{
+  std::set<string> n;
+  for (const auto& e : s.elements) n.insert(e.name);
+  for (const auto& c : s.complexTypes) {
+    for (const auto& e : c.elements) n.insert(e.name);
+    for (const auto& a : c.attributes) n.insert(attribute_name(a));
+  }
+  n.erase("");
+  return vector<string>(n.begin(),n.end());
+}
+
+/** emits the start of a child element in the parser for the given member */
+static void generate_start(ostream& out, const xsd::schema_t& s,
+                           const xsd::schema_t::element_t& m,
+                           const string& owner,
+                           const string& indent)
+{
+  const string id = identifier(m.name);
+  const auto* c = s.complexType(m.type);
+  const auto* e = enum_type(s,m.type);
+  const bool flag = has_flag(s,m);
+  const string present = flag ? "&" + owner + "has_" + id : string("nullptr");
+  out << indent << "case name_id::" << id << ": {" << endl;
+  if (m.maxOccurs==1) {
+    out << indent << "  auto* o = &" << owner << id << ";" << endl;
+    if (e) {
+      out << indent << "  *o = " << identifier(e->name) << "();" << endl
+          << indent << "  " << owner << "has_" << id << " = false;" << endl;
+    } else if (!c) {
+      out << indent << "  *o = xmlpp::string_ref();" << endl;
+    } else if (flag) {
+      out << indent << "  " << owner << "has_" << id << " = true;" << endl;
+    }
   } else {
-    return type;
+    out << indent << "  " << owner << id << ".emplace_back();" << endl
+        << indent << "  auto* o = &" << owner << id << ".back();" << endl;
   }
+  if (c) {
+    if (!c->attributes.empty()) out << indent << "  attributes(*o,atts);" << endl;
+    out << indent << "  stack_.push_back(frame{T_" << identifier(c->name) << ",o,nullptr});" << endl;
+  } else if (e) {
+    // enumerations are converted at the end of the element
+    out << indent << "  text_.clear();" << endl
+        << indent << "  stack_.push_back(frame{E_" << identifier(e->name) << ",o," << present << "});" << endl;
+  } else {
+    out << indent << "  text_.clear();" << endl
+        << indent << "  stack_.push_back(frame{T_text,o,nullptr});" << endl;
+  }
+  out << indent << "  return;" << endl
+      << indent << "}" << endl;
 }
 
-void print(const xsd::schema_t& s) {
-  cout << "schema {" << endl;
+void generate_parser(ostream& out, const xsd::schema_t& s)
+{
+  const auto types = ordered_types(s);
+  bool attributes = false;
+  for (const auto* c : types) attributes = attributes || !c->attributes.empty();
+  // top level elements are in the target namespace, the others if qualified
+  const bool top_qualified = !s.targetNamespace.empty();
+  const bool local_qualified = qualified(s, s.elementsQualified);
+  const string qualified_elements = top_qualified==local_qualified
+    ? string(top_qualified ? "true" : "false") : string("top.type==T_document");
 
-  for (auto st: s.simpleTypes) {
-    generate(st);
+  out << "/** document with the top level elements of the schema.\n"
+         " * the parsed strings refer into the documents arena */" << endl
+      << "struct document {" << endl
+      << "  xmlpp::arena strings;" << endl;
+  for (const auto& e : s.elements) {
+    out << "  " << member_type(s,e.type) << " " << identifier(e.name) << ";" << endl;
+    if (has_flag(s,e)) out << "  bool has_" << identifier(e.name) << "{false};" << endl;
   }
+  out << "};" << endl << endl;
+
+  out << "enum class name_id {" << endl
+      << "  unknown_";
+  for (const auto& n : names(s)) out << "," << endl << "  " << identifier(n);
+  out << endl << "};" << endl << endl;
+
+  vector<std::pair<string,string>> cases;
+  for (const auto& n : names(s)) cases.emplace_back(n, "return name_id::" + identifier(n) + ";");
+  out << "inline name_id intern(const char* s, size_t len) {" << endl;
+  emit_string_switch(out, cases, "return name_id::unknown_;", "  ");
+  out << "}" << endl << endl;
 
-  for( auto c:s.complexTypes) {
-    cout << "struct " << c.name << " {" << endl;
-    for (auto m:c.elements) {
-      cout << "element<"<< map_type(m.type) << ",\"" << m.name << "\">"<< " " << m.name << ";" << endl;
+  out << "/** parser delegate filling a document */" << endl
+      << "class document_parser : public xmlpp::abstract_delegate {" << endl
+      << "public:" << endl
+      << "  explicit document_parser(document& doc) : doc_(doc)" << endl
+      << "  { stack_.push_back(frame{T_document,&doc,nullptr}); }" << endl << endl
+      << "  /** number of enumeration values which are no enumerator, their\n"
+      << "   * members keep has_ false, in lists the first enumerator */" << endl
+      << "  size_t invalid_values() const { return invalid_; }" << endl << endl
+      << "  void onStartElement(const XML_Char *fullname, const XML_Char **"
+      << (attributes ? "atts" : "/*atts*/") << ") override" << endl
+      << "  {" << endl
+      << "    const frame& top = stack_.back();" << endl
+      << "    const name_id id = schema_id(fullname," << qualified_elements << ");" << endl
+      << "    switch (top.type) {" << endl
+      << "      case T_document: {" << endl
+      << "        document* p = static_cast<document*>(top.obj);" << endl
+      << "        switch (id) {" << endl;
+  for (const auto& e : s.elements) {
+    xsd::schema_t::element_t m = e;
+    m.maxOccurs = 1;
+    generate_start(out, s, m, "p->", "          ");
+  }
+  out << "          default: break;" << endl
+      << "        }" << endl
+      << "        break;" << endl
+      << "      }" << endl;
+  for (const auto* c : types) {
+    const string t = identifier(c->name);
+    out << "      case T_" << t << ": {" << endl;
+    if (!c->elements.empty()) {
+      out << "        " << t << "* p = static_cast<" << t << "*>(top.obj);" << endl
+          << "        switch (id) {" << endl;
+      for (const auto& m : c->elements) {
+        generate_start(out, s, m, "p->", "          ");
+      }
+      out << "          default: break;" << endl
+          << "        }" << endl;
     }
+    out << "        break;" << endl
+        << "      }" << endl;
+  }
+  out << "      default: break;" << endl
+      << "    }" << endl
+      << "    // unknown elements and their content are skipped" << endl
+      << "    stack_.push_back(frame{T_skip,nullptr,nullptr});" << endl
+      << "  }" << endl << endl
+      << "  void onEndElement(const XML_Char *) override" << endl
+      << "  {" << endl
+      << "    if (stack_.size() <= 1) return;" << endl
+      << "    const frame& top = stack_.back();" << endl
+      << "    const xmlpp::string_ref text(text_.data(),text_.size());" << endl
+      << "    switch (top.type) {" << endl
+      << "      case T_text:" << endl
+      << "        *static_cast<xmlpp::string_ref*>(top.obj) = doc_.strings.store(text.data,text.size);" << endl
+      << "        break;" << endl;
+  for (const auto& e : s.simpleTypes) {
+    if (e.restriction.values.empty()) continue;
+    const string t = identifier(e.name);
+    out << "      case E_" << t << ":" << endl
+        << "        if (!from_string(text,*static_cast<" << t << "*>(top.obj))) {" << endl
+        << "          ++invalid_;" << endl
+        << "        } else if (top.present) {" << endl
+        << "          *top.present = true;" << endl
+        << "        }" << endl
+        << "        break;" << endl;
+  }
+  out << "      default: break;" << endl
+      << "    }" << endl
+      << "    stack_.pop_back();" << endl
+      << "  }" << endl << endl
+      << "  void onCharacterData(const char *pBuf, int len) override" << endl
+      << "  {" << endl
+      << "    const type_id t = stack_.back().type;" << endl
+      << "    if (t==T_text || (t > T_document && t < T_first_type)) {" << endl
+      << "      text_.append(pBuf,static_cast<size_t>(len));" << endl
+      << "    }" << endl
+      << "  }" << endl << endl
+      << "private:" << endl
+      << "  enum type_id {" << endl
+      << "    T_skip," << endl
+      << "    T_text," << endl
+      << "    T_document";
+  for (const auto& e : s.simpleTypes) {
+    if (!e.restriction.values.empty()) out << "," << endl << "    E_" << identifier(e.name);
+  }
+  out << "," << endl << "    T_first_type";
+  for (const auto* c : types) out << "," << endl << "    T_" << identifier(c->name);
+  out << endl << "  };" << endl
+      << "  struct frame {" << endl
+      << "    type_id type;" << endl
+      << "    void* obj;" << endl
+      << "    /** flag of a single enumeration, set at its end if valid */" << endl
+      << "    bool* present;" << endl
+      << "  };" << endl << endl
+      << "  /** @return the id of the local name if the name is in the namespace\n"
+      << "   * of the schema (qualified) or in no namespace, unknown_ otherwise */" << endl;
+  if (s.targetNamespace.empty()) {
+    out << "  static name_id schema_id(const char* name, bool /*qualified*/)" << endl
+        << "  {" << endl;
+  } else {
+    // the namespace is compared as prefix of the known length, expat
+    // separates it from the local name with ':'
+    out << "  static name_id schema_id(const char* name, bool qualified)" << endl
+        << "  {" << endl
+        << "    static const char NS[] = " << literal(s.targetNamespace) << ";" << endl
+        << "    if (qualified) {" << endl
+        << "      const size_t ns = sizeof(NS) - 1;" << endl
+        << "      if (strncmp(name,NS,ns)!=0 || name[ns]!=':') return name_id::unknown_;" << endl
+        << "      name += ns + 1;" << endl
+        << "    }" << endl;
+  }
+  out << "    // names in other namespaces have a separator" << endl
+      << "    size_t len = 0;" << endl
+      << "    for (; name[len]; ++len) {" << endl
+      << "      if (name[len]==':') return name_id::unknown_;" << endl
+      << "    }" << endl
+      << "    return intern(name,len);" << endl
+      << "  }" << endl << endl;
 
-    for (auto a:c.attributes) {
-      cout <<"attribute<"<< map_type(a.type) << ",\"" << a.name << "\">" << " " << a.name << ";// " << a.ref << " " << a.use << endl;
+  for (const auto* c : types) {
+    if (c->attributes.empty()) continue;
+    out << "  void attributes(" << identifier(c->name) << "& o, const XML_Char **atts)" << endl
+        << "  {" << endl
+        << "    for (; *atts; atts += 2) {" << endl
+        << "      switch (schema_id(atts[0],"
+        << (qualified(s, s.attributesQualified) ? "true" : "false") << ")) {" << endl;
+    for (const auto& a : c->attributes) {
+      const string id = identifier(attribute_name(a));
+      out << "        case name_id::" << id << ":" << endl;
+      if (enum_type(s,a.type)) {
+        out << "          o.has_" << id << " = from_string(xmlpp::string_ref(atts[1],strlen(atts[1])),o."
+            << id << ");" << endl
+            << "          if (!o.has_" << id << ") ++invalid_;" << endl;
+      } else {
+        out << "          o." << id << " = doc_.strings.store(atts[1],strlen(atts[1]));" << endl;
+      }
+      out << "          break;" << endl;
     }
+    out << "        default: break;" << endl
+        << "      }" << endl
+        << "    }" << endl
+        << "  }" << endl << endl;
+  }
+
+  out << "  document& doc_;" << endl
+      << "  std::vector<frame> stack_;" << endl
+      << "  size_t invalid_{0};" << endl
+      << "  /** text of the current text or enumeration element, stored once at\n"
+      << "   * its end */" << endl
+      << "  std::string text_;" << endl
+      << "};" << endl << endl;
 
+  out << "/** parses the document, values which are no enumerators leave their\n"
+         " * members not present and are counted\n"
+         " * @param invalid_values if not nullptr it gets the number of them */" << endl
+      << "inline xmlpp::parser::result parse(const char* xml, document& doc,\n"
+         "                                   size_t* invalid_values = nullptr) {" << endl
+      << "  document_parser p(doc);" << endl
+      << "  const xmlpp::parser::result r = xmlpp::parser::parseString(xml,p);" << endl
+      << "  if (invalid_values) *invalid_values = p.invalid_values();" << endl
+      << "  return r;" << endl
+      << "}" << endl << endl
+      << "inline xmlpp::parser::result parse_file(const std::string& filename, document& doc,\n"
+         "                                        size_t* invalid_values = nullptr) {" << endl
+      << "  document_parser p(doc);" << endl
+      << "  const xmlpp::parser::result r = xmlpp::parser::parseFile(filename,p);" << endl
+      << "  if (invalid_values) *invalid_values = p.invalid_values();" << endl
+      << "  return r;" << endl
+      << "}" << endl << endl;
+}
 
-    cout << "};" << endl << endl ;
+/** @return expression for a string_ref to the literal */
+static string ref_literal(const string& s)
+{
+  return "xmlpp::string_ref(" + literal(s) + "," + std::to_string(s.size()) + ")";
+}
 
+/** emits writing of a child element with the given value expression */
+static void generate_write(ostream& out, const xsd::schema_t& s,
+                           const xsd::schema_t::element_t& m,
+                           const string& value,
+                           const string& indent)
+{
+  if (s.complexType(m.type)) {
+    out << indent << "serialize(w," << value << "," << ref_literal("<" + m.name)
+        << "," << ref_literal("</" + m.name + ">") << ");" << endl;
+    return;
+  }
+  const string open = "<" + m.name + ">";
+  const string close = "</" + m.name + ">";
+  out << indent << "w.raw(" << literal(open) << "," << open.size() << ");" << endl;
+  if (enum_type(s,m.type)) {
+    out << indent << "const char* v = to_string(" << value << ");" << endl
+        << indent << "w.text(v,strlen(v));" << endl;
+  } else {
+    out << indent << "w.text(" << value << ".data," << value << ".size);" << endl;
   }
+  out << indent << "w.raw(" << literal(close) << "," << close.size() << ");" << endl;
+}
 
+/** emits the serializers of the complex types and the document.
+ * the tags are written from precomputed literals, the name of an element
+ * is known by its parent, so it is passed to the serializer of its type
+ * as start ("<name") and end tag ("</name>") */
+void generate_serializer(ostream& out, const xsd::schema_t& s)
+{
+  for (const auto* c : ordered_types(s)) {
+    out << "inline void serialize(xmlpp::generator::writer& w, const "
+        << identifier(c->name) << "& o," << endl
+        << "                      xmlpp::string_ref start, xmlpp::string_ref end) {" << endl
+        << "  w.raw(start.data,start.size);" << endl;
+    for (const auto& a : c->attributes) {
+      const string id = identifier(attribute_name(a));
+      const string prefix = " " + attribute_name(a) + "=\"";
+      string indent = "  ";
+      if (enum_type(s,a.type)) {
+        // optional enumerations are written only if present
+        out << (a.use=="required" ? "  {" : "  if (o.has_" + id + ") {") << endl
+            << "    const char* v = to_string(o." << id << ");" << endl
+            << "    w.raw(" << literal(prefix) << "," << prefix.size() << ");" << endl
+            << "    w.attribute_value(v,strlen(v));" << endl
+            << "    w.raw(\"\\\"\",1);" << endl
+            << "  }" << endl;
+        continue;
+      }
+      if (a.use!="required") {
+        out << "  if (!o." << id << ".empty()) {" << endl;
+        indent = "    ";
+      }
+      out << indent << "w.raw(" << literal(prefix) << "," << prefix.size() << ");" << endl
+          << indent << "w.attribute_value(o." << id << ".data,o." << id << ".size);" << endl
+          << indent << "w.raw(\"\\\"\",1);" << endl;
+      if (a.use!="required") out << "  }" << endl;
+    }
+    out << "  w.raw(\">\",1);" << endl;
+    for (const auto& m : c->elements) {
+      const string id = identifier(m.name);
+      const bool optional = m.maxOccurs==1 && m.minOccurs==0;
+      if (m.maxOccurs!=1) {
+        out << "  for (const auto& x : o." << id << ") {" << endl;
+        generate_write(out, s, m, "x", "    ");
+        out << "  }" << endl;
+      } else if (optional) {
+        // text by its content, enumerations and complex types by has_
+        if (has_flag(s,m)) {
+          out << "  if (o.has_" << id << ") {" << endl;
+        } else {
+          out << "  if (!o." << id << ".empty()) {" << endl;
+        }
+        generate_write(out, s, m, "o." + id, "    ");
+        out << "  }" << endl;
+      } else if (enum_type(s,m.type)) {
+        out << "  {" << endl;
+        generate_write(out, s, m, "o." + id, "    ");
+        out << "  }" << endl;
+      } else {
+        generate_write(out, s, m, "o." + id, "  ");
+      }
+    }
+    out << "  w.raw(end.data,end.size);" << endl
+        << "}" << endl << endl;
+  }
 
-  for (auto e: s.elements) {
-    cout << " element<" << map_type(e.type) << ",\"" << e.name << "\">" << " " << e.name << ";" << endl;
+  out << "/** writes the top level elements of the document */" << endl
+      << "inline void serialize(xmlpp::generator::writer& w, const document& doc) {" << endl;
+  for (const auto& e : s.elements) {
+    if (enum_type(s,e.type)) {
+      out << "  {" << endl;
+      generate_write(out, s, e, "doc." + identifier(e.name), "    ");
+      out << "  }" << endl;
+    } else {
+      generate_write(out, s, e, "doc." + identifier(e.name), "  ");
+    }
   }
-  cout << "};" << endl;
+  out << "}" << endl << endl;
+}
+
+/** @return false if the code can not be generated, the error is reported */
+bool print(ostream& out, const xsd::schema_t& s, const string& ns) {
+  string guard = identifier(ns) + "_generated_hpp";
+  out << "/* generated by xsdgen, do not edit */" << endl
+      << "#ifndef " << guard << endl
+      << "#define " << guard << endl << endl
+      << "#include <cstdint>" << endl
+      << "#include <cstring>" << endl
+      << "#include <string>" << endl
+      << "#include <vector>" << endl << endl
+      << "#include \"arena.hpp\"" << endl
+      << "#include \"generator.hpp\"" << endl
+      << "#include \"xmlparser.hpp\"" << endl << endl
+      << "namespace " << identifier(ns) << " {" << endl << endl;
+
+  bool hashed = false;
+  for (const auto& st : s.simpleTypes) {
+    hashed = hashed || st.restriction.values.size() > MAX_SWITCH_ENUMERATORS;
+  }
+  if (hashed) out << HASH_FUNCTIONS << endl;
+
+  for (auto st: s.simpleTypes) {
+    if (!generate(out,st)) {
+      cerr << "no lookup table found for the enumeration " << st.name << endl;
+      return false;
+    }
+  }
+
+  for (const auto* c : ordered_types(s)) {
+    generate(out,s,*c);
+  }
+
+  generate_parser(out,s);
+  generate_serializer(out,s);
+
+  out << "} // end namespace " << identifier(ns) << endl
+      << "#endif" << endl;
+  return true;
 }
 
 struct xsd_parse_delegate: StatefulDelegate {
   xsd::schema_t schema;
   std::string dirname;
 
-  State xsd_schema{"xsd:schema",StartElement,EndElement,CharacterData};
-  State xsd_import{"xsd:import",StartElement,EndElement,CharacterData};
-  State xsd_element{"xsd:element",
+  State xsd_schema{XSD+"schema",
+    [this](const XML_Char **atts)
+    {
+      schema.targetNamespace = attr(atts,"targetNamespace");
+      schema.elementsQualified = strcmp(attr(atts,"elementFormDefault"),"qualified")==0;
+      schema.attributesQualified = strcmp(attr(atts,"attributeFormDefault"),"qualified")==0;
+    }};
+  State xsd_import{XSD+"import"};
+  State xsd_element{XSD+"element",
     [this](const XML_Char **atts)
     {
       xsd::schema_t::element_t e;
-      e.name = xmlpp::parser::xmlGetAttrValue(atts,"name");
-      e.type = xmlpp::parser::xmlGetAttrValue(atts,"type");
+      e.name = attr(atts,"name");
+      e.type = attr(atts,"type");
       schema.elements.push_back(e);
     },
     nullptr,
@@ -163,11 +1022,11 @@ struct xsd_parse_delegate: StatefulDelegate {
     {
     }
   };
-  State xsd_complexType{"xsd:complexType",
+  State xsd_complexType{XSD+"complexType",
     [this](const XML_Char **atts)
     {
       xsd::schema_t::complexType_t t;
-      t.name = xmlpp::parser::xmlGetAttrValue(atts,"name");
+      t.name = attr(atts,"name");
       schema.complexTypes.push_back(t);
     },
     nullptr,
@@ -175,7 +1034,7 @@ struct xsd_parse_delegate: StatefulDelegate {
     {
     }
   };
-  State xsd_complexType_sequence{"xsd:sequence",
+  State xsd_complexType_sequence{XSD+"sequence",
     [this](const XML_Char ** /*atts*/)
     {
     },
@@ -184,12 +1043,14 @@ struct xsd_parse_delegate: StatefulDelegate {
     {
     }
   };
-  State xsd_complexType_sequence_element{"xsd:element",
+  State xsd_complexType_sequence_element{XSD+"element",
     [this](const XML_Char **atts)
     {
       xsd::schema_t::element_t e;
-      e.name = xmlpp::parser::xmlGetAttrValue(atts,"name") ? xmlpp::parser::xmlGetAttrValue(atts,"name"):"";
-      e.type = xmlpp::parser::xmlGetAttrValue(atts,"type") ? xmlpp::parser::xmlGetAttrValue(atts,"type"):"";
+      e.name = attr(atts,"name");
+      e.type = attr(atts,"type");
+      e.minOccurs = occurs(atts,"minOccurs");
+      e.maxOccurs = occurs(atts,"maxOccurs");
       schema.complexTypes.back().elements.push_back(e);
     },
     nullptr,
@@ -198,16 +1059,16 @@ struct xsd_parse_delegate: StatefulDelegate {
     }
   };
 
-  State xsd_sequence_complexType{"xsd:complexType",StartElement,EndElement,CharacterData};
-  State xsd_sequence{"xsd:sequence",StartElement,EndElement,CharacterData};
-  State xsd_attribute{"xsd:attribute",
+  State xsd_sequence_complexType{XSD+"complexType"};
+  State xsd_sequence{XSD+"sequence"};
+  State xsd_attribute{XSD+"attribute",
     [this](const XML_Char **atts)
     {
       xsd::schema_t::attribute_t a;
-      a.ref= xmlpp::parser::xmlGetAttrValue(atts,"ref")    ? xmlpp::parser::xmlGetAttrValue(atts,"ref")  : "";
-      a.name = xmlpp::parser::xmlGetAttrValue(atts,"name") ? xmlpp::parser::xmlGetAttrValue(atts,"name") : "";
-      a.type = xmlpp::parser::xmlGetAttrValue(atts,"type") ? xmlpp::parser::xmlGetAttrValue(atts,"type") : "";
-      a.use = xmlpp::parser::xmlGetAttrValue(atts,"use")   ? xmlpp::parser::xmlGetAttrValue(atts,"use")  : "";
+      a.ref= attr(atts,"ref");
+      a.name = attr(atts,"name");
+      a.type = attr(atts,"type");
+      a.use = attr(atts,"use");
       schema.complexTypes.back().attributes.push_back(a);
     },
     nullptr,
@@ -215,11 +1076,11 @@ struct xsd_parse_delegate: StatefulDelegate {
     {
     }
   };
-  State xsd_simpleType{"xsd:simpleType",
+  State xsd_simpleType{XSD+"simpleType",
     [this](const XML_Char **atts)
     {
       xsd::schema_t::simpleType_t t;
-      t.name = xmlpp::parser::xmlGetAttrValue(atts,"name") ? xmlpp::parser::xmlGetAttrValue(atts,"name") : "";
+      t.name = attr(atts,"name");
       schema.simpleTypes.push_back(t);
     },
     nullptr,
@@ -227,22 +1088,22 @@ struct xsd_parse_delegate: StatefulDelegate {
     {
     }
   };
-  State xsd_simpleType_restriction{"xsd:restriction",
+  State xsd_simpleType_restriction{XSD+"restriction",
     [this](const XML_Char **atts)
     {
-      schema.simpleTypes.back().restriction.base = xmlpp::parser::xmlGetAttrValue(atts,"base") ? xmlpp::parser::xmlGetAttrValue(atts,"base") : "";
+      schema.simpleTypes.back().restriction.base = attr(atts,"base");
     },
     nullptr,
     [this](const char* /*pBuf*/, int /*len*/)
     {
     }
   };
-  State xsd_simpleType_restriction_enum{"xsd:enumeration",
+  State xsd_simpleType_restriction_enum{XSD+"enumeration",
     [this](const XML_Char **atts)
     {
 
       xsd::schema_t::simpleType_t::restriction_t::enumeration_t e;
-      e.value = xmlpp::parser::xmlGetAttrValue(atts,"value") ? xmlpp::parser::xmlGetAttrValue(atts,"value") : "";
+      e.value = attr(atts,"value");
       schema.simpleTypes.back().restriction.values.push_back(e);
     },
     nullptr,
@@ -251,7 +1112,7 @@ struct xsd_parse_delegate: StatefulDelegate {
     }
   };
 
-  State xsd_group{"xsd:group",
+  State xsd_group{XSD+"group",
     [this](const XML_Char ** /*atts*/)
     {
     },
@@ -261,7 +1122,7 @@ struct xsd_parse_delegate: StatefulDelegate {
     }
   };
 
-  State xsd_group_choice{"xsd:choice",
+  State xsd_group_choice{XSD+"choice",
     [this](const XML_Char ** /*atts*/)
     {
     },
@@ -271,7 +1132,7 @@ struct xsd_parse_delegate: StatefulDelegate {
     }
   };
 
-  State xsd_choice{"xsd:choice",
+  State xsd_choice{XSD+"choice",
     [this](const XML_Char ** /*atts*/)
     {
     },
@@ -281,7 +1142,7 @@ struct xsd_parse_delegate: StatefulDelegate {
     }
   };
 
-  State xsd_choice_element{"xsd:element",
+  State xsd_choice_element{XSD+"element",
     [this](const XML_Char ** /*atts*/)
     {
     },
@@ -318,31 +1179,57 @@ struct xsd_parse_delegate: StatefulDelegate {
 
 };
 
+/** namespace of the generated code, derived from the schema filename */
+static string default_namespace(const string& filename)
+{
+  size_t begin = filename.find_last_of("/\\");
+  begin = begin==string::npos ? 0 : begin+1;
+  size_t end = filename.find('.', begin);
+  return filename.substr(begin, end==string::npos ? string::npos : end-begin);
+}
+
 int main(int argc,char** argv) {
-  if (argc==1 || argc>2) {
+  if (argc < 2 || argc > 4) {
     std::cout
     << "Usage" << std::endl
     << "=====" << std::endl
-    << argv[0] << " filename" << std::endl;
+    << argv[0] << " filename [header [namespace]]" << std::endl
+    << std::endl
+    << "generates C++ types and parser for the schema in filename," << std::endl
+    << "the code is written to header or to standard output." << std::endl;
     return EXIT_FAILURE;
   } else {
     xsd_parse_delegate d;
     //d.dirname = path(argv[1]);
 
     xmlpp::parser::result res = parser::parseFile(argv[1],d);
+    const string ns = argc > 3 ? argv[3] : default_namespace(argv[1]);
     switch(res) {
 
       case xmlpp::parser::result::OK:
-        std::cout << argv[1] << "was sucessfully processed" << std::endl;
-        print(d.schema);
+        if (argc > 2) {
+          std::ofstream out(argv[2]);
+          if (!print(out, d.schema, ns)) {
+            out.close();
+            std::remove(argv[2]);
+            return EXIT_FAILURE;
+          }
+          if (!out) {
+            cerr << argv[2] << " can not be written" << endl;
+            return EXIT_FAILURE;
+          }
+        } else if (!print(cout, d.schema, ns)) {
+          return EXIT_FAILURE;
+        }
+        cerr << argv[1] << " was sucessfully processed" << endl;
         return EXIT_SUCCESS;
 
       case xmlpp::parser::result::ERROR_OPEN_FILE:
-        std::cout << argv[1] << " can not opened" << std::endl;
+        cerr << argv[1] << " can not opened" << std::endl;
         return -static_cast<int>(res);
 
       default:
-        std::cout << "error " << static_cast<int>(res) << " on parsing " << argv[1] << std::endl;
+        cerr << "error " << static_cast<int>(res) << " on parsing " << argv[1] << std::endl;
         return -static_cast<int>(res);
     }
   }
@@ -0,0 +1,274 @@
+/**
+ * \file alloc_probe.cpp implementation of the allocation profiling harness,
+ * replaces the global operator new and delete
+ *
+ * See LICENSE for copyright information.
+ */
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "alloc_probe.hpp"
+#include "xmlparser.hpp"
+
+using xmlpp::parse_stats;
+using xmlpp::parser;
+using namespace xmlpp::probe;
+
+namespace {
+
+std::atomic<uint64_t> total_count{0};
+thread_local uint64_t thread_calls = 0;
+thread_local uint64_t thread_bytes = 0;
+
+void* allocate(size_t size)
+{
+  total_count.fetch_add(1,std::memory_order_relaxed);
+  ++thread_calls;
+  thread_bytes += size;
+  return malloc(size ? size : 1);
+}
+
+void* allocate_or_throw(size_t size)
+{
+  void* p = allocate(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+}
+
+void* operator new(size_t size) { return allocate_or_throw(size); }
+void* operator new[](size_t size) { return allocate_or_throw(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+allocation_count xmlpp::probe::thread_allocations()
+{
+  allocation_count c;
+  c.calls = thread_calls;
+  c.bytes = thread_bytes;
+  return c;
+}
+
+uint64_t xmlpp::probe::total_allocations()
+{
+  return total_count.load(std::memory_order_relaxed);
+}
+
+allocation_count allocation_profile::in_callbacks() const
+{
+  allocation_count sum;
+  for (const allocation_count& c : callbacks) sum += c;
+  return sum;
+}
+
+double allocation_profile::per_document() const
+{
+  if (documents==0) return 0;
+  return static_cast<double>(total.calls - in_callbacks().calls)
+         / static_cast<double>(documents);
+}
+
+double allocation_profile::per_element() const
+{
+  if (elements==0) return 0;
+  return static_cast<double>(in_callbacks().calls) / static_cast<double>(elements);
+}
+
+void allocation_profile::print(FILE* out) const
+{
+  fprintf(out, "%llu documents, %llu elements\n",
+          static_cast<unsigned long long>(documents),
+          static_cast<unsigned long long>(elements));
+  fprintf(out, "  operator new per document (outside callbacks) %10.2f\n", per_document());
+  fprintf(out, "  operator new per element (inside callbacks)   %10.4f\n", per_element());
+  fprintf(out, "  expat allocations per document                %10.2f\n",
+          documents ? static_cast<double>(expat_allocations) / static_cast<double>(documents) : 0.0);
+  fprintf(out, "  expat peak memory                             %10llu\n",
+          static_cast<unsigned long long>(expat_peak_memory));
+  for (unsigned i = 0; i < parse_stats::CALLBACK_COUNT; ++i) {
+    if (callbacks[i].calls==0) continue;
+    fprintf(out, "  %-24s %10llu calls %10llu new %12llu bytes\n",
+            parse_stats::name(static_cast<parse_stats::callback>(i)),
+            static_cast<unsigned long long>(callback_counts[i]),
+            static_cast<unsigned long long>(callbacks[i].calls),
+            static_cast<unsigned long long>(callbacks[i].bytes));
+  }
+}
+
+void probing_delegate::onStartElement(const XML_Char *fullname, const XML_Char **atts)
+{
+  scope s(*this, parse_stats::START_ELEMENT);
+  forwarding_delegate::onStartElement(fullname,atts);
+}
+
+void probing_delegate::onEndElement(const XML_Char *fullname)
+{
+  scope s(*this, parse_stats::END_ELEMENT);
+  forwarding_delegate::onEndElement(fullname);
+}
+
+void probing_delegate::onCharacterData(const char * pBuf, int len)
+{
+  scope s(*this, parse_stats::CHARACTER_DATA);
+  forwarding_delegate::onCharacterData(pBuf,len);
+}
+
+void probing_delegate::onProcessingInstruction(const XML_Char* target,
+                                               const XML_Char* data)
+{
+  scope s(*this, parse_stats::PROCESSING_INSTRUCTION);
+  forwarding_delegate::onProcessingInstruction(target,data);
+}
+
+void probing_delegate::onUnparsedEntityDecl(const XML_Char* entityName,
+                                            const XML_Char* base,
+                                            const XML_Char* systemId,
+                                            const XML_Char* publicId,
+                                            const XML_Char* notationName)
+{
+  scope s(*this, parse_stats::UNPARSED_ENTITY_DECL);
+  forwarding_delegate::onUnparsedEntityDecl(entityName,base,systemId,publicId,notationName);
+}
+
+void probing_delegate::onNotationDecl(const XML_Char* notationName,
+                                      const XML_Char* base,
+                                      const XML_Char* systemId,
+                                      const XML_Char* publicId)
+{
+  scope s(*this, parse_stats::NOTATION_DECL);
+  forwarding_delegate::onNotationDecl(notationName,base,systemId,publicId);
+}
+
+void probing_delegate::onStartNamespace(const XML_Char* prefix, const XML_Char* uri)
+{
+  scope s(*this, parse_stats::START_NAMESPACE);
+  forwarding_delegate::onStartNamespace(prefix,uri);
+}
+
+void probing_delegate::onEndNamespace(const XML_Char* prefix)
+{
+  scope s(*this, parse_stats::END_NAMESPACE);
+  forwarding_delegate::onEndNamespace(prefix);
+}
+
+void probing_delegate::onAttlistDecl(const XML_Char *elname,
+                                     const XML_Char *attname,
+                                     const XML_Char *att_type,
+                                     const XML_Char *dflt,
+                                     bool            isrequired)
+{
+  scope s(*this, parse_stats::ATTLIST_DECL);
+  forwarding_delegate::onAttlistDecl(elname,attname,att_type,dflt,isrequired);
+}
+
+void probing_delegate::onStartCdataSection()
+{
+  scope s(*this, parse_stats::START_CDATA_SECTION);
+  forwarding_delegate::onStartCdataSection();
+}
+
+void probing_delegate::onEndCdataSection()
+{
+  scope s(*this, parse_stats::END_CDATA_SECTION);
+  forwarding_delegate::onEndCdataSection();
+}
+
+void probing_delegate::onStartDoctypeDecl(const XML_Char *doctypeName,
+                                          const XML_Char *sysid,
+                                          const XML_Char *pubid,
+                                          int has_internal_subset)
+{
+  scope s(*this, parse_stats::START_DOCTYPE_DECL);
+  forwarding_delegate::onStartDoctypeDecl(doctypeName,sysid,pubid,has_internal_subset);
+}
+
+void probing_delegate::onEndDoctypeDecl()
+{
+  scope s(*this, parse_stats::END_DOCTYPE_DECL);
+  forwarding_delegate::onEndDoctypeDecl();
+}
+
+void probing_delegate::onComment(const XML_Char *data)
+{
+  scope s(*this, parse_stats::COMMENT);
+  forwarding_delegate::onComment(data);
+}
+
+void probing_delegate::onElementDecl(const XML_Char *name, XML_Content *model)
+{
+  scope s(*this, parse_stats::ELEMENT_DECL);
+  forwarding_delegate::onElementDecl(name,model);
+}
+
+void probing_delegate::onEntityDecl(const XML_Char *entityName,
+                                    int is_parameter_entity,
+                                    const XML_Char *value,
+                                    int value_length,
+                                    const XML_Char *base,
+                                    const XML_Char *systemId,
+                                    const XML_Char *publicId,
+                                    const XML_Char *notationName)
+{
+  scope s(*this, parse_stats::ENTITY_DECL);
+  forwarding_delegate::onEntityDecl(entityName,is_parameter_entity,value,value_length,
+                                    base,systemId,publicId,notationName);
+}
+
+void probing_delegate::onSkippedEntity(const XML_Char *entityName,
+                                       int is_parameter_entity)
+{
+  scope s(*this, parse_stats::SKIPPED_ENTITY);
+  forwarding_delegate::onSkippedEntity(entityName,is_parameter_entity);
+}
+
+void probing_delegate::onXmlDecl(const XML_Char *version,
+                                 const XML_Char *encoding,
+                                 int standalone)
+{
+  scope s(*this, parse_stats::XML_DECL);
+  forwarding_delegate::onXmlDecl(version,encoding,standalone);
+}
+
+void probing_delegate::onParseError(size_t line,size_t column, size_t pos, Error error)
+{
+  scope s(*this, parse_stats::PARSE_ERROR);
+  forwarding_delegate::onParseError(line,column,pos,error);
+}
+
+void probing_delegate::onEndDocument(size_t index)
+{
+  scope s(*this, parse_stats::END_DOCUMENT);
+  forwarding_delegate::onEndDocument(index);
+}
+
+allocation_profile xmlpp::probe::profile_parse(const std::string& doc, delegate& d,
+                                               unsigned runs, unsigned warmup)
+{
+  for (unsigned i = 0; i < warmup; ++i) {
+    parser::parseString(doc.c_str(),d);
+  }
+
+  allocation_profile profile;
+  probing_delegate probe(d,profile);
+  for (unsigned i = 0; i < runs; ++i) {
+    parser::statistics stats;
+    allocation_scope total;
+    parser::parseString(doc.c_str(),probe,&stats);
+    profile.total += total.count();
+    ++profile.documents;
+    profile.elements += stats.elements;
+    profile.expat_allocations += stats.allocations;
+    if (stats.peak_memory > profile.expat_peak_memory) {
+      profile.expat_peak_memory = stats.peak_memory;
+    }
+  }
+  return profile;
+}
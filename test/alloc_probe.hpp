@@ -0,0 +1,162 @@
+/**
+ * \file alloc_probe.hpp contains the allocation profiling harness of the
+ * tests and benchmarks
+ *
+ * linking alloc_probe replaces the global operator new and delete, the
+ * calls and bytes are counted per thread. The allocations of expat are
+ * counted by the memory suite of the parser (parser::stats()).
+ *
+ * See LICENSE for copyright information.
+ */
+#ifndef xmlpp_alloc_probe_hpp
+#define xmlpp_alloc_probe_hpp
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "delegate.hpp"
+#include "instrumented_delegate.hpp"
+
+namespace xmlpp {
+namespace probe {
+
+/** calls of operator new and the requested bytes */
+struct allocation_count {
+  uint64_t calls{0};
+  uint64_t bytes{0};
+
+  allocation_count& operator+=(const allocation_count& other)
+  {
+    calls += other.calls;
+    bytes += other.bytes;
+    return *this;
+  }
+};
+
+/** @return allocations of the calling thread since its start */
+allocation_count thread_allocations();
+/** @return calls of operator new of all threads since program start */
+uint64_t total_allocations();
+
+/** counts the allocations of the calling thread during its lifetime */
+class allocation_scope {
+public:
+  allocation_scope() : start_(thread_allocations()) {}
+  allocation_count count() const
+  {
+    const allocation_count now = thread_allocations();
+    allocation_count c;
+    c.calls = now.calls - start_.calls;
+    c.bytes = now.bytes - start_.bytes;
+    return c;
+  }
+  uint64_t calls() const { return count().calls; }
+private:
+  allocation_count start_;
+};
+
+/** allocations of parsing documents, attributed to the callbacks */
+struct allocation_profile {
+  uint64_t documents{0};
+  uint64_t elements{0};
+  /** all operator new calls during parsing including the parser */
+  allocation_count total;
+  /** operator new calls inside the callbacks of the delegate */
+  allocation_count callbacks[parse_stats::CALLBACK_COUNT];
+  uint64_t callback_counts[parse_stats::CALLBACK_COUNT] = {};
+  /** allocations through the memory suite of expat */
+  uint64_t expat_allocations{0};
+  uint64_t expat_peak_memory{0};
+
+  /** @return operator new calls inside all callbacks */
+  allocation_count in_callbacks() const;
+  /** @return operator new calls outside the callbacks, per document */
+  double per_document() const;
+  /** @return operator new calls inside the callbacks per element */
+  double per_element() const;
+
+  /** prints the totals and the callbacks with allocations */
+  void print(FILE* out) const;
+};
+
+/** delegate decorator attributing the allocations of the next delegate to
+ * its callbacks */
+class probing_delegate : public forwarding_delegate {
+public:
+  explicit probing_delegate(delegate& next, allocation_profile& profile)
+  : forwarding_delegate(&next), profile_(profile)
+  {}
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override;
+  void onEndElement(const XML_Char *fullname) override;
+  void onCharacterData(const char * pBuf, int len) override;
+  void onProcessingInstruction(const XML_Char* target,
+                               const XML_Char* data) override;
+  void onUnparsedEntityDecl(const XML_Char* entityName,
+                            const XML_Char* base,
+                            const XML_Char* systemId,
+                            const XML_Char* publicId,
+                            const XML_Char* notationName) override;
+  void onNotationDecl(const XML_Char* notationName,
+                      const XML_Char* base,
+                      const XML_Char* systemId,
+                      const XML_Char* publicId) override;
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override;
+  void onEndNamespace(const XML_Char* prefix) override;
+  void onAttlistDecl(const XML_Char *elname,
+                     const XML_Char *attname,
+                     const XML_Char *att_type,
+                     const XML_Char *dflt,
+                     bool            isrequired) override;
+  void onStartCdataSection() override;
+  void onEndCdataSection() override;
+  void onStartDoctypeDecl(const XML_Char *doctypeName,
+                          const XML_Char *sysid,
+                          const XML_Char *pubid,
+                          int has_internal_subset) override;
+  void onEndDoctypeDecl() override;
+  void onComment(const XML_Char *data) override;
+  void onElementDecl(const XML_Char *name, XML_Content *model) override;
+  void onEntityDecl(const XML_Char *entityName,
+                    int is_parameter_entity,
+                    const XML_Char *value,
+                    int value_length,
+                    const XML_Char *base,
+                    const XML_Char *systemId,
+                    const XML_Char *publicId,
+                    const XML_Char *notationName) override;
+  void onSkippedEntity(const XML_Char *entityName,
+                       int is_parameter_entity) override;
+  void onXmlDecl(const XML_Char *version,
+                 const XML_Char *encoding,
+                 int standalone) override;
+  void onParseError(size_t line,size_t column, size_t pos, Error error) override;
+  void onEndDocument(size_t index) override;
+private:
+  /** attributes the allocations of one callback */
+  struct scope {
+    scope(probing_delegate& d, parse_stats::callback c) : d_(d), c_(c) {}
+    ~scope()
+    {
+      d_.profile_.callbacks[c_] += allocations_.count();
+      ++d_.profile_.callback_counts[c_];
+    }
+    probing_delegate& d_;
+    parse_stats::callback c_;
+    allocation_scope allocations_;
+  };
+
+  allocation_profile& profile_;
+};
+
+/** parses doc with d warmup + runs times and profiles the last runs.
+ * The warm up parses let the delegate reach its steady state, e.g. grow
+ * its buffers, so the profile shows the allocations repeated per document.
+ */
+allocation_profile profile_parse(const std::string& doc, delegate& d,
+                                 unsigned runs = 1, unsigned warmup = 1);
+
+}
+}
+#endif // #ifndef xmlpp_alloc_probe_hpp
@@ -0,0 +1,165 @@
+/**
+ * \file test_allocations.cpp regression tests for the allocation free fast
+ * paths, uses the allocation probe replacing operator new
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "alloc_probe.hpp"
+#include "generator.hpp"
+#include "instrumented_delegate.hpp"
+#include "state.hpp"
+#include "xmlparser.hpp"
+
+using xmlpp::Attr;
+using xmlpp::State;
+using xmlpp::parse_stats;
+using xmlpp::probe::allocation_profile;
+using xmlpp::probe::allocation_scope;
+using xmlpp::probe::profile_parse;
+
+namespace {
+
+std::string make_records(size_t count)
+{
+  std::string doc("<records>");
+  for (size_t i = 0; i < count; ++i) {
+    const std::string n = std::to_string(i);
+    doc += "<record id='" + n + "' comment='a value longer than the small string buffer'>"
+           "<name>name " + n + "</name><value>" + n + "</value></record>";
+  }
+  return doc + "</records>";
+}
+
+struct null_delegate : public xmlpp::abstract_delegate {};
+
+/** the records of make_records with a state tree */
+struct records_delegate : public xmlpp::StatefulDelegate {
+  size_t events{0};
+  State root{"records"};
+  State record{"record"};
+  State name{"name"};
+  State value{"value"};
+
+  explicit records_delegate(bool callbacks)
+  {
+    if (callbacks) {
+      for (State* s : {&root, &record, &name, &value}) {
+        s->pfStart = [this](const XML_Char**) { ++events; };
+        s->pfEnd = [this]() { ++events; };
+        s->pfText = [this](const char*, int) { ++events; };
+      }
+    }
+    record.addState(&name);
+    record.addState(&value);
+    root.addState(&record);
+    add_state(&root);
+  }
+};
+
+/** reads the attributes of each record */
+struct attribute_delegate : public xmlpp::abstract_delegate {
+  bool copy{false};
+  int64_t sum{0};
+  size_t length{0};
+
+  void onStartElement(const XML_Char *, const XML_Char **atts) override
+  {
+    Attr a(atts);
+    if (copy) {
+      length += a.getValue("comment").size();
+    } else {
+      sum += a.get_or<int64_t>("id",0);
+    }
+  }
+};
+
+}
+
+TEST_CASE("the parser allocates nothing per element")
+{
+  const std::string doc = make_records(100);
+  null_delegate d;
+  const allocation_profile p = profile_parse(doc,d,3);
+  REQUIRE(p.documents==3);
+  REQUIRE(p.elements==3*301);
+  REQUIRE(p.in_callbacks().calls==0);
+  REQUIRE(p.per_element()==0);
+  // expat allocates through its memory suite, not through operator new
+  REQUIRE(p.expat_allocations > 0);
+  REQUIRE(p.expat_peak_memory > 0);
+  REQUIRE(p.callback_counts[parse_stats::START_ELEMENT]==3*301);
+}
+
+TEST_CASE("StatefulDelegate allocates nothing per element in steady state")
+{
+  const std::string doc = make_records(100);
+  records_delegate plain(false);
+  REQUIRE(profile_parse(doc,plain).per_element()==0);
+
+  records_delegate callbacks(true);
+  const allocation_profile p = profile_parse(doc,callbacks);
+  REQUIRE(callbacks.events > 0);
+  REQUIRE(p.per_element()==0);
+}
+
+TEST_CASE("typed attribute access allocates nothing, getValue copies")
+{
+  const std::string doc = make_records(100);
+  attribute_delegate typed;
+  const allocation_profile p = profile_parse(doc,typed);
+  REQUIRE(typed.sum > 0);
+  REQUIRE(p.per_element()==0);
+
+  attribute_delegate copying;
+  copying.copy = true;
+  const allocation_profile c = profile_parse(doc,copying);
+  REQUIRE(copying.length > 0);
+  // one std::string per record, the long value does not fit into the
+  // small string buffer, the empty value of the other elements does
+  REQUIRE(c.callbacks[parse_stats::START_ELEMENT].calls==100);
+  REQUIRE(c.callbacks[parse_stats::END_ELEMENT].calls==0);
+}
+
+TEST_CASE("instrumented_delegate allocates nothing per element")
+{
+  const std::string doc = make_records(100);
+  xmlpp::instrumented_delegate<records_delegate> d(true);
+  REQUIRE(profile_parse(doc,d).per_element()==0);
+}
+
+TEST_CASE("generator tree allocates per node, the writer does not")
+{
+  using namespace xmlpp::generator;
+  allocation_scope tree;
+  auto root = std::make_shared<composite_element>();
+  root->name = "records";
+  for (int i = 0; i < 10; ++i) {
+    auto e = std::make_shared<composite_element>();
+    e->name = "record";
+    e->attributes.push_back(attribute{"id",std::to_string(i)});
+    auto t = std::make_shared<text>();
+    t->value = "value";
+    e->children.push_back(t);
+    root->children.push_back(e);
+  }
+  // a node, a list entry and an attribute entry at least
+  REQUIRE(tree.calls() >= 10*3);
+
+  std::ostringstream os;
+  writer w(os,4096);
+  allocation_scope writing;
+  for (int i = 0; i < 10; ++i) {
+    w.raw("<record id=\"",12);
+    w.attribute_value("1&2",3);
+    w.raw("\">",2);
+    w.text("a<b",3);
+    w.raw("</record>",9);
+  }
+  REQUIRE(writing.calls()==0);
+}
@@ -0,0 +1,218 @@
+/**
+ * \file test_base64.cpp tests the streaming base64 decoder
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <cstring>
+#include <string>
+
+#include "base64.hpp"
+#include "state.hpp"
+#include "xmlparser.hpp"
+
+using xmlpp::base64_decoder;
+using xmlpp::parser;
+using xmlpp::State;
+
+namespace {
+
+std::string encode(const std::string& in, size_t line_length = 0)
+{
+  static const char ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  size_t i = 0;
+  for (; i + 2 < in.size(); i += 3) {
+    const uint32_t b = (uint32_t(uint8_t(in[i])) << 16) | (uint32_t(uint8_t(in[i+1])) << 8) | uint8_t(in[i+2]);
+    out += ALPHABET[b >> 18];
+    out += ALPHABET[(b >> 12) & 63];
+    out += ALPHABET[(b >> 6) & 63];
+    out += ALPHABET[b & 63];
+    if (line_length && (out.size() + 1) % (line_length + 1)==0) out += '\n';
+  }
+  if (i + 1==in.size()) {
+    const uint32_t b = uint32_t(uint8_t(in[i])) << 16;
+    out += ALPHABET[b >> 18];
+    out += ALPHABET[(b >> 12) & 63];
+    out += "==";
+  } else if (i + 2==in.size()) {
+    const uint32_t b = (uint32_t(uint8_t(in[i])) << 16) | (uint32_t(uint8_t(in[i+1])) << 8);
+    out += ALPHABET[b >> 18];
+    out += ALPHABET[(b >> 12) & 63];
+    out += ALPHABET[(b >> 6) & 63];
+    out += '=';
+  }
+  return out;
+}
+
+std::string binary(size_t len)
+{
+  std::string s;
+  for (size_t i = 0; i < len; ++i) s += static_cast<char>((i*131 + 7) & 0xff);
+  return s;
+}
+
+/** decodes the fragments, checks the bounded blocks */
+struct collector {
+  std::string out;
+  size_t max_block{0};
+  size_t blocks{0};
+  base64_decoder::binary_content handler()
+  {
+    return [this](const unsigned char* p, size_t len)
+      {
+        out.append(reinterpret_cast<const char*>(p),len);
+        max_block = len > max_block ? len : max_block;
+        ++blocks;
+      };
+  }
+};
+
+/** decodes <attachment> elements with a State */
+struct attachment_delegate : public xmlpp::StatefulDelegate {
+  collector c;
+  base64_decoder decoder{c.handler(), 1024};
+  bool ok{false};
+
+  State mail{"mail"};
+  State attachment{"attachment",
+    [this](const XML_Char**) { decoder.reset(); },
+    [this]() { ok = decoder.finish(); },
+    decoder.text_handler()};
+
+  attachment_delegate()
+  {
+    mail.addState(&attachment);
+    add_state(&mail);
+  }
+};
+
+}
+
+TEST_CASE("base64 decoding of rfc 4648 test vectors")
+{
+  const char* VECTORS[][2] = {
+    {"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"},
+    {"foob", "Zm9vYg=="}, {"fooba", "Zm9vYmE="}, {"foobar", "Zm9vYmFy"}
+  };
+  for (const auto& v : VECTORS) {
+    INFO(v[1]);
+    collector c;
+    base64_decoder d(c.handler());
+    REQUIRE(d.feed(v[1],strlen(v[1])));
+    REQUIRE(d.finish());
+    REQUIRE(c.out==v[0]);
+    REQUIRE(d.decoded_size()==strlen(v[0]));
+  }
+}
+
+TEST_CASE("base64 decoding of fragments")
+{
+  const std::string data = binary(1000);
+  const std::string text = encode(data,76);
+
+  SECTION("every split position with small blocks") {
+    for (size_t split = 0; split <= text.size(); split += 7) {
+      collector c;
+      base64_decoder d(c.handler(),10);
+      REQUIRE(d.feed(text.data(),split));
+      REQUIRE(d.feed(text.data()+split,text.size()-split));
+      REQUIRE(d.finish());
+      REQUIRE(c.out==data);
+      REQUIRE(c.max_block<=10);
+    }
+  }
+  SECTION("single characters") {
+    collector c;
+    base64_decoder d(c.handler(),64);
+    for (char ch : text) REQUIRE(d.feed(&ch,1));
+    REQUIRE(d.finish());
+    REQUIRE(c.out==data);
+  }
+  SECTION("missing padding") {
+    collector c;
+    base64_decoder d(c.handler());
+    REQUIRE(d.feed("Zm9vYmE",7));
+    REQUIRE(d.finish());
+    REQUIRE(c.out=="fooba");
+  }
+}
+
+TEST_CASE("base64 decoding of invalid input")
+{
+  for (const char* bad : {"Zm9v!", "Zg==Zg==", "Z", "Zg=", "Z===", "Zm9vY=Fy"}) {
+    INFO(bad);
+    collector c;
+    base64_decoder d(c.handler());
+    d.feed(bad,strlen(bad));
+    REQUIRE_FALSE(d.finish());
+    REQUIRE(d.failed());
+  }
+  collector c;
+  base64_decoder d(c.handler());
+  REQUIRE_FALSE(d.feed("Zm$9v",5));
+  d.reset();
+  REQUIRE(d.feed("Zm9v",4));
+  REQUIRE(d.finish());
+  REQUIRE(c.out=="foo");
+}
+
+TEST_CASE("base64 decoding of long runs")
+{
+  // the runs are decoded in blocks with SIMD, the rest per quantum
+  const std::string data = binary(300);
+  const std::string text = encode(data);
+
+  SECTION("every length") {
+    for (size_t len = 0; len <= data.size(); ++len) {
+      INFO(len);
+      const std::string part = data.substr(0,len);
+      collector c;
+      base64_decoder d(c.handler(),len%2 ? 37 : 4096);
+      const std::string t = encode(part);
+      REQUIRE(d.feed(t.data(),t.size()));
+      REQUIRE(d.finish());
+      REQUIRE(c.out==part);
+    }
+  }
+  SECTION("whitespace at every position") {
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+      INFO(pos);
+      std::string t = text;
+      t.insert(pos,1,pos%2 ? '\n' : ' ');
+      collector c;
+      base64_decoder d(c.handler());
+      REQUIRE(d.feed(t.data(),t.size()));
+      REQUIRE(d.finish());
+      REQUIRE(c.out==data);
+    }
+  }
+  SECTION("invalid characters at every position") {
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+      for (char bad : {'!', '=', '-', '_', '\x80', '\xff', '\0'}) {
+        // padding is valid in the last quantum
+        if (bad=='=' && pos + 2 >= text.size()) continue;
+        INFO(pos << " " << int(bad));
+        std::string t = text;
+        t[pos] = bad;
+        collector c;
+        base64_decoder d(c.handler());
+        REQUIRE_FALSE(d.feed(t.data(),t.size()));
+      }
+    }
+  }
+}
+
+TEST_CASE("base64 attachment in a document")
+{
+  const std::string data = binary(100000);
+  const std::string xml = "<mail><attachment>\n" + encode(data,76) + "\n</attachment></mail>";
+  attachment_delegate d;
+  REQUIRE(parser::parseString(xml.c_str(),d)==parser::result::OK);
+  REQUIRE(d.ok);
+  REQUIRE(d.c.out==data);
+  REQUIRE(d.c.max_block<=1024);
+  REQUIRE(d.c.blocks > 1);
+}
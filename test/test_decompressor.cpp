@@ -0,0 +1,201 @@
+/**
+ * \file test_decompressor.cpp tests parsing of compressed files
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include "expatpp_config.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(HAVE_LZMA)
+#include <lzma.h>
+#endif
+
+#include "decompressor.hpp"
+#include "pipeline.hpp"
+
+using xmlpp::compression;
+using xmlpp::parser;
+
+namespace {
+
+/** logs elements and text */
+struct log_delegate : public xmlpp::abstract_delegate {
+  std::string log;
+  void onStartElement(const XML_Char *fullname, const XML_Char **) override
+  {
+    log += "<" + std::string(fullname) + ">";
+  }
+  void onEndElement(const XML_Char *fullname) override
+  {
+    log += "</" + std::string(fullname) + ">";
+  }
+  void onCharacterData(const char *pBuf, int len) override
+  {
+    log.append(pBuf, static_cast<size_t>(len));
+  }
+};
+
+const char* FILE_NAME = "test_decompressor.bin";
+
+std::string document()
+{
+  std::string doc("<list>");
+  for (int i = 0; i < 20000; ++i) doc += "<item>value " + std::to_string(i) + "</item>";
+  return doc + "</list>";
+}
+
+void write_file(const std::string& content)
+{
+  FILE* f = fopen(FILE_NAME, "wb");
+  REQUIRE(f!=nullptr);
+  REQUIRE(fwrite(content.data(), 1, content.size(), f)==content.size());
+  fclose(f);
+}
+
+#if defined(HAVE_ZLIB)
+std::string gzip(const std::string& in)
+{
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  REQUIRE(deflateInit2(&z, 6, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY)==Z_OK);
+  std::string out(deflateBound(&z, static_cast<uLong>(in.size())), '\0');
+  z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+  z.avail_in = static_cast<uInt>(in.size());
+  z.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  z.avail_out = static_cast<uInt>(out.size());
+  REQUIRE(deflate(&z, Z_FINISH)==Z_STREAM_END);
+  out.resize(z.total_out);
+  deflateEnd(&z);
+  return out;
+}
+#endif
+
+#if defined(HAVE_LZMA)
+std::string xz(const std::string& in)
+{
+  std::string out(lzma_stream_buffer_bound(in.size()), '\0');
+  size_t pos = 0;
+  REQUIRE(lzma_easy_buffer_encode(1, LZMA_CHECK_CRC64, nullptr,
+                                  reinterpret_cast<const uint8_t*>(in.data()), in.size(),
+                                  reinterpret_cast<uint8_t*>(&out[0]), &pos, out.size())==LZMA_OK);
+  out.resize(pos);
+  return out;
+}
+#endif
+
+/** parses the file with parseFile, parse_file_read_ahead and
+ * parse_file_pipelined, which must agree */
+parser::result parse_all_ways(std::string& log)
+{
+  xmlpp::pipeline_options small;
+  small.read_size = 1000;
+  log_delegate direct, ahead, pipelined;
+  const parser::result r = parser::parseFile(FILE_NAME, direct);
+  REQUIRE(xmlpp::parse_file_read_ahead(FILE_NAME, ahead, small)==r);
+  REQUIRE(xmlpp::parse_file_pipelined(FILE_NAME, pipelined, small)==r);
+  if (r==parser::OK) {
+    REQUIRE(ahead.log==direct.log);
+    REQUIRE(pipelined.log==direct.log);
+  }
+  log = direct.log;
+  return r;
+}
+
+/** checks a compressed document, two concatenated members and truncation */
+void check_format(const std::function<std::string(const std::string&)>& compress)
+{
+  const std::string doc = document();
+  log_delegate plain;
+  REQUIRE(parser::parseString(doc.c_str(), plain)==parser::OK);
+
+  std::string log;
+  write_file(compress(doc));
+  REQUIRE(parse_all_ways(log)==parser::OK);
+  REQUIRE(log==plain.log);
+
+  const size_t half = doc.size()/2;
+  write_file(compress(doc.substr(0, half)) + compress(doc.substr(half)));
+  REQUIRE(parse_all_ways(log)==parser::OK);
+  REQUIRE(log==plain.log);
+
+  const std::string packed = compress(doc);
+  write_file(packed.substr(0, packed.size() - 20));
+  REQUIRE(parse_all_ways(log)==parser::INVALID_INPUT);
+}
+
+}
+
+TEST_CASE("compression is detected by magic bytes")
+{
+  REQUIRE(xmlpp::detect_compression("\x1f\x8b\x08\x00", 4)==compression::GZIP);
+  REQUIRE(xmlpp::detect_compression("\x28\xb5\x2f\xfd\x00", 5)==compression::ZSTD);
+  REQUIRE(xmlpp::detect_compression("\xfd" "7zXZ\x00", 6)==compression::XZ);
+  REQUIRE(xmlpp::detect_compression("\xfd" "7zXZ", 5)==compression::NONE);
+  REQUIRE(xmlpp::detect_compression("<?xml", 5)==compression::NONE);
+  REQUIRE(xmlpp::detect_compression("", 0)==compression::NONE);
+  REQUIRE(xmlpp::compression_available(compression::NONE));
+  REQUIRE(std::string(xmlpp::to_string(compression::XZ))=="xz");
+}
+
+TEST_CASE("uncompressed files pass through")
+{
+  std::string log;
+  write_file("<a/>");
+  REQUIRE(parse_all_ways(log)==parser::OK);
+  REQUIRE(log=="<a></a>");
+
+  write_file(document());
+  REQUIRE(parse_all_ways(log)==parser::OK);
+  REQUIRE(log.size() > 100000);
+
+  FILE* f = fopen(FILE_NAME, "rb");
+  REQUIRE(f!=nullptr);
+  xmlpp::decompressor input(f);
+  char buffer[16];
+  REQUIRE(input.read(buffer, sizeof(buffer))==16);
+  REQUIRE(input.format()==compression::NONE);
+  REQUIRE(std::string(buffer, 16)=="<list><item>valu");
+  fclose(f);
+  remove(FILE_NAME);
+}
+
+#if defined(HAVE_ZLIB)
+TEST_CASE("gzip files are decompressed")
+{
+  REQUIRE(xmlpp::compression_available(compression::GZIP));
+  check_format(gzip);
+  remove(FILE_NAME);
+}
+#endif
+
+#if defined(HAVE_LZMA)
+TEST_CASE("xz files are decompressed")
+{
+  REQUIRE(xmlpp::compression_available(compression::XZ));
+  check_format(xz);
+  remove(FILE_NAME);
+}
+#endif
+
+TEST_CASE("compressions which are not built in are invalid input")
+{
+  for (compression c : {compression::GZIP, compression::ZSTD, compression::XZ}) {
+    if (xmlpp::compression_available(c)) continue;
+    const char* magic = c==compression::GZIP ? "\x1f\x8b\x08\x00\x00\x00"
+      : c==compression::ZSTD ? "\x28\xb5\x2f\xfd\x00\x00" : "\xfd" "7zXZ\x00";
+    write_file(std::string(magic, 6) + "rest of the data");
+    std::string log;
+    REQUIRE(parse_all_ways(log)==parser::INVALID_INPUT);
+  }
+  remove(FILE_NAME);
+}
@@ -0,0 +1,231 @@
+/**
+ * \file test_entity_resolver.cpp tests the resolution of external
+ * entities
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "entity_resolver.hpp"
+#include "xmlparser.hpp"
+
+using xmlpp::entity_resolver;
+using xmlpp::parser;
+
+namespace {
+
+/** logs elements, attributes, text and skipped entities */
+struct log_delegate : public xmlpp::abstract_delegate {
+  std::string log;
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override
+  {
+    log += "<" + std::string(fullname);
+    for (; *atts; atts += 2) log += " " + std::string(atts[0]) + "=" + atts[1];
+    log += ">";
+  }
+  void onEndElement(const XML_Char *fullname) override
+  {
+    log += "</" + std::string(fullname) + ">";
+  }
+  void onCharacterData(const char *pBuf, int len) override
+  {
+    log.append(pBuf, static_cast<size_t>(len));
+  }
+  void onSkippedEntity(const XML_Char *entityName, int) override
+  {
+    log += "[skipped " + std::string(entityName) + "]";
+  }
+};
+
+const char* DTD =
+  "<!ENTITY company 'ACME Inc.'>"
+  "<!ATTLIST doc version CDATA '1.0'>";
+const char* DOCUMENT =
+  "<!DOCTYPE doc SYSTEM 'doc.dtd'><doc>&company;</doc>";
+const char* RESOLVED = "<doc version=1.0>ACME Inc.</doc>";
+
+parser::status_t parse(parser& p, const std::string& xml)
+{
+  return p.parse(xml.data(), static_cast<int>(xml.size()), true);
+}
+
+std::string parsed(entity_resolver* resolver, const std::string& xml,
+                   parser::status_t expected = parser::status_t::OK)
+{
+  log_delegate d;
+  parser p(d);
+  REQUIRE(p.set_entity_resolver(resolver));
+  REQUIRE(parse(p, xml)==expected);
+  return d.log;
+}
+
+void write_file(const char* name, const char* content)
+{
+  FILE* f = fopen(name, "wb");
+  REQUIRE(f!=nullptr);
+  REQUIRE(fwrite(content, 1, strlen(content), f)==strlen(content));
+  fclose(f);
+}
+
+}
+
+TEST_CASE("the external DTD subset comes from the catalog")
+{
+  REQUIRE(parsed(nullptr, DOCUMENT)=="<doc>[skipped company]</doc>");
+
+  entity_resolver resolver;
+  resolver.add("doc.dtd", DTD);
+  REQUIRE(parsed(&resolver, DOCUMENT)==RESOLVED);
+  REQUIRE(resolver.hits()==1);
+
+  entity_resolver by_public_id;
+  by_public_id.add("-//ACME//DTD doc//EN", DTD);
+  REQUIRE(parsed(&by_public_id,
+                 "<!DOCTYPE doc PUBLIC '-//ACME//DTD doc//EN' 'http://acme.example/doc.dtd'>"
+                 "<doc>&company;</doc>")==RESOLVED);
+}
+
+TEST_CASE("external general entities are parsed into the events")
+{
+  entity_resolver resolver;
+  resolver.add("chapter.xml", "<chapter>one &inner;</chapter>");
+  resolver.add("inner.xml", "<b>nested</b>");
+  REQUIRE(parsed(&resolver,
+                 "<!DOCTYPE book [<!ENTITY chapter SYSTEM 'chapter.xml'>"
+                 "<!ENTITY inner SYSTEM 'inner.xml'>]>"
+                 "<book>&chapter;</book>")==
+          "<book><chapter>one <b>nested</b></chapter></book>");
+}
+
+TEST_CASE("unknown entities are skipped or errors in strict mode")
+{
+  entity_resolver resolver;
+  REQUIRE(parsed(&resolver, DOCUMENT)=="<doc>[skipped company]</doc>");
+  REQUIRE(resolver.misses()==1);
+
+  resolver.set_strict(true);
+  log_delegate d;
+  parser p(d);
+  p.set_entity_resolver(&resolver);
+  REQUIRE(parse(p, DOCUMENT)==parser::status_t::ERROR);
+  REQUIRE(p.errorcode()==parser::error_t::EXTERNAL_ENTITY_HANDLING);
+}
+
+TEST_CASE("files are read once and served from memory")
+{
+  write_file("test_entity_resolver.dtd", DTD);
+  entity_resolver resolver;
+  resolver.add_file("doc.dtd", "test_entity_resolver.dtd");
+  REQUIRE(resolver.loads()==0);
+
+  std::vector<std::thread> threads;
+  std::vector<int> resolved(4, 0);
+  for (size_t t = 0; t < resolved.size(); ++t) {
+    threads.emplace_back([&resolver, &resolved, t]() {
+        for (int i = 0; i < 50; ++i) {
+          log_delegate d;
+          parser p(d);
+          p.set_entity_resolver(&resolver);
+          if (parse(p, DOCUMENT)==parser::status_t::OK && d.log==RESOLVED) ++resolved[t];
+        }
+      });
+  }
+  for (std::thread& t : threads) t.join();
+  for (int r : resolved) REQUIRE(r==50);
+  REQUIRE(resolver.loads()==1);
+  REQUIRE(resolver.hits()==199);
+  remove("test_entity_resolver.dtd");
+}
+
+TEST_CASE("local files are read relative to the base if enabled")
+{
+  write_file("test_entity_resolver_base.dtd", DTD);
+  const std::string xml = "<!DOCTYPE doc SYSTEM 'test_entity_resolver_base.dtd'><doc>&company;</doc>";
+  entity_resolver resolver;
+  REQUIRE(parsed(&resolver, xml)=="<doc>[skipped company]</doc>");
+
+  resolver.set_load_files(true);
+  for (int i = 0; i < 2; ++i) {
+    log_delegate d;
+    parser p(d);
+    p.set_entity_resolver(&resolver);
+    p.set_base("./document.xml");
+    REQUIRE(parse(p, xml)==parser::status_t::OK);
+    REQUIRE(d.log==RESOLVED);
+  }
+  REQUIRE(resolver.loads()==1);
+  REQUIRE(resolver.hits()==1);
+
+  // network urls are never fetched
+  REQUIRE(parsed(&resolver, "<!DOCTYPE doc SYSTEM 'http://example.com/doc.dtd'>"
+                 "<doc>&company;</doc>")=="<doc>[skipped company]</doc>");
+  remove("test_entity_resolver_base.dtd");
+}
+
+TEST_CASE("the resolver is kept for the documents of a stream")
+{
+  entity_resolver resolver;
+  resolver.add("doc.dtd", DTD);
+  log_delegate d;
+  parser p(d);
+  p.set_multi_document(true);
+  p.set_entity_resolver(&resolver);
+  REQUIRE(parse(p, std::string(DOCUMENT) + DOCUMENT)==parser::status_t::OK);
+  REQUIRE(d.log==std::string(RESOLVED) + RESOLVED);
+}
+
+TEST_CASE("compact DTDs give the events of the full DTD")
+{
+  const char* dtd =
+    "<?xml version='1.0' encoding='ISO-8859-1'?>\n"
+    "<!-- the document -->\n"
+    "<!ENTITY % common 'id ID #IMPLIED tags NMTOKENS #IMPLIED'>\n"
+    "<!ENTITY % chars SYSTEM 'chars.ent'>\n"
+    "%chars;\n"
+    "<!ELEMENT doc (item*)>\n"
+    "<!ATTLIST doc version CDATA '1.0' %common;>\n"
+    "<!ATTLIST item note CDATA #IMPLIED kind (a|b) 'b'>\n"
+    "<!ATTLIST item note CDATA 'ignored' sep CDATA '&#9;&#38;&#60;&#39;' fixed CDATA #FIXED 'x'>\n"
+    "<?pi dropped?>\n";
+  const char* chars =
+    "<!ENTITY amp2 '&#38;#38;'>"
+    "<!ENTITY quote \"it's &#37; &#13;\">"
+    "<!ENTITY nested '<b>&amp2;&quote;</b>'>";
+  const char* document =
+    "<!DOCTYPE doc SYSTEM 'doc.dtd'>"
+    "<doc tags=' x  y ' id='d'><item>&nested;</item><item kind='a'/></doc>";
+
+  entity_resolver full;
+  full.add("doc.dtd", dtd);
+  full.add("chars.ent", chars);
+  entity_resolver compact;
+  compact.add("doc.dtd", dtd);
+  compact.add("chars.ent", chars);
+  compact.set_compact_dtds(true);
+
+  const std::string expected = parsed(&full, document);
+  REQUIRE(expected.find("tags=x y") != std::string::npos);
+  REQUIRE(expected.find("<b>&it's % \r</b>") != std::string::npos);
+  REQUIRE(expected.find("note")==std::string::npos);
+  REQUIRE(parsed(&compact, document)==expected);
+  REQUIRE(parsed(&compact, document)==expected);
+
+  const entity_resolver::entity_ptr e = compact.resolve_dtd(nullptr, "doc.dtd", nullptr);
+  REQUIRE(e==compact.resolve_dtd(nullptr, "doc.dtd", nullptr));
+  REQUIRE(e->data.find("ELEMENT")==std::string::npos);
+  REQUIRE(e->data.find("<!--")==std::string::npos);
+  REQUIRE(e->data.find("%common")==std::string::npos);
+  REQUIRE(e->data.find("<!ATTLIST item kind (a|b) 'b' sep CDATA")!=std::string::npos);
+  REQUIRE(full.resolve_dtd(nullptr, "doc.dtd", nullptr)->data==dtd);
+
+  // a DTD which is not well-formed is served as it is and fails the parse
+  compact.add("doc.dtd", "<!ENTITY broken");
+  REQUIRE(compact.resolve_dtd(nullptr, "doc.dtd", nullptr)->data=="<!ENTITY broken");
+  parsed(&compact, document, parser::status_t::ERROR);
+}
@@ -0,0 +1,271 @@
+/**
+ * \file test_event_loop.cpp tests the event loop over socket pairs with both
+ * backends
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "event_loop.hpp"
+
+using xmlpp::event_loop;
+using xmlpp::parser;
+
+namespace {
+
+/** records the events as a string */
+struct recording_delegate : public xmlpp::abstract_delegate {
+  std::string events;
+  size_t documents{0};
+  std::function<void()> on_element;
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **) override
+  {
+    events += std::string("<") + fullname + ">";
+    if (on_element) on_element();
+  }
+  void onEndElement(const XML_Char *fullname) override
+  {
+    events += std::string("</") + fullname + ">";
+  }
+  void onCharacterData(const char *pBuf, int len) override
+  {
+    events.append(pBuf,static_cast<size_t>(len));
+  }
+  void onEndDocument(size_t) override { ++documents; }
+};
+
+/** socket pair, the loop reads the non-blocking end */
+struct channel {
+  int reader{-1};
+  int writer{-1};
+
+  channel()
+  {
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)==0);
+    reader = fds[0];
+    writer = fds[1];
+    REQUIRE(fcntl(reader, F_SETFL, fcntl(reader, F_GETFL) | O_NONBLOCK)==0);
+  }
+  ~channel()
+  {
+    shutdown_writer();
+    ::close(reader);
+  }
+  void send(const std::string& s)
+  {
+    REQUIRE(::write(writer, s.data(), s.size())==static_cast<ssize_t>(s.size()));
+  }
+  void shutdown_writer()
+  {
+    if (writer >= 0) ::close(writer);
+    writer = -1;
+  }
+};
+
+struct closed {
+  int fd{-1};
+  event_loop::close_reason reason{event_loop::close_reason::READ_ERROR};
+  int calls{0};
+
+  event_loop::close_handler handler()
+  {
+    return [this](int f, event_loop::close_reason r, parser&) {
+      fd = f;
+      reason = r;
+      ++calls;
+    };
+  }
+};
+
+void run_until(event_loop& loop, const std::function<bool()>& done)
+{
+  for (int i = 0; i < 1000 && !done(); ++i) {
+    REQUIRE(loop.run_once(10) >= 0);
+  }
+  REQUIRE(done());
+}
+
+}
+
+TEST_CASE("event loop parses input arriving in pieces")
+{
+  for (event_loop::backend b : {event_loop::backend::EPOLL, event_loop::backend::IO_URING}) {
+    event_loop loop(b, 16);
+    INFO(static_cast<int>(loop.active_backend()));
+    REQUIRE(loop.active_backend()!=event_loop::backend::AUTO);
+
+    channel c;
+    recording_delegate d;
+    closed result;
+    REQUIRE(loop.add(c.reader, d, result.handler())!=nullptr);
+    REQUIRE(loop.add(c.reader, d)==nullptr);
+    REQUIRE(loop.connections()==1);
+
+    c.send("<root><a>fi");
+    run_until(loop, [&]() { return d.events=="<root><a>fi"; });
+    c.send("rst</a><b>a text longer than the read size</b>");
+    run_until(loop, [&]() { return d.events.find("</b>")!=std::string::npos; });
+    c.send("</root>");
+    c.shutdown_writer();
+    run_until(loop, [&]() { return result.calls==1; });
+
+    REQUIRE(d.events=="<root><a>first</a><b>a text longer than the read size</b></root>");
+    REQUIRE(result.fd==c.reader);
+    REQUIRE(result.reason==event_loop::close_reason::END_OF_STREAM);
+    REQUIRE(loop.connections()==0);
+  }
+}
+
+TEST_CASE("event loop reports parse errors and incomplete documents")
+{
+  for (event_loop::backend b : {event_loop::backend::EPOLL, event_loop::backend::IO_URING}) {
+    event_loop loop(b);
+    channel invalid;
+    channel incomplete;
+    recording_delegate d1, d2;
+    closed r1, r2;
+    parser::error_t error = parser::error_t::NONE;
+    REQUIRE(loop.add(invalid.reader, d1, [&](int, event_loop::close_reason r, parser& p) {
+      r1.handler()(invalid.reader, r, p);
+      error = p.errorcode();
+    })!=nullptr);
+    REQUIRE(loop.add(incomplete.reader, d2, r2.handler())!=nullptr);
+
+    invalid.send("<a></b>");
+    run_until(loop, [&]() { return r1.calls==1; });
+    REQUIRE(r1.reason==event_loop::close_reason::PARSE_ERROR);
+    REQUIRE(error==parser::error_t::TAG_MISMATCH);
+
+    incomplete.send("<a><b>");
+    incomplete.shutdown_writer();
+    run_until(loop, [&]() { return r2.calls==1; });
+    REQUIRE(r2.reason==event_loop::close_reason::PARSE_ERROR);
+  }
+}
+
+TEST_CASE("event loop with many connections")
+{
+  for (event_loop::backend b : {event_loop::backend::EPOLL, event_loop::backend::IO_URING}) {
+    event_loop loop(b, 64);
+    const size_t COUNT = 200;
+    std::vector<std::unique_ptr<channel>> channels;
+    std::vector<std::unique_ptr<recording_delegate>> delegates;
+    size_t finished = 0;
+    for (size_t i = 0; i < COUNT; ++i) {
+      channels.emplace_back(new channel);
+      delegates.emplace_back(new recording_delegate);
+      REQUIRE(loop.add(channels.back()->reader, *delegates.back(),
+                       [&](int, event_loop::close_reason r, parser&) {
+                         REQUIRE(r==event_loop::close_reason::END_OF_STREAM);
+                         ++finished;
+                       })!=nullptr);
+    }
+    // interleaved writes
+    for (size_t i = 0; i < COUNT; ++i) channels[i]->send("<m n='" + std::to_string(i) + "'>");
+    for (size_t i = 0; i < COUNT; ++i) channels[i]->send(std::to_string(i*i) + "</m>");
+    for (size_t i = 0; i < COUNT; ++i) channels[i]->shutdown_writer();
+    loop.run();
+
+    REQUIRE(finished==COUNT);
+    for (size_t i = 0; i < COUNT; ++i) {
+      REQUIRE(delegates[i]->events=="<m>" + std::to_string(i*i) + "</m>");
+    }
+  }
+}
+
+TEST_CASE("delegates remove their connection while parsing")
+{
+  for (event_loop::backend b : {event_loop::backend::EPOLL, event_loop::backend::IO_URING}) {
+    event_loop loop(b);
+    channel c;
+    recording_delegate d;
+    closed result;
+    REQUIRE(loop.add(c.reader, d, result.handler())!=nullptr);
+    d.on_element = [&]() { loop.remove(c.reader); };
+
+    c.send("<a><b/><c/></a>");
+    run_until(loop, [&]() { return loop.connections()==0; });
+    // the rest of the buffer is still parsed, no further reads follow
+    c.send("<d/>");
+    loop.run_once(10);
+    REQUIRE(d.events.find("<d>")==std::string::npos);
+    REQUIRE(result.calls==0);
+  }
+}
+
+TEST_CASE("event loop parses streams of documents")
+{
+  for (event_loop::backend b : {event_loop::backend::EPOLL, event_loop::backend::IO_URING}) {
+    event_loop loop(b, 8);
+    channel c;
+    recording_delegate d;
+    closed result;
+    parser* p = loop.add(c.reader, d, result.handler());
+    REQUIRE(p!=nullptr);
+    p->set_multi_document(true);
+
+    c.send("<m>1</m>\n<m>2</m>");
+    run_until(loop, [&]() { return d.documents==2; });
+    c.send("<m>3</m>");
+    c.shutdown_writer();
+    run_until(loop, [&]() { return result.calls==1; });
+    REQUIRE(d.documents==3);
+    REQUIRE(d.events=="<m>1</m><m>2</m><m>3</m>");
+    REQUIRE(result.reason==event_loop::close_reason::END_OF_STREAM);
+  }
+}
+
+TEST_CASE("the loop can be destroyed with open connections")
+{
+  channel c;
+  recording_delegate d;
+  {
+    event_loop loop;
+    REQUIRE(loop.add(c.reader, d)!=nullptr);
+    c.send("<a>");
+    run_until(loop, [&]() { return d.events=="<a>"; });
+  }
+  REQUIRE(d.events=="<a>");
+}
+
+TEST_CASE("suspended connections are not read until resumed")
+{
+  for (event_loop::backend b : {event_loop::backend::EPOLL, event_loop::backend::IO_URING}) {
+    event_loop loop(b, 64);
+    channel c;
+    recording_delegate d;
+    closed result;
+    parser* p = loop.add(c.reader, d, result.handler());
+    REQUIRE(p!=nullptr);
+    d.on_element = [&]() { REQUIRE(p->suspend()); };
+
+    c.send("<a><b/>");
+    run_until(loop, [&]() { return p->suspended(); });
+    REQUIRE(d.events=="<a>");
+    REQUIRE_FALSE(loop.resume(c.reader + 1000));
+
+    c.send("<c/></a>");
+    c.shutdown_writer();
+    loop.run_once(10);
+    REQUIRE(d.events=="<a>");
+
+    while (result.calls==0) {
+      if (p->suspended()) {
+        REQUIRE(loop.resume(c.reader));
+      } else {
+        REQUIRE(loop.run_once(10) >= 0);
+      }
+    }
+    REQUIRE(d.events=="<a><b></b><c></c></a>");
+    REQUIRE(result.reason==event_loop::close_reason::END_OF_STREAM);
+  }
+}
@@ -0,0 +1,295 @@
+/**
+ * \file test_event_tape.cpp tests recording, replaying, saving and mapping
+ * of event tapes
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "event_tape.hpp"
+
+using xmlpp::event_tape;
+using xmlpp::parser;
+using xmlpp::tape_recorder;
+using xmlpp::tape_replayer;
+
+namespace {
+
+std::string str(const char* s) { return s ? s : "(null)"; }
+
+/** records all events as text, adjacent character data is merged */
+struct text_delegate : public xmlpp::delegate {
+  std::string log;
+  bool in_text{false};
+
+  void add(const std::string& s) { in_text = false; log += s + "\n"; }
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override
+  {
+    std::string s = "start " + str(fullname);
+    for (; *atts; atts += 2) s += " " + str(atts[0]) + "=" + str(atts[1]);
+    add(s);
+  }
+  void onEndElement(const XML_Char *fullname) override { add("end " + str(fullname)); }
+  void onCharacterData(const char *pBuf, int len) override
+  {
+    if (!in_text) log += "text ";
+    log.append(pBuf,static_cast<size_t>(len));
+    in_text = true;
+  }
+  void onComment(const XML_Char *data) override { add("comment " + str(data)); }
+  void onStartCdataSection() override { add("cdata"); }
+  void onEndCdataSection() override { add("/cdata"); }
+  void onXmlDecl(const XML_Char *version, const XML_Char *encoding, int standalone) override
+  {
+    add("xmldecl " + str(version) + " " + str(encoding) + " " + std::to_string(standalone));
+  }
+  void onParseError(size_t line, size_t column, size_t pos, xmlpp::Error error) override
+  {
+    add("error " + std::to_string(line) + ":" + std::to_string(column) + " "
+        + std::to_string(pos) + " " + error.to_string());
+  }
+  void onProcessingInstruction(const XML_Char* target, const XML_Char* data) override
+  {
+    add("pi " + str(target) + " " + str(data));
+  }
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override
+  {
+    add("ns " + str(prefix) + " " + str(uri));
+  }
+  void onEndNamespace(const XML_Char* prefix) override { add("/ns " + str(prefix)); }
+  void onStartDoctypeDecl(const XML_Char *name, const XML_Char *sysid,
+                          const XML_Char *pubid, int has_internal_subset) override
+  {
+    add("doctype " + str(name) + " " + str(sysid) + " " + str(pubid) + " "
+        + std::to_string(has_internal_subset));
+  }
+  void onEndDoctypeDecl() override { add("/doctype"); }
+  void onElementDecl(const XML_Char *name, XML_Content *model) override
+  {
+    add("elementdecl " + str(name) + " " + describe(model));
+  }
+  void onAttlistDecl(const XML_Char *elname, const XML_Char *attname,
+                     const XML_Char *att_type, const XML_Char *dflt,
+                     bool isrequired) override
+  {
+    add("attlist " + str(elname) + " " + str(attname) + " " + str(att_type) + " "
+        + str(dflt) + " " + std::to_string(isrequired));
+  }
+  void onEntityDecl(const XML_Char *name, int is_parameter_entity,
+                    const XML_Char *value, int value_length, const XML_Char *base,
+                    const XML_Char *systemId, const XML_Char *publicId,
+                    const XML_Char *notationName) override
+  {
+    add("entity " + str(name) + " " + std::to_string(is_parameter_entity) + " "
+        + (value ? std::string(value,static_cast<size_t>(value_length)) : "(null)") + " "
+        + str(base) + " " + str(systemId) + " " + str(publicId) + " " + str(notationName));
+  }
+  void onNotationDecl(const XML_Char* name, const XML_Char* base,
+                      const XML_Char* systemId, const XML_Char* publicId) override
+  {
+    add("notation " + str(name) + " " + str(base) + " " + str(systemId) + " " + str(publicId));
+  }
+  void onUnparsedEntityDecl(const XML_Char* name, const XML_Char* base,
+                            const XML_Char* systemId, const XML_Char* publicId,
+                            const XML_Char* notationName) override
+  {
+    add("unparsed " + str(name) + " " + str(base) + " " + str(systemId) + " "
+        + str(publicId) + " " + str(notationName));
+  }
+  void onSkippedEntity(const XML_Char *name, int is_parameter_entity) override
+  {
+    add("skipped " + str(name) + " " + std::to_string(is_parameter_entity));
+  }
+  void onEndDocument(size_t index) override { add("enddocument " + std::to_string(index)); }
+
+  static std::string describe(const XML_Content* c)
+  {
+    std::string s = "(" + std::to_string(c->type) + "," + std::to_string(c->quant) + ","
+                    + str(c->name);
+    for (unsigned i = 0; i < c->numchildren; ++i) s += " " + describe(&c->children[i]);
+    return s + ")";
+  }
+};
+
+const char* DOCUMENT =
+  "<?xml version='1.0' encoding='UTF-8' standalone='yes'?>\n"
+  "<!DOCTYPE doc [\n"
+  "  <!ELEMENT doc (a|b)*>\n"
+  "  <!ELEMENT a (#PCDATA|b)*>\n"
+  "  <!ELEMENT b EMPTY>\n"
+  "  <!ATTLIST a id CDATA #REQUIRED kind (x|y) 'x'>\n"
+  "  <!ENTITY e 'entity text'>\n"
+  "  <!NOTATION gif SYSTEM 'image/gif'>\n"
+  "  <!ENTITY pic SYSTEM 'pic.gif' NDATA gif>\n"
+  "]>\n"
+  "<doc xmlns:n='urn:n'><?target data?><!-- comment -->"
+  "<a id='1'>text &e; &amp; more<![CDATA[<raw>]]></a><b/><n:c n:x='1'/></doc>";
+
+/** parses xml with the recorder attached, the events also go to next */
+void record(event_tape& tape, const char* xml, xmlpp::delegate* next = nullptr)
+{
+  tape_recorder rec(tape, next);
+  parser p(rec);
+  rec.attach(p);
+  REQUIRE(p.parse(xml,static_cast<int>(strlen(xml)),true)==parser::status_t::OK);
+}
+
+std::string replayed(const event_tape& tape)
+{
+  text_delegate d;
+  REQUIRE(tape.replay(d));
+  return d.log;
+}
+
+/** logs the position of each start element */
+struct position_delegate : public xmlpp::abstract_delegate {
+  std::function<std::string()> where;
+  std::string log;
+  void onStartElement(const XML_Char *fullname, const XML_Char **) override
+  {
+    log += str(fullname) + "@" + where() + "\n";
+  }
+  void onEndElement(const XML_Char *fullname) override
+  {
+    log += "/" + str(fullname) + "@" + where() + "\n";
+  }
+};
+
+const char* TAPE_FILE = "test_event_tape.tape";
+
+}
+
+TEST_CASE("tape replays the events of the parse")
+{
+  event_tape tape;
+  text_delegate direct;
+  record(tape, DOCUMENT, &direct);
+  REQUIRE(tape.has_positions());
+  REQUIRE(tape.events() > 20);
+  // the recorder forwards to the next delegate
+  REQUIRE(direct.log.find("elementdecl doc (5,2,(null) (4,0,a) (4,0,b))")!=std::string::npos);
+  REQUIRE(replayed(tape)==direct.log);
+  // replaying twice gives the same events
+  REQUIRE(replayed(tape)==direct.log);
+}
+
+TEST_CASE("tape interns element and attribute names")
+{
+  std::string doc("<list>");
+  for (int i = 0; i < 100; ++i) doc += "<item n='" + std::to_string(i) + "' kind='k'>text</item>";
+  doc += "</list>";
+  event_tape tape;
+  record(tape, doc.c_str());
+  REQUIRE(tape.names()==4);
+  REQUIRE(std::string(tape.name(0))=="list");
+  REQUIRE(tape.events()==302);
+  // the names are stored once, each item costs less than its markup
+  REQUIRE(tape.size() < doc.size());
+}
+
+TEST_CASE("tape replays the positions of the parser")
+{
+  const char* xml = "<a>\n  <b x='1'/>\n  <c>\n  </c>\n</a>";
+  position_delegate direct;
+  event_tape tape;
+  {
+    tape_recorder rec(tape, &direct);
+    parser p(rec);
+    rec.attach(p);
+    direct.where = [&p]() {
+      return std::to_string(p.current_line_number()) + ":"
+        + std::to_string(p.current_column_number()) + ":"
+        + std::to_string(p.current_byte_index());
+    };
+    REQUIRE(p.parse(xml,static_cast<int>(strlen(xml)),true)==parser::status_t::OK);
+  }
+  tape_replayer r(tape);
+  position_delegate replay;
+  replay.where = [&r]() {
+    return std::to_string(r.current_line_number()) + ":"
+      + std::to_string(r.current_column_number()) + ":"
+      + std::to_string(r.current_byte_index());
+  };
+  REQUIRE(r.replay(replay));
+  REQUIRE(replay.log==direct.log);
+  REQUIRE(replay.log.find("c@3:2:19")!=std::string::npos);
+
+  SECTION("a tape recorded without parser has no positions") {
+    event_tape plain;
+    tape_recorder rec(plain);
+    parser p(rec);
+    REQUIRE(p.parse(xml,static_cast<int>(strlen(xml)),true)==parser::status_t::OK);
+    REQUIRE_FALSE(plain.has_positions());
+    REQUIRE(plain.size() < tape.size());
+  }
+}
+
+TEST_CASE("tape is saved and mapped from a file")
+{
+  event_tape tape;
+  record(tape, DOCUMENT);
+  REQUIRE(tape.save(TAPE_FILE));
+
+  event_tape mapped;
+  REQUIRE(mapped.load(TAPE_FILE));
+  REQUIRE(mapped.events()==tape.events());
+  REQUIRE(mapped.names()==tape.names());
+  REQUIRE(mapped.size()==tape.size());
+  REQUIRE(mapped.has_positions());
+  REQUIRE(replayed(mapped)==replayed(tape));
+
+  SECTION("recording appends to a mapped tape") {
+    record(mapped, "<doc><a id='2'/></doc>");
+    REQUIRE(mapped.events()==tape.events() + 4);
+    REQUIRE(replayed(mapped)==replayed(tape) + "start doc\nstart a id=2\nend a\nend doc\n");
+  }
+  SECTION("damaged files are rejected") {
+    FILE* f = fopen(TAPE_FILE, "rb");
+    REQUIRE(f!=nullptr);
+    std::vector<char> bytes(1024*1024);
+    bytes.resize(fread(bytes.data(), 1, bytes.size(), f));
+    fclose(f);
+
+    f = fopen(TAPE_FILE, "wb");
+    fwrite(bytes.data(), 1, bytes.size() - 10, f);
+    fclose(f);
+    event_tape truncated;
+    REQUIRE_FALSE(truncated.load(TAPE_FILE));
+    REQUIRE(truncated.empty());
+    REQUIRE_FALSE(truncated.load("does/not/exist.tape"));
+  }
+  remove(TAPE_FILE);
+}
+
+TEST_CASE("replay stops at corrupt events")
+{
+  event_tape tape;
+  record(tape, "<a><b/>text</a>");
+  REQUIRE(tape.save(TAPE_FILE));
+  FILE* f = fopen(TAPE_FILE, "rb");
+  REQUIRE(f!=nullptr);
+  std::vector<char> bytes(4096);
+  bytes.resize(fread(bytes.data(), 1, bytes.size(), f));
+  fclose(f);
+  // an unknown event type in place of the last end element
+  const size_t last = bytes.size() - 5;
+  REQUIRE(bytes[last]==2);
+  bytes[last] = 99;
+  f = fopen(TAPE_FILE, "wb");
+  fwrite(bytes.data(), 1, bytes.size(), f);
+  fclose(f);
+
+  event_tape damaged;
+  REQUIRE(damaged.load(TAPE_FILE));
+  text_delegate d;
+  REQUIRE_FALSE(damaged.replay(d));
+  REQUIRE(d.log=="start a\nstart b\nend b\ntext text");
+  remove(TAPE_FILE);
+}
@@ -0,0 +1,194 @@
+#include "catch2/catch_all.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include "index.hpp"
+
+using xmlpp::parser;
+using xmlpp::structural_index;
+
+namespace {
+
+struct recording_delegate : public xmlpp::abstract_delegate {
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override
+  {
+    events.push_back(std::string("<") + fullname);
+    for (; *atts; atts += 2) {
+      events.push_back(std::string("@") + atts[0] + "=" + atts[1]);
+    }
+  }
+  void onEndElement(const XML_Char *fullname) override
+  {
+    events.push_back(std::string("/") + fullname);
+  }
+  void onCharacterData(const char *pBuf, int len) override
+  {
+    events.push_back(std::string(pBuf,len));
+  }
+  void onStartNamespace(const XML_Char* prefix, const XML_Char*) override
+  {
+    events.push_back(std::string("ns ") + (prefix ? prefix : ""));
+  }
+  void onParseError(size_t line, size_t column, size_t pos, xmlpp::Error) override
+  {
+    error_line = line;
+    error_column = column;
+    error_pos = pos;
+  }
+  std::vector<std::string> events;
+  size_t error_line{0};
+  size_t error_column{0};
+  size_t error_pos{0};
+};
+
+const char* DOC =
+  "<?xml version='1.0'?>\n"
+  "<r xmlns='urn:a' xmlns:b='urn:b&amp;c'>"
+  "<item id='1'><b:v>one</b:v></item>"
+  "<item id='2'><v xmlns='urn:c'>two</v></item>"
+  "<empty/>"
+  "</r>";
+
+}
+
+TEST_CASE("structural index")
+{
+  structural_index idx;
+  const size_t len = strlen(DOC);
+  REQUIRE(structural_index::build(DOC, len, idx)==parser::result::OK);
+
+  SECTION("records elements with byte ranges") {
+    REQUIRE(idx.entries().size()==6);
+    const auto& root = idx.entries()[0];
+    REQUIRE(idx.name(root.name)=="urn:a:r");
+    REQUIRE(root.depth==1);
+    REQUIRE(root.begin==strlen("<?xml version='1.0'?>\n"));
+    REQUIRE(root.end==len);
+
+    auto items = idx.find("urn:a:item");
+    REQUIRE(items.size()==2);
+    const auto& item = idx.entries()[items[0]];
+    REQUIRE(std::string(DOC+item.begin, item.end-item.begin)
+            =="<item id='1'><b:v>one</b:v></item>");
+    REQUIRE(item.depth==2);
+
+    auto empty = idx.find("urn:a:empty");
+    REQUIRE(empty.size()==1);
+    const auto& e = idx.entries()[empty[0]];
+    REQUIRE(std::string(DOC+e.begin, e.end-e.begin)=="<empty/>");
+    REQUIRE(idx.find("unknown").empty());
+  }
+
+  SECTION("max depth") {
+    structural_index top;
+    REQUIRE(structural_index::build(DOC, len, top, 2)==parser::result::OK);
+    REQUIRE(top.entries().size()==4);
+    for (const auto& e : top.entries()) REQUIRE(e.depth<=2);
+  }
+
+  SECTION("parse subtree with namespaces in scope") {
+    auto items = idx.find("urn:a:item");
+    recording_delegate d;
+    REQUIRE(idx.parse_subtree(DOC, len, items[0], d)==parser::result::OK);
+    const std::vector<std::string> expected = {
+      "<urn:a:item", "@id=1", "<urn:b&c:v", "one", "/urn:b&c:v", "/urn:a:item"
+    };
+    REQUIRE(d.events==expected);
+
+    recording_delegate d2;
+    REQUIRE(idx.parse_subtree(DOC, len, items[1], d2)==parser::result::OK);
+    const std::vector<std::string> expected2 = {
+      "<urn:a:item", "@id=2", "ns ", "<urn:c:v", "two", "/urn:c:v", "/urn:a:item"
+    };
+    REQUIRE(d2.events==expected2);
+  }
+
+  SECTION("invalid subtree") {
+    recording_delegate d;
+    REQUIRE(idx.parse_subtree(DOC, len, idx.entries().size(), d)
+            ==parser::result::INVALID_INPUT);
+    REQUIRE(idx.parse_subtree(DOC, 10, 0, d)==parser::result::INVALID_INPUT);
+  }
+
+  SECTION("sidecar file round trip") {
+    FILE* f = fopen("index_doc.xml","wb");
+    REQUIRE(f);
+    fputs(DOC,f);
+    fclose(f);
+
+    structural_index from_file;
+    REQUIRE(structural_index::build_file("index_doc.xml", from_file)==parser::result::OK);
+    REQUIRE(from_file.save("index_doc.xml.idx"));
+
+    structural_index loaded;
+    REQUIRE(loaded.load("index_doc.xml.idx"));
+    REQUIRE(loaded.document_size()==len);
+    REQUIRE(loaded.entries().size()==idx.entries().size());
+    for (size_t i = 0; i < idx.entries().size(); ++i) {
+      REQUIRE(loaded.entries()[i].begin==idx.entries()[i].begin);
+      REQUIRE(loaded.entries()[i].end==idx.entries()[i].end);
+      REQUIRE(loaded.entries()[i].depth==idx.entries()[i].depth);
+      REQUIRE(loaded.name(loaded.entries()[i].name)==idx.name(idx.entries()[i].name));
+    }
+
+    auto items = loaded.find("urn:a:item");
+    REQUIRE(items.size()==2);
+    recording_delegate d;
+    REQUIRE(loaded.parse_subtree_file("index_doc.xml", items[0], d)==parser::result::OK);
+    REQUIRE(d.events.size()==6);
+    REQUIRE(d.events[2]=="<urn:b&c:v");
+
+    structural_index broken;
+    REQUIRE_FALSE(broken.load("index_doc.xml"));
+    REQUIRE_FALSE(broken.load("file_does_not_exist"));
+
+    remove("index_doc.xml");
+    remove("index_doc.xml.idx");
+  }
+}
+
+TEST_CASE("structural index of malformed document")
+{
+  structural_index idx;
+  const char* BAD = "<r><a></b></r>";
+  REQUIRE(structural_index::build(BAD, strlen(BAD), idx)==parser::result::PARSE_ERROR);
+}
+
+TEST_CASE("structural index reports subtree errors at their document position")
+{
+  // a two byte character before the subtree on its first line
+  const std::string doc =
+    "<?xml version='1.0'?>\r\n<r xmlns='urn:a'>\n"
+    "  <\xc3\xa9/><item id='1'><v>one</v>\n"
+    "    <v>two</v>\n"
+    "  </item>\n</r>";
+  structural_index idx;
+  REQUIRE(structural_index::build(doc.data(), doc.size(), idx)==parser::result::OK);
+  const auto items = idx.find("urn:a:item");
+  REQUIRE(items.size()==1);
+
+  for (const char* corrupted : {"one", "two"}) {
+    std::string bad = doc;
+    bad[bad.find(corrupted)] = '<';
+    recording_delegate whole;
+    REQUIRE(parser::parseString(bad.c_str(), whole)==parser::result::PARSE_ERROR);
+
+    recording_delegate d;
+    REQUIRE(idx.parse_subtree(bad.data(), bad.size(), items[0], d)==parser::result::PARSE_ERROR);
+    REQUIRE(d.error_pos==whole.error_pos);
+    REQUIRE(d.error_line==whole.error_line);
+    REQUIRE(d.error_column==whole.error_column);
+
+    FILE* f = fopen("index_bad.xml","wb");
+    REQUIRE(f);
+    fwrite(bad.data(), 1, bad.size(), f);
+    fclose(f);
+    recording_delegate from_file;
+    REQUIRE(idx.parse_subtree_file("index_bad.xml", items[0], from_file)==parser::result::PARSE_ERROR);
+    remove("index_bad.xml");
+    REQUIRE(from_file.error_pos==whole.error_pos);
+    REQUIRE(from_file.error_line==whole.error_line);
+    REQUIRE(from_file.error_column==whole.error_column);
+  }
+}
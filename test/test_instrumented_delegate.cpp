@@ -0,0 +1,139 @@
+/**
+ * \file test_instrumented_delegate.cpp tests the event counting and timing
+ * of instrumented_delegate
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <string>
+
+#include "instrumented_delegate.hpp"
+#include "state.hpp"
+#include "xmlparser.hpp"
+
+using xmlpp::instrumented_delegate;
+using xmlpp::latency_histogram;
+using xmlpp::parse_stats;
+using xmlpp::parser;
+using xmlpp::State;
+
+namespace {
+
+const char* SAMPLE =
+  "<?xml version='1.0'?>"
+  "<r xmlns:a='urn:a'><!-- c --><a:e x='1'>text</a:e><e/><?pi data?>"
+  "<![CDATA[cdata]]></r>";
+
+struct element_counter : public xmlpp::abstract_delegate {
+  explicit element_counter(int start) : elements(start) {}
+  void onStartElement(const XML_Char *, const XML_Char **) override { ++elements; }
+  int elements;
+};
+
+struct list_delegate : public xmlpp::StatefulDelegate {
+  int items{0};
+  State list{"list"};
+  State item{"item", [this](const XML_Char**) { ++items; }};
+  list_delegate()
+  {
+    list.addState(&item);
+    add_state(&list);
+  }
+};
+
+}
+
+TEST_CASE("instrumented delegate counts the callbacks")
+{
+  instrumented_delegate<element_counter> d(10);
+  d.begin();
+  REQUIRE(parser::parseString(SAMPLE,d)==parser::result::OK);
+  d.finish();
+
+  REQUIRE(d.elements==13);
+  const parse_stats& s = d.stats();
+  REQUIRE(s.callbacks[parse_stats::START_ELEMENT].count==3);
+  REQUIRE(s.callbacks[parse_stats::END_ELEMENT].count==3);
+  REQUIRE(s.callbacks[parse_stats::CHARACTER_DATA].count==2);
+  REQUIRE(s.callbacks[parse_stats::COMMENT].count==1);
+  REQUIRE(s.callbacks[parse_stats::PROCESSING_INSTRUCTION].count==1);
+  REQUIRE(s.callbacks[parse_stats::START_CDATA_SECTION].count==1);
+  REQUIRE(s.callbacks[parse_stats::END_CDATA_SECTION].count==1);
+  REQUIRE(s.callbacks[parse_stats::START_NAMESPACE].count==1);
+  REQUIRE(s.callbacks[parse_stats::END_NAMESPACE].count==1);
+  REQUIRE(s.callbacks[parse_stats::XML_DECL].count==1);
+  REQUIRE(s.events()==15);
+  REQUIRE(s.callbacks[parse_stats::START_ELEMENT].latency.count()==3);
+  REQUIRE(s.expat_ticks > 0);
+  REQUIRE(s.delegate_ns() >= 0);
+  REQUIRE(std::string(parse_stats::name(parse_stats::CHARACTER_DATA))=="character_data");
+
+  d.reset_stats();
+  REQUIRE(d.stats().events()==0);
+}
+
+TEST_CASE("instrumented StatefulDelegate")
+{
+  instrumented_delegate<list_delegate> d;
+  REQUIRE(parser::parseString("<list><item/><item/></list>",d)==parser::result::OK);
+  REQUIRE(d.items==2);
+  REQUIRE(d.stats().callbacks[parse_stats::START_ELEMENT].count==3);
+}
+
+TEST_CASE("instrumented delegate counts the ends of documents")
+{
+  const std::string stream = "<a/><b><c/></b>\n<d/>";
+  instrumented_delegate<element_counter> d(0);
+  parser p(d);
+  p.set_multi_document(true);
+  d.begin();
+  REQUIRE(p.parse(stream.data(),static_cast<int>(stream.size()),true)==parser::status_t::OK);
+  d.finish();
+
+  const parse_stats& s = d.stats();
+  REQUIRE(d.elements==4);
+  REQUIRE(s.callbacks[parse_stats::END_DOCUMENT].count==3);
+  REQUIRE(s.callbacks[parse_stats::END_DOCUMENT].latency.count()==3);
+  REQUIRE(s.events()==11);
+  REQUIRE(std::string(parse_stats::name(parse_stats::END_DOCUMENT))=="end_document");
+}
+
+TEST_CASE("disabled instrumentation")
+{
+  instrumented_delegate<element_counter,false> d(0);
+  REQUIRE(sizeof(d)==sizeof(element_counter));
+  d.begin();
+  REQUIRE(parser::parseString(SAMPLE,d)==parser::result::OK);
+  d.finish();
+  REQUIRE(d.elements==3);
+  REQUIRE(d.stats().events()==0);
+}
+
+TEST_CASE("latency histogram")
+{
+  latency_histogram h;
+  REQUIRE(h.percentile(50)==0);
+  for (uint64_t v = 1; v <= 1000; ++v) h.record(v);
+  REQUIRE(h.count()==1000);
+  REQUIRE(h.min()==1);
+  REQUIRE(h.max()==1000);
+  // the relative error of a bucket is below 1/16
+  REQUIRE(h.percentile(50) >= 500);
+  REQUIRE(h.percentile(50) <= 500 + 500/16);
+  REQUIRE(h.percentile(99) >= 990);
+  REQUIRE(h.percentile(100)==1000);
+
+  for (uint64_t v : {0ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, 1ull << 40}) {
+    const unsigned i = latency_histogram::index(v);
+    REQUIRE(latency_histogram::upper_bound(i) >= v);
+    if (i > 0) REQUIRE(latency_histogram::upper_bound(i-1) < v);
+  }
+  REQUIRE(latency_histogram::index(UINT64_MAX) < latency_histogram::SIZE);
+
+  latency_histogram other;
+  other.record(5000);
+  h.merge(other);
+  REQUIRE(h.count()==1001);
+  REQUIRE(h.max()==5000);
+}
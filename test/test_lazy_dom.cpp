@@ -0,0 +1,154 @@
+#include "catch2/catch_all.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "lazy_dom.hpp"
+
+using xmlpp::lazy_document;
+using xmlpp::lazy_element;
+using xmlpp::parser;
+
+namespace {
+
+std::string make_document(size_t records)
+{
+  std::string doc("<?xml version='1.0'?>\n<db xmlns='urn:db' version='3'>header");
+  for (size_t i = 0; i < records; ++i) {
+    doc += "<rec id='" + std::to_string(i) + "'>"
+           "<name>record " + std::to_string(i) + "</name>"
+           "<tags><tag>a</tag><tag>b</tag></tags>"
+           "</rec>";
+  }
+  doc += "</db>";
+  return doc;
+}
+
+}
+
+TEST_CASE("lazy document navigation")
+{
+  const std::string doc = make_document(10);
+  lazy_document d;
+  REQUIRE(d.load(doc.data(), doc.size())==parser::result::OK);
+
+  lazy_element root = d.root();
+  REQUIRE(root.valid());
+  REQUIRE(root.name()=="urn:db:db");
+  REQUIRE(root.attribute("version")=="3");
+  REQUIRE(root.text()=="header");
+  REQUIRE(root.child_count()==10);
+  REQUIRE(d.materializations()==0);
+
+  SECTION("second level names need no materialization") {
+    for (const auto& c : root.children()) {
+      REQUIRE(c.name()=="urn:db:rec");
+    }
+    REQUIRE(d.materializations()==0);
+  }
+
+  SECTION("children are materialized on first access") {
+    lazy_element rec = root.child(7);
+    REQUIRE(rec.attribute("id")=="7");
+    REQUIRE(d.materializations()==1);
+    REQUIRE(rec.child_count()==2);
+    REQUIRE(rec.child(0).name()=="urn:db:name");
+    REQUIRE(rec.child(0).text()=="record 7");
+    lazy_element tags = rec.child(1);
+    REQUIRE(tags.child_count()==2);
+    REQUIRE(tags.child(1).text()=="b");
+    REQUIRE(tags.child(1).parent().name()=="urn:db:tags");
+    REQUIRE(rec.parent().name()=="urn:db:db");
+    REQUIRE_FALSE(root.parent().valid());
+    REQUIRE_FALSE(rec.child(2).valid());
+    REQUIRE(d.materializations()==1);
+    REQUIRE(d.materialized()==1);
+  }
+}
+
+TEST_CASE("lazy document evicts under memory cap")
+{
+  const std::string doc = make_document(100);
+  lazy_document d(4096);
+  REQUIRE(d.load(doc.data(), doc.size())==parser::result::OK);
+
+  lazy_element root = d.root();
+  for (size_t i = 0; i < root.child_count(); ++i) {
+    REQUIRE(root.child(i).child(0).text()==("record " + std::to_string(i)).c_str());
+  }
+  REQUIRE(d.materializations()==100);
+  REQUIRE(d.materialized() < 100);
+  REQUIRE(d.memory_used() <= d.memory_cap());
+
+  // evicted subtrees come back on access
+  lazy_element first = root.child(0);
+  REQUIRE(first.attribute("id")=="0");
+  REQUIRE(d.materializations()==101);
+}
+
+TEST_CASE("lazy document from mapped file")
+{
+  const std::string doc = make_document(3);
+  FILE* f = fopen("lazy_doc.xml","wb");
+  REQUIRE(f);
+  fwrite(doc.data(), 1, doc.size(), f);
+  fclose(f);
+
+  {
+    lazy_document d;
+    REQUIRE(d.load_file("lazy_doc.xml")==parser::result::OK);
+    REQUIRE(d.root().child(2).child(0).text()=="record 2");
+  }
+  lazy_document missing;
+  REQUIRE(missing.load_file("file_does_not_exist")==parser::result::ERROR_OPEN_FILE);
+  REQUIRE_FALSE(missing.root().valid());
+  remove("lazy_doc.xml");
+}
+
+TEST_CASE("lazy document of malformed input")
+{
+  const char* BAD = "<r><a></b></r>";
+  lazy_document d;
+  REQUIRE(d.load(BAD, strlen(BAD))==parser::result::PARSE_ERROR);
+  REQUIRE_FALSE(d.root().valid());
+}
+
+TEST_CASE("lazy document subtrees referencing internal entities")
+{
+  const char* DOC = "<!DOCTYPE r [<!ENTITY e \"x\">]><r><a x=\"&e;\"><b/></a><c>text</c></r>";
+  lazy_document d;
+  REQUIRE(d.load(DOC, strlen(DOC))==parser::result::OK);
+  lazy_element a = d.root().child(0);
+  REQUIRE(a.name()=="a");
+  REQUIRE(a.attribute_count()==0);
+  REQUIRE(a.attribute("x").empty());
+  REQUIRE(a.child_count()==0);
+  REQUIRE_FALSE(a.child(0).valid());
+  REQUIRE(a.text().empty());
+  REQUIRE(d.last_error()==parser::result::PARSE_ERROR);
+  REQUIRE(d.root().child(1).text()=="text");
+}
+
+TEST_CASE("lazy document with long and mixed text")
+{
+  std::string line(50, 'x');
+  line += '\n';
+  std::string doc("<r><a>");
+  std::string text;
+  for (int i = 0; i < 20000; ++i) text += line;
+  doc += text + "</a><m>";
+  std::string mixed;
+  for (int i = 0; i < 2000; ++i) {
+    doc += "t" + line + "<c/>";
+    mixed += "t" + line;
+  }
+  doc += "</m>" + text + "</r>";
+  lazy_document d;
+  REQUIRE(d.load(doc.data(), doc.size())==parser::result::OK);
+  REQUIRE(d.root().text().str()==text);
+  REQUIRE(d.root().child(0).text().str()==text);
+  REQUIRE(d.root().child(1).text().str()==mixed);
+  REQUIRE(d.root().child(1).child_count()==2000);
+  REQUIRE(d.memory_used() < 4*text.size());
+}
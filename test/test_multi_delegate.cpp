@@ -0,0 +1,142 @@
+/**
+ * \file test_multi_delegate.cpp tests the fan out of the events to several
+ * delegates
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "multi_delegate.hpp"
+#include "xmlparser.hpp"
+
+using xmlpp::event_buffer;
+using xmlpp::multi_delegate;
+using xmlpp::parser;
+
+namespace {
+
+/** logs the events it gets */
+struct log_delegate : public xmlpp::abstract_delegate {
+  std::string log;
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override
+  {
+    log += "<" + std::string(fullname);
+    for (; *atts; atts += 2) log += " " + std::string(atts[0]) + "=" + atts[1];
+    log += ">";
+  }
+  void onEndElement(const XML_Char *fullname) override
+  {
+    log += "</" + std::string(fullname) + ">";
+  }
+  void onCharacterData(const char *pBuf, int len) override
+  {
+    log.append(pBuf, static_cast<size_t>(len));
+  }
+  void onComment(const XML_Char *data) override { log += "<!--" + std::string(data) + "-->"; }
+  void onEndDocument(size_t index) override { log += "|" + std::to_string(index); }
+};
+
+std::string document(int items)
+{
+  std::string doc("<list><!--c-->");
+  for (int i = 0; i < items; ++i) {
+    doc += "<item n='" + std::to_string(i) + "'>value " + std::to_string(i) + "</item>";
+  }
+  return doc + "</list>";
+}
+
+std::string parsed(const std::string& doc)
+{
+  log_delegate d;
+  REQUIRE(parser::parseString(doc.c_str(), d)==parser::OK);
+  return d.log;
+}
+
+const multi_delegate::event_mask ELEMENTS =
+  event_buffer::mask(event_buffer::event::START_ELEMENT)
+  | event_buffer::mask(event_buffer::event::END_ELEMENT);
+const multi_delegate::event_mask COMMENTS = event_buffer::mask(event_buffer::event::COMMENT);
+
+}
+
+TEST_CASE("multi_delegate passes the events to all delegates")
+{
+  const std::string doc = document(3);
+  for (bool parallel : {false, true}) {
+    log_delegate all, elements, comments, none;
+    multi_delegate multi;
+    multi.set_parallel(parallel, 16, 2);
+    multi.add(all);
+    multi.add(elements, ELEMENTS);
+    multi.add(comments, COMMENTS);
+    multi.add(none, 0);
+    REQUIRE(multi.size()==4);
+    REQUIRE(parser::parseString(doc.c_str(), multi)==parser::OK);
+    multi.finish();
+
+    REQUIRE(all.log==parsed(doc));
+    REQUIRE(elements.log=="<list><item n=0></item><item n=1></item><item n=2></item></list>");
+    REQUIRE(comments.log=="<!--c-->");
+    REQUIRE(none.log.empty());
+  }
+}
+
+TEST_CASE("multi_delegate in parallel mode delivers large documents in order")
+{
+  const std::string doc = document(20000);
+  const std::string expected = parsed(doc);
+  log_delegate a, b, c;
+  multi_delegate multi;
+  multi.set_parallel(true, 1024, 4);
+  multi.add(a);
+  multi.add(b, multi_delegate::CONTENT);
+  multi.add(c);
+  REQUIRE(parser::parseString(doc.c_str(), multi)==parser::OK);
+  multi.finish();
+  REQUIRE(a.log==expected);
+  REQUIRE(b.log==expected.substr(0, 6) + expected.substr(14));
+  REQUIRE(c.log==expected);
+}
+
+TEST_CASE("multi_delegate in parallel mode replays attributes to several consumers")
+{
+  // the consumers replay the same batches at the same time
+  std::string doc("<list>");
+  for (int i = 0; i < 5000; ++i) {
+    const std::string n = std::to_string(i);
+    doc += "<item";
+    for (int a = 0; a < 1 + i % 12; ++a) {
+      doc += " a" + std::to_string(a) + "='" + n + "-" + std::to_string(a) + "'";
+    }
+    doc += "/>";
+  }
+  doc += "</list>";
+  const std::string expected = parsed(doc);
+
+  std::vector<log_delegate> consumers(6);
+  multi_delegate multi;
+  multi.set_parallel(true, 512, 4);
+  for (log_delegate& d : consumers) multi.add(d, ELEMENTS);
+  REQUIRE(parser::parseString(doc.c_str(), multi)==parser::OK);
+  multi.finish();
+  for (const log_delegate& d : consumers) REQUIRE(d.log==expected);
+}
+
+TEST_CASE("multi_delegate forwards the end of the documents of a stream")
+{
+  const char* stream = "<a>1</a><a>2</a>";
+  log_delegate d;
+  multi_delegate multi;
+  multi.set_parallel(true);
+  multi.add(d);
+  parser p(multi);
+  p.set_multi_document(true);
+  REQUIRE(p.parse(stream, static_cast<int>(strlen(stream)), true)==parser::status_t::OK);
+  multi.finish();
+  REQUIRE(d.log=="<a>1</a>|0<a>2</a>|1");
+}
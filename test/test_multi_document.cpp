@@ -0,0 +1,210 @@
+/**
+ * \file test_multi_document.cpp tests parsing streams of concatenated
+ * documents
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xmlparser.hpp"
+
+using xmlpp::parser;
+
+namespace {
+
+/** records the events as a string per document */
+struct recording_delegate : public xmlpp::abstract_delegate {
+  std::vector<std::string> documents{std::string()};
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override
+  {
+    documents.back() += std::string("<") + fullname;
+    for (; *atts; atts += 2) documents.back() += std::string(" ") + atts[0] + "=" + atts[1];
+    documents.back() += ">";
+  }
+  void onEndElement(const XML_Char *fullname) override
+  {
+    documents.back() += std::string("</") + fullname + ">";
+  }
+  void onCharacterData(const char *pBuf, int len) override
+  {
+    documents.back().append(pBuf,static_cast<size_t>(len));
+  }
+  void onEndDocument(size_t index) override
+  {
+    REQUIRE(index==documents.size() - 1);
+    documents.emplace_back();
+  }
+};
+
+const char* STREAM =
+  "<?xml version='1.0' encoding='UTF-8'?>\n<msg id='1'><a>one</a></msg>\n"
+  "<?xml version='1.0'?><msg id='2'/>"
+  "<msg id='3' xmlns='urn:x'><b>three</b></msg>\r\n\t "
+  "<!-- comment --><msg id='4'>four</msg>";
+
+const std::vector<std::string> EXPECTED = {
+  "<msg id=1><a>one</a></msg>",
+  "<msg id=2></msg>",
+  "<urn:x:msg id=3><urn:x:b>three</urn:x:b></urn:x:msg>",
+  "<msg id=4>four</msg>",
+  ""
+};
+
+/** feeds the stream byte by byte, every byte from its own buffer like the
+ * reads of a socket */
+parser::status_t feed_bytes(parser& p, const std::string& stream)
+{
+  for (char c : stream) {
+    std::unique_ptr<char[]> byte(new char[1]);
+    byte[0] = c;
+    const parser::status_t status = p.parse(byte.get(),1,false);
+    if (status!=parser::status_t::OK) return status;
+  }
+  return p.parse(nullptr,0,true);
+}
+
+}
+
+TEST_CASE("concatenated documents in one buffer")
+{
+  recording_delegate d;
+  parser p(d);
+  p.set_multi_document(true);
+  REQUIRE(p.parse(STREAM,static_cast<int>(strlen(STREAM)),true)==parser::status_t::OK);
+  REQUIRE(d.documents==EXPECTED);
+  REQUIRE(p.stats().documents==4);
+  REQUIRE(p.stats().bytes==strlen(STREAM));
+  REQUIRE(p.stats().elements==6);
+}
+
+TEST_CASE("concatenated documents split at every position")
+{
+  const size_t len = strlen(STREAM);
+  for (size_t split = 0; split <= len; ++split) {
+    INFO(split);
+    recording_delegate d;
+    parser p(d);
+    p.set_multi_document(true);
+    REQUIRE(p.parse(STREAM,static_cast<int>(split),false)==parser::status_t::OK);
+    REQUIRE(p.parse(STREAM + split,static_cast<int>(len - split),true)==parser::status_t::OK);
+    REQUIRE(d.documents==EXPECTED);
+  }
+}
+
+TEST_CASE("stream fed byte by byte")
+{
+  recording_delegate d;
+  parser p(d);
+  p.set_multi_document(true);
+  REQUIRE(feed_bytes(p,STREAM)==parser::status_t::OK);
+  REQUIRE(d.documents==EXPECTED);
+  REQUIRE(p.stats().bytes==strlen(STREAM));
+}
+
+TEST_CASE("many small documents fed byte by byte")
+{
+  // reparse deferral keeps complete documents in the buffer of expat
+  std::string stream;
+  const size_t COUNT = 20;
+  for (size_t i = 0; i < COUNT; ++i) stream += "<msg id='" + std::to_string(i) + "'/>";
+
+  for (bool deferral : {true, false}) {
+    INFO(deferral);
+    recording_delegate d;
+    parser p(d);
+    p.set_multi_document(true);
+    p.set_reparse_deferral(deferral);
+    REQUIRE(feed_bytes(p,stream)==parser::status_t::OK);
+    REQUIRE(p.stats().documents==COUNT);
+    REQUIRE(d.documents.size()==COUNT + 1);
+    REQUIRE(d.documents[19]=="<msg id=19></msg>");
+    REQUIRE(p.stats().bytes==stream.size());
+  }
+}
+
+TEST_CASE("many documents reuse the expat parser")
+{
+  std::string stream;
+  const size_t COUNT = 5000;
+  for (size_t i = 0; i < COUNT; ++i) {
+    stream += "<m n='" + std::to_string(i) + "'><v>" + std::to_string(i*i) + "</v></m>\n";
+  }
+  REQUIRE(stream.size() > 4*static_cast<size_t>(parser::MULTI_DOCUMENT_SLICE));
+
+  recording_delegate d;
+  parser p(d);
+  p.set_multi_document(true);
+  REQUIRE(p.parse(stream.data(),static_cast<int>(stream.size()),true)==parser::status_t::OK);
+  REQUIRE(p.stats().documents==COUNT);
+  REQUIRE(d.documents.size()==COUNT + 1);
+  REQUIRE(d.documents[1234]=="<m n=1234><v>1522756</v></m>");
+  // the reset keeps the buffers of expat, it only rebuilds the small
+  // tables of the document
+  REQUIRE(p.stats().allocations < 8*COUNT);
+  REQUIRE(p.stats().peak_memory < 256*1024);
+  REQUIRE(p.stats().bytes==stream.size());
+}
+
+TEST_CASE("incomplete and invalid documents in a stream")
+{
+  SECTION("incomplete last document") {
+    recording_delegate d;
+    parser p(d);
+    p.set_multi_document(true);
+    const char* xml = "<a/><b><c/>";
+    REQUIRE(p.parse(xml,static_cast<int>(strlen(xml)),true)==parser::status_t::ERROR);
+    REQUIRE(p.stats().documents==1);
+  }
+  SECTION("syntax error in the second document") {
+    recording_delegate d;
+    parser p(d);
+    p.set_multi_document(true);
+    const char* xml = "<a/><b></c><d/>";
+    REQUIRE(p.parse(xml,static_cast<int>(strlen(xml)),true)==parser::status_t::ERROR);
+    REQUIRE(p.errorcode()==parser::error_t::TAG_MISMATCH);
+    REQUIRE(d.documents.size()==2);
+  }
+  SECTION("only whitespace after the last document") {
+    recording_delegate d;
+    parser p(d);
+    p.set_multi_document(true);
+    const char* xml = "<a/>\n\n";
+    REQUIRE(p.parse(xml,static_cast<int>(strlen(xml)),true)==parser::status_t::OK);
+    REQUIRE(p.stats().documents==1);
+  }
+  SECTION("comments and processing instructions after the last document") {
+    recording_delegate d;
+    parser p(d);
+    p.set_multi_document(true);
+    const char* xml = "<a/><!-- x --> <?pi y?>\n";
+    REQUIRE(p.parse(xml,static_cast<int>(strlen(xml)),false)==parser::status_t::OK);
+    REQUIRE(p.parse(nullptr,0,true)==parser::status_t::OK);
+    REQUIRE(p.stats().documents==1);
+    REQUIRE(p.errorcode()==parser::error_t::NONE);
+    REQUIRE(feed_bytes(p,"<b/><!-- x -->")==parser::status_t::OK);
+    REQUIRE(p.stats().documents==2);
+  }
+  SECTION("incomplete comment after the last document") {
+    recording_delegate d;
+    parser p(d);
+    p.set_multi_document(true);
+    const char* xml = "<a/><!-- x";
+    REQUIRE(p.parse(xml,static_cast<int>(strlen(xml)),true)==parser::status_t::ERROR);
+  }
+}
+
+TEST_CASE("single document mode rejects concatenated documents")
+{
+  recording_delegate d;
+  parser p(d);
+  const char* xml = "<a/><b/>";
+  REQUIRE(p.parse(xml,static_cast<int>(strlen(xml)),true)==parser::status_t::ERROR);
+  REQUIRE(p.errorcode()==parser::error_t::JUNK_AFTER_DOC_ELEMENT);
+  REQUIRE(d.documents.size()==1);
+}
@@ -0,0 +1,143 @@
+/**
+ * \file test_numarray.cpp tests the number array parser
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "numarray.hpp"
+#include "state.hpp"
+#include "xmlparser.hpp"
+
+using xmlpp::conv_error;
+using xmlpp::number_array_parser;
+using xmlpp::parser;
+using xmlpp::State;
+
+namespace {
+
+const char* VALUES = " 1.5 -2\t3e2\n\n 0.25    12345678.875 -0.001\r\n7 ";
+const double EXPECTED[] = {1.5, -2, 300, 0.25, 12345678.875, -0.001, 7};
+
+/** reads the samples of <values> with a number_array_parser */
+struct samples_delegate : public xmlpp::StatefulDelegate {
+  std::vector<double> values;
+  number_array_parser<double> numbers{values};
+  conv_error error{conv_error::NONE};
+
+  State samples{"samples"};
+  State value_state{"values",
+    [this](const XML_Char**) { numbers.reset(); },
+    [this]() { error = numbers.finish(); },
+    numbers.text_handler()};
+
+  samples_delegate()
+  {
+    samples.addState(&value_state);
+    add_state(&samples);
+  }
+};
+
+/** the same with splitting into strings and std::stod */
+struct stod_delegate : public xmlpp::StatefulDelegate {
+  std::vector<double> values;
+  std::string text;
+
+  State samples{"samples"};
+  State value_state{"values",
+    [this](const XML_Char**) { text.clear(); },
+    [this]()
+    {
+      std::istringstream is(text);
+      std::string token;
+      while (is >> token) values.push_back(std::stod(token));
+    },
+    [this](const char* pBuf, int len) { text.append(pBuf,len); }};
+
+  stod_delegate()
+  {
+    samples.addState(&value_state);
+    add_state(&samples);
+  }
+};
+
+std::string make_samples(size_t count)
+{
+  std::string doc("<samples><values>\n");
+  for (size_t i = 0; i < count; ++i) {
+    doc += std::to_string(i % 1000) + "." + std::to_string(i % 97) + ((i % 8)==7 ? "\n" : " ");
+  }
+  return doc + "</values></samples>";
+}
+
+}
+
+TEST_CASE("number array of one fragment")
+{
+  std::vector<double> v;
+  number_array_parser<double> p(v);
+  REQUIRE(p.feed(VALUES,strlen(VALUES)));
+  REQUIRE(p.finish()==conv_error::NONE);
+  REQUIRE(v==std::vector<double>(std::begin(EXPECTED),std::end(EXPECTED)));
+}
+
+TEST_CASE("number array split at every position")
+{
+  const size_t len = strlen(VALUES);
+  for (size_t split = 0; split <= len; ++split) {
+    for (size_t split2 = split; split2 <= len; split2 += 5) {
+      INFO(split << " " << split2);
+      std::vector<double> v;
+      number_array_parser<double> p(v);
+      REQUIRE(p.feed(VALUES,split));
+      REQUIRE(p.feed(VALUES+split,split2-split));
+      REQUIRE(p.feed(VALUES+split2,len-split2));
+      REQUIRE(p.finish()==conv_error::NONE);
+      REQUIRE(v==std::vector<double>(std::begin(EXPECTED),std::end(EXPECTED)));
+    }
+  }
+}
+
+TEST_CASE("number array of single characters")
+{
+  const std::string text = "12 345 6789012345678 -9 0";
+  std::vector<int64_t> v;
+  number_array_parser<int64_t> p(v);
+  for (char c : text) REQUIRE(p.feed(&c,1));
+  REQUIRE(p.finish()==conv_error::NONE);
+  REQUIRE(v==std::vector<int64_t>{12, 345, 6789012345678, -9, 0});
+}
+
+TEST_CASE("number array errors")
+{
+  std::vector<int64_t> v;
+  number_array_parser<int64_t> p(v);
+  const char* BAD = "1 2 3.5 4";
+  REQUIRE_FALSE(p.feed(BAD,strlen(BAD)));
+  REQUIRE(p.finish()==conv_error::INVALID);
+  REQUIRE(p.error_index()==2);
+  REQUIRE(v.size()==2);
+
+  p.reset();
+  v.clear();
+  const char* BIG = "99999999999999999999";
+  REQUIRE(p.feed(BIG,strlen(BIG)));
+  REQUIRE(p.finish()==conv_error::OUT_OF_RANGE);
+  REQUIRE(v.empty());
+}
+
+TEST_CASE("number array with State")
+{
+  const std::string xml = make_samples(1000);
+  samples_delegate d;
+  REQUIRE(parser::parseString(xml.c_str(),d)==parser::result::OK);
+  REQUIRE(d.error==conv_error::NONE);
+  stod_delegate s;
+  REQUIRE(parser::parseString(xml.c_str(),s)==parser::result::OK);
+  REQUIRE(d.values==s.values);
+}
@@ -0,0 +1,213 @@
+/**
+ * \file test_numconv.cpp tests the numeric conversions and the typed
+ * attribute accessors
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <clocale>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "xmlparser.hpp"
+
+using xmlpp::Attr;
+using xmlpp::conv_error;
+using xmlpp::parser;
+
+namespace {
+
+template<typename T>
+conv_error conv(const char* s, T& value)
+{
+  return xmlpp::convert(s, s + strlen(s), value);
+}
+
+/** sums the numeric attributes of all elements */
+struct sum_delegate : public xmlpp::abstract_delegate {
+  bool typed{true};
+  int64_t ints{0};
+  double doubles{0};
+
+  void onStartElement(const XML_Char *, const XML_Char **atts) override
+  {
+    Attr a(atts);
+    static const char* INTS[] = {"id","ts","a","b","c","d"};
+    static const char* DOUBLES[] = {"lat","lon","x","y","z","w"};
+    if (typed) {
+      for (const char* k : INTS) ints += a.get_or<int64_t>(k,0);
+      for (const char* k : DOUBLES) doubles += a.get_or(k,0.0);
+    } else {
+      for (const char* k : INTS) {
+        const std::string v = a.getValue(k);
+        if (!v.empty()) ints += std::stoll(v);
+      }
+      for (const char* k : DOUBLES) {
+        const std::string v = a.getValue(k);
+        if (!v.empty()) doubles += std::stod(v);
+      }
+    }
+  }
+};
+
+std::string make_feed(size_t elements)
+{
+  std::string doc("<feed>");
+  for (size_t i = 0; i < elements; ++i) {
+    const std::string n = std::to_string(i);
+    doc += "<p id='" + n + "' ts='1700000000" + n + "' a='-12' b='345' c='7' d='99999'"
+           " lat='48.1372" + n + "' lon='11.5756' x='-0.5' y='1e3' z='3.25' w='100'/>";
+  }
+  return doc + "</feed>";
+}
+
+}
+
+TEST_CASE("integer conversion")
+{
+  int64_t i = 7;
+  REQUIRE(conv("42",i)==conv_error::NONE);
+  REQUIRE(i==42);
+  REQUIRE(conv(" -17\n",i)==conv_error::NONE);
+  REQUIRE(i==-17);
+  REQUIRE(conv("+5",i)==conv_error::NONE);
+  REQUIRE(i==5);
+  REQUIRE(conv("9223372036854775807",i)==conv_error::NONE);
+  REQUIRE(i==std::numeric_limits<int64_t>::max());
+  REQUIRE(conv("-9223372036854775808",i)==conv_error::NONE);
+  REQUIRE(i==std::numeric_limits<int64_t>::min());
+  REQUIRE(conv("9223372036854775808",i)==conv_error::OUT_OF_RANGE);
+  REQUIRE(conv("123456789012345678901234567890",i)==conv_error::OUT_OF_RANGE);
+  REQUIRE(conv("123456789012345678901234567890x",i)==conv_error::INVALID);
+  REQUIRE(conv("",i)==conv_error::INVALID);
+  REQUIRE(conv("-",i)==conv_error::INVALID);
+  REQUIRE(conv("1.5",i)==conv_error::INVALID);
+  REQUIRE(conv("1 2",i)==conv_error::INVALID);
+  REQUIRE(i==std::numeric_limits<int64_t>::min());
+
+  int32_t s;
+  REQUIRE(conv("-2147483648",s)==conv_error::NONE);
+  REQUIRE(s==std::numeric_limits<int32_t>::min());
+  REQUIRE(conv("2147483648",s)==conv_error::OUT_OF_RANGE);
+
+  uint32_t u;
+  REQUIRE(conv("4294967295",u)==conv_error::NONE);
+  REQUIRE(u==4294967295u);
+  REQUIRE(conv("-1",u)==conv_error::OUT_OF_RANGE);
+  REQUIRE(conv("-0",u)==conv_error::NONE);
+  uint64_t ul;
+  REQUIRE(conv("18446744073709551615",ul)==conv_error::NONE);
+  REQUIRE(ul==UINT64_MAX);
+  REQUIRE(conv("18446744073709551616",ul)==conv_error::OUT_OF_RANGE);
+}
+
+TEST_CASE("floating point conversion")
+{
+  double d = 0;
+  const char* EXACT[] = {
+    "0", "1", "-1", "3.25", "0.1", ".5", "5.", "1e3", "1E-3", "-12.5e+2",
+    "48.13721", "0.000123", "123456789012345678", "1.7976931348623157e308",
+    "4.9e-324", "2.2250738585072014e-308", "0.30000000000000004",
+    "9007199254740993", "1234567890123456789012345", "1e23"
+  };
+  for (const char* s : EXACT) {
+    INFO(s);
+    REQUIRE(conv(s,d)==conv_error::NONE);
+    REQUIRE(d==strtod(s,nullptr));
+  }
+  REQUIRE(conv(" 2.5 ",d)==conv_error::NONE);
+  REQUIRE(d==2.5);
+  REQUIRE(conv("-0",d)==conv_error::NONE);
+  REQUIRE(std::signbit(d));
+  REQUIRE(conv("INF",d)==conv_error::NONE);
+  REQUIRE(std::isinf(d));
+  REQUIRE(conv("-INF",d)==conv_error::NONE);
+  REQUIRE(d < 0);
+  REQUIRE(conv("NaN",d)==conv_error::NONE);
+  REQUIRE(std::isnan(d));
+
+  d = 1;
+  for (const char* s : {"", ".", "e5", "1e", "1e+", "1.2.3", "0x10", "inf", "nan", "1,5"}) {
+    INFO(s);
+    REQUIRE(conv(s,d)==conv_error::INVALID);
+  }
+  REQUIRE(conv("1e400",d)==conv_error::OUT_OF_RANGE);
+  REQUIRE(d==1);
+}
+
+TEST_CASE("floating point conversion ignores the locale")
+{
+  const char* saved = setlocale(LC_NUMERIC, nullptr);
+  const std::string restore = saved ? saved : "C";
+  const char* comma = nullptr;
+  for (const char* l : {"de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "German"}) {
+    if (setlocale(LC_NUMERIC, l)) {
+      comma = l;
+      break;
+    }
+  }
+  if (comma==nullptr) WARN("no locale with decimal comma installed");
+  double d = 0;
+  // beyond the fast path, converted by strtod
+  REQUIRE(conv("1.5e100",d)==conv_error::NONE);
+  REQUIRE(d==1.5e100);
+  REQUIRE(conv("0.12345678901234567890123",d)==conv_error::NONE);
+  REQUIRE(d > 0.1234);
+  REQUIRE(d < 0.1235);
+  REQUIRE(conv("1,5e100",d)==conv_error::INVALID);
+  setlocale(LC_NUMERIC, restore.c_str());
+}
+
+TEST_CASE("boolean conversion")
+{
+  bool b = false;
+  REQUIRE(conv("true",b)==conv_error::NONE);
+  REQUIRE(b);
+  REQUIRE(conv(" 0 ",b)==conv_error::NONE);
+  REQUIRE_FALSE(b);
+  REQUIRE(conv("1",b)==conv_error::NONE);
+  REQUIRE(b);
+  REQUIRE(conv("false",b)==conv_error::NONE);
+  REQUIRE_FALSE(b);
+  REQUIRE(conv("TRUE",b)==conv_error::INVALID);
+  REQUIRE(conv("yes",b)==conv_error::INVALID);
+}
+
+TEST_CASE("typed attribute accessors")
+{
+  const XML_Char* atts[] = {"id","123","lat","48.5","ok","true","bad","1x",nullptr};
+  Attr a(atts);
+
+  int64_t id = 0;
+  REQUIRE(a.get("id",id)==conv_error::NONE);
+  REQUIRE(id==123);
+  double lat = 0;
+  REQUIRE(a.get<double>("lat",lat)==conv_error::NONE);
+  REQUIRE(lat==48.5);
+  bool ok = false;
+  REQUIRE(a.get("ok",ok)==conv_error::NONE);
+  REQUIRE(ok);
+  REQUIRE(a.get("missing",id)==conv_error::MISSING);
+  REQUIRE(a.get("bad",id)==conv_error::INVALID);
+  REQUIRE(id==123);
+
+  REQUIRE(a.get_or<int64_t>("id",-1)==123);
+  REQUIRE(a.get_or<int64_t>("bad",-1)==-1);
+  REQUIRE(a.get_or("missing",2.5)==2.5);
+  REQUIRE(a.get_or("ok",false));
+}
+
+TEST_CASE("typed attributes while parsing")
+{
+  const std::string xml = make_feed(10);
+  sum_delegate typed;
+  REQUIRE(parser::parseString(xml.c_str(),typed)==parser::result::OK);
+  sum_delegate strings;
+  strings.typed = false;
+  REQUIRE(parser::parseString(xml.c_str(),strings)==parser::result::OK);
+  REQUIRE(typed.ints==strings.ints);
+  REQUIRE(std::fabs(typed.doubles - strings.doubles) <= 1e-9*std::fabs(strings.doubles));
+}
@@ -0,0 +1,196 @@
+/**
+ * \file test_parser_limits.cpp tests the limits of documents
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include "expatpp_config.h"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+
+#include "pipeline.hpp"
+#include "xmlparser.hpp"
+
+using xmlpp::parser;
+
+namespace {
+
+/** counts the elements and records the parse error */
+struct error_delegate : public xmlpp::abstract_delegate {
+  int elements{0};
+  int errors{0};
+  XML_Error error{XML_ERROR_NONE};
+  std::string text;
+
+  void onStartElement(const XML_Char *, const XML_Char **) override { ++elements; }
+  void onParseError(size_t, size_t, size_t, xmlpp::Error e) override
+  {
+    ++errors;
+    error = e.errorcode();
+    text = e.to_string();
+  }
+};
+
+/** @return the error of parsing xml with the limits */
+parser::error_t parse_with(const std::string& xml, const parser::limits& limits,
+                           error_delegate& d)
+{
+  const parser::result r = parser::parseString(xml.c_str(), d, nullptr, &limits);
+  REQUIRE((r==parser::OK)==(d.errors==0));
+  return static_cast<parser::error_t>(d.error);
+}
+
+std::string nested(int depth)
+{
+  std::string xml;
+  for (int i = 0; i < depth; ++i) xml += "<a>";
+  for (int i = 0; i < depth; ++i) xml += "</a>";
+  return xml;
+}
+
+}
+
+TEST_CASE("documents within the limits parse")
+{
+  parser::limits limits;
+  limits.time = std::chrono::seconds(10);
+  limits.bytes = 1000;
+  limits.depth = 3;
+  limits.attributes = 2;
+  limits.text_bytes = 5;
+  error_delegate d;
+  REQUIRE(parse_with("<a x='1' y='2'><b><c>12345</c>12345</b></a>", limits, d)==parser::error_t::NONE);
+  REQUIRE(d.elements==3);
+}
+
+TEST_CASE("limit violations are parse errors with their own codes")
+{
+  parser::limits limits;
+  SECTION("depth") {
+    limits.depth = 3;
+    error_delegate d;
+    REQUIRE(parse_with(nested(4), limits, d)==parser::error_t::TOO_DEEP);
+    REQUIRE(d.elements==3);
+    REQUIRE(d.text=="elements nested deeper than the limit");
+  }
+  SECTION("attributes") {
+    limits.attributes = 2;
+    error_delegate d;
+    REQUIRE(parse_with("<a><b x='1' y='2' z='3'/></a>", limits, d)==parser::error_t::TOO_MANY_ATTRIBUTES);
+    REQUIRE(d.elements==1);
+  }
+  SECTION("text") {
+    limits.text_bytes = 10;
+    error_delegate d;
+    REQUIRE(parse_with("<a>12345<b/>12345&amp;67890</a>", limits, d)==parser::error_t::TEXT_TOO_LONG);
+  }
+  SECTION("bytes") {
+    limits.bytes = 100;
+    error_delegate d;
+    REQUIRE(parse_with(nested(20), limits, d)==parser::error_t::TOO_MANY_BYTES);
+    REQUIRE(d.elements==0);
+  }
+  SECTION("time") {
+    limits.time = std::chrono::nanoseconds(1);
+    error_delegate d;
+    REQUIRE(parse_with(nested(3000), limits, d)==parser::error_t::DEADLINE_EXCEEDED);
+    REQUIRE(d.elements < 3000);
+  }
+}
+
+TEST_CASE("the byte limit of chunks rejects before parsing beyond")
+{
+  parser::limits limits;
+  limits.bytes = 10;
+  error_delegate d;
+  parser p(d);
+  REQUIRE(p.set_limits(limits));
+  REQUIRE(p.parse("<a><b/>", 7, false)==parser::status_t::OK);
+  REQUIRE(p.parse("<b/></a>", 8, true)==parser::status_t::ERROR);
+  REQUIRE(p.errorcode()==parser::error_t::TOO_MANY_BYTES);
+  REQUIRE(d.elements==2);
+  REQUIRE(p.parse("</a>", 4, true)==parser::status_t::ERROR);
+}
+
+TEST_CASE("limits hold for each document of a stream")
+{
+  parser::limits limits;
+  limits.bytes = 12;
+  limits.depth = 2;
+  error_delegate d;
+  parser p(d);
+  p.set_multi_document(true);
+  p.set_limits(limits);
+  const std::string stream = "<a><b/></a> <a><b/></a>\n<a>1234567890</a>";
+  REQUIRE(p.parse(stream.data(), static_cast<int>(stream.size()), true)==parser::status_t::ERROR);
+  REQUIRE(p.errorcode()==parser::error_t::TOO_MANY_BYTES);
+  REQUIRE(p.stats().documents==2);
+  REQUIRE(d.elements==5);
+
+  error_delegate deep;
+  parser q(deep);
+  q.set_multi_document(true);
+  q.set_limits(limits);
+  const std::string nesting = "<a><b/></a><a><b><c/></b></a>";
+  REQUIRE(q.parse(nesting.data(), static_cast<int>(nesting.size()), true)==parser::status_t::ERROR);
+  REQUIRE(q.errorcode()==parser::error_t::TOO_DEEP);
+  REQUIRE(q.stats().documents==1);
+}
+
+TEST_CASE("pipelined parses apply the limits")
+{
+  const std::string xml = nested(100);
+  size_t offset = 0;
+  const xmlpp::read_function read = [&xml, &offset](char* buffer, size_t size) -> long {
+    const size_t n = std::min(size, xml.size() - offset);
+    memcpy(buffer, xml.data() + offset, n);
+    offset += n;
+    return static_cast<long>(n);
+  };
+  xmlpp::pipeline_options options;
+  options.limits.depth = 50;
+  error_delegate d;
+  REQUIRE(xmlpp::parse_pipelined(read, d, options)==parser::PARSE_ERROR);
+  REQUIRE(static_cast<parser::error_t>(d.error)==parser::error_t::TOO_DEEP);
+  REQUIRE(d.elements==50);
+
+  offset = 0;
+  error_delegate ahead;
+  REQUIRE(xmlpp::parse_read_ahead(read, ahead, options)==parser::PARSE_ERROR);
+  REQUIRE(static_cast<parser::error_t>(ahead.error)==parser::error_t::TOO_DEEP);
+}
+
+#if defined(XML_DTD)
+TEST_CASE("the amplification limits of expat survive resets")
+{
+  const std::string laughs =
+    "<!DOCTYPE a [<!ENTITY l0 'lol'>"
+    "<!ENTITY l1 '&l0;&l0;&l0;&l0;&l0;&l0;&l0;&l0;&l0;&l0;'>"
+    "<!ENTITY l2 '&l1;&l1;&l1;&l1;&l1;&l1;&l1;&l1;&l1;&l1;'>"
+    "<!ENTITY l3 '&l2;&l2;&l2;&l2;&l2;&l2;&l2;&l2;&l2;&l2;'>]>"
+    "<a>&l3;</a>";
+  parser::limits limits;
+  limits.amplification = 2.0f;
+  limits.amplification_threshold = 1000;
+  error_delegate plain;
+  REQUIRE(parse_with(laughs, parser::limits(), plain)==parser::error_t::NONE);
+
+  error_delegate d;
+  REQUIRE(parse_with(laughs, limits, d)==parser::error_t::AMPLIFICATION_LIMIT_BREACH);
+
+  const std::string stream = "<a/>" + laughs;
+  error_delegate s;
+  parser p(s);
+  p.set_multi_document(true);
+  REQUIRE(p.set_limits(limits));
+  REQUIRE(p.parse(stream.data(), static_cast<int>(stream.size()), true)==parser::status_t::ERROR);
+  REQUIRE(p.errorcode()==parser::error_t::AMPLIFICATION_LIMIT_BREACH);
+  REQUIRE(p.stats().documents==1);
+
+  limits.amplification = 0.5f;
+  REQUIRE_FALSE(p.set_limits(limits));
+}
+#endif
@@ -0,0 +1,103 @@
+/**
+ * \file test_parser_stats.cpp tests the statistics collected by the parser
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include "xmlparser.hpp"
+
+using xmlpp::parser;
+
+namespace {
+
+struct null_delegate : public xmlpp::abstract_delegate {};
+
+double value_of(const parser::statistics& s, const char* key)
+{
+  for (const auto& kv : s.key_values()) {
+    if (strcmp(kv.first,key)==0) return kv.second;
+  }
+  return -1;
+}
+
+}
+
+TEST_CASE("parser statistics count the document")
+{
+  const char* xml =
+    "<?xml version='1.0'?>\n"
+    "<a x='1' y='2'><b><c z='3'>text</c></b><b/>tail</a>";
+  null_delegate d;
+  parser p(d);
+  REQUIRE(p.parse(xml,static_cast<int>(strlen(xml)),true)==parser::status_t::OK);
+
+  const parser::statistics& s = p.stats();
+  REQUIRE(s.bytes==strlen(xml));
+  REQUIRE(s.elements==4);
+  REQUIRE(s.attributes==3);
+  REQUIRE(s.max_depth==3);
+  REQUIRE(s.depth==0);
+  REQUIRE(s.text_events==2);
+  REQUIRE(s.text_bytes==8);
+  REQUIRE(s.entity_amplification()==1.0);
+
+  REQUIRE(s.allocations > 0);
+  REQUIRE(s.peak_memory >= s.memory);
+  REQUIRE(s.memory > 0);
+
+  REQUIRE(value_of(s,"elements")==4);
+  REQUIRE(value_of(s,"max_depth")==3);
+  REQUIRE(value_of(s,"peak_memory")==static_cast<double>(s.peak_memory));
+  REQUIRE(value_of(s,"entity_amplification")==1.0);
+}
+
+TEST_CASE("parser statistics accumulate over fragments")
+{
+  const std::string xml = "<r><e>0123456789</e><e>0123456789</e></r>";
+  null_delegate d;
+  parser p(d);
+  for (size_t i = 0; i < xml.size(); i += 5) {
+    const size_t n = std::min<size_t>(5, xml.size() - i);
+    REQUIRE(p.parse(xml.data() + i,static_cast<int>(n),false)==parser::status_t::OK);
+  }
+  REQUIRE(p.parse(nullptr,0,true)==parser::status_t::OK);
+  REQUIRE(p.stats().bytes==xml.size());
+  REQUIRE(p.stats().elements==3);
+  REQUIRE(p.stats().text_bytes==20);
+  REQUIRE(p.stats().text_events > 2);
+  REQUIRE(p.stats().entity_amplification()==1.0);
+}
+
+TEST_CASE("parser statistics measure entity amplification")
+{
+  const char* xml =
+    "<!DOCTYPE r [<!ENTITY a '0123456789'>"
+    "<!ENTITY b '&a;&a;&a;&a;&a;&a;&a;&a;&a;&a;'>]>"
+    "<r>&b;&b;&amp;</r>";
+  null_delegate d;
+  parser::statistics s;
+  REQUIRE(parser::parseString(xml,d,&s)==parser::result::OK);
+  REQUIRE(s.text_bytes==201);
+  REQUIRE(s.entity_text_bytes==194);
+  // 200 bytes from 6 bytes of references, &amp; does not amplify
+  const double expected = (strlen(xml) + 200.0 - 6.0) / strlen(xml);
+  REQUIRE(std::fabs(s.entity_amplification() - expected) < 1e-12);
+  REQUIRE(s.entity_amplification() > 2.0);
+}
+
+TEST_CASE("parser statistics of parseString")
+{
+  null_delegate d;
+  parser::statistics s;
+  REQUIRE(parser::parseString("<a><b/></a>",d,&s)==parser::result::OK);
+  REQUIRE(s.elements==2);
+  REQUIRE(s.bytes==11);
+  REQUIRE(parser::parseString("<a><b></a>",d,&s)==parser::result::PARSE_ERROR);
+  REQUIRE(s.elements==2);
+}
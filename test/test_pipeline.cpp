@@ -0,0 +1,267 @@
+/**
+ * \file test_pipeline.cpp tests the event encoding, the spsc queue and the
+ * pipelined parse
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "event_buffer.hpp"
+#include "pipeline.hpp"
+#include "spsc_queue.hpp"
+
+using xmlpp::event_buffer;
+using xmlpp::parser;
+using xmlpp::pipeline_options;
+
+namespace {
+
+std::string str(const char* s) { return s ? s : "(null)"; }
+
+/** records all events as text, adjacent character data is merged */
+struct text_delegate : public xmlpp::delegate {
+  std::string log;
+  bool in_text{false};
+
+  void add(const std::string& s) { in_text = false; log += s + "\n"; }
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **atts) override
+  {
+    std::string s = "start " + str(fullname);
+    for (; *atts; atts += 2) s += " " + str(atts[0]) + "=" + str(atts[1]);
+    add(s);
+  }
+  void onEndElement(const XML_Char *fullname) override { add("end " + str(fullname)); }
+  void onCharacterData(const char *pBuf, int len) override
+  {
+    if (!in_text) log += "text ";
+    log.append(pBuf,static_cast<size_t>(len));
+    in_text = true;
+  }
+  void onComment(const XML_Char *data) override { add("comment " + str(data)); }
+  void onStartCdataSection() override { add("cdata"); }
+  void onEndCdataSection() override { add("/cdata"); }
+  void onXmlDecl(const XML_Char *version, const XML_Char *encoding, int standalone) override
+  {
+    add("xmldecl " + str(version) + " " + str(encoding) + " " + std::to_string(standalone));
+  }
+  void onParseError(size_t line, size_t column, size_t pos, xmlpp::Error error) override
+  {
+    add("error " + std::to_string(line) + ":" + std::to_string(column) + " "
+        + std::to_string(pos) + " " + error.to_string());
+  }
+  void onProcessingInstruction(const XML_Char* target, const XML_Char* data) override
+  {
+    add("pi " + str(target) + " " + str(data));
+  }
+  void onStartNamespace(const XML_Char* prefix, const XML_Char* uri) override
+  {
+    add("ns " + str(prefix) + " " + str(uri));
+  }
+  void onEndNamespace(const XML_Char* prefix) override { add("/ns " + str(prefix)); }
+  void onStartDoctypeDecl(const XML_Char *name, const XML_Char *sysid,
+                          const XML_Char *pubid, int has_internal_subset) override
+  {
+    add("doctype " + str(name) + " " + str(sysid) + " " + str(pubid) + " "
+        + std::to_string(has_internal_subset));
+  }
+  void onEndDoctypeDecl() override { add("/doctype"); }
+  void onElementDecl(const XML_Char *name, XML_Content *model) override
+  {
+    add("elementdecl " + str(name) + " " + describe(model));
+  }
+  void onAttlistDecl(const XML_Char *elname, const XML_Char *attname,
+                     const XML_Char *att_type, const XML_Char *dflt,
+                     bool isrequired) override
+  {
+    add("attlist " + str(elname) + " " + str(attname) + " " + str(att_type) + " "
+        + str(dflt) + " " + std::to_string(isrequired));
+  }
+  void onEntityDecl(const XML_Char *name, int is_parameter_entity,
+                    const XML_Char *value, int value_length, const XML_Char *base,
+                    const XML_Char *systemId, const XML_Char *publicId,
+                    const XML_Char *notationName) override
+  {
+    add("entity " + str(name) + " " + std::to_string(is_parameter_entity) + " "
+        + (value ? std::string(value,static_cast<size_t>(value_length)) : "(null)") + " "
+        + str(base) + " " + str(systemId) + " " + str(publicId) + " " + str(notationName));
+  }
+  void onNotationDecl(const XML_Char* name, const XML_Char* base,
+                      const XML_Char* systemId, const XML_Char* publicId) override
+  {
+    add("notation " + str(name) + " " + str(base) + " " + str(systemId) + " " + str(publicId));
+  }
+  void onUnparsedEntityDecl(const XML_Char* name, const XML_Char* base,
+                            const XML_Char* systemId, const XML_Char* publicId,
+                            const XML_Char* notationName) override
+  {
+    add("unparsed " + str(name) + " " + str(base) + " " + str(systemId) + " "
+        + str(publicId) + " " + str(notationName));
+  }
+  void onSkippedEntity(const XML_Char *name, int is_parameter_entity) override
+  {
+    add("skipped " + str(name) + " " + std::to_string(is_parameter_entity));
+  }
+  void onEndDocument(size_t index) override { add("enddocument " + std::to_string(index)); }
+
+  static std::string describe(const XML_Content* c)
+  {
+    std::string s = "(" + std::to_string(c->type) + "," + std::to_string(c->quant) + ","
+                    + str(c->name);
+    for (unsigned i = 0; i < c->numchildren; ++i) s += " " + describe(&c->children[i]);
+    return s + ")";
+  }
+};
+
+const char* DOCUMENT =
+  "<?xml version='1.0' encoding='UTF-8' standalone='yes'?>\n"
+  "<!DOCTYPE doc [\n"
+  "  <!ELEMENT doc (a|b)*>\n"
+  "  <!ELEMENT a (#PCDATA|b)*>\n"
+  "  <!ELEMENT b EMPTY>\n"
+  "  <!ATTLIST a id CDATA #REQUIRED kind (x|y) 'x'>\n"
+  "  <!ENTITY e 'entity text'>\n"
+  "  <!NOTATION gif SYSTEM 'image/gif'>\n"
+  "  <!ENTITY pic SYSTEM 'pic.gif' NDATA gif>\n"
+  "]>\n"
+  "<doc xmlns:n='urn:n'><?target data?><!-- comment -->"
+  "<a id='1'>text &e; &amp; more<![CDATA[<raw>]]></a><b/><n:c n:x='1'/></doc>";
+
+std::string expected_events(const char* xml)
+{
+  text_delegate d;
+  parser p(d);
+  if (p.parse(xml,static_cast<int>(strlen(xml)),true)==parser::status_t::ERROR) {
+    d.onParseError(p.current_line_number(), p.current_column_number(),
+                   p.current_byte_index(), xmlpp::Error(static_cast<XML_Error>(p.errorcode())));
+  }
+  return d.log;
+}
+
+std::string write_file(const std::string& content)
+{
+  const std::string name = "test_pipeline.xml";
+  FILE* f = fopen(name.c_str(), "wb");
+  REQUIRE(f!=nullptr);
+  REQUIRE(fwrite(content.data(),1,content.size(),f)==content.size());
+  fclose(f);
+  return name;
+}
+
+}
+
+TEST_CASE("event_buffer replays all events")
+{
+  event_buffer events;
+  parser p(events);
+  REQUIRE(p.parse(DOCUMENT,static_cast<int>(strlen(DOCUMENT)),true)==parser::status_t::OK);
+  events.onEndDocument(7);
+  REQUIRE(events.events() > 20);
+
+  text_delegate replayed;
+  events.replay(replayed);
+  REQUIRE(replayed.log==expected_events(DOCUMENT) + "enddocument 7\n");
+  REQUIRE(replayed.log.find("elementdecl doc (5,2,(null) (4,0,a) (4,0,b))")!=std::string::npos);
+  REQUIRE(replayed.log.find("entity e 0 entity text")!=std::string::npos);
+
+  // replaying twice gives the same events
+  text_delegate again;
+  events.replay(again);
+  REQUIRE(again.log==replayed.log);
+
+  events.clear();
+  REQUIRE(events.empty());
+  REQUIRE(events.events()==0);
+}
+
+TEST_CASE("spsc_queue passes values between two threads in order")
+{
+  xmlpp::spsc_queue<size_t> q(5);
+  REQUIRE(q.capacity()==8);
+  const size_t COUNT = 100000;
+  std::thread producer([&]() {
+    for (size_t i = 1; i <= COUNT; ++i) q.push(i);
+  });
+  size_t expected = 1;
+  size_t value = 0;
+  while (expected <= COUNT) {
+    REQUIRE(q.pop(value));
+    REQUIRE(value==expected);
+    ++expected;
+  }
+  producer.join();
+  REQUIRE_FALSE(q.try_pop(value));
+
+  std::atomic<bool> stop{true};
+  REQUIRE_FALSE(q.pop(value, &stop));
+}
+
+TEST_CASE("pipelined parse delivers the events of parseFile")
+{
+  std::string doc("<list>");
+  for (int i = 0; i < 5000; ++i) {
+    doc += "<item n='" + std::to_string(i) + "'>value " + std::to_string(i) + "&amp;<e/></item>\n";
+  }
+  doc += "</list>";
+  const std::string file = write_file(doc);
+  const std::string expected = expected_events(doc.c_str());
+
+  pipeline_options small;
+  small.read_size = 100;
+  small.read_buffers = 2;
+  small.parse_slice = 7;
+  small.event_buffers = 2;
+  pipeline_options no_deferral = small;
+  no_deferral.reparse_deferral = false;
+  for (const pipeline_options& o : {pipeline_options(), small, no_deferral}) {
+    text_delegate d;
+    parser::statistics stats;
+    REQUIRE(xmlpp::parse_file_pipelined(file, d, o, &stats)==parser::OK);
+    REQUIRE(d.log==expected);
+    REQUIRE(stats.bytes==doc.size());
+    REQUIRE(stats.elements==10001);
+    REQUIRE(stats.documents==1);
+
+    text_delegate ahead;
+    REQUIRE(xmlpp::parse_file_read_ahead(file, ahead, o)==parser::OK);
+    REQUIRE(ahead.log==expected);
+  }
+  remove(file.c_str());
+}
+
+TEST_CASE("pipelined parse reports errors")
+{
+  SECTION("parse error") {
+    std::string doc("<list>");
+    for (int i = 0; i < 1000; ++i) doc += "<item/>";
+    doc += "</wrong>";
+    const std::string file = write_file(doc);
+    pipeline_options o;
+    o.read_size = 64;
+    text_delegate d;
+    REQUIRE(xmlpp::parse_file_pipelined(file, d, o)==parser::PARSE_ERROR);
+    REQUIRE(d.log==expected_events(doc.c_str()));
+    REQUIRE(d.log.find("error 1:")!=std::string::npos);
+    remove(file.c_str());
+  }
+  SECTION("read error") {
+    int calls = 0;
+    text_delegate d;
+    const parser::result r = xmlpp::parse_pipelined([&calls](char* buffer, size_t) -> long {
+        if (++calls > 1) return -1;
+        memcpy(buffer, "<a><b/>", 7);
+        return 7;
+      }, d);
+    REQUIRE(r==parser::READ_ERROR);
+    REQUIRE(d.log=="start a\nstart b\nend b\n");
+  }
+  SECTION("missing file") {
+    text_delegate d;
+    REQUIRE(xmlpp::parse_file_pipelined("does/not/exist.xml", d)==parser::ERROR_OPEN_FILE);
+  }
+}
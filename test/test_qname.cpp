@@ -0,0 +1,116 @@
+/**
+ * \file test_qname.cpp tests the split namespace qualified names
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <cstring>
+#include <string>
+
+#include "qname.hpp"
+#include "xmlparser.hpp"
+
+using xmlpp::parser;
+using xmlpp::qname;
+using xmlpp::qname_delegate;
+
+namespace {
+
+/** logs the names as {uri}prefix:local */
+struct log_delegate : public qname_delegate {
+  std::string log;
+
+  std::string format(const qname& n)
+  {
+    std::string s;
+    if (n.uri!=NO_NAMESPACE) s += "{" + uri(n.uri).str() + "}";
+    if (!n.prefix.empty()) s += n.prefix.str() + ":";
+    return s + n.local.str();
+  }
+  void onStartElementNs(const qname& name, const xmlpp::qattribute* atts,
+                        size_t count) override
+  {
+    log += "<" + format(name);
+    for (size_t i = 0; i < count; ++i) log += " " + format(atts[i].name) + "=" + atts[i].value;
+    log += ">";
+  }
+  void onEndElementNs(const qname& name) override
+  {
+    log += "</" + format(name) + ">";
+  }
+};
+
+std::string parsed(log_delegate& d, const char* xml)
+{
+  parser p(d, parser::TRIPLET_SEPARATOR);
+  p.set_namespace_triplets(true);
+  REQUIRE(p.namespace_triplets());
+  REQUIRE(p.parse(xml, static_cast<int>(strlen(xml)), true)==parser::status_t::OK);
+  return d.log;
+}
+
+}
+
+TEST_CASE("qualified names arrive split into uri, prefix and local name")
+{
+  log_delegate d;
+  const char* xml =
+    "<HDcomment xmlns='http://www.asam.net/mdf/v4' xmlns:x='urn:x:y'>"
+    "<x:TX x:a='1' b='2' xml:lang='en'/>"
+    "<e xmlns=''><x:f/></e>"
+    "<x:x/><x/>"
+    "</HDcomment>";
+  REQUIRE(parsed(d, xml)==
+          "<{http://www.asam.net/mdf/v4}HDcomment>"
+          "<{urn:x:y}x:TX {urn:x:y}x:a=1 b=2 {http://www.w3.org/XML/1998/namespace}xml:lang=en>"
+          "</{urn:x:y}x:TX>"
+          "<e><{urn:x:y}x:f></{urn:x:y}x:f></e>"
+          "<{urn:x:y}x:x></{urn:x:y}x:x>"
+          "<{http://www.asam.net/mdf/v4}x></{http://www.asam.net/mdf/v4}x>"
+          "</{http://www.asam.net/mdf/v4}HDcomment>");
+}
+
+TEST_CASE("namespace uris are interned once")
+{
+  log_delegate d;
+  const uint32_t mdf = d.intern_uri(xmlpp::string_ref("http://www.asam.net/mdf/v4", 26));
+  const size_t uris = d.uris();
+  parsed(d, "<a xmlns='http://www.asam.net/mdf/v4'><b xmlns='http://www.asam.net/mdf/v4'/>"
+            "<p:c xmlns:p='urn:p'/><p:d xmlns:p='urn:p'/></a>");
+  REQUIRE(d.uris()==uris + 1);
+  REQUIRE(d.find_uri(xmlpp::string_ref("http://www.asam.net/mdf/v4", 26))==mdf);
+  REQUIRE(d.find_uri(xmlpp::string_ref("urn:p", 5))==mdf + 1);
+  REQUIRE(d.find_uri(xmlpp::string_ref("urn:q", 5))==qname_delegate::NO_NAMESPACE);
+
+  d.clear_uris();
+  REQUIRE(d.find_uri(xmlpp::string_ref("urn:p", 5))==qname_delegate::NO_NAMESPACE);
+  REQUIRE(d.uri(qname_delegate::NO_NAMESPACE).empty());
+}
+
+TEST_CASE("names of prefixes rebound in nested elements")
+{
+  log_delegate d;
+  REQUIRE(parsed(d, "<p:a xmlns:p='urn:1'><p:b xmlns:p='urn:22'/><p:c/></p:a>")==
+          "<{urn:1}p:a><{urn:22}p:b></{urn:22}p:b><{urn:1}p:c></{urn:1}p:c></{urn:1}p:a>");
+}
+
+TEST_CASE("triplets are kept for the documents of a stream")
+{
+  log_delegate d;
+  parser p(d, parser::TRIPLET_SEPARATOR);
+  p.set_namespace_triplets(true);
+  p.set_multi_document(true);
+  const std::string stream = "<p:a xmlns:p='urn:a'/><p:b xmlns:p='urn:b'/>";
+  REQUIRE(p.parse(stream.data(), static_cast<int>(stream.size()), true)==parser::status_t::OK);
+  REQUIRE(d.log=="<{urn:a}p:a></{urn:a}p:a><{urn:b}p:b></{urn:b}p:b>");
+}
+
+TEST_CASE("names without triplets are split at the separator")
+{
+  log_delegate d;
+  parser p(d, parser::TRIPLET_SEPARATOR);
+  const char* xml = "<p:a xmlns:p='urn:a'><b xmlns='urn:b'/></p:a>";
+  REQUIRE(p.parse(xml, static_cast<int>(strlen(xml)), true)==parser::status_t::OK);
+  REQUIRE(d.log=="<{urn:a}a><{urn:b}b></{urn:b}b></{urn:a}a>");
+}
@@ -0,0 +1,67 @@
+/**
+ * \file test_reparse_deferral.cpp tests switching the reparse deferral of
+ * expat
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <string>
+
+#include "xmlparser.hpp"
+
+using xmlpp::parser;
+
+namespace {
+
+struct element_counter : public xmlpp::abstract_delegate {
+  int elements{0};
+  void onStartElement(const XML_Char *, const XML_Char **) override { ++elements; }
+};
+
+/** feeds a large start tag, then its last bytes, expat tries to parse a
+ * token again once it failed to complete it
+ * @return elements started after the last bytes */
+int elements_after_tail(parser& p, element_counter& d)
+{
+  REQUIRE(p.parse("<r>", 3, false)==parser::status_t::OK);
+  const std::string head = "<b x='" + std::string(4000, 'x');
+  REQUIRE(p.parse(head.data(), static_cast<int>(head.size()), false)==parser::status_t::OK);
+  REQUIRE(p.parse("'/>", 3, false)==parser::status_t::OK);
+  const int elements = d.elements;
+  REQUIRE(p.parse("</r>", 4, true)==parser::status_t::OK);
+  REQUIRE(d.elements==2);
+  return elements;
+}
+
+}
+
+TEST_CASE("without reparse deferral tokens are delivered at once")
+{
+  element_counter d;
+  parser p(d);
+  REQUIRE(p.reparse_deferral());
+  REQUIRE(p.set_reparse_deferral(false)==parser::reparse_deferral_available());
+  REQUIRE_FALSE(p.reparse_deferral());
+  REQUIRE(elements_after_tail(p, d)==2);
+}
+
+TEST_CASE("reparse deferral waits for more input")
+{
+  if (!parser::reparse_deferral_available()) return;
+  element_counter d;
+  parser p(d);
+  REQUIRE(elements_after_tail(p, d)==1);
+}
+
+TEST_CASE("the reparse deferral setting holds for each document of a stream")
+{
+  element_counter d;
+  parser p(d);
+  p.set_multi_document(true);
+  p.set_reparse_deferral(false);
+  REQUIRE(p.parse("<a/>", 4, false)==parser::status_t::OK);
+  REQUIRE(d.elements==1);
+  d.elements = 0;
+  REQUIRE(elements_after_tail(p, d)==2);
+}
@@ -0,0 +1,220 @@
+/**
+ * \file test_suspend.cpp tests suspending the parser from the delegate and
+ * resuming it
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+
+#include "xmlparser.hpp"
+
+using xmlpp::parser;
+
+namespace {
+
+/** pushes the events into a bounded queue, suspends the parser when the
+ * queue is full */
+struct queue_delegate : public xmlpp::abstract_delegate {
+  parser* p{nullptr};
+  size_t capacity{4};
+  size_t max_size{0};
+  size_t suspensions{0};
+  std::deque<std::string> queue;
+  std::string consumed;
+
+  void push(const std::string& event)
+  {
+    queue.push_back(event);
+    if (queue.size() > max_size) max_size = queue.size();
+    if (queue.size() >= capacity && p->suspend()) ++suspensions;
+  }
+  void consume()
+  {
+    for (const std::string& e : queue) consumed += e;
+    queue.clear();
+  }
+
+  void onStartElement(const XML_Char *fullname, const XML_Char **) override
+  {
+    push(std::string("<") + fullname + ">");
+  }
+  void onEndElement(const XML_Char *fullname) override
+  {
+    push(std::string("</") + fullname + ">");
+  }
+  void onCharacterData(const char *pBuf, int len) override
+  {
+    push(std::string(pBuf,static_cast<size_t>(len)));
+  }
+  void onEndDocument(size_t) override { push("|"); }
+};
+
+std::string make_document(size_t count)
+{
+  std::string doc("<list>");
+  for (size_t i = 0; i < count; ++i) {
+    doc += "<item n='" + std::to_string(i) + "'>" + std::to_string(i*i) + "<e/></item>";
+  }
+  return doc + "</list>";
+}
+
+/** parses with a queue of the capacity, consumes the queue at each
+ * suspension */
+std::string parse_with_queue(const std::string& doc, size_t capacity, size_t chunk,
+                             bool multi_document, queue_delegate& d)
+{
+  parser p(d);
+  p.set_multi_document(multi_document);
+  d.p = &p;
+  d.capacity = capacity;
+  for (size_t pos = 0; pos <= doc.size(); pos += chunk) {
+    const size_t len = std::min(chunk, doc.size() - pos);
+    parser::status_t status = p.parse(doc.data() + pos, static_cast<int>(len),
+                                      pos + len==doc.size());
+    while (status==parser::status_t::SUSPENDED) {
+      REQUIRE(p.suspended());
+      d.consume();
+      status = p.resume();
+    }
+    REQUIRE(status==parser::status_t::OK);
+    if (pos + len==doc.size()) break;
+  }
+  d.consume();
+  return d.consumed;
+}
+
+}
+
+TEST_CASE("a bounded queue suspends and resumes the parser")
+{
+  const std::string doc = make_document(200);
+  queue_delegate unbounded;
+  const std::string expected = parse_with_queue(doc, 1000000, doc.size(), false, unbounded);
+  REQUIRE(unbounded.suspensions==0);
+
+  for (size_t chunk : {doc.size(), size_t(1000), size_t(7), size_t(1)}) {
+    INFO(chunk);
+    queue_delegate d;
+    REQUIRE(parse_with_queue(doc, 4, chunk, false, d)==expected);
+    REQUIRE(d.suspensions > 100);
+    // expat may deliver a few events after the suspension, e.g. the end of
+    // an empty element
+    REQUIRE(d.max_size <= 4 + 2);
+  }
+}
+
+TEST_CASE("parse is refused while suspended")
+{
+  queue_delegate d;
+  parser p(d);
+  d.p = &p;
+  d.capacity = 1;
+
+  REQUIRE_FALSE(p.suspend());
+  REQUIRE(p.resume()==parser::status_t::ERROR);
+  REQUIRE(p.errorcode()==parser::error_t::NOT_SUSPENDED);
+
+  const char* first = "<a><b>text</b>";
+  REQUIRE(p.parse(first,static_cast<int>(strlen(first)),false)==parser::status_t::SUSPENDED);
+  REQUIRE(p.errorcode()==parser::error_t::SUSPENDED);
+  REQUIRE(p.parse("</a>",4,true)==parser::status_t::ERROR);
+  REQUIRE(p.parse_buffer(0,true)==parser::status_t::ERROR);
+  REQUIRE(p.suspended());
+
+  // the caller's buffer is not needed for resuming
+  parser::status_t status = parser::status_t::SUSPENDED;
+  while (status==parser::status_t::SUSPENDED) {
+    d.consume();
+    status = p.resume();
+  }
+  REQUIRE(status==parser::status_t::OK);
+  d.capacity = 100;
+  REQUIRE(p.parse("</a>",4,true)==parser::status_t::OK);
+  REQUIRE(p.stats().documents==1);
+  d.consume();
+  REQUIRE(d.consumed=="<a><b>text</b></a>");
+}
+
+TEST_CASE("suspension in a stream of documents")
+{
+  std::string stream;
+  for (int i = 0; i < 50; ++i) {
+    stream += "<m n='" + std::to_string(i) + "'><v>" + std::to_string(i) + "</v></m>\n";
+  }
+  queue_delegate unbounded;
+  const std::string expected = parse_with_queue(stream, 1000000, stream.size(), true, unbounded);
+  REQUIRE(std::count(expected.begin(), expected.end(), '|')==50);
+
+  for (size_t capacity : {size_t(1), size_t(3), size_t(6)}) {
+    for (size_t chunk : {stream.size(), size_t(100), size_t(13), size_t(1)}) {
+      INFO(capacity << " " << chunk);
+      queue_delegate d;
+      REQUIRE(parse_with_queue(stream, capacity, chunk, true, d)==expected);
+      REQUIRE(d.suspensions > 0);
+    }
+  }
+}
+
+TEST_CASE("one document per resume in a stream")
+{
+  /** suspends after each document */
+  struct document_delegate : public xmlpp::abstract_delegate {
+    parser* p{nullptr};
+    size_t documents{0};
+    void onEndDocument(size_t) override
+    {
+      ++documents;
+      REQUIRE(p->suspend());
+    }
+  } d;
+  parser p(d);
+  d.p = &p;
+  p.set_multi_document(true);
+  const char* stream = "<a/><b/> <c>text</c>";
+  REQUIRE(p.parse(stream,static_cast<int>(strlen(stream)),true)==parser::status_t::SUSPENDED);
+  REQUIRE(d.documents==1);
+  REQUIRE(p.resume()==parser::status_t::SUSPENDED);
+  REQUIRE(d.documents==2);
+  REQUIRE(p.resume()==parser::status_t::SUSPENDED);
+  REQUIRE(d.documents==3);
+  REQUIRE(p.resume()==parser::status_t::OK);
+  REQUIRE(p.stats().documents==3);
+  REQUIRE(p.stats().bytes==strlen(stream));
+}
+
+TEST_CASE("parse_file continues after suspensions")
+{
+  const std::string doc = make_document(2000);
+  FILE* f = tmpfile();
+  REQUIRE(f!=nullptr);
+  REQUIRE(fwrite(doc.data(),1,doc.size(),f)==doc.size());
+
+  queue_delegate unbounded;
+  const std::string expected = parse_with_queue(doc, 1000000, doc.size(), false, unbounded);
+
+  for (bool multi_document : {false, true}) {
+    rewind(f);
+    queue_delegate d;
+    parser p(d);
+    p.set_multi_document(multi_document);
+    d.p = &p;
+    d.capacity = 16;
+    parser::status_t status;
+    while ((status = p.parse_file(f, 512))==parser::status_t::SUSPENDED) {
+      d.consume();
+    }
+    REQUIRE(status==parser::status_t::OK);
+    d.consume();
+    REQUIRE(d.consumed==(multi_document ? expected + "|" : expected));
+    REQUIRE(d.max_size <= 16 + 2);
+    REQUIRE(p.stats().documents==1);
+    REQUIRE(p.stats().bytes==doc.size());
+  }
+  fclose(f);
+}
@@ -0,0 +1,337 @@
+/**
+ * \file test_xsdgen.cpp tests the parser generated by xsdgen from
+ * xsd/catalog.xsd and compares it with a hand-written StatefulDelegate
+ *
+ * See LICENSE for copyright information.
+ */
+#include "catch2/catch_all.hpp"
+
+#include <cstring>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "state.hpp"
+#include "catalog.hpp"
+#include "codes.hpp"
+
+using xmlpp::parser;
+using xmlpp::State;
+
+namespace {
+
+const char* SAMPLE =
+  "<catalog version='2'>"
+  "<item id='a1' currency='EUR'>"
+  "<title>XML &amp; C++</title><author>Ann</author><author>Bob</author>"
+  "<price>12.50</price><unknown><title>ignored</title></unknown>"
+  "<language>de-CH</language>"
+  "</item>"
+  "<item id='a2' currency='YEN'><title>Second</title><price>3</price></item>"
+  "</catalog>";
+
+/** hand-written parser for the catalog schema */
+struct catalog_delegate : public xmlpp::StatefulDelegate {
+  struct item {
+    std::string id;
+    std::string currency;
+    std::string title;
+    std::vector<std::string> authors;
+    std::string price;
+  };
+  std::string version;
+  std::vector<item> items;
+  std::string* text{nullptr};
+
+  static std::string value(const XML_Char** atts, const char* key)
+  {
+    const XML_Char* v = parser::xmlGetAttrValue(atts,key);
+    return v ? v : "";
+  }
+
+  State catalog{"catalog",
+    [this](const XML_Char** atts) { version = value(atts,"version"); }};
+  State item_state{"item",
+    [this](const XML_Char** atts)
+    {
+      items.emplace_back();
+      items.back().id = value(atts,"id");
+      items.back().currency = value(atts,"currency");
+    }};
+  State title{"title",
+    [this](const XML_Char**) { text = &items.back().title; },
+    [this]() { text = nullptr; },
+    [this](const char* pBuf, int len) { text->append(pBuf,len); }};
+  State author{"author",
+    [this](const XML_Char**) { items.back().authors.emplace_back(); text = &items.back().authors.back(); },
+    [this]() { text = nullptr; },
+    [this](const char* pBuf, int len) { text->append(pBuf,len); }};
+  State price{"price",
+    [this](const XML_Char**) { text = &items.back().price; },
+    [this]() { text = nullptr; },
+    [this](const char* pBuf, int len) { text->append(pBuf,len); }};
+
+  catalog_delegate()
+  {
+    item_state.addState(&title);
+    item_state.addState(&author);
+    item_state.addState(&price);
+    catalog.addState(&item_state);
+    add_state(&catalog);
+  }
+};
+
+std::string make_catalog(size_t items)
+{
+  std::string doc("<catalog version='1'>");
+  for (size_t i = 0; i < items; ++i) {
+    doc += "<item id='i" + std::to_string(i) + "' currency='USD'>"
+           "<title>Title number " + std::to_string(i) + "</title>"
+           "<author>First Author</author><author>Second Author</author>"
+           "<price>" + std::to_string(i % 100) + ".99</price></item>";
+  }
+  return doc + "</catalog>";
+}
+
+}
+
+TEST_CASE("xsdgen generated parser")
+{
+  catalog::document doc;
+  // the currency of the second item is no enumerator
+  size_t invalid = 0;
+  REQUIRE(catalog::parse(SAMPLE,doc,&invalid)==parser::result::OK);
+  REQUIRE(invalid==1);
+
+  REQUIRE(doc.catalog.version=="2");
+  REQUIRE(doc.catalog.item.size()==2);
+  const auto& i = doc.catalog.item[0];
+  REQUIRE(i.id=="a1");
+  REQUIRE(i.has_currency);
+  REQUIRE(i.currency==catalog::currency_t::EUR);
+  REQUIRE(i.has_language);
+  REQUIRE(i.language==catalog::language_t::de_CH);
+  REQUIRE(i.title=="XML & C++");
+  REQUIRE(i.author.size()==2);
+  REQUIRE(i.author[1]=="Bob");
+  REQUIRE(i.price=="12.50");
+  REQUIRE(doc.catalog.item[1].id=="a2");
+  REQUIRE(doc.catalog.item[1].author.empty());
+  // unknown and missing enumerations are not present
+  REQUIRE_FALSE(doc.catalog.item[1].has_currency);
+  REQUIRE_FALSE(doc.catalog.item[1].has_language);
+
+  REQUIRE(catalog::intern("item",4)==catalog::name_id::item);
+  REQUIRE(catalog::intern("items",5)==catalog::name_id::unknown_);
+  REQUIRE(std::string(catalog::to_string(catalog::currency_t::GBP))=="GBP");
+}
+
+TEST_CASE("xsdgen generated parser reports invalid enumerations")
+{
+  catalog::document doc;
+  size_t invalid = 0;
+  REQUIRE(catalog::parse("<catalog><item id='a' currency='GBP'><title>t</title>"
+                         "<price>1</price><language>xx</language></item></catalog>",doc,&invalid)
+          ==parser::result::OK);
+  REQUIRE(invalid==1);
+  REQUIRE(doc.catalog.item[0].has_currency);
+  REQUIRE(doc.catalog.item[0].currency==catalog::currency_t::GBP);
+  REQUIRE_FALSE(doc.catalog.item[0].has_language);
+
+  catalog::document d;
+  catalog::document_parser p(d);
+  REQUIRE(parser::parseString("<catalog><item currency='YEN'/><item currency=''/></catalog>",p)
+          ==parser::result::OK);
+  REQUIRE(p.invalid_values()==2);
+
+  // a missing input is no invalid value
+  catalog::document none;
+  REQUIRE(catalog::parse(nullptr,none,&invalid)==parser::result::INVALID_INPUT);
+  REQUIRE(invalid==0);
+}
+
+TEST_CASE("xsdgen generated parser matches names with their namespace")
+{
+  const char* xml =
+    "<catalog xmlns:o='urn:other' version='1' o:version='2'>"
+    "<o:item id='foreign'><title>no</title></o:item>"
+    "<item id='local'><title>yes</title><o:title>no</o:title><price>1</price></item>"
+    "</catalog>";
+  catalog::document doc;
+  REQUIRE(catalog::parse(xml,doc)==parser::result::OK);
+  REQUIRE(doc.catalog.version=="1");
+  REQUIRE(doc.catalog.item.size()==1);
+  REQUIRE(doc.catalog.item[0].id=="local");
+  REQUIRE(doc.catalog.item[0].title=="yes");
+
+  // the schema has no target namespace
+  catalog::document other;
+  REQUIRE(catalog::parse("<catalog xmlns='urn:other'><item id='x'/></catalog>",other)
+          ==parser::result::OK);
+  REQUIRE(other.catalog.item.empty());
+}
+
+TEST_CASE("xsdgen generated parser collects long text once")
+{
+  std::string line(60, 'x');
+  line += '\n';
+  std::string title;
+  for (int i = 0; i < 20000; ++i) title += line;
+  const std::string xml = "<catalog><item id='a'><title>" + title
+    + "</title><price>1</price></item></catalog>";
+  catalog::document doc;
+  REQUIRE(catalog::parse(xml.c_str(),doc)==parser::result::OK);
+  REQUIRE(doc.catalog.item[0].title.str()==title);
+  REQUIRE(doc.strings.capacity() < 2*title.size());
+}
+
+TEST_CASE("xsdgen generated serializer")
+{
+  catalog::document doc;
+  REQUIRE(catalog::parse(SAMPLE,doc)==parser::result::OK);
+  // whitespace in attribute values survives the normalization
+  const char* id = "a\t1\nb";
+  doc.catalog.item[1].id = xmlpp::string_ref(id,strlen(id));
+
+  std::ostringstream os;
+  {
+    xmlpp::generator::writer w(os, 16);
+    catalog::serialize(w,doc);
+  }
+  const std::string xml = os.str();
+  REQUIRE(xml.find("<catalog version=\"2\"><item id=\"a1\" currency=\"EUR\">")==0);
+  REQUIRE(xml.find("<title>XML &amp; C++</title>")!=std::string::npos);
+  REQUIRE(xml.find("<unknown>")==std::string::npos);
+  // missing and invalid optional values are not made up
+  REQUIRE(xml.find("<item id=\"a&#9;1&#10;b\"><title>Second</title><price>3</price></item>")
+          !=std::string::npos);
+
+  catalog::document again;
+  REQUIRE(catalog::parse(xml.c_str(),again)==parser::result::OK);
+  REQUIRE(again.catalog.version=="2");
+  REQUIRE(again.catalog.item.size()==2);
+  for (size_t n = 0; n < 2; ++n) {
+    const auto& a = doc.catalog.item[n];
+    const auto& b = again.catalog.item[n];
+    REQUIRE(a.id==b.id);
+    REQUIRE(a.has_currency==b.has_currency);
+    REQUIRE(a.currency==b.currency);
+    REQUIRE(a.title==b.title);
+    REQUIRE(a.author.size()==b.author.size());
+    REQUIRE(a.price==b.price);
+    REQUIRE(a.has_language==b.has_language);
+    REQUIRE(a.language==b.language);
+  }
+}
+
+TEST_CASE("generator writer escapes text and attribute values")
+{
+  {
+    // empty markup into a full buffer
+    std::ostringstream os;
+    xmlpp::generator::writer w(os, 4);
+    w.raw("<ab>",4);
+    w.raw("",0);
+    w.flush();
+    REQUIRE(os.str()=="<ab>");
+  }
+  std::ostringstream os;
+  {
+    xmlpp::generator::writer w(os, 4);
+    w.raw("<a b=\"",6);
+    w.attribute_value("\"<&>\t\n\r",7);
+    w.raw("\">",2);
+    w.text("1 < 2 & \"3\" > 0\t\n",17);
+    w.raw("</a>",4);
+  }
+  REQUIRE(os.str()=="<a b=\"&quot;&lt;&amp;>&#9;&#10;&#13;\">1 &lt; 2 &amp; \"3\" &gt; 0\t\n</a>");
+}
+
+TEST_CASE("xsdgen enumeration lookup")
+{
+  using xmlpp::string_ref;
+
+  SECTION("small enumerations") {
+    catalog::currency_t c;
+    REQUIRE(catalog::from_string(string_ref("CHF",3),c));
+    REQUIRE(c==catalog::currency_t::CHF);
+    REQUIRE_FALSE(catalog::from_string(string_ref("CH",2),c));
+    REQUIRE_FALSE(catalog::from_string(string_ref("CHE",3),c));
+    REQUIRE_FALSE(catalog::from_string(string_ref(),c));
+  }
+
+  SECTION("perfect hashed enumerations") {
+    const catalog::language_t all[] = {
+      catalog::language_t::ar, catalog::language_t::de_AT, catalog::language_t::de_CH,
+      catalog::language_t::en, catalog::language_t::en_US, catalog::language_t::zh
+    };
+    for (auto l : all) {
+      const std::string s = catalog::to_string(l);
+      catalog::language_t r = catalog::language_t::sv;
+      REQUIRE(catalog::from_string(string_ref(s.data(),s.size()),r));
+      REQUIRE(r==l);
+    }
+    catalog::language_t r;
+    for (const char* s : {"", "d", "dd", "de-", "de-DE", "zh-CN", "english"}) {
+      REQUIRE_FALSE(catalog::from_string(string_ref(s,strlen(s)),r));
+    }
+  }
+}
+
+TEST_CASE("xsdgen enumeration lookup with hundreds of random enumerators")
+{
+  using xmlpp::string_ref;
+
+  // xsd/codes.xsd has 600 random enumerators, too many for a single seeded hash
+  const int COUNT = 600;
+  std::set<std::string> values;
+  for (int i = 0; i < COUNT; ++i) {
+    const auto c = static_cast<codes::code_t>(i);
+    const std::string s = codes::to_string(c);
+    REQUIRE_FALSE(s.empty());
+    values.insert(s);
+    codes::code_t r = static_cast<codes::code_t>((i + 1) % COUNT);
+    REQUIRE(codes::from_string(string_ref(s.data(),s.size()),r));
+    REQUIRE(r==c);
+    // prefixes and extensions of the enumerators are no enumerators
+    const std::string longer = s + "x";
+    if (!values.count(longer)) {
+      REQUIRE_FALSE(codes::from_string(string_ref(longer.data(),longer.size()),r));
+    }
+  }
+  REQUIRE(values.size()==COUNT);
+
+  // the top level element is in the target namespace of the schema
+  const std::string last = codes::to_string(static_cast<codes::code_t>(COUNT-1));
+  codes::document doc;
+  std::string xml = "<c:code xmlns:c='urn:codes'>" + last + "</c:code>";
+  REQUIRE(codes::parse(xml.c_str(),doc)==parser::result::OK);
+  REQUIRE(doc.has_code);
+  REQUIRE(doc.code==static_cast<codes::code_t>(COUNT-1));
+
+  for (const char* ns : {"", " xmlns='urn:codes:x'", " xmlns='urn:code'"}) {
+    INFO(ns);
+    codes::document other;
+    xml = std::string("<code") + ns + ">" + last + "</code>";
+    REQUIRE(codes::parse(xml.c_str(),other)==parser::result::OK);
+    REQUIRE_FALSE(other.has_code);
+  }
+}
+
+TEST_CASE("xsdgen generated parser matches hand-written delegate")
+{
+  const std::string xml = make_catalog(50);
+  catalog::document doc;
+  REQUIRE(catalog::parse(xml.c_str(),doc)==parser::result::OK);
+  catalog_delegate d;
+  REQUIRE(parser::parseString(xml.c_str(),d)==parser::result::OK);
+
+  REQUIRE(d.items.size()==doc.catalog.item.size());
+  for (size_t n = 0; n < d.items.size(); ++n) {
+    REQUIRE(doc.catalog.item[n].id==d.items[n].id.c_str());
+    REQUIRE(doc.catalog.item[n].title==d.items[n].title.c_str());
+    REQUIRE(doc.catalog.item[n].price==d.items[n].price.c_str());
+    REQUIRE(doc.catalog.item[n].author.size()==d.items[n].authors.size());
+  }
+}